@@ -298,7 +298,12 @@ def get_var_attrs(cli, var_token, partial_word):
         elif var_token == '[SCHEDULER]':
             var_type = 'name'
             var_desc = 'specify the type of scheduler (none for default)'
-            var_candidates = ['', 'experimental']
+            var_candidates = ['', 'default', 'experimental']
+
+        elif var_token == '[IDLE_POLICY]':
+            var_type = 'name'
+            var_desc = 'what the worker does when idle (default "spin")'
+            var_candidates = ['spin', 'backoff', 'sleep']
 
         elif var_token == 'PORT':
             var_type = 'name'
@@ -316,6 +321,15 @@ def get_var_attrs(cli, var_token, partial_word):
             except:
                 pass
 
+        elif var_token == 'TC':
+            var_type = 'name'
+            var_desc = 'name of a traffic class'
+            try:
+                var_candidates = [getattr(c, 'class').name
+                                  for c in cli.bess.list_tcs().classes_status]
+            except:
+                pass
+
         elif var_token == 'TC...':
             var_type = 'tcname+'
             var_desc = 'one or more traffic class names'
@@ -909,9 +923,11 @@ def run_file(cli, conf_file, env_map):
     _run_file(cli, os.path.expanduser(conf_file), env_map)
 
 
-@cmd('add worker WORKER_ID CORE [SCHEDULER]', 'Create a worker')
-def add_worker(cli, wid, core, scheduler):
-    cli.bess.add_worker(wid, core, scheduler or '')
+@cmd('add worker WORKER_ID CORE [SCHEDULER] [IDLE_POLICY]', 'Create a worker')
+def add_worker(cli, wid, core, scheduler, idle_policy):
+    if scheduler == 'default':
+        scheduler = ''
+    cli.bess.add_worker(wid, core, scheduler or '', idle_policy or '')
 
 
 @cmd('add port DRIVER [NEW_PORT] [PORT_ARGS...]', 'Add a new port')
@@ -1020,6 +1036,24 @@ def _show_worker(cli, w):
         w.num_tcs,
         w.silent_drops))
 
+    if w.idle_policy not in ('', 'spin'):
+        cli.fout.write('  %10s idle: %s, %d sleeps (%.3f s, %d woken), '
+                       'wake-up latency avg %d ns max %d ns\n' % (
+                           '',
+                           w.idle_policy,
+                           w.idle_sleeps,
+                           w.idle_sleep_ns / 1e9,
+                           w.idle_woken,
+                           w.wakeup_latency_avg_ns,
+                           w.wakeup_latency_max_ns))
+
+    if w.work_stealing:
+        cli.fout.write('  %10s stolen: %d runs, %d packets\n' % (
+            '', w.stolen_runs, w.stolen_packets))
+
+    if w.wakeup_queue == 'timer_wheel':
+        cli.fout.write('  %10s wakeup queue: timer wheel\n' % '')
+
 
 @cmd('show worker', 'Show the status of all worker threads')
 def show_worker_all(cli):
@@ -1050,6 +1084,43 @@ def show_worker_list(cli, worker_ids):
             _show_worker(cli, worker)
 
 
+@cmd('profile ENABLE_DISABLE WORKER_ID...',
+     'Enable/disable profiling of modules on specified workers')
+def profile_worker(cli, flag, worker_ids):
+    for wid in worker_ids:
+        cli.bess.set_worker_profiling(wid, flag == 'enable')
+
+
+@cmd('profile reset WORKER_ID...', 'Reset profiles of specified workers')
+def profile_reset(cli, worker_ids):
+    for wid in worker_ids:
+        cli.bess.get_worker_profile(wid, reset=True)
+
+
+@cmd('show profile WORKER_ID...',
+     'Show where specified workers spend CPU cycles, per module and gate')
+def show_profile(cli, worker_ids):
+    for wid in worker_ids:
+        profile = cli.bess.get_worker_profile(wid)
+        cli.fout.write('  Worker %d (profiling %s)\n' %
+                       (wid, 'enabled' if profile.enabled else 'disabled'))
+
+        total_cycles = sum(m.cycles for m in profile.modules) or 1
+        cli.fout.write('    %-24s%16s%8s%14s%14s%12s\n' % (
+            'Module', 'Cycles', '%', 'Batches', 'Packets', 'Cycles/pkt'))
+        for m in sorted(profile.modules, key=lambda m: -m.cycles):
+            cli.fout.write('    %-24s%16d%8.2f%14d%14d%12.1f\n' % (
+                m.name, m.cycles, 100.0 * m.cycles / total_cycles,
+                m.batches, m.packets, float(m.cycles) / max(m.packets, 1)))
+
+        cli.fout.write('\n    %-24s%8s%16s%14s%14s%12s\n' % (
+            'Module', 'IGate', 'Cycles', 'Batches', 'Packets', 'Avg fill'))
+        for g in sorted(profile.gates, key=lambda g: -g.cycles):
+            cli.fout.write('    %-24s%8d%16d%14d%14d%12.2f\n' % (
+                g.module, g.igate, g.cycles, g.batches, g.packets,
+                g.avg_batch_fill))
+
+
 def _limit_to_str(limit):
     if 'count' in limit:
         return '%d times/s' % limit['count']
@@ -1217,6 +1288,16 @@ def show_tc_workers(cli, wids):
         _show_tc_list(cli, cli.bess.list_tcs(wid).classes_status)
 
 
+@cmd('migrate tc TC WORKER_ID',
+     'Move a leaf traffic class to the top of the tree of another worker')
+def migrate_tc(cli, tc, wid):
+    ret = cli.bess.migrate_tc(tc, wid=wid)
+    cli.fout.write('  Worker %d -> %d: paused for %d/%dns, '
+                   '%dns without a worker\n' %
+                   (ret.src_wid, ret.dst_wid, ret.src_pause_ns,
+                    ret.dst_pause_ns, ret.detached_ns))
+
+
 @cmd('show status', 'Show the overall status')
 def show_status(cli):
     workers = sorted(cli.bess.list_workers().workers_status,
@@ -1455,6 +1536,15 @@ def _show_module(cli, module_name):
                            (gate.igate, track_str,
                             ', '.join('%s:%d ->' % (g.name, g.ogate)
                                       for g in gate.ogates)))
+            if gate.coalesce:
+                cli.fout.write(
+                    '             coalescing: avg fill %.2f -> %.2f '
+                    '(batches %d -> %d)\n' %
+                    (float(gate.coalesce_in_pkts) /
+                     max(gate.coalesce_in_batches, 1),
+                     float(gate.coalesce_out_pkts) /
+                     max(gate.coalesce_out_batches, 1),
+                     gate.coalesce_in_batches, gate.coalesce_out_batches))
 
     if len(info.ogates) > 0:
         cli.fout.write('    Output gates:\n')
@@ -1919,6 +2009,15 @@ def _track_module(cli, bits, flag, module_name, direction, gate):
         cli.bess.resume_all()
 
 
+@cmd('coalesce ENABLE_DISABLE MODULE [GATE]',
+     'Top up batches to the maximum burst at an input gate of a module')
+def coalesce_igate(cli, flag, module_name, gate):
+    if gate is None:
+        gate = 0
+
+    cli.bess.configure_igate(module_name, gate, flag == 'enable')
+
+
 @cmd('track ENABLE_DISABLE [MODULE] [DIRECTION] [GATE]',
      'Count the packets and batches on specified or all gates')
 def track_module(cli, flag, module_name, direction, gate):
@@ -104,6 +104,25 @@ class BessAclTest(BessModuleTestCase):
 
         self.assertBessAlive()
 
+    def test_run_acl_update(self):
+        fw = ACL(rules=[{'src_ip': '172.12.0.0/16', 'drop': False}])
+
+        pkt_udp = get_udp_packet(sip='172.12.0.3', dip='127.12.0.4')
+        pkt_tcp = get_tcp_packet(sip='192.168.32.4', dip='1.2.3.4')
+        rwtemp = [bytes(pkt_udp), bytes(pkt_tcp)]
+
+        Source() -> Rewrite(templates=rwtemp) -> fw -> Sink()
+
+        # Rules are replaced while the worker is running
+        bess.resume_all()
+        for i in range(100):
+            fw.add(rules=[{'src_ip': '192.168.%d.0/24' % i, 'drop': False}])
+            if i % 10 == 0:
+                fw.clear()
+        bess.pause_all()
+
+        self.assertBessAlive()
+
 suite = unittest.TestLoader().loadTestsFromTestCase(BessAclTest)
 results = unittest.TextTestRunner(verbosity=2).run(suite)
 
@@ -52,6 +52,123 @@ class BessIPLookupTest(BessModuleTestCase):
         self.assertSamePackets(pkt_outs[0][0], pkts[0])
         self.assertSamePackets(pkt_outs[1][0], pkts[1])
 
+    def test_iplookup_too_many_tbl8s(self):
+        with self.assertRaises(bess.Error):
+            IPLookup(max_tbl8s=(1 << 24))
+        with self.assertRaises(bess.Error):
+            IPLookup(max_tbl8s_v6=(1 << 24))
+
+    def test_iplookup_v6(self):
+        ipl = IPLookup()
+        eth = scapy.Ether(src='02:1e:67:9f:4d:ae', dst='06:16:3e:1b:72:32')
+        tcp = scapy.TCP(sport=10001, dport=80)
+        dips = ['2001:db8:1::1', '2001:db8:1:2::1', '2001:db8:2::1']
+        pkts = [bytes(eth / scapy.IPv6(src='2001:db8::1', dst=dip) / tcp)
+                for dip in dips]
+
+        ipl.add(prefix='2001:db8:1::', prefix_len=48, gate=0)
+        ipl.add(prefix='2001:db8:1:2::', prefix_len=64, gate=1)
+        ipl.add(prefix='::', prefix_len=0, gate=2)
+
+        with self.assertRaises(bess.Error):
+            ipl.add(prefix='2001:db8:1::', prefix_len=32, gate=0)
+
+        pkt_outs = self.run_module(ipl, 0, pkts, [0, 1, 2])
+        self.assertEquals(len(pkt_outs[0]), 1)
+        self.assertEquals(len(pkt_outs[1]), 1)
+        self.assertEquals(len(pkt_outs[2]), 1)
+        self.assertSamePackets(pkt_outs[0][0], pkts[0])
+        self.assertSamePackets(pkt_outs[1][0], pkts[1])
+        self.assertSamePackets(pkt_outs[2][0], pkts[2])
+
+    def test_iplookup_default_routes(self):
+        ipl = IPLookup()
+        eth = scapy.Ether(src='02:1e:67:9f:4d:ae', dst='06:16:3e:1b:72:32')
+        tcp = scapy.TCP(sport=10001, dport=80)
+        pkt4 = get_tcp_packet(sip='12.22.22.22', dip='22.22.22.22')
+        pkt6 = bytes(eth / scapy.IPv6(src='2001:db8::1', dst='2001:db8::2') /
+                     tcp)
+
+        # Each family has its own default route
+        ipl.add(prefix='0.0.0.0', prefix_len=0, gate=0)
+        ipl.add(prefix='::', prefix_len=0, gate=1)
+
+        pkt_outs = self.run_module(ipl, 0, [pkt4, pkt6], [0, 1])
+        self.assertEquals(len(pkt_outs[0]), 1)
+        self.assertEquals(len(pkt_outs[1]), 1)
+        self.assertSamePackets(pkt_outs[0][0], pkt4)
+        self.assertSamePackets(pkt_outs[1][0], pkt6)
+
+        # Withdrawing one leaves the other in place
+        ipl.delete(prefix='::', prefix_len=0)
+        pkt_outs = self.run_module(ipl, 0, [pkt4, pkt6], [0, 1])
+        self.assertEquals(len(pkt_outs[0]), 1)
+        self.assertEquals(len(pkt_outs[1]), 0)
+        self.assertSamePackets(pkt_outs[0][0], pkt4)
+
+    def test_iplookup_update(self):
+        ipl = IPLookup()
+        pkts = [get_tcp_packet(sip='12.22.22.22', dip='22.22.22.22'),
+                get_tcp_packet(sip='12.22.22.22', dip='32.22.22.22')]
+
+        ipl.add(prefix='22.22.22.0', prefix_len=24, gate=0)
+
+        # Fails on the last route, so nothing changes
+        with self.assertRaises(bess.Error):
+            ipl.update(routes=[
+                {'prefix': '22.22.22.0', 'prefix_len': 24, 'withdraw': True},
+                {'prefix': '32.22.22.0', 'prefix_len': 24, 'gate': 1},
+                {'prefix': '42.22.22.0', 'prefix_len': 24, 'withdraw': True}])
+
+        ipl.update(routes=[
+            {'prefix': '22.22.22.0', 'prefix_len': 24, 'withdraw': True},
+            {'prefix': '22.22.0.0', 'prefix_len': 16, 'gate': 1},
+            {'prefix': '32.22.22.0', 'prefix_len': 24, 'gate': 0}])
+
+        pkt_outs = self.run_module(ipl, 0, pkts, [0, 1])
+        self.assertEquals(len(pkt_outs[0]), 1)
+        self.assertEquals(len(pkt_outs[1]), 1)
+        self.assertSamePackets(pkt_outs[0][0], pkts[1])
+        self.assertSamePackets(pkt_outs[1][0], pkts[0])
+
+    def test_iplookup_migrate(self):
+        NUM_WORKERS = 3
+
+        for wid in range(NUM_WORKERS):
+            bess.add_worker(wid=wid, core=wid)
+        bess.pause_all()
+
+        # A Source on worker 2 keeps looking up routes while the leaf of
+        # another one moves between workers 0 and 1. Each move makes IPLookup
+        # replace the tables that worker 2 is using.
+        ipl = IPLookup()
+        ipl.add(prefix='22.22.22.0', prefix_len=24, gate=0)
+        ipl:0 -> Sink()
+
+        pkt = bytes(get_tcp_packet(sip='12.22.22.22', dip='22.22.22.22'))
+        srcs = []
+        for wid in [0, 2]:
+            src = Source()
+            src -> Rewrite(templates=[pkt]) -> ipl
+            src.attach_task(wid=wid)
+            srcs.append(src)
+
+        bess.resume_all()
+        leaf = '!leaf_%s:0' % srcs[0].name
+        for i in range(100):
+            bess.migrate_tc(leaf, wid=(i + 1) % 2)
+        self.assertBessAlive()
+
+        bess.pause_all()
+        before = bess.get_module_info(ipl.name).ogates[0].pkts
+        bess.resume_all()
+        time.sleep(1)
+        bess.pause_all()
+        self.assertGreater(bess.get_module_info(ipl.name).ogates[0].pkts,
+                           before)
+
+        bess.reset_all()
+
     def test_prefix(self):
         ipl = IPLookup()
         with self.assertRaises(bess.Error):
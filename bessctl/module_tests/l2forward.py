@@ -48,6 +48,28 @@ class BessL2ForwardTest(BessModuleTestCase):
         with self.assertRaises(bess.Error):
             l2fib.delete(addrs=['00:01:02:03:04:05'])
 
+    def test_l2forward_learn(self):
+        l2fib = L2Forward(learn=True)
+        l2fib.set_default_gate(gate=0)
+
+        ip = scapy.IP(src='10.0.0.1', dst='10.0.0.2') / scapy.UDP()
+        a_to_b = bytes(scapy.Ether(src='02:00:00:00:00:0a',
+                                   dst='02:00:00:00:00:0b') / ip)
+        b_to_a = bytes(scapy.Ether(src='02:00:00:00:00:0b',
+                                   dst='02:00:00:00:00:0a') / ip)
+
+        # B is unknown, so this goes to the default gate
+        pkt_outs = self.run_module(l2fib, 1, [a_to_b], [0])
+        self.assertEquals(len(pkt_outs[0]), 1)
+
+        pkt_outs = self.run_module(l2fib, 0, [b_to_a], [0, 1])
+        self.assertEquals(len(pkt_outs[0]), 0)
+        self.assertEquals(len(pkt_outs[1]), 1)
+        self.assertSamePackets(pkt_outs[1][0], b_to_a)
+
+        ret = l2fib.lookup(addrs=['02:00:00:00:00:0a', '02:00:00:00:00:0b'])
+        self.assertEquals(ret.gates, [1, 0])
+
 suite = unittest.TestLoader().loadTestsFromTestCase(BessL2ForwardTest)
 results = unittest.TextTestRunner(verbosity=2).run(suite)
 
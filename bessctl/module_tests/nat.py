@@ -84,6 +84,7 @@ class BessNatTest(BessModuleTestCase):
         self.assertEquals(len(pkt_outs[1]), 1)
         self.assertSamePackets(eth / ip_unnatted / _swap_l4(l4_orig) / l7,
                                pkt_outs[1][0])
+        return pkt_natted
 
     def test_nat_udp(self):
         nat_config = [{'ext_addr': '192.168.1.1'}]
@@ -106,6 +107,16 @@ class BessNatTest(BessModuleTestCase):
         nat = NAT(ext_addrs=nat_config)
         self._test_l4(nat, scapy.ICMP(), '192.168.1.1')
 
+    def test_nat_sharded(self):
+        # The test runs on worker 0, whose shard only allocates ports that
+        # are multiples of num_shards.
+        nat_config = [{'ext_addr': '192.168.1.1'}]
+        nat = NAT(ext_addrs=nat_config, num_shards=4)
+        for sport in range(50000, 50016):
+            pkt_natted = self._test_l4(
+                nat, scapy.UDP(sport=sport, dport=53), '192.168.1.1')
+            self.assertEquals(pkt_natted[scapy.UDP].sport % 4, 0)
+
     def test_nat_selfconfig(self):
         # Send initial conf unsorted, see that it comes back sorted
         # (note that this is a bit different from other modules
@@ -59,6 +59,38 @@ class BessReplicateTest(BessModuleTestCase):
         self.assertEquals(len(pkt_outs[2]), 1)
         self.assertSamePackets(pkt_outs[2][0], pkt_in)
 
+    def test_replicate_zero_copy(self):
+        pkt_in = get_tcp_packet(sip='22.22.22.22', dip='22.22.22.22')
+
+        for header_len in [0, 14, 2048]:
+            rep3 = Replicate(gates=[0, 1, 2], zero_copy=True,
+                             header_len=header_len)
+            pkt_outs = self.run_module(rep3, 0, [pkt_in], [0, 1, 2])
+
+            for ogate in [0, 1, 2]:
+                self.assertEquals(len(pkt_outs[ogate]), 1)
+                self.assertSamePackets(pkt_outs[ogate][0], pkt_in)
+
+    def test_replicate_header_to_port(self):
+        pkt_in = get_tcp_packet(sip='22.22.22.22', dip='22.22.22.22')
+        rep3 = Replicate(gates=[0, 1, 2], zero_copy=True, header_len=14)
+        merge = Merge()
+
+        rep3:0 -> Sink()
+
+        # A net_ring vdev with no arguments loops back what it sends. The
+        # first port flattens replicas, the second sends them as they are.
+        for ogate, multi_segment_tx in [(1, False), (2, True)]:
+            port = PMDPort(vdev='net_ring_repl%d' % ogate,
+                           multi_segment_tx=multi_segment_tx)
+            rep3:ogate -> PortOut(port=port.name)
+            PortInc(port=port.name) -> merge
+
+        pkt_outs = self.run_pipeline(rep3, merge, 0, [pkt_in], [0])
+        self.assertEquals(len(pkt_outs[0]), 2)
+        self.assertSamePackets(pkt_outs[0][0], pkt_in)
+        self.assertSamePackets(pkt_outs[0][1], pkt_in)
+
 suite = unittest.TestLoader().loadTestsFromTestCase(BessReplicateTest)
 results = unittest.TextTestRunner(verbosity=2).run(suite)
 
@@ -0,0 +1,199 @@
+# Copyright (c) 2016-2017, Nefeli Networks, Inc.
+# Copyright (c) 2016-2017, Nefeli Networks, Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#
+# * Redistributions of source code must retain the above copyright notice, this
+# list of conditions and the following disclaimer.
+#
+# * Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation
+# and/or other materials provided with the distribution.
+#
+# * Neither the names of the copyright holders nor the names of their
+# contributors may be used to endorse or promote products derived from this
+# software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+# AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+# LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+# SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+# ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+# POSSIBILITY OF SUCH DAMAGE.
+
+from test_utils import *
+
+
+# The priority class of each packet is its IP TOS byte, at offset 15
+def get_prio_packet(prio):
+    eth = scapy.Ether(src=scapy.RandMAC()._fix(), dst=scapy.RandMAC()._fix())
+    ip = scapy.IP(src=scapy.RandIP()._fix(), dst=scapy.RandIP()._fix(),
+                  tos=prio)
+    udp = scapy.UDP(sport=random.randrange(pow(2, 16)),
+                    dport=random.randrange(pow(2, 16)))
+    return eth / ip / udp / ('0' * 18)
+
+
+class BessShardedQueueTest(BessModuleTestCase):
+
+    def test_run_sharded_queue(self):
+        q = ShardedQueue(priorities=2, priority_attr='prio')
+        self.run_for(q, [0], 3)
+        self.assertBessAlive()
+
+    def test_sharded_queue_priority(self):
+        classify = SetMetadata(
+            attrs=[{'name': 'prio', 'size': 1, 'offset': 15}])
+        q = ShardedQueue(priorities=2, priority_attr='prio')
+        classify -> q
+
+        # Hold the packets in the rings. Classes beyond the last count as the
+        # last.
+        q.set_burst(burst=0)
+        pkts = [get_prio_packet(prio) for prio in [1, 0, 7, 1, 0]]
+        pkt_outs = self.run_pipeline(classify, q, 0, pkts, [0])
+        self.assertEquals(len(pkt_outs[0]), 0)
+
+        status = q.get_status()
+        self.assertEquals(len(status.classes), 2)
+        self.assertEquals(status.classes[0].count, 2)
+        self.assertEquals(status.classes[0].enqueued, 2)
+        self.assertEquals(status.classes[1].count, 3)
+        self.assertEquals(status.classes[1].enqueued, 3)
+        for cls in status.classes:
+            self.assertEquals(cls.dequeued, 0)
+            self.assertEquals(cls.dropped, 0)
+            self.assertEquals(cls.size, 1024)  # one producer
+
+        # The highest class leaves first, each class in arrival order
+        q.set_burst(burst=32)
+        self.bess.resume_all()
+        time.sleep(1)
+        pkt_outs = self._collect_output([0])
+        self.bess.pause_all()
+
+        expected = [pkts[i] for i in [1, 4, 0, 2, 3]]
+        self.assertEquals(len(pkt_outs[0]), len(expected))
+        for pkt_out, pkt in zip(pkt_outs[0], expected):
+            self.assertSamePackets(pkt_out, pkt)
+
+        status = q.get_status()
+        self.assertEquals(status.classes[0].dequeued, 2)
+        self.assertEquals(status.classes[1].dequeued, 3)
+        for cls in status.classes:
+            self.assertEquals(cls.count, 0)
+
+    def test_sharded_queue_set_size(self):
+        q = ShardedQueue(size=64)
+        q.set_burst(burst=0)
+
+        pkts = [get_tcp_packet() for _ in range(40)]
+        self.run_module(q, 0, pkts, [0])
+
+        status = q.get_status()
+        self.assertEquals(status.classes[0].count, 40)
+        self.assertEquals(status.classes[0].dropped, 0)
+
+        # A ring of 16 slots holds 15 packets, so 25 of them are dropped
+        # when the rings are replaced
+        q.set_size(size=16)
+        status = q.get_status()
+        self.assertEquals(status.classes[0].size, 16)
+        self.assertEquals(status.classes[0].count, 15)
+        self.assertEquals(status.classes[0].enqueued, 40)
+        self.assertEquals(status.classes[0].dropped, 25)
+
+        # Packets that were kept are still delivered in order
+        q.set_burst(burst=32)
+        self.bess.resume_all()
+        time.sleep(1)
+        pkt_outs = self._collect_output([0])
+        self.bess.pause_all()
+
+        self.assertEquals(len(pkt_outs[0]), 15)
+        for pkt_out, pkt in zip(pkt_outs[0], pkts):
+            self.assertSamePackets(pkt_out, pkt)
+
+    def test_sharded_queue_weights(self):
+        NUM_WORKERS = 2
+
+        for wid in range(NUM_WORKERS):
+            bess.add_worker(wid=wid, core=wid)
+        bess.pause_all()
+
+        # The queue is drained much slower than the producers fill it, so
+        # both rings stay busy and are served in proportion to their weights
+        q = ShardedQueue(weights={1: 3})
+        split = Split(size=1, offset=15)
+        q -> split
+        split:0 -> Sink()
+        split:1 -> Sink()
+
+        srcs = []
+        for wid in range(NUM_WORKERS):
+            src = Source()
+            src -> Rewrite(templates=[bytes(get_prio_packet(wid))]) -> q
+            src.attach_task(wid=wid)
+            srcs.append(src)
+
+        bess.add_tc('drain', policy='rate_limit', wid=0, resource='packet',
+                    limit={'packet': 100000})
+        q.attach_task(parent='drain')
+
+        bess.resume_all()
+        time.sleep(3)
+        bess.pause_all()
+
+        ogates = bess.get_module_info(split.name).ogates
+        pkts = dict((ogate.ogate, ogate.pkts) for ogate in ogates)
+        self.assertGreater(pkts[0], 0)
+        self.assertAlmostEqual(float(pkts[1]) / pkts[0], 3.0, delta=0.3)
+
+        status = q.get_status()
+        self.assertEquals(status.classes[0].size, 1024 * NUM_WORKERS)
+        self.assertGreater(status.classes[0].dropped, 0)
+
+        bess.reset_all()
+
+    def test_sharded_queue_migrate_producer(self):
+        NUM_WORKERS = 3
+
+        for wid in range(NUM_WORKERS):
+            bess.add_worker(wid=wid, core=wid)
+        bess.pause_all()
+
+        # The consumer keeps draining on worker 2 while a producer moves
+        # between workers 0 and 1, which adds rings for the new workers.
+        q = ShardedQueue()
+        q -> Sink()
+        src = Source()
+        src -> q
+        src.attach_task(wid=0)
+        q.attach_task(wid=2)
+
+        bess.resume_all()
+        leaf = '!leaf_%s:0' % src.name
+        for i in range(100):
+            bess.migrate_tc(leaf, wid=(i + 1) % 2)
+        self.assertBessAlive()
+        time.sleep(1)
+        bess.pause_all()
+
+        status = q.get_status()
+        self.assertGreaterEqual(status.classes[0].size, 1024 * 2)
+        self.assertGreater(status.classes[0].dequeued, 0)
+
+        bess.reset_all()
+
+suite = unittest.TestLoader().loadTestsFromTestCase(BessShardedQueueTest)
+results = unittest.TextTestRunner(verbosity=2).run(suite)
+
+if results.failures or results.errors:
+    sys.exit(1)
@@ -99,6 +99,38 @@ class BessUrlFilterTest(BessModuleTestCase):
         self.assertEquals(len(pkt_outs[1]), 2)
         self.assertSamePackets(pkt_outs[1][0], err_pkt)
 
+    # Wildcard rules: any subdomain, any path
+    def test_urlfilter_wildcard(self):
+        uf = UrlFilter()
+        uf.add(blacklist=[{'host': '*.blacklisted.com', 'path': '*'}])
+
+        eth = scapy.Ether(src='02:1e:67:9f:4d:ae', dst='06:16:3e:1b:72:32')
+        ip1 = scapy.IP(src='192.168.0.1', dst='10.0.0.1')
+        ip2 = scapy.IP(src='192.168.0.2', dst='10.0.0.2')
+        tcp = scapy.TCP(sport=10001, dport=80, seq=12345)
+        tplus = tcp.copy()
+        tplus.ack = 23456
+        tplus.flags = 0
+        tplus.seq += 1
+        # The bare domain is not a subdomain of itself
+        good_payload = 'GET /a HTTP/1.1\r\nHost: blacklisted.com\r\n\r\n'
+        bad_payload = 'GET /b HTTP/1.1\r\nHost: ads.blacklisted.com\r\n\r\n'
+        good_pkt = bytes(eth / ip1 / tplus / good_payload)
+        bad_pkt = bytes(eth / ip2 / tplus / bad_payload)
+
+        pkt_outs = self.run_pipeline(src_module=uf, dst_module=uf,
+                                     igate=0,
+                                     input_pkts=[bytes(eth / ip1 / tcp),
+                                                 good_pkt,
+                                                 bytes(eth / ip2 / tcp),
+                                                 bad_pkt],
+                                     ogates=[0, 1])
+
+        # SYN, GET, SYN, RST on gate 0, and 403, RST on gate 1
+        self.assertEquals(len(pkt_outs[0]), 4)
+        self.assertSamePackets(pkt_outs[0][1], good_pkt)
+        self.assertEquals(len(pkt_outs[1]), 2)
+
     def test_urlfilter_selfconfig(self):
         iconf = {}
         uf = UrlFilter(**iconf)
@@ -101,6 +101,38 @@ class BessWildcardMatchTest(BessModuleTestCase):
         self.assertEquals(len(pkt_outs[3]), 1)
         self.assertSamePackets(pkt_outs[3][0], pkt_nomatch)
 
+    def test_wildcardmatch_priority_across_masks(self):
+        # Rules with different masks live in different tuples, which are
+        # searched in order of their highest priority.
+        wm = WildcardMatch(fields=[{'offset': 26, 'num_bytes': 4},
+                                   {'offset': 30, 'num_bytes': 4}])
+        sip = socket.inet_aton('65.43.21.00')
+        dip = socket.inet_aton('12.34.56.78')
+        any_ip = b'\x00\x00\x00\x00'
+        wm.add(gate=0, priority=0,
+               masks=vstring([0xff] * 4, [0x00] * 4),
+               values=[{'value_bin': sip}, {'value_bin': any_ip}])
+        wm.add(gate=1, priority=2,
+               masks=vstring([0x00] * 4, [0xff] * 4),
+               values=[{'value_bin': any_ip}, {'value_bin': dip}])
+        wm.add(gate=2, priority=1,
+               masks=vstring([0xff] * 4, [0xff] * 4),
+               values=[{'value_bin': sip}, {'value_bin': dip}])
+        wm.set_default_gate(gate=3)
+
+        pkt = get_tcp_packet(sip='65.43.21.00', dip='12.34.56.78')
+        pkt_outs = self.run_module(wm, 0, [pkt], range(4))
+        self.assertEquals(len(pkt_outs[1]), 1)
+
+        wm.delete(masks=vstring([0x00] * 4, [0xff] * 4),
+                  values=[{'value_bin': any_ip}, {'value_bin': dip}])
+        pkt_outs = self.run_module(wm, 0, [pkt], range(4))
+        self.assertEquals(len(pkt_outs[2]), 1)
+
+        with self.assertRaises(bess.Error):
+            wm.delete(masks=vstring([0x00] * 4, [0xff] * 4),
+                      values=[{'value_bin': any_ip}, {'value_bin': dip}])
+
     def test_wildcardmatch_with_metadata(self):
         # One wildcard match field
         mask = vstring([0xff, 0xff])
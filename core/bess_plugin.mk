@@ -69,6 +69,10 @@ CXXFLAGS += -std=c++11 -g3 -ggdb3 $(CXXARCHFLAGS) \
 PERMISSIVE := -Wno-unused-parameter -Wno-missing-field-initializers \
 	      -Wno-unused-private-field
 
+# Must match the MAX_BURST that BESS itself was built with.
+MAX_BURST ?= 32
+CXXFLAGS += -DBESS_MAX_BURST=$(MAX_BURST)
+
 # -Wshadow should not be used for g++ 4.x, as it has too many false positives
 ifeq "$(shell expr $(CXXCOMPILER) = g++ \& $(CXXVERSION) \< 50000)" "0"
 	CXXFLAGS += -Wshadow
@@ -90,6 +90,31 @@ static inline Status return_with_errno(T* response, int code) {
   return Status::OK;
 }
 
+static bool parse_idle_policy(const std::string& name, idle_policy_t* policy) {
+  if (name == "" || name == "spin") {
+    *policy = IDLE_SPIN;
+  } else if (name == "backoff") {
+    *policy = IDLE_BACKOFF;
+  } else if (name == "sleep") {
+    *policy = IDLE_SLEEP;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static const char* idle_policy_name(idle_policy_t policy) {
+  switch (policy) {
+    case IDLE_SPIN:
+      return "spin";
+    case IDLE_BACKOFF:
+      return "backoff";
+    case IDLE_SLEEP:
+      return "sleep";
+  }
+  return "unknown";
+}
+
 static inline bess::Gate* module_gate(const Module* m, bool is_igate,
                                       gate_idx_t gate_idx) {
   if (is_igate) {
@@ -189,6 +214,15 @@ static int collect_igates(Module* m, GetModuleInfoResponse* response) {
       igate->set_timestamp(get_epoch_time());
     }
 
+    igate->set_coalesce(g->coalesce());
+    if (g->coalesce()) {
+      bess::IGate::CoalesceStats stats = g->coalesce_stats();
+      igate->set_coalesce_in_batches(stats.in_batches);
+      igate->set_coalesce_in_pkts(stats.in_packets);
+      igate->set_coalesce_out_batches(stats.out_batches);
+      igate->set_coalesce_out_pkts(stats.out_packets);
+    }
+
     igate->set_igate(g->gate_idx());
     for (const auto& og : g->ogates_upstream()) {
       GetModuleInfoResponse_IGate_OGate* ogate = igate->add_ogates();
@@ -371,6 +405,7 @@ static void collect_tc(const bess::TrafficClass* c, int wid,
     CHECK(it != module->tasks().end());
     uint64_t task_id = it - module->tasks().begin();
     status->mutable_class_()->set_leaf_module_taskid(task_id);
+    status->mutable_class_()->set_stealable(leaf->stealable());
   }
 }
 
@@ -476,6 +511,25 @@ class BESSControlImpl final : public BESSControl::Service {
       status->set_core(workers[wid]->core());
       status->set_num_tcs(workers[wid]->scheduler()->NumTcs());
       status->set_silent_drops(workers[wid]->silent_drops());
+
+      const struct worker_idle_stats& idle = workers[wid]->idle_stats();
+      status->set_idle_policy(idle_policy_name(workers[wid]->idle_policy()));
+      status->set_idle_sleeps(idle.sleeps);
+      status->set_idle_sleep_ns(tsc_to_ns(idle.sleep_cycles));
+      status->set_idle_woken(idle.woken);
+      if (idle.timed_wakeups) {
+        status->set_wakeup_latency_avg_ns(
+            tsc_to_ns(idle.latency_cycles / idle.timed_wakeups));
+      }
+      status->set_wakeup_latency_max_ns(tsc_to_ns(idle.max_latency_cycles));
+
+      status->set_work_stealing(workers[wid]->work_stealing());
+      status->set_stolen_runs(workers[wid]->stolen_runs());
+      status->set_stolen_packets(workers[wid]->stolen_packets());
+      status->set_wakeup_queue(
+          workers[wid]->scheduler()->wakeup_queue().timer_wheel()
+              ? "timer_wheel"
+              : "heap");
     }
     return Status::OK;
   }
@@ -499,8 +553,30 @@ class BESSControlImpl final : public BESSControl::Service {
       return return_with_error(response, EINVAL, "Invalid scheduler %s",
                                scheduler.c_str());
     }
+    const std::string& wakeup_queue = request->wakeup_queue();
+    if (wakeup_queue != "" && wakeup_queue != "heap" &&
+        wakeup_queue != "timer_wheel") {
+      return return_with_error(response, EINVAL, "Invalid wakeup queue %s",
+                               wakeup_queue.c_str());
+    }
+    idle_policy_t idle_policy;
+    if (!parse_idle_policy(request->idle_policy(), &idle_policy)) {
+      return return_with_error(response, EINVAL, "Invalid idle policy %s",
+                               request->idle_policy().c_str());
+    }
+    if (request->idle_sleep_us() < 0 || request->idle_max_sleep_us() < 0) {
+      return return_with_error(response, EINVAL,
+                               "Idle sleep times must not be negative");
+    }
+    uint64_t idle_sleep_us = request->idle_sleep_us()
+                                 ? request->idle_sleep_us()
+                                 : Worker::kDefaultIdleSleepUs;
+    uint64_t idle_max_sleep_us = request->idle_max_sleep_us()
+                                     ? request->idle_max_sleep_us()
+                                     : Worker::kDefaultIdleMaxSleepUs;
 
-    launch_worker(wid, core, scheduler);
+    launch_worker(wid, core, scheduler, idle_policy, idle_sleep_us,
+                  idle_max_sleep_us, request->work_stealing(), wakeup_queue);
     return Status::OK;
   }
 
@@ -531,6 +607,122 @@ class BESSControlImpl final : public BESSControl::Service {
     return Status::OK;
   }
 
+  Status SetWorkerProfiling(ServerContext*,
+                            const SetWorkerProfilingRequest* request,
+                            EmptyResponse* response) override {
+    int64_t wid = request->wid();
+    if (wid == -1) {
+      for (int i = 0; i < Worker::kMaxWorkers; i++) {
+        if (is_worker_active(i)) {
+          workers[i]->set_profiling(request->enable());
+        }
+      }
+      return Status::OK;
+    }
+
+    if (wid < 0 || wid >= Worker::kMaxWorkers) {
+      return return_with_error(response, EINVAL, "Invalid worker id");
+    }
+    if (!is_worker_active(wid)) {
+      return return_with_error(response, ENOENT, "Worker %d is not active",
+                               wid);
+    }
+
+    workers[wid]->set_profiling(request->enable());
+    return Status::OK;
+  }
+
+  Status GetWorkerProfile(ServerContext*,
+                          const GetWorkerProfileRequest* request,
+                          GetWorkerProfileResponse* response) override {
+    uint64_t wid = request->wid();
+    if (wid >= Worker::kMaxWorkers) {
+      return return_with_error(response, EINVAL, "Invalid worker id");
+    }
+    if (!is_worker_active(wid)) {
+      return return_with_error(response, ENOENT, "Worker %d is not active",
+                               wid);
+    }
+
+    // Tasks run by the worker
+    std::vector<const Task*> tasks;
+    bess::TrafficClass* root = workers[wid]->scheduler()->root();
+    if (root) {
+      for (const auto& it : TrafficClassBuilder::all_tcs()) {
+        bess::TrafficClass* c = it.second;
+        if (c->policy() == bess::POLICY_LEAF && c->Root() == root) {
+          tasks.push_back(static_cast<bess::LeafTrafficClass*>(c)->task());
+        }
+      }
+    }
+
+    response->set_timestamp(get_epoch_time());
+    response->set_enabled(workers[wid]->profiling());
+
+    for (const auto& pair : ModuleGraph::GetAllModules()) {
+      const Module* m = pair.second;
+      task_profile module_total = {};
+
+      for (const Task* t : tasks) {
+        if (t->module() == m) {
+          task_profile p = t->GetTaskProfile();
+          module_total.cycles += p.cycles;
+          module_total.batches += p.batches;
+          module_total.packets += p.packets;
+        }
+      }
+
+      for (const bess::IGate* igate : m->igates()) {
+        if (!igate) {
+          continue;
+        }
+
+        task_profile gate_total = {};
+        for (const Task* t : tasks) {
+          task_profile p = t->GetGateProfile(igate);
+          gate_total.cycles += p.cycles;
+          gate_total.batches += p.batches;
+          gate_total.packets += p.packets;
+        }
+
+        if (gate_total.batches == 0) {
+          continue;
+        }
+
+        GetWorkerProfileResponse_GateProfile* gate = response->add_gates();
+        gate->set_module(m->name());
+        gate->set_igate(igate->gate_idx());
+        gate->set_cycles(gate_total.cycles);
+        gate->set_batches(gate_total.batches);
+        gate->set_packets(gate_total.packets);
+        gate->set_avg_batch_fill(static_cast<double>(gate_total.packets) /
+                                 gate_total.batches);
+
+        module_total.cycles += gate_total.cycles;
+        module_total.batches += gate_total.batches;
+        module_total.packets += gate_total.packets;
+      }
+
+      if (module_total.batches == 0) {
+        continue;
+      }
+
+      GetWorkerProfileResponse_ModuleProfile* module = response->add_modules();
+      module->set_name(m->name());
+      module->set_cycles(module_total.cycles);
+      module->set_batches(module_total.batches);
+      module->set_packets(module_total.packets);
+    }
+
+    if (request->reset()) {
+      for (const Task* t : tasks) {
+        t->ResetProfile();
+      }
+    }
+
+    return Status::OK;
+  }
+
   Status ResetTcs(ServerContext*, const EmptyRequest*,
                   EmptyResponse* response) override {
     WorkerPauser wp;
@@ -752,10 +944,13 @@ class BESSControlImpl final : public BESSControl::Service {
         return return_with_error(response, EINVAL, "Invalid resource");
       }
       tc->set_resource(bess::ResourceMap.at(resource));
+    } else if (c->policy() == bess::POLICY_LEAF) {
+      bess::LeafTrafficClass* tc = static_cast<bess::LeafTrafficClass*>(c);
+      tc->set_stealable(request->class_().stealable());
     } else {
       return return_with_error(response, EINVAL,
-                               "Only 'rate_limit' and"
-                               " 'weighted_fair' can be updated");
+                               "Only 'rate_limit', 'weighted_fair', and"
+                               " 'leaf' can be updated");
     }
 
     return Status::OK;
@@ -794,6 +989,150 @@ class BESSControlImpl final : public BESSControl::Service {
     return AttachTc(c, request->class_(), response);
   }
 
+  Status MigrateTc(ServerContext*, const MigrateTcRequest* request,
+                   MigrateTcResponse* response) override {
+    const bess::pb::TrafficClass& class_ = request->class_();
+
+    bess::TrafficClass* c = FindTc(class_, response);
+    if (!c) {
+      return Status::OK;
+    }
+
+    if (c->policy() != bess::POLICY_LEAF) {
+      return return_with_error(response, EINVAL,
+                               "Only leaf TCs can be migrated");
+    }
+
+    if (c->WorkerId() == Worker::kAnyWorker) {
+      return return_with_error(response, EINVAL,
+                               "'%s' is not attached to a worker",
+                               c->name().c_str());
+    }
+
+    // Everything that may fail is checked here, before any worker is paused.
+    int wid = class_.wid();
+    bess::TrafficClass* parent = nullptr;
+    if (class_.parent() == "") {
+      if (wid < 0 || wid >= Worker::kMaxWorkers || !is_worker_active(wid)) {
+        return return_with_error(response, EINVAL, "worker:%d does not exist",
+                                 wid);
+      }
+    } else {
+      if (wid != Worker::kAnyWorker) {
+        return return_with_error(response, EINVAL,
+                                 "Both 'parent' and 'wid'"
+                                 "have been specified");
+      }
+
+      const auto& tcs = TrafficClassBuilder::all_tcs();
+      const auto& it = tcs.find(class_.parent());
+      if (it == tcs.end()) {
+        return return_with_error(response, ENOENT, "Parent TC '%s' not found",
+                                 class_.parent().c_str());
+      }
+      parent = it->second;
+
+      if (parent == c->parent()) {
+        return return_with_error(response, EEXIST,
+                                 "'%s' is already a child of '%s'",
+                                 c->name().c_str(), parent->name().c_str());
+      }
+
+      wid = parent->WorkerId();
+      if (wid == Worker::kAnyWorker) {
+        return return_with_error(response, EINVAL,
+                                 "Parent TC '%s' is not attached to a worker",
+                                 parent->name().c_str());
+      }
+
+      switch (parent->policy()) {
+        case bess::POLICY_PRIORITY: {
+          if (class_.arg_case() != bess::pb::TrafficClass::kPriority) {
+            return return_with_error(response, EINVAL,
+                                     "No priority specified");
+          }
+          bess::priority_t pri = class_.priority();
+          if (pri == DEFAULT_PRIORITY) {
+            return return_with_error(response, EINVAL,
+                                     "Priority %d is reserved",
+                                     DEFAULT_PRIORITY);
+          }
+          for (const auto& child :
+               static_cast<bess::PriorityTrafficClass*>(parent)->children()) {
+            if (child.priority_ == pri) {
+              return return_with_error(response, EEXIST,
+                                       "Priority %u is already in use", pri);
+            }
+          }
+          break;
+        }
+        case bess::POLICY_WEIGHTED_FAIR:
+          if (class_.arg_case() != bess::pb::TrafficClass::kShare ||
+              class_.share() == 0) {
+            return return_with_error(response, EINVAL, "No share specified");
+          }
+          break;
+        case bess::POLICY_ROUND_ROBIN:
+          break;
+        case bess::POLICY_RATE_LIMIT:
+          if (!parent->Children().empty()) {
+            return return_with_error(response, EEXIST,
+                                     "Parent TC '%s' already has a child",
+                                     parent->name().c_str());
+          }
+          break;
+        default:
+          return return_with_error(response, EPERM,
+                                   "Parent tc doesn't support children");
+      }
+    }
+
+    std::function<bool(bess::TrafficClass*)> attach;
+    if (parent) {
+      attach = [&](bess::TrafficClass* leaf) {
+        switch (parent->policy()) {
+          case bess::POLICY_PRIORITY:
+            return static_cast<bess::PriorityTrafficClass*>(parent)->AddChild(
+                leaf, class_.priority());
+          case bess::POLICY_WEIGHTED_FAIR:
+            return static_cast<bess::WeightedFairTrafficClass*>(parent)
+                ->AddChild(leaf, class_.share());
+          case bess::POLICY_ROUND_ROBIN:
+            return static_cast<bess::RoundRobinTrafficClass*>(parent)->AddChild(
+                leaf);
+          case bess::POLICY_RATE_LIMIT:
+            return static_cast<bess::RateLimitTrafficClass*>(parent)->AddChild(
+                leaf);
+          default:
+            return false;
+        }
+      };
+    }
+
+    struct tc_migration_stats stats;
+    int ret = migrate_leaf(static_cast<bess::LeafTrafficClass*>(c), wid,
+                           attach, &stats);
+    if (ret == -EEXIST) {
+      return return_with_error(response, EINVAL,
+                               "AddChild() failed, '%s' was attached at the "
+                               "top of worker:%d",
+                               c->name().c_str(), wid);
+    } else if (ret) {
+      return return_with_error(response, -ret, "Cannot detach '%s'",
+                               c->name().c_str());
+    }
+
+    VLOG(1) << "Migrated '" << c->name() << "' from worker " << stats.src_wid
+            << " to " << stats.dst_wid << " in " << stats.detached_ns << "ns";
+
+    response->set_src_wid(stats.src_wid);
+    response->set_dst_wid(stats.dst_wid);
+    response->set_src_pause_ns(stats.src_pause_ns);
+    response->set_dst_pause_ns(stats.dst_pause_ns);
+    response->set_detached_ns(stats.detached_ns);
+    return Status::OK;
+  }
+
   Status GetTcStats(ServerContext*, const GetTcStatsRequest* request,
                     GetTcStatsResponse* response) override {
     const char* tc_name = request->name().c_str();
@@ -818,6 +1157,17 @@ class BESSControlImpl final : public BESSControl::Service {
     response->set_packets(c->stats().usage[bess::RESOURCE_PACKET]);
     response->set_bits(c->stats().usage[bess::RESOURCE_BIT]);
 
+    if (c->policy() == bess::POLICY_LEAF) {
+      const Task* t = static_cast<bess::LeafTrafficClass*>(c)->task();
+      response->set_batch_pool_capacity(t->pbatch_capacity());
+      response->set_batch_pool_high_water(t->pbatch_high_water());
+      response->set_batch_pool_grows(t->pbatch_grows());
+
+      const auto* leaf = static_cast<bess::LeafTrafficClass*>(c);
+      response->set_stolen_runs(leaf->stolen_runs());
+      response->set_stolen_packets(leaf->stolen_packets());
+    }
+
     return Status::OK;
   }
 
@@ -1254,6 +1604,32 @@ class BESSControlImpl final : public BESSControl::Service {
     return Status::OK;
   }
 
+  Status ConfigureIGate(ServerContext*, const ConfigureIGateRequest* request,
+                        EmptyResponse* response) override {
+    WorkerPauser wp;
+
+    if (!request->name().length())
+      return return_with_error(response, EINVAL, "Missing 'name' field");
+
+    const auto& it = ModuleGraph::GetAllModules().find(request->name());
+    if (it == ModuleGraph::GetAllModules().end()) {
+      return return_with_error(response, ENOENT, "No module '%s' found",
+                               request->name().c_str());
+    }
+    Module* m = it->second;
+
+    uint64_t igate_idx = request->igate();
+    if (igate_idx >= m->igates().size() || !m->igates()[igate_idx]) {
+      return return_with_error(response, EINVAL,
+                               "Input gate %d of '%s' is not connected",
+                               static_cast<int>(igate_idx),
+                               request->name().c_str());
+    }
+
+    m->igates()[igate_idx]->set_coalesce(request->coalesce());
+    return Status::OK;
+  }
+
   Status DumpMempool(ServerContext*, const DumpMempoolRequest* request,
                      DumpMempoolResponse* response) override {
     int socket_filter = request->socket();
@@ -1647,8 +2023,9 @@ class BESSControlImpl final : public BESSControl::Service {
     return Status::OK;
   }
 
+  template <typename T>
   bess::TrafficClass* FindTc(const bess::pb::TrafficClass& class_,
-                             EmptyResponse* response) {
+                             T* response) {
     bess::TrafficClass* c = nullptr;
 
     if (class_.name().length() != 0) {
@@ -34,6 +34,7 @@
 
 #include "../utils/ether.h"
 #include "../utils/format.h"
+#include "../utils/time.h"
 
 /*!
  * The following are deprecated. Ignore us.
@@ -255,11 +256,34 @@ CommandResponse PMDPort::Init(const bess::pb::PMDPortArg &arg) {
     eth_rxconf.rx_drop_en = 1;
   }
 
+  // Single-segment TX queues are faster with some PMDs (e.g., vector TX of
+  // ixgbe and i40e), so chained packets are flattened unless asked otherwise
+  multi_segment_tx_ = SN_TSO_SG || arg.multi_segment_tx();
+
   eth_txconf = dev_info.default_txconf;
   eth_txconf.txq_flags = ETH_TXQ_FLAGS_NOVLANOFFL |
-                         ETH_TXQ_FLAGS_NOMULTSEGS * (1 - SN_TSO_SG) |
+                         ETH_TXQ_FLAGS_NOMULTSEGS * !multi_segment_tx_ |
                          ETH_TXQ_FLAGS_NOXSUMS * (1 - SN_HW_TXCSUM);
 
+  if (arg.rx_timestamp()) {
+    rx_timestamp_ = true;
+    hw_timestamp_ = dev_info.rx_offload_capa & DEV_RX_OFFLOAD_TIMESTAMP;
+    if (hw_timestamp_) {
+      eth_conf.rxmode.offloads |= DEV_RX_OFFLOAD_TIMESTAMP;
+      eth_rxconf.offloads |= DEV_RX_OFFLOAD_TIMESTAMP;
+
+      double ns_per_tick =
+          arg.rx_timestamp_hz() ? 1e9 / arg.rx_timestamp_hz() : 1.0;
+      for (auto &clock : rx_clocks_) {
+        clock = bess::utils::ClockSync(ns_per_tick);
+      }
+    } else {
+      // e.g., net_pcap and net_null. Fall back to the time of polling.
+      LOG(INFO) << "Device " << driver_ << " has no RX timestamp offload. "
+                << "Using software timestamps";
+    }
+  }
+
   ret = rte_eth_dev_configure(ret_port_id, num_rxq, num_txq, &eth_conf);
   if (ret != 0) {
     return CommandFailure(-ret, "rte_eth_dev_configure() failed");
@@ -434,13 +458,63 @@ void PMDPort::CollectStats(bool reset) {
   }
 }
 
+void PMDPort::TimestampPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  uint64_t now_ns = tsc_to_ns(rdtsc());
+
+  if (!hw_timestamp_) {
+    for (int i = 0; i < cnt; i++) {
+      pkts[i]->set_rx_timestamp(now_ns);
+    }
+    return;
+  }
+
+  // Every packet in the burst arrived before now_ns, so each one bounds the
+  // clock offset. ClockSync keeps the tightest bound over its window.
+  bess::utils::ClockSync &clock = rx_clocks_[qid];
+  for (int i = 0; i < cnt; i++) {
+    uint64_t ticks = pkts[i]->rx_timestamp();
+    if (ticks) {
+      clock.Sample(ticks, now_ns);
+    }
+  }
+
+  for (int i = 0; i < cnt; i++) {
+    uint64_t ticks = pkts[i]->rx_timestamp();
+    pkts[i]->set_rx_timestamp(ticks ? clock.ToLocal(ticks) : now_ns);
+  }
+}
+
 int PMDPort::RecvPackets(queue_t qid, bess::Packet **pkts, int cnt) {
-  return rte_eth_rx_burst(dpdk_port_id_, qid, (struct rte_mbuf **)pkts, cnt);
+  int recv =
+      rte_eth_rx_burst(dpdk_port_id_, qid, (struct rte_mbuf **)pkts, cnt);
+  if (rx_timestamp_ && recv > 0) {
+    TimestampPackets(qid, pkts, recv);
+  }
+  return recv;
+}
+
+int PMDPort::FlattenPackets(bess::Packet **pkts, int cnt) {
+  for (int i = 0; i < cnt; i++) {
+    if (likely(pkts[i]->nb_segs() == 1)) {
+      continue;
+    }
+
+    bess::Packet *flat = bess::Packet::flatten(pkts[i]);
+    if (!flat) {
+      return i;
+    }
+    bess::Packet::Free(pkts[i]);
+    pkts[i] = flat;
+  }
+
+  return cnt;
 }
 
 int PMDPort::SendPackets(queue_t qid, bess::Packet **pkts, int cnt) {
+  int to_send = multi_segment_tx_ ? cnt : FlattenPackets(pkts, cnt);
   int sent = rte_eth_tx_burst(dpdk_port_id_, qid,
-                              reinterpret_cast<struct rte_mbuf **>(pkts), cnt);
+                              reinterpret_cast<struct rte_mbuf **>(pkts),
+                              to_send);
   queue_stats[PACKET_DIR_OUT][qid].dropped += (cnt - sent);
   return sent;
 }
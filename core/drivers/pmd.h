@@ -39,6 +39,7 @@
 
 #include "../module.h"
 #include "../port.h"
+#include "../utils/clock_sync.h"
 
 typedef uint16_t dpdk_port_t;
 
@@ -53,7 +54,11 @@ class PMDPort final : public Port {
       : Port(),
         dpdk_port_id_(DPDK_PORT_UNKNOWN),
         hot_plugged_(false),
-        node_placement_(UNCONSTRAINED_SOCKET) {}
+        node_placement_(UNCONSTRAINED_SOCKET),
+        rx_timestamp_(false),
+        hw_timestamp_(false),
+        rx_clocks_(),
+        multi_segment_tx_(false) {}
 
   void InitDriver() override;
 
@@ -67,6 +72,9 @@ class PMDPort final : public Port {
    * * string pci : The PCI address of the port to bind to.
    * * string vdev : If a virtual device, the virtual device address (e.g.
    * tun/tap)
+   * * bool rx_timestamp : Record the receive time of packets.
+   * * uint64 rx_timestamp_hz : The frequency of the NIC clock.
+   * * bool multi_segment_tx : Send scattered packets as they are.
    *
    * EXPECTS:
    * * Must specify exactly one of port_id or PCI or vdev.
@@ -138,6 +146,19 @@ class PMDPort final : public Port {
   }
 
  private:
+  /*!
+   * Sets the receive time of packets, converting NIC timestamps to the TSC
+   * clock domain if the device provides them.
+   */
+  void TimestampPackets(queue_t qid, bess::Packet **pkts, int cnt);
+
+  /*!
+   * Replaces scattered packets with single-segment copies, for TX queues set
+   * up without multi-segment support. Returns the number of packets that can
+   * be sent: the caller frees those after a failed copy, as unsent ones.
+   */
+  int FlattenPackets(bess::Packet **pkts, int cnt);
+
   /*!
    * The DPDK port ID number (set after binding).
    */
@@ -155,6 +176,28 @@ class PMDPort final : public Port {
   placement_constraint node_placement_;
 
   std::string driver_;  // ixgbe, i40e, ...
+
+  /*!
+   * True if received packets should carry their receive time.
+   */
+  bool rx_timestamp_;
+
+  /*!
+   * True if the device timestamps packets with its own clock.
+   */
+  bool hw_timestamp_;
+
+  /*!
+   * Per-queue mapping from the NIC clock to the TSC clock. Each RX queue is
+   * polled by a single worker, so they need no locking.
+   */
+  bess::utils::ClockSync rx_clocks_[MAX_QUEUES_PER_DIR];
+
+  /*!
+   * True if TX queues accept packets of more than one segment. Otherwise
+   * they are flattened before they are sent.
+   */
+  bool multi_segment_tx_;
 };
 
 #endif  // BESS_DRIVERS_PMD_H_
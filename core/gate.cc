@@ -32,10 +32,12 @@
 #include "gate_hooks/track.h"
 
 #include <algorithm>
+#include <cstring>
 #include <map>
 #include <string>
 #include <utility>
 
+#include "mem_alloc.h"
 #include "worker.h"
 
 namespace bess {
@@ -164,6 +166,37 @@ void Gate::ClearHooks() {
   hooks_.clear();
 }
 
+IGate::~IGate() {
+  mem_free(coalesce_stats_);
+}
+
+void IGate::set_coalesce(bool coalesce) {
+  size_t size = sizeof(WorkerCoalesceStats) * Worker::kMaxWorkers;
+  if (!coalesce_stats_) {
+    coalesce_stats_ = static_cast<WorkerCoalesceStats *>(
+        mem_alloc_ex(size, alignof(WorkerCoalesceStats), -1));
+    CHECK(coalesce_stats_);
+  }
+  memset(coalesce_stats_, 0, size);
+  coalesce_ = coalesce;
+}
+
+IGate::CoalesceStats IGate::coalesce_stats() const {
+  CoalesceStats total = {};
+  if (!coalesce_stats_) {
+    return total;
+  }
+
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    const CoalesceStats &stats = coalesce_stats_[wid].stats;
+    total.in_batches += stats.in_batches;
+    total.in_packets += stats.in_packets;
+    total.out_batches += stats.out_batches;
+    total.out_packets += stats.out_packets;
+  }
+  return total;
+}
+
 void IGate::PushOgate(OGate *og) {
   ogates_upstream_.push_back(og);
   mergeable_ = (ogates_upstream_.size() > 1);
@@ -157,7 +157,11 @@ inline CommandResponse GateHook::RunCommand(const std::string &cmd,
 class Gate {
  public:
   Gate(Module *m, gate_idx_t idx)
-      : module_(m), gate_idx_(idx), global_gate_index_(), hooks_() {}
+      : module_(m),
+        gate_idx_(idx),
+        global_gate_index_(),
+        task_gate_index_(),
+        hooks_() {}
 
   virtual ~Gate() { ClearHooks(); }
 
@@ -170,6 +174,11 @@ class Gate {
     global_gate_index_ = global_gate_index;
   }
 
+  uint32_t task_gate_index() const { return task_gate_index_; }
+  void SetTaskIdx(uint32_t task_gate_index) {
+    task_gate_index_ = task_gate_index;
+  }
+
   const std::vector<GateHook *> &hooks() const { return hooks_; }
 
   // Creates, initializes, and then inserts gate hook in priority order.
@@ -191,6 +200,7 @@ class Gate {
   Module *module_;              // the module this gate belongs to
   gate_idx_t gate_idx_;         // input/output gate index of itself
   uint32_t global_gate_index_;  // a globally unique igate index
+  uint32_t task_gate_index_;    // unique among gates reachable from a task
 
   // TODO(melvin): Consider using a map here instead. It gets rid of the need to
   // scan to find modules for queries. Not sure how priority would work in a
@@ -205,27 +215,76 @@ class OGate;
 // A class for input gate
 class IGate : public Gate {
  public:
+  // Batch fill statistics of a coalescing igate. 'in' counts batches as
+  // handed over by upstream modules, 'out' counts batches that the igate
+  // actually runs the module with.
+  struct CoalesceStats {
+    uint64_t in_batches;
+    uint64_t in_packets;
+    uint64_t out_batches;
+    uint64_t out_packets;
+  };
+
   IGate(Module *m, gate_idx_t idx)
-      : Gate(m, idx), ogates_upstream_(), priority_(), mergeable_(false) {}
+      : Gate(m, idx),
+        ogates_upstream_(),
+        task_igate_index_(),
+        priority_(),
+        mergeable_(false),
+        coalesce_(false),
+        coalesce_stats_() {}
+
+  ~IGate() override;
 
   const std::vector<OGate *> &ogates_upstream() const {
     return ogates_upstream_;
   }
 
+  // Position in the run schedule of the tasks that reach this igate. Within
+  // each of them, these indices are in the order of global_gate_index().
+  uint32_t task_igate_index() const { return task_igate_index_; }
+  void SetTaskIGateIdx(uint32_t task_igate_index) {
+    task_igate_index_ = task_igate_index;
+  }
+
   void SetPriority(uint32_t priority) { priority_ = priority; }
 
   uint32_t priority() const { return priority_; }
   bool mergeable() const { return mergeable_; }
 
+  // If true, a batch that does not fit in the pending batch of this igate
+  // tops it up to PacketBatch::kMaxBurst and only the remainder starts a new
+  // batch, instead of starting a new batch with all of its packets.
+  bool coalesce() const { return coalesce_; }
+  // Also resets the statistics. Must not be called while workers are running.
+  void set_coalesce(bool coalesce);
+
+  // Returns the statistics of all workers
+  CoalesceStats coalesce_stats() const;
+
+  // Statistics of worker 'wid', only updated by that worker. Valid once
+  // coalescing has been enabled.
+  CoalesceStats *mutable_coalesce_stats(int wid) {
+    return &coalesce_stats_[wid].stats;
+  }
+
   void PushOgate(OGate *og);
   void RemoveOgate(const OGate *og);
 
  private:
   std::vector<OGate *> ogates_upstream_;  // previous ogates connected with
+  uint32_t task_igate_index_;  // see task_igate_index()
   uint32_t priority_;  // priority to be scheduled with a task. lower number
                        // meaning higher priority.
   bool mergeable_;  // set to be true, if it is connected with multiple ogates
                     // so that the inputs can be merged and processed once
+  // Padded to a cache line, as every upstream worker updates its own
+  struct alignas(64) WorkerCoalesceStats {
+    CoalesceStats stats;
+  };
+
+  bool coalesce_;   // top up pending batches, see coalesce()
+  WorkerCoalesceStats *coalesce_stats_;  // per worker, null until enabled
 
   DISALLOW_COPY_AND_ASSIGN(IGate);
 };
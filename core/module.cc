@@ -181,10 +181,12 @@ placement_constraint Module::ComputePlacementConstraints(
 }
 
 void Module::AddActiveWorker(int wid, const Task *t) {
-  if (!HaveVisitedWorker(t)) {  // Have not already accounted for
-                                // worker.
+  // A task may run on several workers if its leaf is stealable.
+  if (!HaveVisitedWorker(t) || !active_workers_[wid]) {
     active_workers_[wid] = true;
-    visited_tasks_.push_back(t);
+    if (!HaveVisitedWorker(t)) {
+      visited_tasks_.push_back(t);
+    }
     // Check if we should propagate downstream. We propagate if either
     // `propagate_workers_` is true or if the current module created the task.
     bool propagate = propagate_workers_;
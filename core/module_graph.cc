@@ -30,6 +30,9 @@
 
 #include "module_graph.h"
 
+#include <algorithm>
+#include <vector>
+
 #include <glog/logging.h>
 
 #include "gate.h"
@@ -140,6 +143,8 @@ void ModuleGraph::SetIGatePriority(Module *task_module) {
   }
 }
 
+// IGates are numbered first, in ascending order of priority, so that the
+// task-local run schedule indices (see SetTaskGateIdx()) can follow them.
 void ModuleGraph::SetUniqueGateIdx() {
   bess::utils::extended_priority_queue<bess::OGate *> ogates_queue;
   bess::utils::extended_priority_queue<bess::IGate *, IGateGreater>
@@ -179,21 +184,168 @@ void ModuleGraph::SetUniqueGateIdx() {
 
     ogate->SetUniqueIdx(gate_cnt_++);
   }
+
+  SetTaskGateIdx();
+}
+
+// Gives the gates reachable from each task small indices that are unique among
+// those gates, so that a Task can keep its per-gate batches in a short, dense
+// table instead of one with an entry for every gate in the graph. Gates are
+// numbered greedily, task by task in the order the task reaches them, with the
+// smallest index not yet taken in any task that can reach the gate.
+//
+// IGates also get a task-local index for the run schedule, which must keep
+// the priority order of global indices within each task. They are numbered in
+// that order, each with the smallest index above those of the igates before
+// it in any task that can reach it.
+void ModuleGraph::SetTaskGateIdx() {
+  std::vector<std::vector<bess::Gate *>> task_gates;
+  std::unordered_map<bess::Gate *, std::vector<size_t>> gate_tasks;
+  std::vector<bess::IGate *> igates;
+
+  for (auto const &e : all_modules_) {
+    if (tasks_.count(e.first) == 0) {
+      continue;
+    }
+
+    size_t task_idx = task_gates.size();
+    task_gates.emplace_back();
+    for (bess::OGate *ogate : ReachableOGates(e.second)) {
+      for (bess::Gate *gate : {static_cast<bess::Gate *>(ogate),
+                               static_cast<bess::Gate *>(ogate->igate())}) {
+        std::vector<size_t> &owners = gate_tasks[gate];
+        if (owners.empty() && gate == ogate->igate()) {
+          igates.push_back(ogate->igate());
+        }
+        if (owners.empty() || owners.back() != task_idx) {
+          owners.push_back(task_idx);
+          task_gates[task_idx].push_back(gate);
+        }
+      }
+    }
+  }
+
+  // used[t][i] is true if a gate reachable from the t-th task has index i
+  std::vector<std::vector<bool>> used(task_gates.size());
+  std::unordered_set<bess::Gate *> assigned;
+
+  for (const auto &gates : task_gates) {
+    for (bess::Gate *gate : gates) {
+      if (!assigned.insert(gate).second) {
+        continue;
+      }
+
+      const std::vector<size_t> &owners = gate_tasks[gate];
+      uint32_t idx = 0;
+      for (bool taken = true; taken;) {
+        taken = false;
+        for (size_t t : owners) {
+          if (idx < used[t].size() && used[t][idx]) {
+            taken = true;
+            idx++;
+            break;
+          }
+        }
+      }
+
+      for (size_t t : owners) {
+        if (used[t].size() <= idx) {
+          used[t].resize(idx + 1, false);
+        }
+        used[t][idx] = true;
+      }
+      gate->SetTaskIdx(idx);
+    }
+  }
+
+  std::sort(igates.begin(), igates.end(),
+            [](const bess::IGate *a, const bess::IGate *b) {
+              return a->global_gate_index() < b->global_gate_index();
+            });
+
+  // next_igate_idx[t] is above the indices of all igates numbered so far that
+  // the t-th task reaches
+  std::vector<uint32_t> next_igate_idx(task_gates.size(), 0);
+  for (bess::IGate *igate : igates) {
+    const std::vector<size_t> &owners = gate_tasks[igate];
+    uint32_t idx = 0;
+    for (size_t t : owners) {
+      idx = std::max(idx, next_igate_idx[t]);
+    }
+    for (size_t t : owners) {
+      next_igate_idx[t] = idx + 1;
+    }
+    igate->SetTaskIGateIdx(idx);
+  }
+}
+
+std::vector<bess::OGate *> ModuleGraph::ReachableOGates(Module *task_module) {
+  std::unordered_set<Module *> visited_modules;
+  std::vector<Module *> stack;
+  std::vector<bess::OGate *> ogates;
+
+  visited_modules.insert(task_module);
+  stack.push_back(task_module);
+  while (!stack.empty()) {
+    Module *module = stack.back();
+    stack.pop_back();
+
+    for (bess::OGate *ogate : module->ogates()) {
+      if (!ogate) {
+        continue;
+      }
+
+      ogates.push_back(ogate);
+      Module *child = ogate->igate()->module();
+      // Packets reaching another task module are not processed further by
+      // this task
+      if (child->is_task() || visited_modules.count(child) != 0) {
+        continue;
+      }
+
+      visited_modules.insert(child);
+      stack.push_back(child);
+    }
+  }
+
+  return ogates;
 }
 
 void ModuleGraph::ConfigureTasks() {
-  for (int i = 0; i < Worker::kMaxWorkers; i++) {
-    if (workers[i] == nullptr) {
+  for (const auto &tc_pair : bess::TrafficClassBuilder::all_tcs()) {
+    bess::TrafficClass *c = tc_pair.second;
+    if (c->policy() != bess::POLICY_LEAF) {
       continue;
     }
 
-    for (const auto &tc_pair : bess::TrafficClassBuilder::all_tcs()) {
-      bess::TrafficClass *c = tc_pair.second;
-      if (c->policy() == bess::POLICY_LEAF) {
-        auto leaf = static_cast<bess::LeafTrafficClass *>(c);
-        leaf->task()->UpdatePerGateBatch(gate_cnt_);
+    auto leaf = static_cast<bess::LeafTrafficClass *>(c);
+    Task *task = leaf->task();
+
+    // Place packet batches on the NUMA node of the worker running the task
+    int socket = -1;
+    for (int i = 0; i < Worker::kMaxWorkers; i++) {
+      if (workers[i] && workers[i]->scheduler()->root() == c->Root()) {
+        socket = workers[i]->socket();
+        break;
+      }
+    }
+
+    // Each ogate and its igate may hold a batch at the same time. IGates
+    // shared by several ogates are counted once per ogate.
+    uint32_t batch_cnt = 0;
+    uint32_t task_gate_cnt = 0;
+    std::vector<bess::IGate *> igates;
+    if (task->module()) {
+      for (bess::OGate *ogate : ReachableOGates(task->module())) {
+        batch_cnt += 2;
+        task_gate_cnt = std::max(task_gate_cnt, ogate->task_gate_index() + 1);
+        task_gate_cnt =
+            std::max(task_gate_cnt, ogate->igate()->task_gate_index() + 1);
+        igates.push_back(ogate->igate());
       }
     }
+    task->UpdatePerGateBatch(igates, task_gate_cnt);
+    task->ReservePacketBatches(batch_cnt, socket);
   }
 }
 
@@ -397,8 +549,20 @@ void ModuleGraph::PropagateActiveWorker() {
         if (c->policy() == bess::POLICY_LEAF && c->Root() == root) {
           auto leaf = static_cast<bess::LeafTrafficClass *>(c);
           leaf->task()->AddActiveWorker(i);
+          if (leaf->stealable()) {
+            AddStealingWorkers(leaf, i);
+          }
         }
       }
     }
   }
 }
+
+void ModuleGraph::AddStealingWorkers(bess::LeafTrafficClass *leaf, int wid) {
+  for (int i = 0; i < Worker::kMaxWorkers; i++) {
+    if (i != wid && workers[i] && workers[i]->work_stealing() &&
+        workers[i]->socket() == workers[wid]->socket()) {
+      leaf->task()->AddActiveWorker(i);
+    }
+  }
+}
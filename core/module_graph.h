@@ -35,6 +35,7 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "gate.h"
 #include "message.h"
@@ -46,6 +47,10 @@ using bess::gate_idx_t;
 class Module;
 class ModuleBuilder;
 
+namespace bess {
+class LeafTrafficClass;
+}  // namespace bess
+
 // Manages a global graph of modules
 class ModuleGraph {
  public:
@@ -93,6 +98,15 @@ class ModuleGraph {
 
   static void SetIGatePriority(Module *task_module);
   static void SetUniqueGateIdx();
+  static void SetTaskGateIdx();
+
+  // Returns the ogates through which the task may pass packet batches, i.e.,
+  // those up to and including the ones that lead to another task module.
+  static std::vector<bess::OGate *> ReachableOGates(Module *task_module);
+
+  // Marks the pipeline of 'leaf', owned by worker 'wid', as active on every
+  // worker that may steal the leaf.
+  static void AddStealingWorkers(bess::LeafTrafficClass *leaf, int wid);
   static void ConfigureTasks();
 
   // All modules that are tasks in the current pipeline.
@@ -30,6 +30,7 @@
 #include "module.h"
 #include "module_graph.h"
 
+#include <algorithm>
 #include <stdlib.h>
 #include <string.h>
 
@@ -390,4 +391,64 @@ TEST_F(ModuleTester, SetIGatePriority) {
   EXPECT_EQ(6, m5->igates()[0]->global_gate_index());
   EXPECT_EQ(7, m6->igates()[0]->global_gate_index());
 }
+
+TEST_F(ModuleTester, SetTaskGateIdx) {
+  pb_error_t perr;
+  Module *t1, *t2, *m1, *m2, *m3, *m4;
+
+  /* Test Topology
+   * t1 -- m1 -- m2 -- m4
+   *            /
+   * t2 -------/
+   *   \
+   *    m3
+   */
+  ASSERT_NE(nullptr, t1 = create_acme_with_task("t1", &perr));
+  ASSERT_NE(nullptr, t2 = create_acme_with_task("t2", &perr));
+  ASSERT_NE(nullptr, m1 = create_acme("m1", &perr));
+  ASSERT_NE(nullptr, m2 = create_acme("m2", &perr));
+  ASSERT_NE(nullptr, m3 = create_acme("m3", &perr));
+  ASSERT_NE(nullptr, m4 = create_acme("m4", &perr));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(t1, 0, m1, 0));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(m1, 0, m2, 0));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(m2, 0, m4, 0));
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(t2, 0, m2, 0));  // merge
+  EXPECT_EQ(0, ModuleGraph::ConnectModules(t2, 1, m3, 0));
+
+  ModuleGraph::UpdateTaskGraph();
+
+  // Each task reaches six gates, so their indices must be a permutation of
+  // [0, 6) within each task, although the graph has 9 gates in total.
+  std::vector<bess::Gate *> t1_gates = {
+      t1->ogates()[0], m1->igates()[0], m1->ogates()[0],
+      m2->igates()[0], m2->ogates()[0], m4->igates()[0]};
+  std::vector<bess::Gate *> t2_gates = {
+      t2->ogates()[0], t2->ogates()[1], m2->igates()[0],
+      m2->ogates()[0], m3->igates()[0], m4->igates()[0]};
+
+  for (const auto &gates : {t1_gates, t2_gates}) {
+    std::vector<bool> seen(gates.size(), false);
+    for (bess::Gate *gate : gates) {
+      ASSERT_LT(gate->task_gate_index(), gates.size());
+      EXPECT_FALSE(seen[gate->task_gate_index()]);
+      seen[gate->task_gate_index()] = true;
+    }
+  }
+
+  // Within each task, igates are numbered densely in global priority order.
+  std::vector<bess::IGate *> t1_igates = {m1->igates()[0], m2->igates()[0],
+                                          m4->igates()[0]};
+  std::vector<bess::IGate *> t2_igates = {m2->igates()[0], m3->igates()[0],
+                                          m4->igates()[0]};
+
+  for (auto igates : {t1_igates, t2_igates}) {
+    std::sort(igates.begin(), igates.end(),
+              [](const bess::IGate *a, const bess::IGate *b) {
+                return a->global_gate_index() < b->global_gate_index();
+              });
+    for (size_t i = 0; i < igates.size(); i++) {
+      EXPECT_EQ(i, igates[i]->task_igate_index());
+    }
+  }
+}
 }  // namespace
@@ -35,9 +35,58 @@
 
 const Commands ACL::cmds = {
     {"add", "ACLArg", MODULE_CMD_FUNC(&ACL::CommandAdd),
-     Command::THREAD_UNSAFE},
+     Command::THREAD_SAFE},
     {"clear", "EmptyArg", MODULE_CMD_FUNC(&ACL::CommandClear),
-     Command::THREAD_UNSAFE}};
+     Command::THREAD_SAFE}};
+
+static bess::utils::HyperSplit<4>::Range PrefixRange(const Ipv4Prefix &p) {
+  uint32_t mask = p.mask.value();
+  uint32_t lo = p.addr.value() & mask;
+  return {lo, lo | ~mask};
+}
+
+static bess::utils::HyperSplit<4>::Range PortRange(be16_t port) {
+  if (port == be16_t(0)) {
+    return {0, UINT16_MAX};
+  }
+  return {port.value(), port.value()};
+}
+
+static std::vector<bess::utils::HyperSplit<4>::Rule> ToRanges(
+    const std::vector<ACL::ACLRule> &rules) {
+  std::vector<bess::utils::HyperSplit<4>::Rule> ret;
+  for (const auto &rule : rules) {
+    ret.push_back({{PrefixRange(rule.src_ip), PrefixRange(rule.dst_ip),
+                    PortRange(rule.src_port), PortRange(rule.dst_port)}});
+  }
+  return ret;
+}
+
+ACL::Classifier::Classifier(const std::vector<ACLRule> &rules)
+    : tree_(ToRanges(rules)), drop_() {
+  for (const auto &rule : rules) {
+    drop_.push_back(rule.drop);
+  }
+}
+
+void ACL::UpdateClassifier() {
+  const Classifier *old = classifier_.exchange(new Classifier(rules_));
+  if (!old) {
+    return;
+  }
+
+  // Workers that still use the old classifier are in the middle of a batch
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    while (readers_[wid].load() == old) {
+      __builtin_ia32_pause();
+    }
+  }
+  delete old;
+}
+
+void ACL::DeInit() {
+  delete classifier_.exchange(nullptr);
+}
 
 CommandResponse ACL::Init(const bess::pb::ACLArg &arg) {
   for (const auto &rule : arg.rules()) {
@@ -49,6 +98,7 @@ CommandResponse ACL::Init(const bess::pb::ACLArg &arg) {
         .drop = rule.drop()};
     rules_.push_back(new_rule);
   }
+  UpdateClassifier();
   return CommandSuccess();
 }
 
@@ -59,6 +109,7 @@ CommandResponse ACL::CommandAdd(const bess::pb::ACLArg &arg) {
 
 CommandResponse ACL::CommandClear(const bess::pb::EmptyArg &) {
   rules_.clear();
+  UpdateClassifier();
   return CommandSuccess();
 }
 
@@ -70,6 +121,9 @@ void ACL::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   gate_idx_t incoming_gate = ctx->current_igate;
 
   int cnt = batch->cnt();
+  Classifier::Key keys[bess::PacketBatch::kMaxBurst];
+  int matches[bess::PacketBatch::kMaxBurst];
+
   for (int i = 0; i < cnt; i++) {
     bess::Packet *pkt = batch->pkts()[i];
 
@@ -79,21 +133,31 @@ void ACL::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     Udp *udp =
         reinterpret_cast<Udp *>(reinterpret_cast<uint8_t *>(ip) + ip_bytes);
 
-    bool emitted = false;
-    for (const auto &rule : rules_) {
-      if (rule.Match(ip->src, ip->dst, udp->src_port, udp->dst_port)) {
-        if (!rule.drop) {
-          emitted = true;
-          EmitPacket(ctx, pkt, incoming_gate);
-        }
-        break;  // Stop matching other rules
-      }
-    }
+    keys[i] =
+        Classifier::MakeKey(ip->src, ip->dst, udp->src_port, udp->dst_port);
+  }
+
+  // Announce the classifier we use before using it. Check that it was not
+  // replaced in the meantime, since UpdateClassifier() may have missed us.
+  std::atomic<const Classifier *> &reader = readers_[ctx->wid];
+  const Classifier *classifier;
+  do {
+    classifier = classifier_.load();
+    reader.store(classifier);
+  } while (classifier != classifier_.load());
+
+  classifier->Lookup(keys, cnt, matches);
 
-    if (!emitted) {
+  for (int i = 0; i < cnt; i++) {
+    bess::Packet *pkt = batch->pkts()[i];
+    if (matches[i] >= 0 && !classifier->drop(matches[i])) {
+      EmitPacket(ctx, pkt, incoming_gate);
+    } else {
       DropPacket(ctx, pkt);
     }
   }
+
+  reader.store(nullptr, std::memory_order_release);
 }
 
 ADD_MODULE(ACL, "acl", "ACL module from NetBricks")
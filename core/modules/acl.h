@@ -30,10 +30,12 @@
 #ifndef BESS_MODULES_ACL_H_
 #define BESS_MODULES_ACL_H_
 
+#include <atomic>
 #include <vector>
 
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
+#include "../utils/hyper_split.h"
 #include "../utils/ip.h"
 
 using bess::utils::be16_t;
@@ -56,11 +58,39 @@ class ACL final : public Module {
     bool drop;
   };
 
+  // A list of ACLRules, compiled into a decision tree over the 4 fields.
+  // Immutable once built.
+  class Classifier {
+   public:
+    typedef bess::utils::HyperSplit<4>::Key Key;
+
+    explicit Classifier(const std::vector<ACLRule> &rules);
+
+    static Key MakeKey(be32_t sip, be32_t dip, be16_t sport, be16_t dport) {
+      return {{sip.value(), dip.value(), sport.value(), dport.value()}};
+    }
+
+    // Sets matches[i] to the index of the first rule that matches keys[i],
+    // or -1 if none.
+    void Lookup(const Key *keys, int cnt, int *matches) const {
+      tree_.Lookup(keys, cnt, matches);
+    }
+
+    bool drop(int rule) const { return drop_[rule]; }
+
+   private:
+    bess::utils::HyperSplit<4> tree_;
+    std::vector<bool> drop_;
+  };
+
   static const Commands cmds;
 
-  ACL() : Module() { max_allowed_workers_ = Worker::kMaxWorkers; }
+  ACL() : Module(), rules_(), classifier_(), readers_() {
+    max_allowed_workers_ = Worker::kMaxWorkers;
+  }
 
   CommandResponse Init(const bess::pb::ACLArg &arg);
+  void DeInit() override;
 
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
@@ -68,7 +98,16 @@ class ACL final : public Module {
   CommandResponse CommandClear(const bess::pb::EmptyArg &arg);
 
  private:
+  // Compiles rules_, and switches workers to the result
+  void UpdateClassifier();
+
   std::vector<ACLRule> rules_;
+
+  // Replaced as a whole whenever rules_ changes, without pausing workers.
+  // readers_[wid] is the classifier in use by the worker, if any. A replaced
+  // classifier is freed once no worker uses it anymore.
+  std::atomic<const Classifier *> classifier_;
+  std::atomic<const Classifier *> readers_[Worker::kMaxWorkers];
 };
 
 #endif  // BESS_MODULES_ACL_H_
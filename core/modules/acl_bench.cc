@@ -0,0 +1,146 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmarks for ACL rule lookups.
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include <string>
+#include <vector>
+
+#include "../utils/random.h"
+#include "acl.h"
+
+namespace {
+
+struct Fields {
+  be32_t sip;
+  be32_t dip;
+  be16_t sport;
+  be16_t dport;
+};
+
+std::string RandomPrefix(Random *rd, int min_len) {
+  int len = min_len + rd->GetRange(33 - min_len);
+  uint32_t ip = rd->Get();
+  return std::to_string(ip >> 24) + "." + std::to_string((ip >> 16) & 0xff) +
+         "." + std::to_string((ip >> 8) & 0xff) + "." +
+         std::to_string(ip & 0xff) + "/" + std::to_string(len);
+}
+
+// Rules with random source and destination prefixes. About half of them have
+// a wildcard port.
+std::vector<ACL::ACLRule> MakeRules(int n) {
+  Random rd;
+  std::vector<ACL::ACLRule> rules;
+  for (int i = 0; i < n; i++) {
+    rules.push_back({Ipv4Prefix(RandomPrefix(&rd, 8)),
+                     Ipv4Prefix(RandomPrefix(&rd, 16)),
+                     be16_t(rd.GetRange(2) ? 0 : 1 + rd.GetRange(1024)),
+                     be16_t(rd.GetRange(2) ? 0 : 1 + rd.GetRange(1024)),
+                     rd.GetRange(2) == 0});
+  }
+  return rules;
+}
+
+// Packets that hit random rules
+std::vector<Fields> MakePackets(const std::vector<ACL::ACLRule> &rules) {
+  Random rd;
+  std::vector<Fields> pkts;
+  for (int i = 0; i < 4096; i++) {
+    const ACL::ACLRule &r = rules[rd.GetRange(rules.size())];
+    pkts.push_back({r.src_ip.addr & r.src_ip.mask,
+                    r.dst_ip.addr & r.dst_ip.mask, r.src_port, r.dst_port});
+  }
+  return pkts;
+}
+
+const int kBurst = bess::PacketBatch::kMaxBurst;
+
+}  // namespace
+
+// What ACL::ProcessBatch() does, per batch. items/s is packets/s.
+static void BM_Classifier(benchmark::State &state) {
+  std::vector<ACL::ACLRule> rules = MakeRules(state.range(0));
+  ACL::Classifier classifier(rules);
+
+  std::vector<ACL::Classifier::Key> keys;
+  for (const Fields &f : MakePackets(rules)) {
+    keys.push_back(ACL::Classifier::MakeKey(f.sip, f.dip, f.sport, f.dport));
+  }
+
+  int matches[kBurst];
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    classifier.Lookup(&keys[i], kBurst, matches);
+    benchmark::DoNotOptimize(matches);
+    i = (i + kBurst) % keys.size();
+  }
+  state.SetItemsProcessed(state.iterations() * kBurst);
+}
+
+// The linear scan of rules that ACL used to do
+static void BM_LinearScan(benchmark::State &state) {
+  std::vector<ACL::ACLRule> rules = MakeRules(state.range(0));
+  std::vector<Fields> pkts = MakePackets(rules);
+
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    for (int j = 0; j < kBurst; j++) {
+      const Fields &f = pkts[i + j];
+      int match = -1;
+      for (size_t k = 0; k < rules.size(); k++) {
+        if (rules[k].Match(f.sip, f.dip, f.sport, f.dport)) {
+          match = k;
+          break;
+        }
+      }
+      benchmark::DoNotOptimize(match);
+    }
+    i = (i + kBurst) % pkts.size();
+  }
+  state.SetItemsProcessed(state.iterations() * kBurst);
+}
+
+// Compiling rules, as done on every "add" or "clear" command
+static void BM_Compile(benchmark::State &state) {
+  std::vector<ACL::ACLRule> rules = MakeRules(state.range(0));
+  while (state.KeepRunning()) {
+    ACL::Classifier classifier(rules);
+    benchmark::DoNotOptimize(&classifier);
+  }
+  state.SetItemsProcessed(state.iterations() * rules.size());
+}
+
+BENCHMARK(BM_Classifier)->RangeMultiplier(10)->Range(10, 100000);
+BENCHMARK(BM_LinearScan)->RangeMultiplier(10)->Range(10, 100000);
+BENCHMARK(BM_Compile)->RangeMultiplier(10)->Range(10, 100000);
+
+BENCHMARK_MAIN();
@@ -120,8 +120,9 @@ CommandResponse DRR::CommandMaxFlowQueueSize(
   return SetMaxFlowQueueSize(arg.max_queue_size());
 }
 
-void DRR::ProcessBatch(Context *, bess::PacketBatch *batch) {
+void DRR::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   int err = 0;
+  uint64_t now = ctx->current_ns;
 
   // insert packets in the batch into their corresponding flows
   int cnt = batch->cnt();
@@ -138,11 +139,11 @@ void DRR::ProcessBatch(Context *, bess::PacketBatch *batch) {
       if (llring_full(flow_ring_)) {
         bess::Packet::Free(pkt);
       } else {
-        AddNewFlow(pkt, id, &err);
+        AddNewFlow(pkt, id, now, &err);
         assert(err == 0);
       }
     } else {
-      Enqueue(it->second, pkt, &err);
+      Enqueue(it->second, pkt, now, &err);
       assert(err == 0);
     }
   }
@@ -160,7 +161,7 @@ struct task_result DRR::RunTask(Context *ctx, bess::PacketBatch *batch,
   batch->clear();
   uint32_t total_bytes = 0;
   if (flow_ring_ != NULL) {
-    total_bytes = GetNextBatch(batch, &err);
+    total_bytes = GetNextBatch(batch, ctx->current_ns, &err);
   }
   assert(err >= 0);  // TODO(joshua) do proper error checking
 
@@ -174,7 +175,8 @@ struct task_result DRR::RunTask(Context *ctx, bess::PacketBatch *batch,
   return {.block = (cnt == 0), .packets = cnt, .bits = bits_retrieved};
 }
 
-uint32_t DRR::GetNextBatch(bess::PacketBatch *batch, int *err) {
+uint32_t DRR::GetNextBatch(bess::PacketBatch *batch, uint64_t now,
+                           int *err) {
   Flow *f;
   uint32_t total_bytes = 0;
   uint32_t count = llring_count(flow_ring_);
@@ -198,7 +200,7 @@ uint32_t DRR::GetNextBatch(bess::PacketBatch *batch, int *err) {
     }
     count--;
 
-    f = GetNextFlow(err);
+    f = GetNextFlow(now, err);
     if (*err != 0) {
       return total_bytes;
     } else if (f == nullptr) {
@@ -230,9 +232,8 @@ uint32_t DRR::GetNextBatch(bess::PacketBatch *batch, int *err) {
   return total_bytes;
 }
 
-DRR::Flow *DRR::GetNextFlow(int *err) {
+DRR::Flow *DRR::GetNextFlow(uint64_t now, int *err) {
   Flow *f;
-  double now = get_epoch_time();
 
   if (!current_flow_) {
     *err = llring_dequeue(flow_ring_, reinterpret_cast<void **>(&f));
@@ -242,7 +243,7 @@ DRR::Flow *DRR::GetNextFlow(int *err) {
 
     if (llring_empty(f->queue) && !f->next_packet) {
       // if the flow expired, remove it
-      if (now - f->timer > kTtl) {
+      if (now - f->timer > kTtlNs) {
         RemoveFlow(f);
       } else {
         *err = llring_enqueue(flow_ring_, f);
@@ -306,7 +307,7 @@ DRR::FlowId DRR::GetId(bess::Packet *pkt) {
   return id;
 }
 
-void DRR::AddNewFlow(bess::Packet *pkt, FlowId id, int *err) {
+void DRR::AddNewFlow(bess::Packet *pkt, FlowId id, uint64_t now, int *err) {
   // creates flow
   Flow *f = new Flow(id);
 
@@ -319,7 +320,7 @@ void DRR::AddNewFlow(bess::Packet *pkt, FlowId id, int *err) {
 
   flows_.Insert(id, f);
 
-  Enqueue(f, pkt, err);
+  Enqueue(f, pkt, now, err);
   if (*err != 0) {
     return;
   }
@@ -355,7 +356,7 @@ llring *DRR::AddQueue(uint32_t slots, int *err) {
   return queue;
 }
 
-void DRR::Enqueue(Flow *f, bess::Packet *newpkt, int *err) {
+void DRR::Enqueue(Flow *f, bess::Packet *newpkt, uint64_t now, int *err) {
   // if the queue is full. drop the packet.
   if (llring_count(f->queue) >= max_queue_size_) {
     bess::Packet::Free(newpkt);
@@ -376,7 +377,7 @@ void DRR::Enqueue(Flow *f, bess::Packet *newpkt, int *err) {
 
   *err = llring_enqueue(f->queue, reinterpret_cast<void *>(newpkt));
   if (*err == 0) {
-    f->timer = get_epoch_time();
+    f->timer = now;
   } else {
     bess::Packet::Free(newpkt);
   }
@@ -82,7 +82,8 @@ class DRR final : public Module {
       2;  // the scale at which a flow's queue grows
   static const int kFlowQueueMax =
       8192;                     // the max flow queue size if non-specified
-  static const int kTtl = 300;  // time to live for flow entries
+  static const uint64_t kTtlNs =
+      300ull * 1000 * 1000 * 1000;  // time to live for flow entries
   static const int kDefaultQuantum =
       1500;  // default value to initialize qauntum_ to
   static const int kPacketOverhead =
@@ -101,7 +102,7 @@ class DRR final : public Module {
   // in.
   struct Flow {
     int deficit;                // the allocated bytes to the flow
-    double timer;               // to determine if TTL should be used
+    uint64_t timer;             // last enqueue time (ctx.current_ns)
     FlowId id;                  // allows the flow to remove itself from the map
     struct llring *queue;       // queue to store current packets for flow
     bess::Packet *next_packet;  // buffer to store next packet from the queue.
@@ -193,9 +194,9 @@ class DRR final : public Module {
   llring *ResizeQueue(llring *old_queue, uint32_t new_size, int *err);
 
   //  Puts the packet into the llring queue within the flow. Takes the flow to
-  //  enqueue the packet into, the packet to enqueue into the flow's queue
-  //  and integer pointer to be set on error.
-  void Enqueue(Flow *f, bess::Packet *pkt, int *err);
+  //  enqueue the packet into, the packet to enqueue into the flow's queue,
+  //  the current time and integer pointer to be set on error.
+  void Enqueue(Flow *f, bess::Packet *pkt, uint64_t now, int *err);
 
   //  Takes a Packet to get a flow id for. Returns the 5 element identifier for
   //  the flow that the packet belongs to
@@ -203,18 +204,18 @@ class DRR final : public Module {
 
   //  Creates a new flow and adds it to the round robin queue. Takes the first
   //  pkt
-  //  to be enqueued in the new flow, the id of the new flow to be created and
-  //  integer pointer to set on error.
-  void AddNewFlow(bess::Packet *pkt, FlowId id, int *err);
+  //  to be enqueued in the new flow, the id of the new flow to be created, the
+  //  current time and integer pointer to set on error.
+  void AddNewFlow(bess::Packet *pkt, FlowId id, uint64_t now, int *err);
 
   //  Removes the flow from the hash table and frees all the packets within its
   //  queue. Takes the pointer to the flow to remove
   void RemoveFlow(Flow *f);
 
   //  Obtain the next batch of packets from the next flows in round robin.
-  //  Takes a PacketBatch to insert the packets into and integer pointer
-  //  to set on error. Returns total bytes added to batch.
-  uint32_t GetNextBatch(bess::PacketBatch *batch, int *err);
+  //  Takes a PacketBatch to insert the packets into, the current time and
+  //  integer pointer to set on error. Returns total bytes added to batch.
+  uint32_t GetNextBatch(bess::PacketBatch *batch, uint64_t now, int *err);
 
   //  gets the next set of packets from flow given allocated bytes
   //  Takes the PacketBatch to put the packets into and the flow to get the
@@ -224,9 +225,10 @@ class DRR final : public Module {
   uint32_t GetNextPackets(bess::PacketBatch *batch, Flow *f, int *err);
 
   //  gets the next flow from the queue of flows. Returns nullptr if the next
-  //  flow is empty or if the flow is deleted. If there is a an error returns
-  //  an error and sets the integer pointer to error value.
-  Flow *GetNextFlow(int *err);
+  //  flow is empty or if the flow is deleted (when it has been idle for kTtlNs
+  //  as of now). If there is a an error returns an error and sets the integer
+  //  pointer to error value.
+  Flow *GetNextFlow(uint64_t now, int *err);
 
   //  allocates llring queue space and adds the queue to the specified flow with
   //  size indicated by slots. Takes the Flow to add the queue, the number
@@ -50,11 +50,11 @@ const Commands ExactMatch::cmds = {
     {"set_runtime_config", "ExactMatchConfig",
      MODULE_CMD_FUNC(&ExactMatch::SetRuntimeConfig), Command::THREAD_UNSAFE},
     {"add", "ExactMatchCommandAddArg", MODULE_CMD_FUNC(&ExactMatch::CommandAdd),
-     Command::THREAD_UNSAFE},
+     Command::THREAD_SAFE},
     {"delete", "ExactMatchCommandDeleteArg",
-     MODULE_CMD_FUNC(&ExactMatch::CommandDelete), Command::THREAD_UNSAFE},
+     MODULE_CMD_FUNC(&ExactMatch::CommandDelete), Command::THREAD_SAFE},
     {"clear", "EmptyArg", MODULE_CMD_FUNC(&ExactMatch::CommandClear),
-     Command::THREAD_UNSAFE},
+     Command::THREAD_SAFE},
     {"set_default_gate", "ExactMatchCommandSetDefaultGateArg",
      MODULE_CMD_FUNC(&ExactMatch::CommandSetDefaultGate),
      Command::THREAD_SAFE}};
@@ -115,6 +115,9 @@ CommandResponse ExactMatch::Init(const bess::pb::ExactMatchArg &arg) {
 
   default_gate_ = DROP_GATE;
 
+  // Rules are updated while workers are looking them up
+  table_.EnableConcurrentReads();
+
   return CommandSuccess();
 }
 
@@ -215,9 +218,11 @@ CommandResponse ExactMatch::SetRuntimeConfig(
   for (auto i = 0; i < arg.rules_size(); i++) {
     Error ret = AddRule(arg.rules(i));
     if (ret.first) {
+      ReclaimRules();
       return CommandFailure(ret.first, "%s", ret.second.c_str());
     }
   }
+  ReclaimRules();
   return CommandSuccess();
 }
 
@@ -270,9 +275,19 @@ void ExactMatch::RuleFieldsFromPb(
   }
 }
 
+// Frees what rule updates have left behind, once no worker can be looking
+// at it anymore.
+void ExactMatch::ReclaimRules() {
+  if (table_.NeedsReclaim()) {
+    synchronize_workers();
+    table_.Reclaim();
+  }
+}
+
 CommandResponse ExactMatch::CommandAdd(
     const bess::pb::ExactMatchCommandAddArg &arg) {
   Error ret = AddRule(arg);
+  ReclaimRules();
   if (ret.first) {
     return CommandFailure(ret.first, "%s", ret.second.c_str());
   }
@@ -292,6 +307,7 @@ CommandResponse ExactMatch::CommandDelete(
   RuleFieldsFromPb(arg.fields(), &rule);
 
   Error ret = table_.DeleteRule(rule);
+  ReclaimRules();
   if (ret.first) {
     return CommandFailure(ret.first, "%s", ret.second.c_str());
   }
@@ -301,6 +317,7 @@ CommandResponse ExactMatch::CommandDelete(
 
 CommandResponse ExactMatch::CommandClear(const bess::pb::EmptyArg &) {
   table_.ClearRules();
+  ReclaimRules();
   return CommandSuccess();
 }
 
@@ -76,6 +76,7 @@ class ExactMatch final : public Module {
   void RuleFieldsFromPb(const RepeatedPtrField<bess::pb::FieldData> &fields,
                         bess::utils::ExactMatchRuleFields *rule);
   Error AddRule(const bess::pb::ExactMatchCommandAddArg &arg);
+  void ReclaimRules();
 
   gate_idx_t default_gate_;
   bool empty_masks_;  // mainly for GetInitialArg
@@ -30,16 +30,13 @@
 
 #include "ip_lookup.h"
 
-#include <rte_config.h>
-#include <rte_errno.h>
-#include <rte_lpm.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
 
 #include "../utils/bits.h"
 #include "../utils/ether.h"
 #include "../utils/format.h"
-#include "../utils/ip.h"
-
-#define VECTOR_OPTIMIZATION 1
 
 static inline int is_valid_gate(gate_idx_t gate) {
   return (gate < MAX_GATES || gate == DROP_GATE);
@@ -47,109 +44,238 @@ static inline int is_valid_gate(gate_idx_t gate) {
 
 const Commands IPLookup::cmds = {
     {"add", "IPLookupCommandAddArg", MODULE_CMD_FUNC(&IPLookup::CommandAdd),
-     Command::THREAD_UNSAFE},
+     Command::THREAD_SAFE},
     {"delete", "IPLookupCommandDeleteArg", MODULE_CMD_FUNC(&IPLookup::CommandDelete),
-     Command::THREAD_UNSAFE},
+     Command::THREAD_SAFE},
     {"clear", "EmptyArg", MODULE_CMD_FUNC(&IPLookup::CommandClear),
-     Command::THREAD_UNSAFE}};
+     Command::THREAD_SAFE},
+    {"update", "IPLookupCommandUpdateArg",
+     MODULE_CMD_FUNC(&IPLookup::CommandUpdate), Command::THREAD_SAFE}};
 
 CommandResponse IPLookup::Init(const bess::pb::IPLookupArg &arg) {
-  struct rte_lpm_config conf = {
-      .max_rules = arg.max_rules() ? arg.max_rules() : 1024,
-      .number_tbl8s = arg.max_tbl8s() ? arg.max_tbl8s() : 128,
-      .flags = 0,
-  };
+  const size_t max_tbl8s = arg.max_tbl8s() ?: 128;
+  const size_t max_tbl8s_v6 = arg.max_tbl8s_v6() ?: 1024;
 
-  default_gate_ = DROP_GATE;
+  // Group indices share a table entry with a tag byte
+  if (max_tbl8s > Lpm4::kMaxValue || max_tbl8s_v6 > Lpm6::kMaxValue) {
+    return CommandFailure(EINVAL, "max_tbl8s and max_tbl8s_v6 must be <= %u",
+                          Lpm4::kMaxValue);
+  }
 
-  lpm_ = rte_lpm_create(name().c_str(), /* socket_id = */ 0, &conf);
+  // Tables start on socket 0, until we know where the workers are
+  for (Tables &tables : tables_) {
+    tables.v4.reset(new Lpm4(arg.max_rules() ?: 1024, max_tbl8s, 0));
+    tables.v6.reset(new Lpm6(arg.max_rules_v6() ?: 1024, max_tbl8s_v6, 0));
+    tables.default_gate4 = DROP_GATE;
+    tables.default_gate6 = DROP_GATE;
 
-  if (!lpm_) {
-    return CommandFailure(rte_errno, "DPDK error: %s", rte_strerror(rte_errno));
+    if (!tables.v4->allocated() || !tables.v6->allocated()) {
+      return CommandFailure(ENOMEM, "could not allocate routing tables");
+    }
   }
 
   return CommandSuccess();
 }
 
-void IPLookup::DeInit() {
-  if (lpm_) {
-    rte_lpm_free(lpm_);
-  }
-}
-
 void IPLookup::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   using bess::utils::Ethernet;
   using bess::utils::Ipv4;
+  using bess::utils::Ipv6;
+  using bess::utils::be16_t;
+
+  const int cnt = batch->cnt();
+  const Tables *tables = active_.load(std::memory_order_acquire);
+
+  Lpm4::Key keys[bess::PacketBatch::kMaxBurst];
+  Lpm6::Key keys6[bess::PacketBatch::kMaxBurst];
+  uint32_t next_hops[bess::PacketBatch::kMaxBurst];
+  uint32_t next_hops6[bess::PacketBatch::kMaxBurst];
+  int idx6[bess::PacketBatch::kMaxBurst];
+  int cnt4 = 0;
+  int cnt6 = 0;
+
+  // Split the batch by address family, to look up each at once
+  for (int i = 0; i < cnt; i++) {
+    Ethernet *eth = batch->pkts()[i]->head_data<Ethernet *>();
+
+    if (eth->ether_type == be16_t(Ethernet::Type::kIpv6)) {
+      const Ipv6 *ip6 = reinterpret_cast<const Ipv6 *>(eth + 1);
+      keys6[cnt6] = ip6->dst;
+      idx6[cnt6++] = i;
+    } else {
+      const Ipv4 *ip = reinterpret_cast<const Ipv4 *>(eth + 1);
+      memcpy(keys[cnt4++].data(), &ip->dst, sizeof(Lpm4::Key));
+    }
+  }
 
-  gate_idx_t default_gate = default_gate_;
+  tables->v4->LookupBatch(keys, cnt4, next_hops, tables->default_gate4);
+  tables->v6->LookupBatch(keys6, cnt6, next_hops6, tables->default_gate6);
 
-  int cnt = batch->cnt();
-  int i;
+  // Emit in the original order
+  int j4 = 0;
+  int j6 = 0;
+  for (int i = 0; i < cnt; i++) {
+    if (j6 < cnt6 && idx6[j6] == i) {
+      EmitPacket(ctx, batch->pkts()[i], next_hops6[j6++]);
+    } else {
+      EmitPacket(ctx, batch->pkts()[i], next_hops[j4++]);
+    }
+  }
+}
 
-#if VECTOR_OPTIMIZATION
-  // Convert endianness for four addresses at the same time
-  const __m128i bswap_mask =
-      _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+int IPLookup::OnEvent(bess::Event e) {
+  if (e != bess::Event::PreResume) {
+    return -ENOTSUP;
+  }
 
-  /* 4 at a time */
-  for (i = 0; i + 3 < cnt; i += 4) {
-    Ethernet *eth;
-    Ipv4 *ip;
+  // Workers are paused, so the tables can be replaced in the meantime
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    if (active_workers()[wid]) {
+      MoveTables(workers[wid]->socket());
+      break;
+    }
+  }
 
-    uint32_t a0, a1, a2, a3;
-    uint32_t next_hops[4];
+  return 0;
+}
 
-    __m128i ip_addr;
+void IPLookup::MoveTables(int socket) {
+  const Tables *active = active_.load(std::memory_order_relaxed);
+  if (active->v4->socket() == socket) {
+    return;
+  }
 
-    eth = batch->pkts()[i]->head_data<Ethernet *>();
-    ip = (Ipv4 *)(eth + 1);
-    a0 = ip->dst.raw_value();
+  Tables moved[2];
+  bool ok = true;
+
+  for (Tables &tables : moved) {
+    tables.v4.reset(
+        new Lpm4(active->v4->max_rules(), active->v4->max_groups(), socket));
+    tables.v6.reset(
+        new Lpm6(active->v6->max_rules(), active->v6->max_groups(), socket));
+    tables.default_gate4 = active->default_gate4;
+    tables.default_gate6 = active->default_gate6;
+
+    if (!tables.v4->allocated() || !tables.v6->allocated()) {
+      LOG(WARNING) << name() << ": could not allocate tables on socket "
+                   << socket;
+      return;
+    }
+  }
 
-    eth = batch->pkts()[i + 1]->head_data<Ethernet *>();
-    ip = (Ipv4 *)(eth + 1);
-    a1 = ip->dst.raw_value();
+  active->v4->ForEachRule(
+      [&](const Lpm4::Key &prefix, int depth, uint32_t gate) {
+        ok = ok && moved[0].v4->Add(prefix, depth, gate) == 0;
+      });
+  active->v6->ForEachRule(
+      [&](const Lpm6::Key &prefix, int depth, uint32_t gate) {
+        ok = ok && moved[0].v6->Add(prefix, depth, gate) == 0;
+      });
+
+  if (!ok) {
+    LOG(WARNING) << name() << ": routes do not fit in new tables on socket "
+                 << socket;
+    return;
+  }
 
-    eth = batch->pkts()[i + 2]->head_data<Ethernet *>();
-    ip = (Ipv4 *)(eth + 1);
-    a2 = ip->dst.raw_value();
+  moved[1].v4->CopyFrom(*moved[0].v4);
+  moved[1].v6->CopyFrom(*moved[0].v6);
 
-    eth = batch->pkts()[i + 3]->head_data<Ethernet *>();
-    ip = (Ipv4 *)(eth + 1);
-    a3 = ip->dst.raw_value();
+  tables_[0] = std::move(moved[0]);
+  tables_[1] = std::move(moved[1]);
+  active_.store(&tables_[0], std::memory_order_release);
+}
 
-    ip_addr = _mm_set_epi32(a3, a2, a1, a0);
-    ip_addr = _mm_shuffle_epi8(ip_addr, bswap_mask);
+std::string IPLookup::GetDesc() const {
+  const Tables *active = active_.load(std::memory_order_relaxed);
+  return bess::utils::Format("%zu IPv4, %zu IPv6 routes",
+                             active->v4->num_rules(), active->v6->num_rules());
+}
 
-    rte_lpm_lookupx4(lpm_, ip_addr, next_hops, default_gate);
+IPLookup::Tables *IPLookup::SwapTables() {
+  Tables *old = active_.exchange(standby(), std::memory_order_acq_rel);
+  synchronize_workers();
+  return old;
+}
 
-    EmitPacket(ctx, batch->pkts()[i], next_hops[0]);
-    EmitPacket(ctx, batch->pkts()[i + 1], next_hops[1]);
-    EmitPacket(ctx, batch->pkts()[i + 2], next_hops[2]);
-    EmitPacket(ctx, batch->pkts()[i + 3], next_hops[3]);
+// Each batch of routes is applied twice, once to each copy, and waits for
+// one scheduling round of the workers in between.
+CommandResponse IPLookup::UpdateRoutes(const std::vector<Route> &routes) {
+  Tables *next = standby();
+
+  for (size_t i = 0; i < routes.size(); i++) {
+    int ret = ApplyRoute(next, routes[i]);
+    if (ret) {
+      // Undo the routes applied so far
+      const Tables *active = active_.load(std::memory_order_relaxed);
+      next->v4->CopyFrom(*active->v4);
+      next->v6->CopyFrom(*active->v6);
+      next->default_gate4 = active->default_gate4;
+      next->default_gate6 = active->default_gate6;
+      return CommandFailure(-ret, "Failed to %s route %zu: %s",
+                            routes[i].withdraw ? "delete" : "add", i,
+                            strerror(-ret));
+    }
   }
-#endif
 
-  /* process the rest one by one */
-  for (; i < cnt; i++) {
-    Ethernet *eth;
-    Ipv4 *ip;
+  Tables *prev = SwapTables();
 
-    uint32_t next_hop;
-    int ret;
+  // Cannot fail, as the tables were the same
+  for (const Route &route : routes) {
+    CHECK_EQ(ApplyRoute(prev, route), 0);
+  }
 
-    eth = batch->pkts()[i]->head_data<Ethernet *>();
-    ip = (Ipv4 *)(eth + 1);
+  return CommandSuccess();
+}
 
-    ret = rte_lpm_lookup(lpm_, ip->dst.value(), &next_hop);
+int IPLookup::ApplyRoute(Tables *tables, const Route &route) {
+  if (route.prefix_len == 0) {
+    gate_idx_t &default_gate =
+        route.ipv6 ? tables->default_gate6 : tables->default_gate4;
+    default_gate = route.withdraw ? DROP_GATE : route.gate;
+    return 0;
+  }
 
-    if (ret == 0) {
-      EmitPacket(ctx, batch->pkts()[i], next_hop);
-    } else {
-      EmitPacket(ctx, batch->pkts()[i], default_gate);
-    }
+  if (route.ipv6) {
+    return route.withdraw
+               ? tables->v6->Delete(route.prefix6, route.prefix_len)
+               : tables->v6->Add(route.prefix6, route.prefix_len, route.gate);
+  } else {
+    return route.withdraw
+               ? tables->v4->Delete(route.prefix, route.prefix_len)
+               : tables->v4->Add(route.prefix, route.prefix_len, route.gate);
   }
 }
 
+CommandResponse IPLookup::ParseRoute(const std::string &prefix,
+                                     uint64_t prefix_len, uint64_t gate,
+                                     bool withdraw, Route *route) {
+  int err;
+  std::string msg;
+  be32_t net_addr;
+
+  route->ipv6 = prefix.find(':') != std::string::npos;
+  route->withdraw = withdraw;
+  route->prefix_len = prefix_len;
+  route->gate = gate;
+
+  if (route->ipv6) {
+    std::tie(err, msg, route->prefix6) = ParseIpv6Prefix(prefix, prefix_len);
+  } else {
+    std::tie(err, msg, net_addr) = ParseIpv4Prefix(prefix, prefix_len);
+    memcpy(route->prefix.data(), &net_addr, sizeof(route->prefix));
+  }
+  if (err) {
+    return CommandFailure(err, "%s", msg.c_str());
+  }
+
+  if (!withdraw && (gate > DROP_GATE || !is_valid_gate(gate))) {
+    return CommandFailure(EINVAL, "Invalid gate: %" PRIu64, gate);
+  }
+
+  return CommandSuccess();
+}
+
 ParsedPrefix IPLookup::ParseIpv4Prefix(
     const std::string &prefix, uint64_t prefix_len) {
   using bess::utils::Format;
@@ -183,59 +309,92 @@ ParsedPrefix IPLookup::ParseIpv4Prefix(
   return std::make_tuple(0, "", net_addr);
 }
 
-CommandResponse IPLookup::CommandAdd(
-    const bess::pb::IPLookupCommandAddArg &arg) {
-  gate_idx_t gate = arg.gate();
-  uint64_t prefix_len = arg.prefix_len();
-  ParsedPrefix prefix = ParseIpv4Prefix(arg.prefix(), prefix_len);
-  if (std::get<0>(prefix)) {
-    return CommandFailure(std::get<0>(prefix), "%s",
-			  std::get<1>(prefix).c_str());
+ParsedPrefix6 IPLookup::ParseIpv6Prefix(const std::string &prefix,
+                                       uint64_t prefix_len) {
+  using bess::utils::Format;
+  Ipv6Address net_addr;
+
+  if (!prefix.length()) {
+    return std::make_tuple(EINVAL, "prefix' is missing", Ipv6Address());
+  }
+  if (!bess::utils::ParseIpv6Address(prefix, &net_addr)) {
+    return std::make_tuple(
+        EINVAL, Format("Invalid IP prefix: %s", prefix.c_str()), Ipv6Address());
   }
 
-  if (!is_valid_gate(gate)) {
-    return CommandFailure(EINVAL, "Invalid gate: %hu", gate);
+  if (prefix_len > 128) {
+    return std::make_tuple(
+        EINVAL, Format("Invalid prefix length: %" PRIu64, prefix_len),
+        Ipv6Address());
   }
 
-  if (prefix_len == 0) {
-    default_gate_ = gate;
-  } else {
-    be32_t net_addr = std::get<2>(prefix);
-    int ret = rte_lpm_add(lpm_, net_addr.value(), prefix_len, gate);
-    if (ret) {
-      return CommandFailure(-ret, "rpm_lpm_add() failed");
+  for (size_t i = 0; i < net_addr.size(); i++) {
+    int bits = static_cast<int>(prefix_len) - static_cast<int>(i) * 8;
+    bits = std::min(std::max(bits, 0), 8);
+    if (net_addr[i] & (0xff >> bits)) {
+      return std::make_tuple(EINVAL,
+                             Format("Invalid IP prefix %s/%" PRIu64,
+                                    prefix.c_str(), prefix_len),
+                             Ipv6Address());
     }
   }
+  return std::make_tuple(0, "", net_addr);
+}
+
+CommandResponse IPLookup::CommandAdd(
+    const bess::pb::IPLookupCommandAddArg &arg) {
+  std::vector<Route> routes(1);
+
+  CommandResponse err = ParseRoute(arg.prefix(), arg.prefix_len(), arg.gate(),
+                                   false, &routes[0]);
+  if (err.has_error()) {
+    return err;
+  }
 
-  return CommandSuccess();
+  return UpdateRoutes(routes);
 }
 
 CommandResponse IPLookup::CommandDelete(
     const bess::pb::IPLookupCommandDeleteArg &arg) {
-  uint64_t prefix_len = arg.prefix_len();
-  ParsedPrefix prefix = ParseIpv4Prefix(arg.prefix(), prefix_len);
-  if (std::get<0>(prefix)) {
-    return CommandFailure(std::get<0>(prefix), "%s",
-			  std::get<1>(prefix).c_str());
-  }
+  std::vector<Route> routes(1);
 
-  if (prefix_len == 0) {
-    default_gate_ = DROP_GATE;
-  } else {
-    be32_t net_addr = std::get<2>(prefix);
-    int ret = rte_lpm_delete(lpm_, net_addr.value(), prefix_len);
-    if (ret) {
-      return CommandFailure(-ret, "rpm_lpm_delete() failed");
-    }
+  CommandResponse err =
+      ParseRoute(arg.prefix(), arg.prefix_len(), 0, true, &routes[0]);
+  if (err.has_error()) {
+    return err;
   }
 
-  return CommandSuccess();
+  return UpdateRoutes(routes);
 }
 
 CommandResponse IPLookup::CommandClear(const bess::pb::EmptyArg &) {
-  rte_lpm_delete_all(lpm_);
+  Tables *next = standby();
+  next->v4->Clear();
+  next->v6->Clear();
+
+  Tables *prev = SwapTables();
+  prev->v4->Clear();
+  prev->v6->Clear();
   return CommandSuccess();
 }
 
+CommandResponse IPLookup::CommandUpdate(
+    const bess::pb::IPLookupCommandUpdateArg &arg) {
+  std::vector<Route> routes(arg.routes_size());
+
+  for (int i = 0; i < arg.routes_size(); i++) {
+    const auto &route = arg.routes(i);
+    CommandResponse err =
+        ParseRoute(route.prefix(), route.prefix_len(), route.gate(),
+                   route.withdraw(), &routes[i]);
+    if (err.has_error()) {
+      return CommandFailure(err.error().code(), "routes[%d]: %s", i,
+                            err.error().errmsg().c_str());
+    }
+  }
+
+  return UpdateRoutes(routes);
+}
+
 ADD_MODULE(IPLookup, "ip_lookup",
-           "performs Longest Prefix Match on IPv4 packets")
+           "performs Longest Prefix Match on IPv4 and IPv6 packets")
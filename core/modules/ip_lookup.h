@@ -31,37 +31,103 @@
 #ifndef BESS_MODULES_IPLOOKUP_H_
 #define BESS_MODULES_IPLOOKUP_H_
 
+#include <atomic>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
 #include "../utils/endian.h"
+#include "../utils/ip.h"
+#include "../utils/lpm.h"
 
 using bess::utils::be32_t;
+using bess::utils::Ipv6Address;
 using ParsedPrefix = std::tuple<int, std::string, be32_t>;
+using ParsedPrefix6 = std::tuple<int, std::string, Ipv6Address>;
 
+// Forwards IPv4 and IPv6 packets by the longest prefix match of their
+// destination addresses. Packets that are not IPv6 are looked up as IPv4.
+//
+// Routes are kept in two copies of the tables. Workers look up the active
+// one, while commands update the standby one, swap them, and then bring the
+// other copy up to date once workers are done with it. Route changes thus
+// never stall forwarding, and a batch of them takes effect all at once.
 class IPLookup final : public Module {
  public:
+  // IPv4 lookups take at most two memory accesses. For IPv6, a smaller root
+  // (256KB, instead of 64MB) takes one more.
+  typedef bess::utils::Lpm<4, 24> Lpm4;
+  typedef bess::utils::Lpm<16, 16> Lpm6;
+
   static const gate_idx_t kNumOGates = MAX_GATES;
 
   static const Commands cmds;
 
-  IPLookup() : Module(), lpm_(), default_gate_() {
+  IPLookup() : Module(), tables_(), active_(&tables_[0]) {
     max_allowed_workers_ = Worker::kMaxWorkers;
   }
 
   CommandResponse Init(const bess::pb::IPLookupArg &arg);
 
-  void DeInit() override;
-
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
+  int OnEvent(bess::Event e) override;
+
+  std::string GetDesc() const override;
+
   CommandResponse CommandAdd(const bess::pb::IPLookupCommandAddArg &arg);
   CommandResponse CommandDelete(const bess::pb::IPLookupCommandDeleteArg &arg);
   CommandResponse CommandClear(const bess::pb::EmptyArg &arg);
+  CommandResponse CommandUpdate(const bess::pb::IPLookupCommandUpdateArg &arg);
 
  private:
-  struct rte_lpm *lpm_;
-  gate_idx_t default_gate_;
+  // One copy of the routing state
+  struct Tables {
+    std::unique_ptr<Lpm4> v4;
+    std::unique_ptr<Lpm6> v6;
+    gate_idx_t default_gate4;  // The /0 route of each family
+    gate_idx_t default_gate6;
+  };
+
+  // A route to add or withdraw, after validation
+  struct Route {
+    bool ipv6;
+    bool withdraw;
+    int prefix_len;
+    Lpm4::Key prefix;
+    Lpm6::Key prefix6;
+    gate_idx_t gate;
+  };
+
+  Tables *standby() {
+    return active_.load(std::memory_order_relaxed) == &tables_[0] ? &tables_[1]
+                                                                  : &tables_[0];
+  }
+
+  // Makes the standby tables active, and returns the previously active ones
+  // once no worker looks them up anymore
+  Tables *SwapTables();
+
+  // Applies all routes, in order, or none of them if any fails
+  CommandResponse UpdateRoutes(const std::vector<Route> &routes);
+
+  // Returns 0 or -errno
+  static int ApplyRoute(Tables *tables, const Route &route);
+
+  // Moves the tables to the NUMA node of the workers that run this module
+  void MoveTables(int socket);
+
+  CommandResponse ParseRoute(const std::string &prefix, uint64_t prefix_len,
+                             uint64_t gate, bool withdraw, Route *route);
   ParsedPrefix ParseIpv4Prefix(const std::string &prefix, uint64_t prefix_len);
+  ParsedPrefix6 ParseIpv6Prefix(const std::string &prefix,
+                                uint64_t prefix_len);
+
+  Tables tables_[2];
+  std::atomic<Tables *> active_;
 };
 
 #endif  // BESS_MODULES_IPLOOKUP_H_
@@ -31,39 +31,25 @@
 #ifndef BESS_MODULES_L2FORWARD_H_
 #define BESS_MODULES_L2FORWARD_H_
 
+#include <memory>
+
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
+#include "../utils/mac_table.h"
 
 #if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
 #error this code assumes little endian architecture (x86)
 #endif
 
-struct alignas(32) l2_entry {
-  union {
-    struct {
-      uint64_t addr : 48;
-      uint64_t gate : 15;
-      uint64_t occupied : 1;
-    };
-    uint64_t entry;
-  };
-};
-
-struct l2_table {
-  struct l2_entry *table;
-  uint64_t size;
-  uint64_t size_power;
-  uint64_t bucket;
-  uint64_t count;
-};
-
 class L2Forward final : public Module {
  public:
+  static const gate_idx_t kNumIGates = MAX_GATES;
   static const gate_idx_t kNumOGates = MAX_GATES;
 
   static const Commands cmds;
 
-  L2Forward() : Module(), l2_table_(), default_gate_() {
+  L2Forward()
+      : Module(), table_(), default_gate_(), learn_(), aging_time_() {
     max_allowed_workers_ = Worker::kMaxWorkers;
   }
 
@@ -82,8 +68,18 @@ class L2Forward final : public Module {
       const bess::pb::L2ForwardCommandPopulateArg &arg);
 
  private:
-  struct l2_table l2_table_;
+  // Learns the source addresses of packets from the input gate, and removes
+  // some of the expired ones
+  void Learn(Context *ctx, bess::PacketBatch *batch, uint32_t now);
+
+  // Moves the rest of the entries to the new table, if it is growing
+  void FinishGrowing();
+
+  std::unique_ptr<bess::utils::MacTable> table_;
   gate_idx_t default_gate_;
+
+  bool learn_;
+  uint32_t aging_time_;  // in seconds
 };
 
 #endif  // BESS_MODULES_L2FORWARD_H_
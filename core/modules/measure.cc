@@ -61,26 +61,12 @@ const Commands Measure::cmds = {
 };
 
 CommandResponse Measure::Init(const bess::pb::MeasureArg &arg) {
-  uint64_t latency_ns_max = arg.latency_ns_max();
-  uint64_t latency_ns_resolution = arg.latency_ns_resolution();
-  if (latency_ns_max == 0) {
-    latency_ns_max = kDefaultMaxNs;
-  }
-  if (latency_ns_resolution == 0) {
-    latency_ns_resolution = kDefaultNsPerBucket;
-  }
-  uint64_t quotient = latency_ns_max / latency_ns_resolution;
-  if ((latency_ns_max % latency_ns_resolution) != 0) {
-    quotient += 1;  // absorb any remainder
-  }
-  if (quotient > rtt_hist_.max_num_buckets() / 2) {
-    return CommandFailure(E2BIG,
-                          "excessive latency_ns_max / latency_ns_resolution");
-  }
+  max_ns_ = arg.latency_ns_max() ?: kDefaultMaxNs;
+  resolution_ns_ = arg.latency_ns_resolution() ?: kDefaultNsPerBucket;
 
-  size_t num_buckets = quotient;
-  rtt_hist_.Resize(num_buckets, latency_ns_resolution);
-  jitter_hist_.Resize(num_buckets, latency_ns_resolution);
+  for (auto &shard : shards_) {
+    shard.reset(new Shard(resolution_ns_, max_ns_));
+  }
 
   if (arg.offset()) {
     offset_ = arg.offset();
@@ -94,8 +80,6 @@ CommandResponse Measure::Init(const bess::pb::MeasureArg &arg) {
     jitter_sample_prob_ = kDefaultIpDvSampleProb;
   }
 
-  mcs_lock_init(&lock_);
-
   return CommandSuccess();
 }
 
@@ -103,41 +87,55 @@ void Measure::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   // We don't use ctx->current_ns here for better accuracy
   uint64_t now_ns = tsc_to_ns(rdtsc());
   size_t offset = offset_;
+  Shard *shard = shards_[ctx->wid].get();
+
+  if (unlikely(shard->clear.load(std::memory_order_acquire))) {
+    shard->rtt_hist.Reset();
+    shard->jitter_hist.Reset();
+    shard->last_rtt_ns = 0;
+    shard->pkt_cnt.store(0, std::memory_order_relaxed);
+    shard->bytes_cnt.store(0, std::memory_order_relaxed);
+    shard->clear.store(false, std::memory_order_release);
+  }
 
-  mcslock_node_t mynode;
-  mcs_lock(&lock_, &mynode);
-
-  pkt_cnt_ += batch->cnt();
+  uint64_t bytes_cnt = 0;
 
   int cnt = batch->cnt();
   for (int i = 0; i < cnt; i++) {
     uint64_t pkt_time;
     if (IsTimestamped(batch->pkts()[i], offset, &pkt_time)) {
+      // The receive time, if the port recorded it, leaves out the time spent
+      // in the RX queue and in modules before this one
+      uint64_t rx_ns = batch->pkts()[i]->rx_timestamp() ?: now_ns;
       uint64_t diff;
 
-      if (now_ns >= pkt_time) {
-        diff = now_ns - pkt_time;
+      if (rx_ns >= pkt_time) {
+        diff = rx_ns - pkt_time;
       } else {
         // The magic number matched, but timestamp doesn't seem correct
         continue;
       }
 
-      bytes_cnt_ += batch->pkts()[i]->total_len();
+      bytes_cnt += batch->pkts()[i]->total_len();
 
-      rtt_hist_.Insert(diff);
-      if (rand_.GetRealNonzero() <= jitter_sample_prob_) {
-        if (unlikely(!last_rtt_ns_)) {
-          last_rtt_ns_ = diff;
+      shard->rtt_hist.Insert(diff);
+      if (shard->rand.GetRealNonzero() <= jitter_sample_prob_) {
+        if (unlikely(!shard->last_rtt_ns)) {
+          shard->last_rtt_ns = diff;
           continue;
         }
-        uint64_t jitter = absdiff(diff, last_rtt_ns_);
-        jitter_hist_.Insert(jitter);
-        last_rtt_ns_ = diff;
+        uint64_t jitter = absdiff(diff, shard->last_rtt_ns);
+        shard->jitter_hist.Insert(jitter);
+        shard->last_rtt_ns = diff;
       }
     }
   }
 
-  mcs_unlock(&lock_, &mynode);
+  shard->pkt_cnt.store(shard->pkt_cnt.load(std::memory_order_relaxed) + cnt,
+                       std::memory_order_relaxed);
+  shard->bytes_cnt.store(
+      shard->bytes_cnt.load(std::memory_order_relaxed) + bytes_cnt,
+      std::memory_order_relaxed);
 
   RunNextModule(ctx, batch);
 }
@@ -145,10 +143,10 @@ void Measure::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 template <typename T>
 static void SetHistogram(
     bess::pb::MeasureCommandGetSummaryResponse::Histogram *r, const T &hist,
-    uint64_t bucket_width) {
+    uint64_t resolution) {
   r->set_count(hist.count);
   r->set_above_range(hist.above_range);
-  r->set_resolution_ns(bucket_width);
+  r->set_resolution_ns(resolution);
   r->set_min_ns(hist.min);
   r->set_max_ns(hist.max);
   r->set_avg_ns(hist.avg);
@@ -158,21 +156,11 @@ static void SetHistogram(
   }
 }
 
+// Workers may be running, so they reset their own shards.
 void Measure::Clear() {
-  // vector initialization is expensive thus should be out of critical section
-  decltype(rtt_hist_) new_rtt_hist(rtt_hist_.num_buckets(),
-                                   rtt_hist_.bucket_width());
-  decltype(jitter_hist_) new_jitter_hist(jitter_hist_.num_buckets(),
-                                         jitter_hist_.bucket_width());
-
-  // Use move semantics to minimize critical section
-  mcslock_node_t mynode;
-  mcs_lock(&lock_, &mynode);
-  pkt_cnt_ = 0;
-  bytes_cnt_ = 0;
-  rtt_hist_ = std::move(new_rtt_hist);
-  jitter_hist_ = std::move(new_jitter_hist);
-  mcs_unlock(&lock_, &mynode);
+  for (auto &shard : shards_) {
+    shard->clear.store(true, std::memory_order_release);
+  }
 }
 
 static bool IsValidPercentiles(const std::vector<double> &percentiles) {
@@ -205,22 +193,36 @@ CommandResponse Measure::CommandGetSummary(
     return CommandFailure(EINVAL, "invalid 'jitter_percentiles'");
   }
 
-  r.set_timestamp(get_epoch_time());
-  r.set_packets(pkt_cnt_);
-  r.set_bits((bytes_cnt_ + pkt_cnt_ * 24) * 8);
-  const auto &rtt = rtt_hist_.Summarize(latency_percentiles);
-  const auto &jitter = jitter_hist_.Summarize(jitter_percentiles);
+  Histogram<uint64_t> rtt_hist(resolution_ns_, max_ns_);
+  Histogram<uint64_t> jitter_hist(resolution_ns_, max_ns_);
+  uint64_t pkt_cnt = 0;
+  uint64_t bytes_cnt = 0;
 
-  SetHistogram(r.mutable_latency(), rtt, rtt_hist_.bucket_width());
-  SetHistogram(r.mutable_jitter(), jitter, jitter_hist_.bucket_width());
+  for (const auto &shard : shards_) {
+    if (shard->clear.load(std::memory_order_acquire)) {
+      continue;
+    }
+    rtt_hist.Merge(shard->rtt_hist);
+    jitter_hist.Merge(shard->jitter_hist);
+    pkt_cnt += shard->pkt_cnt.load(std::memory_order_relaxed);
+    bytes_cnt += shard->bytes_cnt.load(std::memory_order_relaxed);
+  }
 
   if (arg.clear()) {
-    // Note that some samples might be lost due to the small gap between
-    // Summarize() and the next mcs_lock... but we posit that smaller
-    // critical section is more important.
+    // Note that samples recorded since the merge above are lost too... but we
+    // posit that never stopping workers is more important.
     Clear();
   }
 
+  r.set_timestamp(get_epoch_time());
+  r.set_packets(pkt_cnt);
+  r.set_bits((bytes_cnt + pkt_cnt * 24) * 8);
+  const auto &rtt = rtt_hist.Summarize(latency_percentiles);
+  const auto &jitter = jitter_hist.Summarize(jitter_percentiles);
+
+  SetHistogram(r.mutable_latency(), rtt, resolution_ns_);
+  SetHistogram(r.mutable_jitter(), jitter, resolution_ns_);
+
   return CommandSuccess(r);
 }
 
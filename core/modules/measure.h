@@ -31,24 +31,25 @@
 #ifndef BESS_MODULES_MEASURE_H_
 #define BESS_MODULES_MEASURE_H_
 
+#include <atomic>
+#include <memory>
+
 #include "../module.h"
 #include "../pb/module_msg.pb.h"
 #include "../utils/histogram.h"
-#include "../utils/mcslock.h"
 #include "../utils/random.h"
 
+// Each worker records samples into its own shard, without locking. Commands
+// merge the shards.
 class Measure final : public Module {
  public:
-  Measure(uint64_t ns_per_bucket = 1, uint64_t max_ns = 0)
+  Measure()
       : Module(),
-        rtt_hist_(max_ns / ns_per_bucket, ns_per_bucket),
-        jitter_hist_(max_ns / ns_per_bucket, ns_per_bucket),
-        rand_(),
+        shards_(),
+        resolution_ns_(),
+        max_ns_(),
         jitter_sample_prob_(),
-        last_rtt_ns_(),
-        offset_(),
-        pkt_cnt_(),
-        bytes_cnt_() {
+        offset_() {
     max_allowed_workers_ = Worker::kMaxWorkers;
   }
 
@@ -63,25 +64,44 @@ class Measure final : public Module {
   static const Commands cmds;
 
  private:
-  static const uint64_t kDefaultNsPerBucket = 100;
+  static const uint64_t kDefaultNsPerBucket = 1;
   static const uint64_t kDefaultMaxNs = 100'000'000;  // 100 ms
   static constexpr double kDefaultIpDvSampleProb = 0.05;
 
+  // Samples of one worker, which only that worker updates
+  struct Shard {
+    Shard(uint64_t resolution_ns, uint64_t max_ns)
+        : rtt_hist(resolution_ns, max_ns),
+          jitter_hist(resolution_ns, max_ns),
+          rand(),
+          last_rtt_ns(),
+          pkt_cnt(),
+          bytes_cnt(),
+          clear() {}
+
+    Histogram<uint64_t> rtt_hist;
+    Histogram<uint64_t> jitter_hist;
+
+    Random rand;
+    uint64_t last_rtt_ns;
+
+    std::atomic<uint64_t> pkt_cnt;
+    std::atomic<uint64_t> bytes_cnt;
+
+    // Set by Clear(). The worker resets the shard before its next batch, and
+    // until then the shard counts as empty.
+    std::atomic<bool> clear;
+  };
+
   void Clear();
 
-  Histogram<uint64_t> rtt_hist_;
-  Histogram<uint64_t> jitter_hist_;
+  std::unique_ptr<Shard> shards_[Worker::kMaxWorkers];
 
-  Random rand_;
+  uint64_t resolution_ns_;
+  uint64_t max_ns_;
   double jitter_sample_prob_;
-  uint64_t last_rtt_ns_;
 
   size_t offset_;  // in bytes
-
-  uint64_t pkt_cnt_;
-  uint64_t bytes_cnt_;
-
-  mcslock lock_;
 };
 
 #endif  // BESS_MODULES_MEASURE_H_
@@ -106,6 +106,15 @@ CommandResponse NAT::Init(const bess::pb::NATArg &arg) {
                           "at least one external IP address must be specified");
   }
 
+  uint32_t num_shards = std::max(arg.num_shards(), 1u);
+  if (num_shards > static_cast<uint32_t>(Worker::kMaxWorkers)) {
+    return CommandFailure(EINVAL, "num_shards must be at most %d",
+                          Worker::kMaxWorkers);
+  }
+
+  shards_.resize(num_shards);
+  max_allowed_workers_ = num_shards;
+
   // Sort so that GetInitialArg is predictable and consistent.
   std::sort(ext_addrs_.begin(), ext_addrs_.end());
 
@@ -124,6 +133,9 @@ CommandResponse NAT::GetInitialArg(const bess::pb::EmptyArg &) {
       erange->set_suspended(irange.suspended);
     }
   }
+  if (shards_.size() > 1) {
+    resp.set_num_shards(shards_.size());
+  }
   return CommandSuccess(resp);
 }
 
@@ -177,9 +189,18 @@ static inline std::pair<bool, Endpoint> ExtractEndpoint(const Ipv4 *ip,
       false, Endpoint{.addr = ip->src, .port = be16_t(0), .protocol = 0});
 }
 
+// Returns the first port at or after `port` that belongs to the shard
+static inline uint32_t ShardPort(uint32_t port, uint32_t shard_idx,
+                                 uint32_t num_shards) {
+  return port + (shard_idx + num_shards - port % num_shards) % num_shards;
+}
+
 // Not necessary to inline this function, since it is less frequently called
-NAT::HashTable::Entry *NAT::CreateNewEntry(const Endpoint &src_internal,
+NAT::HashTable::Entry *NAT::CreateNewEntry(Shard *shard, uint32_t shard_idx,
+                                           const Endpoint &src_internal,
                                            uint64_t now) {
+  HashTable &map = shard->map;
+  uint32_t num_shards = shards_.size();
   Endpoint src_external;
 
   // An internal IP address is always mapped to the same external IP address,
@@ -221,14 +242,25 @@ NAT::HashTable::Entry *NAT::CreateNewEntry(const Endpoint &src_internal,
       }
     }
 
+    // Only the ports of this shard, i.e., [first, end) in steps of num_shards
+    uint32_t end = min + range;
+    uint32_t first = ShardPort(min, shard_idx, num_shards);
+    if (first >= end) {
+      continue;
+    }
+
     // Start from a random port, then do linear probing
-    uint16_t start_port = min + rng_.GetRange(range);
-    uint16_t port = start_port;
+    uint32_t start_port =
+        ShardPort(min + shard->rng.GetRange(range), shard_idx, num_shards);
+    if (start_port >= end) {
+      start_port = first;
+    }
+    uint32_t port = start_port;
     int trials = 0;
 
     do {
       src_external.port = be16_t(port);
-      auto *hash_reverse = map_.Find(src_external);
+      auto *hash_reverse = map.Find(src_external);
       if (hash_reverse == nullptr) {
       found:
         // Found an available src_internal <-> src_external mapping
@@ -236,33 +268,34 @@ NAT::HashTable::Entry *NAT::CreateNewEntry(const Endpoint &src_internal,
         NatEntry reverse_entry;
 
         reverse_entry.endpoint = src_internal;
-        map_.Insert(src_external, reverse_entry);
+        map.Insert(src_external, reverse_entry);
 
         forward_entry.endpoint = src_external;
-        return map_.Insert(src_internal, forward_entry);
+        shard->expiry.Add(now + kTimeOutNs, src_internal);
+        return map.Insert(src_internal, forward_entry);
       } else {
         // A':a' is not free, but it might have been expired.
         // Check with the forward hash entry since timestamp refreshes only for
         // forward direction.
-        auto *hash_forward = map_.Find(hash_reverse->second.endpoint);
+        auto *hash_forward = map.Find(hash_reverse->second.endpoint);
 
         // Forward and reverse entries must share the same lifespan.
         DCHECK(hash_forward != nullptr);
 
         if (now - hash_forward->second.last_refresh > kTimeOutNs) {
           // Found an expired mapping. Remove A':a' <-> A'':a''...
-          map_.Remove(hash_forward->first);
-          map_.Remove(hash_reverse->first);
+          map.Remove(hash_forward->first);
+          map.Remove(hash_reverse->first);
           goto found;  // and go install A:a <-> A':a'
         }
       }
 
-      port++;
+      port += num_shards;
       trials++;
 
-      // Out of range? Also check if zero due to uint16_t overflow
-      if (port == 0 || port >= min + range) {
-        port = min;
+      // Out of range?
+      if (port >= end) {
+        port = first;
       }
       // FIXME: Should not try for kMaxTrials.
     } while (port != start_port && trials < kMaxTrials);
@@ -322,8 +355,31 @@ inline void Stamp(Ipv4 *ip, void *l4, const Endpoint &before,
   }
 }
 
+void NAT::ExpireEntries(Shard *shard, uint64_t now) {
+  HashTable &map = shard->map;
+
+  // The wheel is not updated as packets refresh a mapping, so check again
+  auto check = [&](const Endpoint &internal) {
+    auto *hash_forward = map.Find(internal);
+    if (hash_forward == nullptr) {
+      return;  // already gone
+    }
+
+    uint64_t last_refresh = hash_forward->second.last_refresh;
+    if (now - last_refresh > kTimeOutNs) {
+      map.Remove(hash_forward->second.endpoint);
+      map.Remove(internal);
+    } else {
+      shard->expiry.Add(last_refresh + kTimeOutNs, internal);
+    }
+  };
+
+  shard->expiry.Expire(now, check, kExpiryBudget);
+}
+
 template <NAT::Direction dir>
-inline void NAT::DoProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+inline void NAT::DoProcessBatch(Context *ctx, bess::PacketBatch *batch,
+                                Shard *shard, uint32_t shard_idx) {
   gate_idx_t ogate_idx = static_cast<gate_idx_t>(dir);
   int cnt = batch->cnt();
   uint64_t now = ctx->current_ns;
@@ -345,10 +401,11 @@ inline void NAT::DoProcessBatch(Context *ctx, bess::PacketBatch *batch) {
       continue;
     }
 
-    auto *hash_item = map_.Find(before);
+    auto *hash_item = shard->map.Find(before);
 
     if (hash_item == nullptr) {
-      if (dir != kForward || !(hash_item = CreateNewEntry(before, now))) {
+      if (dir != kForward ||
+          !(hash_item = CreateNewEntry(shard, shard_idx, before, now))) {
         DropPacket(ctx, pkt);
         continue;
       }
@@ -366,17 +423,49 @@ inline void NAT::DoProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 
 void NAT::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   gate_idx_t incoming_gate = ctx->current_igate;
+  uint32_t shard_idx = ctx->wid % shards_.size();
+  Shard *shard = &shards_[shard_idx];
+
+  ExpireEntries(shard, ctx->current_ns);
 
   if (incoming_gate == 0) {
-    DoProcessBatch<kForward>(ctx, batch);
+    DoProcessBatch<kForward>(ctx, batch, shard, shard_idx);
   } else {
-    DoProcessBatch<kReverse>(ctx, batch);
+    DoProcessBatch<kReverse>(ctx, batch, shard, shard_idx);
+  }
+}
+
+CheckConstraintResult NAT::CheckModuleConstraints() const {
+  CheckConstraintResult status = Module::CheckModuleConstraints();
+  if (status == CHECK_FATAL_ERROR) {
+    return status;
   }
+
+  // Each shard must be used by at most one worker
+  std::vector<int> shard_workers(shards_.size(), -1);
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    if (!active_workers()[wid]) {
+      continue;
+    }
+    int &owner = shard_workers[wid % shards_.size()];
+    if (owner >= 0) {
+      LOG(ERROR) << "Workers " << owner << " and " << wid
+                 << " share a flow table shard of NAT " << name();
+      return CHECK_FATAL_ERROR;
+    }
+    owner = wid;
+  }
+
+  return status;
 }
 
 std::string NAT::GetDesc() const {
+  size_t count = 0;
+  for (const auto &shard : shards_) {
+    count += shard.map.Count();
+  }
   // Divide by 2 since the table has both forward and reverse entries
-  return bess::utils::Format("%zu entries", map_.Count() / 2);
+  return bess::utils::Format("%zu entries", count / 2);
 }
 
 ADD_MODULE(NAT, "nat", "Dynamic Network address/port translator")
@@ -45,6 +45,7 @@
 #include "../utils/cuckoo_map.h"
 #include "../utils/endian.h"
 #include "../utils/random.h"
+#include "../utils/timer_wheel.h"
 
 // Theory of operation:
 //
@@ -53,11 +54,12 @@
 // Forward direction = outbound (internal -> external)
 // Reverse direction = inbound (external -> internal)
 //
-// There is a single hash table of Endpoint -> (Endpoint, timestamp), which
-// contains both forward and reverse mapping. They have the same lifespan.
+// Flows are kept in 'num_shards' hash tables (shards) of
+// Endpoint -> (Endpoint, timestamp). Each shard contains both forward and
+// reverse mappings of its flows. They have the same lifespan.
 // (e.g., if one entry is deleted, its peer is also deleted)
 //
-// Suppose the table is empty, and we see a packet A:a ===> B:b.
+// Suppose the shard is empty, and we see a packet A:a ===> B:b.
 // Then we find a free external endpoint A':a' for the internal endpoint A:a
 // from the pool and create two entries:
 // - entry 1  A:a -> A':a'
@@ -65,6 +67,13 @@
 // Then the packet is updated to A':a' ===> B:b (with entry 1).
 // When a return packet B:b ===> A':a' comes in, the destination (since it is
 // reverse dir) endpoint is B:b ===> A:a (with entry 2).
+//
+// Worker 'wid' uses shard 'wid % num_shards' only, so that no two workers
+// share a shard (see CheckModuleConstraints()) and shards need no locking.
+// Shard i hands out only the external ports with 'port % num_shards == i'.
+// Both entries of a mapping thus live in the same shard. A reverse-direction
+// packet to A':a' must reach a worker whose 'wid % num_shards' is
+// 'a' % num_shards', e.g., by steering on the destination port.
 
 using bess::utils::be16_t;
 using bess::utils::be32_t;
@@ -113,8 +122,8 @@ struct NatEntry {
 
   // last_refresh is only updated for forward-direction (outbound) packets, as
   // per rfc4787 REQ-6. Reverse entries will have an garbage value.
-  // We do lazy reclaim of expired; NAT mapping entry will NOT expire unless it
-  // runs out of ports in the pool.
+  // Expired mappings are reclaimed by the expiry wheel of the shard, a few
+  // per batch, or when a port is found expired while allocating a new one.
   uint64_t last_refresh;  // in nanoseconds (ctx.current_ns)
 };
 
@@ -150,6 +159,8 @@ class NAT final : public Module {
 
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
+  CheckConstraintResult CheckModuleConstraints() const override;
+
   // returns the number of active NAT entries (flows)
   std::string GetDesc() const override;
 
@@ -163,10 +174,32 @@ class NAT final : public Module {
   // how many times shall we try to find a free port number?
   static const int kMaxTrials = 128;
 
-  HashTable::Entry *CreateNewEntry(const Endpoint &internal, uint64_t now);
+  // how many mappings to check for expiry per batch, at most?
+  static const size_t kExpiryBudget = 32;
+
+  // granularity of expiry checks (2^30 ns, about a second)
+  static const int kExpiryTickShift = 30;
+
+  // Flow table of a worker, with its own slice of the external ports.
+  // The expiry wheel holds the internal endpoint of every mapping, to be
+  // checked when it may have timed out.
+  struct Shard {
+    Shard() : map(), rng(), expiry(kExpiryTickShift) {}
+
+    HashTable map;
+    Random rng;
+    bess::utils::TimerWheel<Endpoint> expiry;
+  };
+
+  HashTable::Entry *CreateNewEntry(Shard *shard, uint32_t shard_idx,
+                                   const Endpoint &internal, uint64_t now);
+
+  // Removes up to kExpiryBudget expired mappings of the shard
+  void ExpireEntries(Shard *shard, uint64_t now);
 
   template <Direction dir>
-  void DoProcessBatch(Context *ctx, bess::PacketBatch *batch);
+  void DoProcessBatch(Context *ctx, bess::PacketBatch *batch, Shard *shard,
+                      uint32_t shard_idx);
 
   std::vector<be32_t> ext_addrs_;
 
@@ -174,8 +207,7 @@ class NAT final : public Module {
   // ext_addrs_ range.
   std::vector<std::vector<PortRange>> port_ranges_;
 
-  HashTable map_;
-  Random rng_;
+  std::vector<Shard> shards_;
 };
 
 #endif  // BESS_MODULES_NAT_H_
@@ -47,6 +47,12 @@ CommandResponse Replicate::Init(const bess::pb::ReplicateArg &arg) {
   }
   ngates_ = arg.gates_size();
 
+  if (arg.header_len() > SNBUF_DATA) {
+    return CommandFailure(EINVAL, "header_len must be at most %d", SNBUF_DATA);
+  }
+  zero_copy_ = arg.zero_copy();
+  header_len_ = arg.header_len();
+
   return CommandSuccess();
 }
 
@@ -69,7 +75,9 @@ void Replicate::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   for (int i = 0; i < cnt; i++) {
     bess::Packet *tocopy = batch->pkts()[i];
     for (int j = 1; j < ngates_; j++) {
-      bess::Packet *newpkt = bess::Packet::copy(tocopy);
+      bess::Packet *newpkt = zero_copy_
+                                 ? bess::Packet::clone(tocopy, header_len_)
+                                 : bess::Packet::copy(tocopy);
       if (newpkt) {
         EmitPacket(ctx, newpkt, gates_[j]);
       }
@@ -40,7 +40,7 @@ class Replicate final : public Module {
 
   static const Commands cmds;
 
-  Replicate() : Module(), gates_(), ngates_() {
+  Replicate() : Module(), gates_(), ngates_(), zero_copy_(), header_len_() {
     max_allowed_workers_ = Worker::kMaxWorkers;
   }
 
@@ -59,6 +59,9 @@ class Replicate final : public Module {
   gate_idx_t gates_[kMaxGates];
   // The total number of output gates
   int ngates_;
+  // Whether replicas share packet data, but for the first header_len_ bytes
+  bool zero_copy_;
+  uint16_t header_len_;
 };
 
 #endif  // BESS_MODULES_RELICATE_H_
@@ -0,0 +1,109 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmarks for copying and cloning packets in Replicate.
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+#include <unistd.h>
+
+#include "../dpdk.h"
+#include "../packet.h"
+#include "../pktbatch.h"
+
+namespace {
+
+const int kBurst = bess::PacketBatch::kMaxBurst;
+
+// 4-way mirroring: the original packet goes out as is
+const int kReplicas = 3;
+
+// What Replicate::ProcessBatch() does for a batch of packets of
+// state.range(0) bytes, and then freeing the replicas, as ports do once they
+// are sent. state.range(1) is header_len for zero_copy, or -1 to copy packets.
+void BM_Replicate(benchmark::State &state) {
+  const int size = state.range(0);
+  const int header_len = state.range(1);
+  struct rte_mempool *pool = bess::get_pframe_pool_socket(0);
+
+  bess::Packet *pkts[kBurst];
+  for (int i = 0; i < kBurst; i++) {
+    pkts[i] = bess::__packet_alloc_pool(pool);
+    CHECK(pkts[i]);
+    memset(pkts[i]->append(size), 0, size);
+  }
+
+  bess::PacketBatch replicas;
+  while (state.KeepRunning()) {
+    for (int j = 0; j < kReplicas; j++) {
+      replicas.clear();
+      for (int i = 0; i < kBurst; i++) {
+        bess::Packet *newpkt =
+            header_len < 0 ? bess::Packet::copy(pkts[i])
+                           : bess::Packet::clone(pkts[i], header_len);
+        if (newpkt) {
+          replicas.add(newpkt);
+        }
+      }
+      bess::Packet::Free(&replicas);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * kBurst);
+  state.SetBytesProcessed(state.iterations() * kBurst * kReplicas * size);
+  bess::Packet::Free(pkts, kBurst);
+}
+
+void ReplicateArgs(benchmark::internal::Benchmark *b) {
+  for (int size : {64, 256, 512, 1024, 1500}) {
+    for (int header_len : {-1, 0, 64}) {
+      b->Args({size, header_len});
+    }
+  }
+}
+
+BENCHMARK(BM_Replicate)->Apply(ReplicateArgs);
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+
+  if (geteuid() != 0) {
+    LOG(INFO) << "This benchmark requires root privileges. Skipping...";
+    return 0;
+  }
+
+  init_dpdk(argv[0], 1024, 0, true);
+  bess::init_mempool();
+
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,478 @@
+// Copyright (c) 2014-2016, The Regents of the University of California.
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#include "sharded_queue.h"
+
+#include <algorithm>
+#include <cinttypes>
+
+#include "../mem_alloc.h"
+#include "../utils/format.h"
+
+#define DEFAULT_QUEUE_SIZE 1024
+
+const Commands ShardedQueue::cmds = {
+    {"set_burst", "QueueCommandSetBurstArg",
+     MODULE_CMD_FUNC(&ShardedQueue::CommandSetBurst), Command::THREAD_SAFE},
+    {"set_size", "QueueCommandSetSizeArg",
+     MODULE_CMD_FUNC(&ShardedQueue::CommandSetSize), Command::THREAD_UNSAFE},
+    {"get_status", "QueueCommandGetStatusArg",
+     MODULE_CMD_FUNC(&ShardedQueue::CommandGetStatus), Command::THREAD_SAFE}};
+
+struct llring *ShardedQueue::NewRing(int slots, int socket) {
+  int bytes = llring_bytes_with_slots(slots);
+
+  struct llring *ring =
+      static_cast<llring *>(mem_alloc_ex(bytes, alignof(llring), socket));
+  if (!ring) {
+    return nullptr;
+  }
+
+  // Each ring has a single producer and a single consumer
+  if (llring_init(ring, slots, 1, 1)) {
+    mem_free(ring);
+    return nullptr;
+  }
+
+  return ring;
+}
+
+int ShardedQueue::AddProducer(int wid) {
+  int socket = workers[wid]->socket();
+  Shard *shards[kMaxPriorities] = {};
+
+  for (int cls = 0; cls < num_classes_; cls++) {
+    shards[cls] = static_cast<Shard *>(mem_alloc_ex(sizeof(Shard), 64, socket));
+    if (shards[cls]) {
+      shards[cls]->ring = NewRing(size_, socket);
+    }
+
+    if (!shards[cls] || !shards[cls]->ring) {
+      for (int i = 0; i <= cls; i++) {
+        if (shards[i]) {
+          mem_free(shards[i]->ring);
+          mem_free(shards[i]);
+        }
+      }
+      return -ENOMEM;
+    }
+  }
+
+  for (int cls = 0; cls < num_classes_; cls++) {
+    shards_[cls][wid] = shards[cls];
+  }
+  producers_.push_back(wid);
+
+  return 0;
+}
+
+int ShardedQueue::Resize(int slots) {
+  std::vector<struct llring *> new_rings;
+
+  // Allocate all rings first, so that nothing changes if any fails
+  for (int wid : producers_) {
+    for (int cls = 0; cls < num_classes_; cls++) {
+      struct llring *ring = NewRing(slots, workers[wid]->socket());
+      if (!ring) {
+        for (struct llring *r : new_rings) {
+          mem_free(r);
+        }
+        return -ENOMEM;
+      }
+      new_rings.push_back(ring);
+    }
+  }
+
+  /* migrate packets from the old rings */
+  auto it = new_rings.begin();
+  for (int wid : producers_) {
+    for (int cls = 0; cls < num_classes_; cls++) {
+      Shard *shard = shards_[cls][wid];
+      struct llring *new_ring = *it++;
+      bess::Packet *pkt;
+
+      while (llring_sc_dequeue(shard->ring, (void **)&pkt) == 0) {
+        if (llring_sp_enqueue(new_ring, pkt) == -LLRING_ERR_NOBUF) {
+          bess::Packet::Free(pkt);
+          shard->dropped++;
+        }
+      }
+
+      mem_free(shard->ring);
+      shard->ring = new_ring;
+    }
+  }
+
+  return 0;
+}
+
+CommandResponse ShardedQueue::Init(const bess::pb::ShardedQueueArg &arg) {
+  task_id_t tid;
+  CommandResponse err;
+
+  tid = RegisterTask(nullptr);
+  if (tid == INVALID_TASK_ID) {
+    return CommandFailure(ENOMEM, "Task creation failed");
+  }
+
+  burst_ = bess::PacketBatch::kMaxBurst;
+
+  if (arg.priorities() > kMaxPriorities) {
+    return CommandFailure(EINVAL, "'priorities' must be 1-%d", kMaxPriorities);
+  }
+  num_classes_ = arg.priorities() ?: 1;
+
+  if (arg.backpressure_classes() > static_cast<uint32_t>(num_classes_)) {
+    return CommandFailure(EINVAL, "'backpressure_classes' must be 1-%d",
+                          num_classes_);
+  }
+  if (arg.backpressure()) {
+    VLOG(1) << "Backpressure enabled for " << name() << "::ShardedQueue";
+    backpressure_classes_ = arg.backpressure_classes() ?: 1;
+  }
+
+  if (num_classes_ > 1) {
+    if (!arg.priority_attr().length()) {
+      return CommandFailure(EINVAL,
+                            "'priority_attr' must be given for priorities");
+    }
+    attr_id_ = AddMetadataAttr(arg.priority_attr(), 1,
+                               bess::metadata::Attribute::AccessMode::kRead);
+    if (attr_id_ < 0) {
+      return CommandFailure(-attr_id_, "add_metadata_attr() failed");
+    }
+  }
+
+  std::fill(std::begin(weights_), std::end(weights_), 1);
+  for (const auto &it : arg.weights()) {
+    if (it.first < 0 || it.first >= Worker::kMaxWorkers) {
+      return CommandFailure(EINVAL, "invalid worker id %" PRId64, it.first);
+    }
+    if (it.second == 0) {
+      return CommandFailure(EINVAL, "weights must be positive");
+    }
+    weights_[it.first] = it.second;
+  }
+
+  if (arg.size() != 0) {
+    err = SetSize(arg.size());
+    if (err.error().code() != 0) {
+      return err;
+    }
+  } else {
+    size_ = DEFAULT_QUEUE_SIZE;
+    AdjustWaterLevels();
+  }
+
+  if (arg.prefetch()) {
+    prefetch_ = true;
+  }
+
+  return CommandSuccess();
+}
+
+void ShardedQueue::DeInit() {
+  bess::Packet *pkt;
+
+  for (int wid : producers_) {
+    for (int cls = 0; cls < num_classes_; cls++) {
+      Shard *shard = shards_[cls][wid];
+      while (llring_sc_dequeue(shard->ring, (void **)&pkt) == 0) {
+        bess::Packet::Free(pkt);
+      }
+      mem_free(shard->ring);
+      mem_free(shard);
+      shards_[cls][wid] = nullptr;
+    }
+  }
+  producers_.clear();
+}
+
+int ShardedQueue::OnEvent(bess::Event e) {
+  if (e != bess::Event::PreResume) {
+    return -ENOTSUP;
+  }
+
+  // Workers are paused, so rings can be added for new producers. Those of
+  // producers that have been detached are kept, to drain what is left.
+  const std::vector<bool> &actives = active_workers();
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    if (actives[wid] && !shards_[0][wid] && AddProducer(wid) != 0) {
+      LOG(ERROR) << name() << ": cannot allocate rings for worker " << wid
+                 << ", its packets will be dropped";
+    }
+  }
+
+  return 0;
+}
+
+std::string ShardedQueue::GetDesc() const {
+  uint64_t count = 0;
+
+  for (int wid : producers_) {
+    for (int cls = 0; cls < num_classes_; cls++) {
+      count += llring_count(shards_[cls][wid]->ring);
+    }
+  }
+
+  return bess::utils::Format("%" PRIu64 "/%" PRIu64, count,
+                             size_ * num_classes_ * producers_.size());
+}
+
+void ShardedQueue::Enqueue(int cls, Shard *shard, bess::Packet **pkts,
+                           int cnt) {
+  // Rings could not be allocated for this worker
+  if (!shard) {
+    bess::Packet::Free(pkts, cnt);
+    return;
+  }
+
+  int queued = llring_sp_enqueue_burst(shard->ring, (void **)pkts, cnt);
+  if (cls < backpressure_classes_ && llring_count(shard->ring) > high_water_) {
+    SignalOverload();
+  }
+
+  shard->enqueued += queued;
+
+  if (queued < cnt) {
+    int to_drop = cnt - queued;
+    shard->dropped += to_drop;
+    bess::Packet::Free(pkts + queued, to_drop);
+  }
+}
+
+/* from upstream */
+void ShardedQueue::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
+  int wid = ctx->wid;
+  int cnt = batch->cnt();
+
+  if (num_classes_ == 1) {
+    Enqueue(0, shards_[0][wid], batch->pkts(), cnt);
+    return;
+  }
+
+  // Split the batch by class, keeping the order of packets in each
+  bess::Packet *pkts[kMaxPriorities][bess::PacketBatch::kMaxBurst];
+  int cnts[kMaxPriorities] = {};
+  bess::metadata::mt_offset_t offset = attr_offset(attr_id_);
+
+  for (int i = 0; i < cnt; i++) {
+    bess::Packet *pkt = batch->pkts()[i];
+    int cls = std::min<int>(get_attr_with_offset<uint8_t>(offset, pkt),
+                            num_classes_ - 1);
+    pkts[cls][cnts[cls]++] = pkt;
+  }
+
+  for (int cls = 0; cls < num_classes_; cls++) {
+    if (cnts[cls]) {
+      Enqueue(cls, shards_[cls][wid], pkts[cls], cnts[cls]);
+    }
+  }
+}
+
+uint32_t ShardedQueue::Dequeue(int cls, bess::Packet **pkts, uint32_t cnt) {
+  const size_t n = producers_.size();
+  size_t &cursor = cursors_[cls];
+  uint32_t dequeued = 0;
+  size_t idle = 0;  // rings found empty in a row
+
+  // Deficit round robin: each turn of a ring, its deficit grows by its share,
+  // and is spent on packets. It carries over if the batch fills up, but not
+  // if the ring runs out.
+  while (dequeued < cnt && idle < n) {
+    int wid = producers_[cursor];
+    uint64_t &deficit = deficits_[cls][wid];
+    if (deficit == 0) {
+      deficit = static_cast<uint64_t>(weights_[wid]) * kQuantum;
+    }
+
+    uint32_t want = std::min<uint64_t>(deficit, cnt - dequeued);
+    uint32_t got = llring_sc_dequeue_burst(shards_[cls][wid]->ring,
+                                           (void **)(pkts + dequeued), want);
+    dequeued += got;
+    deficit -= got;
+    idle = got ? 0 : idle + 1;
+
+    if (got < want) {
+      deficit = 0;
+    }
+    if (deficit == 0) {
+      cursor = (cursor + 1) % n;
+    }
+  }
+
+  dequeued_[cls] += dequeued;
+  return dequeued;
+}
+
+bool ShardedQueue::Underloaded() const {
+  for (int wid : producers_) {
+    for (int cls = 0; cls < backpressure_classes_; cls++) {
+      if (llring_count(shards_[cls][wid]->ring) >= low_water_) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/* to downstream */
+struct task_result ShardedQueue::RunTask(Context *ctx,
+                                         bess::PacketBatch *batch, void *) {
+  if (children_overload_ > 0) {
+    return {
+        .block = true, .packets = 0, .bits = 0,
+    };
+  }
+
+  const uint32_t burst = ACCESS_ONCE(burst_);
+  const int pkt_overhead = 24;
+
+  uint64_t total_bytes = 0;
+
+  // Strict priority: lower classes only get what is left of the burst
+  uint32_t cnt = 0;
+  for (int cls = 0; cls < num_classes_ && cnt < burst; cls++) {
+    cnt += Dequeue(cls, batch->pkts() + cnt, burst - cnt);
+  }
+
+  if (cnt == 0) {
+    return {.block = true, .packets = 0, .bits = 0};
+  }
+
+  batch->set_cnt(cnt);
+
+  if (prefetch_) {
+    for (uint32_t i = 0; i < cnt; i++) {
+      total_bytes += batch->pkts()[i]->total_len();
+      rte_prefetch0(batch->pkts()[i]->head_data());
+    }
+  } else {
+    for (uint32_t i = 0; i < cnt; i++) {
+      total_bytes += batch->pkts()[i]->total_len();
+    }
+  }
+
+  RunNextModule(ctx, batch);
+
+  if (backpressure_classes_ && Underloaded()) {
+    SignalUnderload();
+  }
+
+  return {.block = false,
+          .packets = cnt,
+          .bits = (total_bytes + cnt * pkt_overhead) * 8};
+}
+
+CommandResponse ShardedQueue::CommandSetBurst(
+    const bess::pb::QueueCommandSetBurstArg &arg) {
+  uint64_t burst = arg.burst();
+
+  if (burst > bess::PacketBatch::kMaxBurst) {
+    return CommandFailure(EINVAL, "burst size must be [0,%zu]",
+                          bess::PacketBatch::kMaxBurst);
+  }
+
+  burst_ = burst;
+  return CommandSuccess();
+}
+
+CommandResponse ShardedQueue::SetSize(uint64_t size) {
+  if (size < 4 || size > 16384) {
+    return CommandFailure(EINVAL, "must be in [4, 16384]");
+  }
+
+  if (size & (size - 1)) {
+    return CommandFailure(EINVAL, "must be a power of 2");
+  }
+
+  int ret = Resize(size);
+  if (ret) {
+    return CommandFailure(-ret);
+  }
+  size_ = size;
+  AdjustWaterLevels();
+
+  return CommandSuccess();
+}
+
+CommandResponse ShardedQueue::CommandSetSize(
+    const bess::pb::QueueCommandSetSizeArg &arg) {
+  return SetSize(arg.size());
+}
+
+CommandResponse ShardedQueue::CommandGetStatus(
+    const bess::pb::QueueCommandGetStatusArg &) {
+  bess::pb::ShardedQueueCommandGetStatusResponse resp;
+
+  for (int cls = 0; cls < num_classes_; cls++) {
+    auto *status = resp.add_classes();
+    uint64_t count = 0;
+    uint64_t enqueued = 0;
+    uint64_t dropped = 0;
+
+    for (int wid : producers_) {
+      const Shard *shard = shards_[cls][wid];
+      count += llring_count(shard->ring);
+      enqueued += shard->enqueued;
+      dropped += shard->dropped;
+    }
+
+    status->set_count(count);
+    status->set_size(size_ * producers_.size());
+    status->set_enqueued(enqueued);
+    status->set_dequeued(dequeued_[cls]);
+    status->set_dropped(dropped);
+  }
+
+  return CommandSuccess(resp);
+}
+
+void ShardedQueue::AdjustWaterLevels() {
+  high_water_ = static_cast<uint64_t>(size_ * kHighWaterRatio);
+  low_water_ = static_cast<uint64_t>(size_ * kLowWaterRatio);
+}
+
+CheckConstraintResult ShardedQueue::CheckModuleConstraints() const {
+  CheckConstraintResult status = CHECK_OK;
+  if (num_active_tasks() - tasks().size() < 1) {
+    LOG(ERROR) << "ShardedQueue has no producers";
+    status = CHECK_NONFATAL_ERROR;
+  }
+
+  if (tasks().size() > 1) {  // Single consumer
+    LOG(ERROR) << "More than one consumer for the queue" << name();
+    return CHECK_FATAL_ERROR;
+  }
+
+  return status;
+}
+
+ADD_MODULE(ShardedQueue, "sharded_queue",
+           "queue with a ring per producer worker and priority class")
@@ -0,0 +1,160 @@
+// Copyright (c) 2014-2016, The Regents of the University of California.
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#ifndef BESS_MODULES_SHARDED_QUEUE_H_
+#define BESS_MODULES_SHARDED_QUEUE_H_
+
+#include <vector>
+
+#include "../kmod/llring.h"
+#include "../module.h"
+#include "../pb/module_msg.pb.h"
+
+// A Queue with a ring for each producer worker and priority class. Producers
+// never contend with each other, and packets of a class are dequeued only
+// when all higher classes are empty, so that they are not dropped as long as
+// their own rings have room. Within a class, the rings are drained by deficit
+// round robin, with a weight for each producer.
+class ShardedQueue final : public Module {
+ public:
+  static const Commands cmds;
+
+  static const int kMaxPriorities = 8;
+
+  // Packets dequeued from a ring of weight 1 per round
+  static const uint32_t kQuantum = 8;
+
+  ShardedQueue()
+      : Module(),
+        shards_(),
+        producers_(),
+        num_classes_(),
+        attr_id_(-1),
+        weights_(),
+        deficits_(),
+        cursors_(),
+        dequeued_(),
+        prefetch_(),
+        backpressure_classes_(),
+        burst_(),
+        size_(),
+        high_water_(),
+        low_water_() {
+    is_task_ = true;
+    propagate_workers_ = false;
+    max_allowed_workers_ = Worker::kMaxWorkers;
+  }
+
+  CommandResponse Init(const bess::pb::ShardedQueueArg &arg);
+
+  void DeInit() override;
+
+  struct task_result RunTask(Context *ctx, bess::PacketBatch *batch,
+                             void *arg) override;
+  void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
+
+  int OnEvent(bess::Event e) override;
+
+  std::string GetDesc() const override;
+
+  CommandResponse CommandSetBurst(const bess::pb::QueueCommandSetBurstArg &arg);
+  CommandResponse CommandSetSize(const bess::pb::QueueCommandSetSizeArg &arg);
+  CommandResponse CommandGetStatus(
+      const bess::pb::QueueCommandGetStatusArg &arg);
+
+  CheckConstraintResult CheckModuleConstraints() const override;
+
+ private:
+  const double kHighWaterRatio = 0.90;
+  const double kLowWaterRatio = 0.15;
+
+  // The ring of a producer for a class, with counters that only the producer
+  // updates. Each is allocated on its own cache line.
+  struct Shard {
+    struct llring *ring;
+    uint64_t enqueued;
+    uint64_t dropped;
+  };
+
+  static struct llring *NewRing(int slots, int socket);
+
+  // Allocates the shards of a newly seen producer
+  int AddProducer(int wid);
+
+  void Enqueue(int cls, Shard *shard, bess::Packet **pkts, int cnt);
+
+  // Dequeues up to cnt packets of a class into pkts
+  uint32_t Dequeue(int cls, bess::Packet **pkts, uint32_t cnt);
+
+  // Whether the rings that apply backpressure are all below low water
+  bool Underloaded() const;
+
+  int Resize(int slots);
+
+  // Readjusts the water level according to `size_`.
+  void AdjustWaterLevels();
+
+  CommandResponse SetSize(uint64_t size);
+
+  Shard *shards_[kMaxPriorities][Worker::kMaxWorkers];
+
+  // Workers that have shards, in the order they are drained
+  std::vector<int> producers_;
+
+  int num_classes_;
+
+  // Metadata attribute with the class of each packet, if num_classes_ > 1
+  int attr_id_;
+
+  uint32_t weights_[Worker::kMaxWorkers];
+
+  // Consumer state for each class
+  uint64_t deficits_[kMaxPriorities][Worker::kMaxWorkers];
+  size_t cursors_[kMaxPriorities];  // index in producers_
+  uint64_t dequeued_[kMaxPriorities];
+
+  bool prefetch_;
+
+  // Backpressure is applied when a ring of the highest backpressure_classes_
+  // classes is overloaded, and never if it is 0. Lower classes drop packets.
+  int backpressure_classes_;
+
+  int burst_;
+
+  // Capacity of each ring
+  uint64_t size_;
+
+  // High water occupancy of each ring
+  uint64_t high_water_;
+
+  // Low water occupancy of each ring
+  uint64_t low_water_;
+};
+
+#endif  // BESS_MODULES_SHARDED_QUEUE_H_
@@ -29,8 +29,7 @@
 
 #include "url_filter.h"
 
-#include <algorithm>
-#include <tuple>
+#include <cinttypes>
 
 #include "../utils/checksum.h"
 #include "../utils/ether.h"
@@ -51,11 +50,11 @@ const Commands UrlFilter::cmds = {
     {"get_runtime_config", "EmptyArg",
      MODULE_CMD_FUNC(&UrlFilter::GetRuntimeConfig), Command::THREAD_SAFE},
     {"set_runtime_config", "UrlFilterConfig",
-     MODULE_CMD_FUNC(&UrlFilter::SetRuntimeConfig), Command::THREAD_UNSAFE},
+     MODULE_CMD_FUNC(&UrlFilter::SetRuntimeConfig), Command::THREAD_SAFE},
     {"add", "UrlFilterArg", MODULE_CMD_FUNC(&UrlFilter::CommandAdd),
-     Command::THREAD_UNSAFE},
+     Command::THREAD_SAFE},
     {"clear", "EmptyArg", MODULE_CMD_FUNC(&UrlFilter::CommandClear),
-     Command::THREAD_UNSAFE}};
+     Command::THREAD_SAFE}};
 
 // Template for generating TCP packets without data
 struct[[gnu::packed]] PacketTemplate {
@@ -97,6 +96,40 @@ static const char HTTP_403_BODY[] =
 
 static PacketTemplate rst_template;
 
+// A request is matched against the blacklist as the text
+// "<kHostBegin><host><kPathBegin><path><kPathEnd>".
+static const char kHostBegin = '\x01';
+static const char kPathBegin = '\x02';
+static const char kPathEnd = '\x03';
+
+// Returns the pattern that finds the rule in the text above. A rule matches
+// the exact host and path, except that a host "*<suffix>" (e.g.,
+// "*.example.com") matches any host that ends with the suffix, and a path
+// "<prefix>*" matches any path that starts with the prefix.
+static std::string RulePattern(const UrlFilter::Url &url) {
+  const std::string &host = url.first;
+  const std::string &path = url.second;
+  std::string pattern;
+
+  if (!host.empty() && host[0] == '*') {
+    pattern.append(host, 1, std::string::npos);
+  } else {
+    pattern += kHostBegin;
+    pattern += host;
+  }
+
+  pattern += kPathBegin;
+
+  if (!path.empty() && path.back() == '*') {
+    pattern.append(path, 0, path.size() - 1);
+  } else {
+    pattern += path;
+    pattern += kPathEnd;
+  }
+
+  return pattern;
+}
+
 // Generate an HTTP 403 packet
 inline static bess::Packet *Generate403Packet(const Ethernet::Address &src_eth,
                                               const Ethernet::Address &dst_eth,
@@ -173,20 +206,115 @@ inline static bess::Packet *GenerateResetPacket(
   return pkt;
 }
 
+FlowCache::FlowCache(size_t capacity)
+    : index_(align_ceil_pow2(std::max(capacity / 2, size_t{1})), capacity),
+      records_(capacity),
+      links_(capacity),
+      free_indices_(),
+      head_(kNone),
+      tail_(kNone),
+      evictions_(0) {
+  free_indices_.reserve(capacity);
+  for (size_t i = capacity; i > 0; i--) {
+    free_indices_.push_back(i - 1);
+  }
+}
+
+FlowRecord *FlowCache::Find(const Flow &flow) {
+  auto *entry = index_.Find(flow);
+  return entry ? &records_[entry->second] : nullptr;
+}
+
+void FlowCache::Touch(FlowRecord *record) {
+  uint32_t idx = IndexOf(record);
+  if (idx != head_) {
+    Unlink(idx);
+    PushFront(idx);
+  }
+}
+
+FlowRecord *FlowCache::Emplace(const Flow &flow) {
+  if (free_indices_.empty()) {
+    if (tail_ == kNone) {
+      return nullptr;  // zero capacity
+    }
+    Erase(&records_[tail_]);
+    evictions_++;
+  }
+
+  uint32_t idx = free_indices_.back();
+  if (!index_.Insert(flow, idx)) {
+    return nullptr;
+  }
+  free_indices_.pop_back();
+
+  links_[idx].flow = flow;
+  PushFront(idx);
+  return &records_[idx];
+}
+
+void FlowCache::Erase(FlowRecord *record) {
+  uint32_t idx = IndexOf(record);
+  index_.Remove(links_[idx].flow);
+  Unlink(idx);
+  record->Reset(kMaxPooledBufLen);
+  free_indices_.push_back(idx);
+}
+
+bool FlowCache::InUse(uint32_t idx) const {
+  const auto *entry = index_.Find(links_[idx].flow);
+  return entry && entry->second == idx;
+}
+
+void FlowCache::Unlink(uint32_t idx) {
+  Link &link = links_[idx];
+  if (link.prev == kNone) {
+    head_ = link.next;
+  } else {
+    links_[link.prev].next = link.next;
+  }
+  if (link.next == kNone) {
+    tail_ = link.prev;
+  } else {
+    links_[link.next].prev = link.prev;
+  }
+}
+
+void FlowCache::PushFront(uint32_t idx) {
+  Link &link = links_[idx];
+  link.prev = kNone;
+  link.next = head_;
+  if (head_ == kNone) {
+    tail_ = idx;
+  } else {
+    links_[head_].prev = idx;
+  }
+  head_ = idx;
+}
+
 CommandResponse UrlFilter::Init(const bess::pb::UrlFilterArg &arg) {
-  for (const auto &url : arg.blacklist()) {
-    blacklist_[url.host()].Insert(url.path(), {});
+  size_t max_flows = arg.max_flows() ?: kDefaultMaxFlows;
+  if (max_flows > FlowCache::kMaxCapacity) {
+    return CommandFailure(EINVAL, "max_flows must be at most %u",
+                          FlowCache::kMaxCapacity);
   }
-  return CommandSuccess();
+  flow_cache_.reset(new FlowCache(max_flows));
+
+  return UpdateBlacklist(arg.blacklist(), false);
+}
+
+void UrlFilter::DeInit() {
+  delete matcher_.load();
+  matcher_ = nullptr;
 }
 
 CommandResponse UrlFilter::CommandAdd(const bess::pb::UrlFilterArg &arg) {
-  Init(arg);
-  return CommandSuccess();
+  return UpdateBlacklist(arg.blacklist(), false);
 }
 
 CommandResponse UrlFilter::CommandClear(const bess::pb::EmptyArg &) {
   blacklist_.clear();
+  PublishBlacklist();
   return CommandSuccess();
 }
 
@@ -202,37 +330,89 @@ CommandResponse UrlFilter::GetInitialArg(const bess::pb::EmptyArg &) {
 // Retrieves a configuration that will restore this module.
 CommandResponse UrlFilter::GetRuntimeConfig(const bess::pb::EmptyArg &) {
   bess::pb::UrlFilterConfig resp;
-  using rule_t = bess::pb::UrlFilterArg_Url;
-  for (const auto &it : blacklist_) {
-    auto entries = it.second.Dump();
-    for (auto entry : entries) {
-      rule_t *hp = resp.add_blacklist();
-      hp->set_host(it.first);
-      hp->set_path(std::get<0>(entry));
-      // For now, ignore get<1> and get<2>, which are
-      // the tuple and the prefix boolean, respectively.
-      // The tuple is (currently) always empty and the boolean
-      // is (currently) always false -- see the .Insert() above.
-    }
+  // blacklist_ is sorted by host, then path
+  for (const Url &url : blacklist_) {
+    bess::pb::UrlFilterArg_Url *hp = resp.add_blacklist();
+    hp->set_host(url.first);
+    hp->set_path(url.second);
   }
-  // Dump() is sorted, but blacklist_ is not: we use a
-  // stable sort to just sort by the host as the outer key.
-  std::stable_sort(
-      resp.mutable_blacklist()->begin(), resp.mutable_blacklist()->end(),
-      [](const rule_t &a, const rule_t &b) { return a.host() < b.host(); });
   return CommandSuccess(resp);
 }
 
 // Restores the module's configuration.
 CommandResponse UrlFilter::SetRuntimeConfig(
     const bess::pb::UrlFilterConfig &arg) {
-  blacklist_.clear();
-  for (const auto &url : arg.blacklist()) {
-    blacklist_[url.host()].Insert(url.path(), {});
+  return UpdateBlacklist(arg.blacklist(), true);
+}
+
+CommandResponse UrlFilter::UpdateBlacklist(const UrlList &urls, bool replace) {
+  for (const auto &url : urls) {
+    if (url.host().find('*', 1) != std::string::npos) {
+      return CommandFailure(EINVAL,
+                            "host '%s': '*' is only allowed as the first "
+                            "character",
+                            url.host().c_str());
+    }
+
+    for (char c : {kHostBegin, kPathBegin, kPathEnd}) {
+      if (url.host().find(c) != std::string::npos ||
+          url.path().find(c) != std::string::npos) {
+        return CommandFailure(EINVAL, "invalid character in '%s%s'",
+                              url.host().c_str(), url.path().c_str());
+      }
+    }
+  }
+
+  if (replace) {
+    blacklist_.clear();
+  }
+  for (const auto &url : urls) {
+    blacklist_.emplace(url.host(), url.path());
   }
+
+  PublishBlacklist();
   return CommandSuccess();
 }
 
+// The new matcher is built while workers go on with the current one, which
+// may take a few seconds for millions of rules.
+void UrlFilter::PublishBlacklist() {
+  std::vector<std::string> patterns;
+  patterns.reserve(blacklist_.size());
+  for (const Url &url : blacklist_) {
+    patterns.push_back(RulePattern(url));
+  }
+
+  const AhoCorasick *old_matcher = matcher_.exchange(
+      new AhoCorasick(std::move(patterns)), std::memory_order_acq_rel);
+
+  if (old_matcher) {
+    synchronize_workers();
+    delete old_matcher;
+  }
+}
+
+void UrlFilter::ExpireFlows(uint64_t now) {
+  // Expiry times are extended as packets come, and records are reused for
+  // new flows, so check again
+  auto check = [&](uint32_t idx) {
+    FlowRecord *record = flow_cache_->RecordAt(idx);
+    if (!flow_cache_->InUse(idx)) {
+      record->SetExpiryScheduled(false);  // already gone
+      return;
+    }
+
+    if (now >= record->ExpiryTime()) {
+      flow_cache_->Erase(record);
+      record->SetExpiryScheduled(false);
+    } else {
+      expiry_.Add(record->ExpiryTime(), idx);
+    }
+  };
+
+  expiry_.Expire(now, check, kExpiryBudget);
+}
+
 void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
   gate_idx_t igate = ctx->current_igate;
 
@@ -242,6 +422,11 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     return;
   }
 
+  ExpireFlows(ctx->current_ns);
+
+  // Rules may be updated concurrently; see PublishBlacklist()
+  const AhoCorasick *matcher = matcher_.load(std::memory_order_acquire);
+
   int cnt = batch->cnt();
 
   for (int i = 0; i < cnt; i++) {
@@ -268,39 +453,46 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     uint64_t now = ctx->current_ns;
 
     // Find existing flow, if we have one.
-    std::unordered_map<Flow, FlowRecord, FlowHash>::iterator it =
-        flow_cache_.find(flow);
+    FlowRecord *record = flow_cache_->Find(flow);
 
-    if (it != flow_cache_.end()) {
-      if (now >= it->second.ExpiryTime()) {
+    if (record != nullptr) {
+      if (now >= record->ExpiryTime()) {
         // Discard old flow and start over.
-        flow_cache_.erase(it);
-        it = flow_cache_.end();
-      } else if (it->second.IsAnalyzed()) {
+        flow_cache_->Erase(record);
+        record = nullptr;
+      } else if (record->IsAnalyzed()) {
         // Once we're finished analyzing, we only record *blocked* flows.
         // Continue blocking this flow for TIME_OUT_NS more ns.
-        it->second.SetExpiryTime(now + TIME_OUT_NS);
+        record->SetExpiryTime(now + TIME_OUT_NS);
+        flow_cache_->Touch(record);
         DropPacket(ctx, pkt);
         continue;
+      } else {
+        flow_cache_->Touch(record);
       }
     }
 
-    if (it == flow_cache_.end()) {
+    if (record == nullptr) {
       // Don't have a flow, or threw an aged one out.  If there's no
       // SYN in this packet the reconstruct code will fail.  This is
       // a common case (for any flow that got analyzed and allowed);
       // skip a pointless emplace/erase pair for such packets.
       if (tcp->flags & Tcp::Flag::kSyn) {
-        std::tie(it, std::ignore) = flow_cache_.emplace(
-            std::piecewise_construct, std::make_tuple(flow), std::make_tuple());
-      } else {
+        record = flow_cache_->Emplace(flow);
+      }
+      if (record == nullptr) {
         EmitPacket(ctx, pkt, 0);
         continue;
       }
+      // A record erased before its entry came up reuses that entry, which
+      // is due no later than this flow expires.
+      if (!record->IsExpiryScheduled()) {
+        record->SetExpiryScheduled(true);
+        expiry_.Add(now + TIME_OUT_NS, flow_cache_->IndexOf(record));
+      }
     }
 
-    FlowRecord &record = it->second;
-    TcpFlowReconstruct &buffer = record.GetBuffer();
+    TcpFlowReconstruct &buffer = record->GetBuffer();
 
     // If the reconstruct code indicates failure, treat this
     // as a flow to pass.  Note: we only get failure if there is
@@ -309,13 +501,13 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     bool success = buffer.InsertPacket(pkt);
     if (!success) {
       VLOG(1) << "Reconstruction failure";
-      flow_cache_.erase(it);
+      flow_cache_->Erase(record);
       EmitPacket(ctx, pkt, 0);
       continue;
     }
 
     // Have something on this flow; keep it alive for a while longer.
-    record.SetExpiryTime(now + TIME_OUT_NS);
+    record->SetExpiryTime(now + TIME_OUT_NS);
 
     // We are by definition still analyzing.  See if we can determine
     // the final disposition of this flow.
@@ -330,16 +522,17 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 
     // -2 means incomplete
     if (parse_result > 0 || parse_result == -2) {
-      const std::string path_str(path, path_len);
-
       // Look for the Host header
       for (size_t j = 0; j < num_headers && !matched; ++j) {
         if (strncmp(headers[j].name, HTTP_HEADER_HOST, headers[j].name_len) ==
             0) {
-          const std::string host(headers[j].value, headers[j].value_len);
-          const auto rule_iterator = blacklist_.find(host);
-          matched = rule_iterator != blacklist_.end() &&
-                    rule_iterator->second.Match(path_str);
+          AhoCorasick::State s =
+              matcher->Next(AhoCorasick::kStart, kHostBegin);
+          s = matcher->Feed(s, headers[j].value, headers[j].value_len);
+          s = matcher->Next(s, kPathBegin);
+          s = matcher->Feed(s, path, path_len);
+          s = matcher->Next(s, kPathEnd);
+          matched = s == AhoCorasick::kMatched;
         }
       }
     }
@@ -352,12 +545,12 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
       // NOTE: if FIN is lost on its way to destination, this will simply pass
       // the retransmitted packet.
       if (parse_result != -2 || (tcp->flags & Tcp::Flag::kFin)) {
-        flow_cache_.erase(it);
+        flow_cache_->Erase(record);
       }
     } else {
       // No need to keep reconstructing, just mark it as analyzed
       // (and hence blocked).
-      it->second.SetAnalyzed();
+      record->SetAnalyzed();
 
       // Inject RST to destination
       EmitPacket(ctx, GenerateResetPacket(eth->src_addr, eth->dst_addr, ip->src,
@@ -386,7 +579,13 @@ void UrlFilter::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 }
 
 std::string UrlFilter::GetDesc() const {
-  return bess::utils::Format("%zu hosts", blacklist_.size());
+  if (!flow_cache_) {
+    return bess::utils::Format("%zu rules", blacklist_.size());
+  }
+  return bess::utils::Format("%zu rules, %zu/%zu flows, %" PRIu64 " evicted",
+                             blacklist_.size(), flow_cache_->Count(),
+                             flow_cache_->capacity(),
+                             flow_cache_->evictions());
 }
 
 ADD_MODULE(UrlFilter, "url-filter", "Filter HTTP connection")
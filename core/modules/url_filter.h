@@ -33,20 +33,23 @@
 #include <rte_config.h>
 #include <rte_hash_crc.h>
 
-#include <map>
+#include <atomic>
+#include <memory>
+#include <set>
 #include <string>
-#include <tuple>
 #include <utility>
 #include <vector>
 
 #include "../module.h"
 #include "../packet.h"
 #include "../pb/module_msg.pb.h"
+#include "../utils/aho_corasick.h"
+#include "../utils/cuckoo_map.h"
 #include "../utils/tcp_flow_reconstruct.h"
-#include "../utils/trie.h"
+#include "../utils/timer_wheel.h"
 
+using bess::utils::AhoCorasick;
 using bess::utils::TcpFlowReconstruct;
-using bess::utils::Trie;
 using bess::utils::be16_t;
 using bess::utils::be32_t;
 
@@ -68,7 +71,7 @@ class alignas(16) Flow {
 
 static_assert(sizeof(Flow) == 16, "Flow must be 16 bytes.");
 
-// Hash function for std::unordered_map
+// Hash function for FlowCache
 struct FlowHash {
   std::size_t operator()(const Flow &f) const {
     uint32_t init_val = 0;
@@ -91,7 +94,11 @@ struct FlowHash {
 
 class FlowRecord {
  public:
-  FlowRecord() : done_analyzing_(false), buffer_(128), expiry_time_(0) {}
+  FlowRecord()
+      : done_analyzing_(false),
+        buffer_(128),
+        expiry_time_(0),
+        expiry_scheduled_(false) {}
 
   bool IsAnalyzed() { return done_analyzing_; }
   void SetAnalyzed() { done_analyzing_ = true; }
@@ -99,25 +106,117 @@ class FlowRecord {
   uint64_t ExpiryTime() { return expiry_time_; }
   void SetExpiryTime(uint64_t time) { expiry_time_ = time; }
 
+  // Whether the expiry wheel holds an entry for this record. It outlives the
+  // flow, since the entry stays until it comes up, so Reset() keeps it.
+  bool IsExpiryScheduled() { return expiry_scheduled_; }
+  void SetExpiryScheduled(bool scheduled) { expiry_scheduled_ = scheduled; }
+
+  // Clears the record for another flow. See TcpFlowReconstruct::Reset().
+  void Reset(size_t max_buflen) {
+    done_analyzing_ = false;
+    buffer_.Reset(max_buflen);
+    expiry_time_ = 0;
+  }
+
  private:
   bool done_analyzing_;
   TcpFlowReconstruct buffer_;
   uint64_t expiry_time_;
+  bool expiry_scheduled_;
+};
+
+// A table of up to 'capacity' flows. All records, with their reassembly
+// buffers, are allocated up front and recycled, so that a new flow does not
+// allocate memory on the data path. When the table is full, the least recently
+// used flow is evicted to make room for a new one.
+class FlowCache {
+ public:
+  static const uint32_t kMaxCapacity = 1 << 24;
+
+  explicit FlowCache(size_t capacity);
+
+  size_t Count() const { return index_.Count(); }
+  size_t capacity() const { return records_.size(); }
+
+  // The number of flows evicted so far
+  uint64_t evictions() const { return evictions_; }
+
+  // Returns the record of the flow, or nullptr if not found
+  FlowRecord *Find(const Flow &flow);
+
+  // Marks the flow of the record as the most recently used
+  void Touch(FlowRecord *record);
+
+  // Starts tracking a flow that is not in the table, with a fresh record.
+  // Returns nullptr if the flow could not be stored.
+  FlowRecord *Emplace(const Flow &flow);
+
+  // Stops tracking the flow of the record
+  void Erase(FlowRecord *record);
+
+  // Records are numbered [0, capacity()), whether they are in use or not
+  uint32_t IndexOf(const FlowRecord *record) const {
+    return record - records_.data();
+  }
+  FlowRecord *RecordAt(uint32_t idx) { return &records_[idx]; }
+
+  // Returns true if the record with the index holds a flow
+  bool InUse(uint32_t idx) const;
+
+ private:
+  static const uint32_t kNone = UINT32_MAX;
+
+  // Reassembly buffers larger than this are not kept for the next flow
+  static const size_t kMaxPooledBufLen = 16384;
+
+  // Node of the LRU list, for the record with the same index
+  struct Link {
+    Flow flow;
+    uint32_t prev;  // more recently used, or kNone
+    uint32_t next;  // less recently used, or kNone
+  };
+
+  void Unlink(uint32_t idx);
+  void PushFront(uint32_t idx);
+
+  bess::utils::CuckooMap<Flow, uint32_t, FlowHash> index_;
+  std::vector<FlowRecord> records_;
+  std::vector<Link> links_;
+  std::vector<uint32_t> free_indices_;
+  uint32_t head_;  // most recently used
+  uint32_t tail_;  // least recently used
+  uint64_t evictions_;
 };
 
 // A module of HTTP URL filtering. Ends an HTTP connection if the Host field
-// matches the blacklist.
+// and the path match the blacklist.
 // igate/ogate 0: traffic from internal network to external network
 // igate/ogate 1: traffic from external network to internal network
+//
+// The blacklist is compiled into an Aho-Corasick automaton, which checks a
+// request against all rules in one pass and supports wildcard hosts and paths
+// (see RulePattern() in url_filter.cc). Updates build a new automaton on the
+// control thread while workers keep using the current one, and then swap it.
 class UrlFilter final : public Module {
  public:
   typedef std::pair<std::string, std::string> Url;
 
+  // Default capacity of the flow table
+  static const size_t kDefaultMaxFlows = 65536;
+
+  UrlFilter()
+      : Module(),
+        blacklist_(),
+        matcher_(),
+        flow_cache_(),
+        expiry_(kExpiryTickShift) {}
+
   static const Commands cmds;
   static const gate_idx_t kNumIGates = 2;
   static const gate_idx_t kNumOGates = 2;
 
   CommandResponse Init(const bess::pb::UrlFilterArg &arg);
+  void DeInit() override;
 
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
@@ -130,8 +229,38 @@ class UrlFilter final : public Module {
   CommandResponse SetRuntimeConfig(const bess::pb::UrlFilterConfig &arg);
 
  private:
-  std::unordered_map<std::string, Trie<std::tuple<>>> blacklist_;
-  std::unordered_map<Flow, FlowRecord, FlowHash> flow_cache_;
+  // how many flows to check for expiry per batch, at most?
+  static const size_t kExpiryBudget = 32;
+
+  // granularity of expiry checks (2^27 ns, about 134 ms)
+  static const int kExpiryTickShift = 27;
+
+  typedef google::protobuf::RepeatedPtrField<bess::pb::UrlFilterArg_Url>
+      UrlList;
+
+  // Removes up to kExpiryBudget expired flows from flow_cache_
+  void ExpireFlows(uint64_t now);
+
+  // Adds the rules to the blacklist (or replaces it with them) and
+  // recompiles matcher_. The blacklist is unchanged if any rule is invalid.
+  CommandResponse UpdateBlacklist(const UrlList &urls, bool replace);
+
+  // Swaps in a matcher of the current blacklist_, and frees the old one once
+  // workers are done with it.
+  void PublishBlacklist();
+
+  // Rules, in order of host and then path
+  std::set<Url> blacklist_;
+
+  // Compiled from blacklist_, for the data path
+  std::atomic<const AhoCorasick *> matcher_;
+
+  std::unique_ptr<FlowCache> flow_cache_;
+
+  // Indices of records in flow_cache_, to be checked when their flows may
+  // have expired. There is at most one entry per record (see
+  // FlowRecord::IsExpiryScheduled()), so the wheel is bounded by max_flows.
+  bess::utils::TimerWheel<uint32_t> expiry_;
 };
 
 #endif  // BESS_MODULES_URL_FILTER_H_
@@ -32,6 +32,9 @@
 #include <benchmark/benchmark.h>
 #include <glog/logging.h>
 
+#include <tuple>
+#include <unordered_map>
+
 #include "url_filter.h"
 
 // Benchmarks the NAT flow hash.
@@ -46,4 +49,66 @@ static void BM_FlowHash(benchmark::State& state) {
 
 BENCHMARK(BM_FlowHash);
 
+static Flow MakeFlow(uint32_t i) {
+  Flow f;
+  f.src_ip = be32_t(0x0a000000 | (i >> 16));
+  f.dst_ip = be32_t(0x08080808);
+  f.src_port = be16_t(i & 0xffff);
+  f.dst_port = be16_t(80);
+  return f;
+}
+
+// Flow churn: every iteration starts a new flow, looks up a few recent ones,
+// and ends an old one. Arg(0) is the table size, and half of it is in use.
+static void BM_FlowCacheChurn(benchmark::State& state) {
+  const uint32_t live = state.range(0);
+  FlowCache cache(live);
+  uint32_t next = 0;
+
+  while (state.KeepRunning()) {
+    Flow f = MakeFlow(next);
+    FlowRecord* record = cache.Emplace(f);
+    benchmark::DoNotOptimize(record);
+    for (uint32_t i = 1; i <= 4 && i <= next; i++) {
+      record = cache.Find(MakeFlow(next - i));
+      if (record) {
+        cache.Touch(record);
+      }
+    }
+    if (next >= live / 2) {
+      record = cache.Find(MakeFlow(next - live / 2));
+      if (record) {
+        cache.Erase(record);
+      }
+    }
+    next++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_FlowCacheChurn)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+// The same churn with a node-based std::unordered_map, as a baseline
+static void BM_UnorderedMapChurn(benchmark::State& state) {
+  const uint32_t live = state.range(0);
+  std::unordered_map<Flow, FlowRecord, FlowHash> cache;
+  uint32_t next = 0;
+
+  while (state.KeepRunning()) {
+    auto it = cache.emplace(std::piecewise_construct,
+                            std::make_tuple(MakeFlow(next)), std::make_tuple());
+    benchmark::DoNotOptimize(it);
+    for (uint32_t i = 1; i <= 4 && i <= next; i++) {
+      benchmark::DoNotOptimize(cache.find(MakeFlow(next - i)));
+    }
+    if (next >= live / 2) {
+      cache.erase(MakeFlow(next - live / 2));
+    }
+    next++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_UnorderedMapChurn)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
 BENCHMARK_MAIN();
@@ -30,6 +30,7 @@
 
 #include "wildcard_match.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -63,11 +64,11 @@ const Commands WildcardMatch::cmds = {
     {"set_runtime_config", "WildcardMatchConfig",
      MODULE_CMD_FUNC(&WildcardMatch::SetRuntimeConfig), Command::THREAD_UNSAFE},
     {"add", "WildcardMatchCommandAddArg",
-     MODULE_CMD_FUNC(&WildcardMatch::CommandAdd), Command::THREAD_UNSAFE},
+     MODULE_CMD_FUNC(&WildcardMatch::CommandAdd), Command::THREAD_SAFE},
     {"delete", "WildcardMatchCommandDeleteArg",
-     MODULE_CMD_FUNC(&WildcardMatch::CommandDelete), Command::THREAD_UNSAFE},
+     MODULE_CMD_FUNC(&WildcardMatch::CommandDelete), Command::THREAD_SAFE},
     {"clear", "EmptyArg", MODULE_CMD_FUNC(&WildcardMatch::CommandClear),
-     Command::THREAD_UNSAFE},
+     Command::THREAD_SAFE},
     {"set_default_gate", "WildcardMatchCommandSetDefaultGateArg",
      MODULE_CMD_FUNC(&WildcardMatch::CommandSetDefaultGate),
      Command::THREAD_SAFE}};
@@ -130,30 +131,68 @@ CommandResponse WildcardMatch::Init(const bess::pb::WildcardMatchArg &arg) {
   default_gate_ = DROP_GATE;
   total_key_size_ = align_ceil(size_acc, sizeof(uint64_t));
 
+  PublishTuples();
+
   return CommandSuccess();
 }
 
-inline gate_idx_t WildcardMatch::LookupEntry(const wm_hkey_t &key,
-                                             gate_idx_t def_gate) {
-  struct WmData result = {
-      .priority = INT_MIN, .ogate = def_gate,
-  };
+void WildcardMatch::DeInit() {
+  delete tuple_list_.load();
+  tuple_list_ = nullptr;
+}
 
-  for (auto &tuple : tuples_) {
-    const auto &ht = tuple.ht;
-    wm_hkey_t key_masked;
+// Looks up the whole batch one tuple at a time, so that CuckooMap can overlap
+// the bucket loads of all packets. Since tuples are sorted by their highest
+// priority, a packet whose best match so far beats a tuple is not looked up
+// there, and the search stops once no packet can be improved.
+// Rules may be updated concurrently; see PublishTuples().
+void WildcardMatch::LookupBatch(const wm_hkey_t *keys, int cnt,
+                                gate_idx_t def_gate, gate_idx_t *ogates) {
+  struct WmData results[bess::PacketBatch::kMaxBurst];
+  wm_hkey_t keys_masked[bess::PacketBatch::kMaxBurst];
+  const std::pair<wm_hkey_t, struct WmData>
+      *entries[bess::PacketBatch::kMaxBurst];
+  int idxs[bess::PacketBatch::kMaxBurst];
+
+  for (int i = 0; i < cnt; i++) {
+    results[i].priority = INT_MIN;
+    results[i].ogate = def_gate;
+  }
 
-    mask(&key_masked, key, tuple.mask, total_key_size_);
+  const struct WmTupleList *list = tuple_list_.load(std::memory_order_acquire);
 
-    const auto *entry =
-        ht.Find(key_masked, wm_hash(total_key_size_), wm_eq(total_key_size_));
+  for (int k = 0; k < list->num_tuples; k++) {
+    const struct WmTuple &tuple = *list->tuples[k];
+    int max_priority = list->max_priorities[k];
+    int n = 0;
+
+    for (int i = 0; i < cnt; i++) {
+      if (results[i].priority <= max_priority) {
+        mask(&keys_masked[n], keys[i], tuple.mask, total_key_size_);
+        idxs[n++] = i;
+      }
+    }
+
+    if (n == 0) {
+      break;
+    }
 
-    if (entry && entry->second.priority >= result.priority) {
-      result = entry->second;
+    if (!tuple.ht.FindBatch(keys_masked, n, entries, wm_hash(total_key_size_),
+                            wm_eq(total_key_size_))) {
+      continue;
+    }
+
+    for (int j = 0; j < n; j++) {
+      struct WmData &result = results[idxs[j]];
+      if (entries[j] && entries[j]->second.priority >= result.priority) {
+        result = entries[j]->second;
+      }
     }
   }
 
-  return result.ogate;
+  for (int i = 0; i < cnt; i++) {
+    ogates[i] = results[i].ogate;
+  }
 }
 
 void WildcardMatch::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
@@ -196,9 +235,11 @@ void WildcardMatch::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
     }
   }
 
+  gate_idx_t ogates[bess::PacketBatch::kMaxBurst];
+  LookupBatch(keys, cnt, default_gate, ogates);
+
   for (int i = 0; i < cnt; i++) {
-    bess::Packet *pkt = batch->pkts()[i];
-    EmitPacket(ctx, pkt, LookupEntry(keys[i], default_gate));
+    EmitPacket(ctx, batch->pkts()[i], ogates[i]);
   }
 }
 
@@ -206,7 +247,7 @@ std::string WildcardMatch::GetDesc() const {
   int num_rules = 0;
 
   for (const auto &tuple : tuples_) {
-    num_rules += tuple.ht.Count();
+    num_rules += tuple->ht.Count();
   }
 
   return bess::utils::Format("%zu fields, %d rules", fields_.size(), num_rules);
@@ -279,7 +320,7 @@ int WildcardMatch::FindTuple(wm_hkey_t *mask) {
   int i = 0;
 
   for (const auto &tuple : tuples_) {
-    if (memcmp(&tuple.mask, mask, total_key_size_) == 0) {
+    if (memcmp(&tuple->mask, mask, total_key_size_) == 0) {
       return i;
     }
     i++;
@@ -292,28 +333,85 @@ int WildcardMatch::AddTuple(wm_hkey_t *mask) {
     return -ENOSPC;
   }
 
-  tuples_.emplace_back();
-  struct WmTuple &tuple = tuples_.back();
+  tuples_.emplace_back(new WmTuple());
+  struct WmTuple &tuple = *tuples_.back();
+  tuple.ht.EnableConcurrentReads();
   bess::utils::Copy(&tuple.mask, mask, sizeof(*mask));
+  tuple.max_priority = INT_MIN;
 
   return int(tuples_.size() - 1);
 }
 
 int WildcardMatch::DelEntry(int idx, wm_hkey_t *key) {
-  struct WmTuple &tuple = tuples_[idx];
-  int ret =
-      tuple.ht.Remove(*key, wm_hash(total_key_size_), wm_eq(total_key_size_));
-  if (ret) {
-    return ret;
+  struct WmTuple &tuple = *tuples_[idx];
+  if (!tuple.ht.Remove(*key, wm_hash(total_key_size_),
+                       wm_eq(total_key_size_))) {
+    return -ENOENT;
   }
 
   if (tuple.ht.Count() == 0) {
+    retired_tuples_.push_back(std::move(tuples_[idx]));
     tuples_.erase(tuples_.begin() + idx);
+  } else {
+    tuple.max_priority = INT_MIN;
+    for (const auto &entry : tuple.ht) {
+      tuple.max_priority = std::max(tuple.max_priority, entry.second.priority);
+    }
   }
+  PublishTuples();
 
   return 0;
 }
 
+// Publishes a new WmTupleList for the data path, with the tuples in
+// descending order of max_priority. The sort is stable so that tuples with
+// the same priority keep their insertion order. The old list is retired.
+void WildcardMatch::PublishTuples() {
+  std::unique_ptr<struct WmTupleList> list(new WmTupleList());
+  std::vector<const struct WmTuple *> sorted;
+
+  for (const auto &tuple : tuples_) {
+    sorted.push_back(tuple.get());
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const WmTuple *a, const WmTuple *b) {
+                     return a->max_priority > b->max_priority;
+                   });
+
+  list->num_tuples = sorted.size();
+  for (size_t i = 0; i < sorted.size(); i++) {
+    list->tuples[i] = sorted[i];
+    list->max_priorities[i] = sorted[i]->max_priority;
+  }
+
+  const struct WmTupleList *old_list =
+      tuple_list_.exchange(list.release(), std::memory_order_acq_rel);
+  if (old_list) {
+    retired_lists_.emplace_back(old_list);
+  }
+}
+
+// Frees the tuples, tuple lists, and hash table entries that rule updates
+// have left behind, once no worker can be looking at them anymore.
+void WildcardMatch::ReclaimRules() {
+  bool needed = !retired_tuples_.empty() || !retired_lists_.empty();
+  for (const auto &tuple : tuples_) {
+    needed = needed || tuple->ht.NeedsReclaim();
+  }
+
+  if (!needed) {
+    return;
+  }
+
+  synchronize_workers();
+
+  retired_tuples_.clear();
+  retired_lists_.clear();
+  for (auto &tuple : tuples_) {
+    tuple->ht.Reclaim();
+  }
+}
+
 CommandResponse WildcardMatch::CommandAdd(
     const bess::pb::WildcardMatchCommandAddArg &arg) {
   gate_idx_t gate = arg.gate();
@@ -336,20 +434,33 @@ CommandResponse WildcardMatch::CommandAdd(
   data.priority = priority;
   data.ogate = gate;
 
+  bool new_tuple = false;
   int idx = FindTuple(&mask);
   if (idx < 0) {
     idx = AddTuple(&mask);
     if (idx < 0) {
       return CommandFailure(-idx, "failed to add a new wildcard pattern");
     }
+    new_tuple = true;
   }
 
-  auto *ret = tuples_[idx].ht.Insert(key, data, wm_hash(total_key_size_),
-                                     wm_eq(total_key_size_));
+  struct WmTuple &tuple = *tuples_[idx];
+  auto *ret = tuple.ht.Insert(key, data, wm_hash(total_key_size_),
+                              wm_eq(total_key_size_));
   if (ret == nullptr) {
+    if (new_tuple) {
+      tuples_.pop_back();
+    }
     return CommandFailure(EINVAL, "failed to add a rule");
   }
 
+  if (priority > tuple.max_priority || new_tuple) {
+    tuple.max_priority = std::max(tuple.max_priority, priority);
+    PublishTuples();
+  }
+
+  ReclaimRules();
+
   return CommandSuccess();
 }
 
@@ -373,18 +484,23 @@ CommandResponse WildcardMatch::CommandDelete(
     return CommandFailure(-ret, "failed to delete a rule");
   }
 
+  ReclaimRules();
+
   return CommandSuccess();
 }
 
 CommandResponse WildcardMatch::CommandClear(const bess::pb::EmptyArg &) {
   WildcardMatch::Clear();
+  ReclaimRules();
   return CommandSuccess();
 }
 
 void WildcardMatch::Clear() {
   for (auto &tuple : tuples_) {
-    tuple.ht.Clear();
+    tuple->ht.Clear();
+    tuple->max_priority = INT_MIN;
   }
+  PublishTuples();
 }
 
 // Retrieves a WildcardMatchArg that would reconstruct this module.
@@ -412,10 +528,10 @@ CommandResponse WildcardMatch::GetRuntimeConfig(const bess::pb::EmptyArg &) {
 
   // Each tuple provides a single mask, which may have many data-matches.
   for (auto &tuple : tuples_) {
-    wm_hkey_t mask = tuple.mask;
+    wm_hkey_t mask = tuple->mask;
     // Each entry in the hash table has priority, ogate, and the data
     // (one datum per field, under the mask for this field).
-    for (auto &entry : tuple.ht) {
+    for (auto &entry : tuple->ht) {
       // Create the rule instance
       rule_t *rule = resp.add_rules();
       rule->set_priority(entry.second.priority);
@@ -33,6 +33,9 @@
 
 #include "../module.h"
 
+#include <atomic>
+#include <memory>
+
 #include <rte_config.h>
 #include <rte_hash_crc.h>
 
@@ -135,12 +138,21 @@ class WildcardMatch final : public Module {
   static const Commands cmds;
 
   WildcardMatch()
-      : Module(), default_gate_(), total_key_size_(), fields_(), tuples_() {
+      : Module(),
+        default_gate_(),
+        total_key_size_(),
+        fields_(),
+        tuples_(),
+        tuple_list_(),
+        retired_tuples_(),
+        retired_lists_() {
     max_allowed_workers_ = Worker::kMaxWorkers;
   }
 
   CommandResponse Init(const bess::pb::WildcardMatchArg &arg);
 
+  void DeInit() override;
+
   void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override;
 
   std::string GetDesc() const override;
@@ -159,9 +171,19 @@ class WildcardMatch final : public Module {
   struct WmTuple {
     CuckooMap<wm_hkey_t, struct WmData, wm_hash, wm_eq> ht;
     wm_hkey_t mask;
+    int max_priority; /* upper bound of the priorities of entries in ht */
   };
 
-  gate_idx_t LookupEntry(const wm_hkey_t &key, gate_idx_t def_gate);
+  // The tuples as seen by the data path, in descending order of max_priority.
+  // It is never modified once published; commands publish a new one instead.
+  struct WmTupleList {
+    int num_tuples;
+    const struct WmTuple *tuples[MAX_TUPLES];
+    int max_priorities[MAX_TUPLES];
+  };
+
+  void LookupBatch(const wm_hkey_t *keys, int cnt, gate_idx_t def_gate,
+                   gate_idx_t *ogates);
 
   CommandResponse AddFieldOne(const bess::pb::Field &field, struct WmField *f);
 
@@ -171,6 +193,8 @@ class WildcardMatch final : public Module {
   int FindTuple(wm_hkey_t *mask);
   int AddTuple(wm_hkey_t *mask);
   int DelEntry(int idx, wm_hkey_t *key);
+  void PublishTuples();
+  void ReclaimRules();
 
   void Clear();
 
@@ -180,7 +204,12 @@ class WildcardMatch final : public Module {
 
   // TODO(melvinw): this can be refactored to use ExactMatchTable
   std::vector<struct WmField> fields_;
-  std::vector<struct WmTuple> tuples_;
+  std::vector<std::unique_ptr<struct WmTuple>> tuples_;
+  std::atomic<const struct WmTupleList *> tuple_list_;
+
+  // Removed tuples and replaced tuple lists that workers may still be using
+  std::vector<std::unique_ptr<struct WmTuple>> retired_tuples_;
+  std::vector<std::unique_ptr<const struct WmTupleList>> retired_lists_;
 };
 
 #endif  // BESS_MODULES_WILDCARDMATCH_H_
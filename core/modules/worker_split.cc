@@ -72,9 +72,11 @@ void WorkerSplit::ProcessBatch(Context *ctx, bess::PacketBatch *batch) {
 }
 
 void WorkerSplit::AddActiveWorker(int wid, const Task *t) {
-  if (!HaveVisitedWorker(t)) {  // Have not already accounted for worker.
+  if (!HaveVisitedWorker(t) || !active_workers_[wid]) {
     active_workers_[wid] = true;
-    visited_tasks_.push_back(t);
+    if (!HaveVisitedWorker(t)) {
+      visited_tasks_.push_back(t);
+    }
     // Only propagate workers downstream on ogate mapped to `wid`
     int g = gates_[wid];
     bess::OGate *ogate = (g < 0) ? nullptr : ogates()[g];
@@ -45,8 +45,6 @@
 
 namespace bess {
 
-const size_t PacketBatch::kMaxBurst;
-
 static struct rte_mempool *pframe_pool[RTE_MAX_NUMA_NODES];
 
 static void packet_init(struct rte_mempool *mp, void *opaque_arg, void *_m,
@@ -164,10 +162,12 @@ Packet::Packet() {
   check_offset(data_off);
   check_offset(refcnt);
   check_offset(nb_segs);
+  check_offset(ol_flags);
   check_offset(rx_descriptor_fields1);
   check_offset(pkt_len);
   check_offset(data_len);
   check_offset(buf_len);
+  check_offset(timestamp);
   check_offset(pool);
   check_offset(next);
 
@@ -168,6 +168,16 @@ class alignas(64) Packet {
   int total_len() const { return pkt_len_; }
   void set_total_len(uint32_t len) { pkt_len_ = len; }
 
+  // Receive time in ns (see tsc_to_ns()), as set by ports that support it.
+  // Returns 0 if it is not set.
+  uint64_t rx_timestamp() const {
+    return (ol_flags_ & PKT_RX_TIMESTAMP) ? timestamp_ : 0;
+  }
+  void set_rx_timestamp(uint64_t ns) {
+    timestamp_ = ns;
+    ol_flags_ |= PKT_RX_TIMESTAMP;
+  }
+
   uint16_t refcnt() const { return rte_mbuf_refcnt_read(&as_rte_mbuf()); }
 
   void set_refcnt(uint16_t cnt) { rte_mbuf_refcnt_set(&as_rte_mbuf(), cnt); }
@@ -242,6 +252,69 @@ class alignas(64) Packet {
     return dst;
   }
 
+  // Like copy(), but only the first header_len bytes are copied, into a
+  // private segment. The rest is in a segment attached to the buffer of src,
+  // which holds a reference to it. Neither packet may write to the shared
+  // bytes until both are freed.
+  // If header_len is 0, the clone is a single, read-only segment.
+  // returns nullptr if memory allocation failed
+  static Packet *clone(Packet *src, uint16_t header_len) {
+    DCHECK(src->is_linear());
+
+    if (header_len >= src->total_len()) {
+      return copy(src);
+    }
+
+    Packet *tail = __packet_alloc_pool(src->pool_);
+    if (!tail) {
+      return nullptr;
+    }
+
+    rte_pktmbuf_attach(&tail->as_rte_mbuf(), &src->as_rte_mbuf());
+    if (header_len == 0) {
+      return tail;
+    }
+
+    Packet *head = __packet_alloc_pool(src->pool_);
+    if (!head) {
+      Free(tail);
+      return nullptr;
+    }
+
+    bess::utils::CopyInlined(head->append(header_len), src->head_data(),
+                             header_len);
+    tail->adj(header_len);
+    head->next_ = tail;
+    head->nb_segs_ = 2;
+    head->pkt_len_ = src->pkt_len_;
+
+    return head;
+  }
+
+  // Like copy(), but src may be scattered, e.g., a clone() with a header.
+  // The copy is always a single segment, for devices that cannot send
+  // chained packets.
+  // returns nullptr if memory allocation failed or src does not fit
+  static Packet *flatten(Packet *src) {
+    Packet *dst = __packet_alloc_pool(src->pool_);
+    if (!dst) {
+      return nullptr;  // FAIL.
+    }
+
+    char *p = static_cast<char *>(dst->append(src->total_len()));
+    if (!p) {
+      Free(dst);
+      return nullptr;
+    }
+
+    for (Packet *seg = src; seg; seg = seg->next_) {
+      bess::utils::CopyInlined(p, seg->head_data(), seg->head_len());
+      p += seg->head_len();
+    }
+
+    return dst;
+  }
+
   phys_addr_t dma_addr() { return buf_physaddr_ + data_off_; }
 
   std::string Dump();
@@ -257,7 +330,8 @@ class alignas(64) Packet {
   // cnt must be [0, PacketBatch::kMaxBurst]
   static inline size_t Alloc(Packet **pkts, size_t cnt, uint16_t len);
 
-  // pkt may be nullptr
+  // pkt may be nullptr. A packet that is shared (refcnt > 1) only drops its
+  // reference, and attached segments release the buffer they point to.
   static void Free(Packet *pkt) {
     rte_pktmbuf_free(reinterpret_cast<struct rte_mbuf *>(pkt));
   }
@@ -293,7 +367,7 @@ class alignas(64) Packet {
           // offset 22:
           uint16_t _dummy0_;  // rte_mbuf.port
           // offset 24:
-          uint64_t _dummy1_;  // rte_mbuf.ol_flags
+          uint64_t ol_flags_;
         };
       };
 
@@ -328,7 +402,7 @@ class alignas(64) Packet {
       const uint16_t buf_len_;
 
       // offset 56:
-      uint64_t _dummy6_;  // rte_mbuf.timestamp
+      uint64_t timestamp_;  // Receive time, if PKT_RX_TIMESTAMP
 
       // 2nd cacheline - fields only used in slow path or on TX --------------
       // offset 64:
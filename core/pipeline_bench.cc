@@ -0,0 +1,247 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+
+// Benchmarks for moving packet batches through a port and a module chain.
+// kMaxBurst is fixed at build time, so compare burst sizes by building with
+// `make -C core MAX_BURST=<n>`; each result is labeled with its burst size.
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "dpdk.h"
+#include "drivers/pmd.h"
+#include "module.h"
+#include "module_graph.h"
+#include "packet.h"
+#include "pktbatch.h"
+#include "worker.h"
+
+namespace {
+
+const int kBurst = bess::PacketBatch::kMaxBurst;
+
+// net_null RX hands out packets from the pool and TX frees them, so this
+// port costs what a driver call does without being limited by a NIC.
+PMDPort *port;
+
+std::string BurstLabel() {
+  return "burst=" + std::to_string(kBurst);
+}
+
+// Receives up to a full batch from the port, as PortInc does.
+class BenchRx final : public Module {
+ public:
+  static const gate_idx_t kNumIGates = 0;
+  static const gate_idx_t kNumOGates = 1;
+
+  BenchRx() : Module() { is_task_ = true; }
+
+  CommandResponse Init(const bess::pb::EmptyArg &) {
+    if (RegisterTask(nullptr) == INVALID_TASK_ID) {
+      return CommandFailure(ENOMEM, "Task creation failed");
+    }
+    return CommandSuccess();
+  }
+
+  struct task_result RunTask(Context *ctx, bess::PacketBatch *batch,
+                             void *) override {
+    batch->set_cnt(port->RecvPackets(0, batch->pkts(), kBurst));
+    uint32_t cnt = batch->cnt();
+    RunNextModule(ctx, batch);
+    return {.block = (cnt == 0), .packets = cnt, .bits = 0};
+  }
+};
+
+// Sends packets out of ogates 0 and 1 in turn, so that each ogate gets a
+// batch of half the burst.
+class BenchSplit final : public Module {
+ public:
+  static const gate_idx_t kNumIGates = 1;
+  static const gate_idx_t kNumOGates = 2;
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override {
+    int cnt = batch->cnt();
+    for (int i = 0; i < cnt; i++) {
+      EmitPacket(ctx, batch->pkts()[i], i & 1);
+    }
+  }
+};
+
+class BenchForward final : public Module {
+ public:
+  static const gate_idx_t kNumIGates = 1;
+  static const gate_idx_t kNumOGates = 1;
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void ProcessBatch(Context *ctx, bess::PacketBatch *batch) override {
+    RunNextModule(ctx, batch);
+  }
+};
+
+// Sends the batch to the port and frees what the port did not take, as
+// PortOut does.
+class BenchTx final : public Module {
+ public:
+  static const gate_idx_t kNumIGates = 1;
+  static const gate_idx_t kNumOGates = 0;
+
+  CommandResponse Init(const bess::pb::EmptyArg &) { return CommandSuccess(); }
+
+  void ProcessBatch(Context *, bess::PacketBatch *batch) override {
+    int sent = port->SendPackets(0, batch->pkts(), batch->cnt());
+    if (sent < batch->cnt()) {
+      bess::Packet::Free(batch->pkts() + sent, batch->cnt() - sent);
+    }
+  }
+};
+
+ADD_MODULE(BenchRx, "bench_rx", "receives packets from the benchmark port")
+ADD_MODULE(BenchSplit, "bench_split", "splits batches in two")
+ADD_MODULE(BenchForward, "bench_forward", "passes batches on")
+ADD_MODULE(BenchTx, "bench_tx", "sends packets to the benchmark port")
+
+Module *CreateBenchModule(const std::string &class_name,
+                          const std::string &name) {
+  const ModuleBuilder &builder =
+      ModuleBuilder::all_module_builders().find(class_name)->second;
+
+  google::protobuf::Any arg;
+  arg.PackFrom(bess::pb::EmptyArg());
+
+  pb_error_t perr;
+  Module *m = ModuleGraph::CreateModule(builder, name, arg, &perr);
+  CHECK(m) << name << ": " << perr.errmsg();
+  return m;
+}
+
+// The driver loop alone: receives a batch from the port and sends it back.
+void BM_PortRxTx(benchmark::State &state) {
+  bess::PacketBatch batch;
+  uint64_t pkts = 0;
+
+  while (state.KeepRunning()) {
+    batch.set_cnt(port->RecvPackets(0, batch.pkts(), kBurst));
+    int sent = port->SendPackets(0, batch.pkts(), batch.cnt());
+    if (sent < batch.cnt()) {
+      bess::Packet::Free(batch.pkts() + sent, batch.cnt() - sent);
+    }
+    pkts += batch.cnt();
+  }
+
+  state.SetItemsProcessed(pkts);
+  state.SetLabel(BurstLabel());
+}
+
+// Runs the task of the pipeline below, with state.range(0) forwarding
+// modules after the merge. Each run receives a batch, splits it into two
+// half batches with EmitPacket(), merges them again at the igate of fwd0,
+// passes the batch down the chain and sends it.
+//
+//   rx -> split -> fwd_a -> fwd0 -> fwd1 -> ... -> tx
+//              \-> fwd_b --/
+void BM_ModuleChain(benchmark::State &state) {
+  const int chain_len = state.range(0);
+
+  Module *rx = CreateBenchModule("BenchRx", "rx");
+  Module *split = CreateBenchModule("BenchSplit", "split");
+  Module *fwd_a = CreateBenchModule("BenchForward", "fwd_a");
+  Module *fwd_b = CreateBenchModule("BenchForward", "fwd_b");
+  std::vector<Module *> chain;
+  for (int i = 0; i < chain_len; i++) {
+    chain.push_back(
+        CreateBenchModule("BenchForward", "fwd" + std::to_string(i)));
+  }
+  Module *tx = CreateBenchModule("BenchTx", "tx");
+
+  CHECK_EQ(0, ModuleGraph::ConnectModules(rx, 0, split, 0));
+  CHECK_EQ(0, ModuleGraph::ConnectModules(split, 0, fwd_a, 0));
+  CHECK_EQ(0, ModuleGraph::ConnectModules(split, 1, fwd_b, 0));
+  CHECK_EQ(0, ModuleGraph::ConnectModules(fwd_a, 0, chain.front(), 0));
+  CHECK_EQ(0, ModuleGraph::ConnectModules(fwd_b, 0, chain.front(), 0));
+  for (int i = 1; i < chain_len; i++) {
+    CHECK_EQ(0, ModuleGraph::ConnectModules(chain[i - 1], 0, chain[i], 0));
+  }
+  CHECK_EQ(0, ModuleGraph::ConnectModules(chain.back(), 0, tx, 0));
+  ModuleGraph::UpdateTaskGraph();
+
+  const Task *task = rx->tasks()[0];
+  Context ctx = {};
+  ctx.task = const_cast<Task *>(task);
+  uint64_t pkts = 0;
+
+  while (state.KeepRunning()) {
+    pkts += (*task)(&ctx).packets;
+  }
+
+  state.SetItemsProcessed(pkts);
+  state.SetLabel(BurstLabel());
+
+  ModuleGraph::DestroyAllModules();
+}
+
+BENCHMARK(BM_PortRxTx);
+BENCHMARK(BM_ModuleChain)->Arg(1)->Arg(4)->Arg(16);
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+
+  if (geteuid() != 0) {
+    LOG(INFO) << "This benchmark requires root privileges. Skipping...";
+    return 0;
+  }
+
+  init_dpdk(argv[0], 1024, 0, true);
+  bess::init_mempool();
+  current_worker.SetNonWorker();
+
+  port = new PMDPort();
+  port->num_queues[PACKET_DIR_INC] = 1;
+  port->num_queues[PACKET_DIR_OUT] = 1;
+  port->queue_size[PACKET_DIR_INC] = port->DefaultIncQueueSize();
+  port->queue_size[PACKET_DIR_OUT] = port->DefaultOutQueueSize();
+
+  bess::pb::PMDPortArg arg;
+  arg.set_vdev("net_null0");
+  CommandResponse ret = port->Init(arg);
+  CHECK_EQ(0, ret.error().code()) << ret.error().errmsg();
+
+  benchmark::RunSpecifiedBenchmarks();
+
+  port->DeInit();
+  delete port;
+  return 0;
+}
@@ -31,13 +31,26 @@
 #ifndef BESS_PKTBATCH_H_
 #define BESS_PKTBATCH_H_
 
+#include <cstddef>
+#include <type_traits>
+
 #include "utils/copy.h"
 
+// Maximum number of packets in a batch. Set it at build time with
+// `make -C core MAX_BURST=<n>`. Plugins must be built with the same value.
+#ifndef BESS_MAX_BURST
+#define BESS_MAX_BURST 32
+#endif
+
 namespace bess {
 
 class Packet;
 
-class PacketBatch {
+// A batch of up to MaxBurst packets. Everything in BESS uses the PacketBatch
+// instantiation below; other sizes exist only so that benchmarks can compare
+// burst sizes within a single binary.
+template <size_t MaxBurst>
+class BasicPacketBatch {
  public:
   int cnt() const { return cnt_; }
   void set_cnt(int cnt) { cnt_ = cnt; }
@@ -52,7 +65,7 @@ class PacketBatch {
   // overrun the buffer by calling this. We are not adding bounds check because
   // we want maximum GOFAST.
   void add(Packet *pkt) { pkts_[cnt_++] = pkt; }
-  void add(PacketBatch *batch) {
+  void add(BasicPacketBatch *batch) {
     bess::utils::CopyInlined(pkts_ + cnt_, batch->pkts(),
                              batch->cnt() * sizeof(Packet *));
     cnt_ += batch->cnt();
@@ -62,18 +75,26 @@ class PacketBatch {
 
   bool full() { return (cnt_ == kMaxBurst); }
 
-  void Copy(const PacketBatch *src) {
+  void Copy(const BasicPacketBatch *src) {
     cnt_ = src->cnt_;
     bess::utils::CopyInlined(pkts_, src->pkts_, cnt_ * sizeof(Packet *));
   }
 
-  static const size_t kMaxBurst = 32;
+  static const size_t kMaxBurst = MaxBurst;
+
+  static_assert(MaxBurst > 0 && MaxBurst <= 256,
+                "Burst size must be in [1, 256]");
 
  private:
   int cnt_;
   Packet *pkts_[kMaxBurst];
 };
 
+template <size_t MaxBurst>
+const size_t BasicPacketBatch<MaxBurst>::kMaxBurst;
+
+using PacketBatch = BasicPacketBatch<BESS_MAX_BURST>;
+
 static_assert(std::is_pod<PacketBatch>::value, "PacketBatch is not a POD Type");
 
 }  // namespace bess
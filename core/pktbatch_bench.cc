@@ -0,0 +1,101 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmarks for PacketBatch operations at different burst sizes.
+
+#include "pktbatch.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+
+namespace {
+
+using bess::BasicPacketBatch;
+using bess::Packet;
+
+template <size_t Burst>
+void FillBatch(BasicPacketBatch<Burst> *batch, int cnt) {
+  batch->clear();
+  for (int i = 0; i < cnt; i++) {
+    batch->add(reinterpret_cast<Packet *>(static_cast<uintptr_t>(i + 1)));
+  }
+}
+
+// Copies a full batch, as Replicate and the port inc/out paths do.
+template <size_t Burst>
+void BM_BatchCopy(benchmark::State &state) {
+  BasicPacketBatch<Burst> src;
+  BasicPacketBatch<Burst> dst;
+  FillBatch(&src, Burst);
+
+  while (state.KeepRunning()) {
+    dst.Copy(&src);
+    benchmark::DoNotOptimize(dst);
+  }
+
+  state.SetItemsProcessed(state.iterations() * Burst);
+}
+
+// Merges batches of state.range(0) packets until the destination is full,
+// as Task::AddToRun does when several upstream gates feed one igate.
+template <size_t Burst>
+void BM_BatchMerge(benchmark::State &state) {
+  const int chunk = state.range(0);
+  BasicPacketBatch<Burst> src;
+  BasicPacketBatch<Burst> dst;
+  FillBatch(&src, chunk);
+  dst.clear();
+
+  size_t pkts = 0;
+  while (state.KeepRunning()) {
+    if (dst.cnt() + chunk > static_cast<int>(Burst)) {
+      dst.clear();
+    }
+    dst.add(&src);
+    benchmark::DoNotOptimize(dst);
+    pkts += chunk;
+  }
+
+  state.SetItemsProcessed(pkts);
+}
+
+BENCHMARK_TEMPLATE(BM_BatchCopy, 8);
+BENCHMARK_TEMPLATE(BM_BatchCopy, 32);
+BENCHMARK_TEMPLATE(BM_BatchCopy, 64);
+BENCHMARK_TEMPLATE(BM_BatchCopy, 128);
+
+BENCHMARK_TEMPLATE(BM_BatchMerge, 8)->Arg(1)->Arg(4)->Arg(8);
+BENCHMARK_TEMPLATE(BM_BatchMerge, 32)->Arg(1)->Arg(4)->Arg(8)->Arg(32);
+BENCHMARK_TEMPLATE(BM_BatchMerge, 64)->Arg(1)->Arg(4)->Arg(8)->Arg(32);
+BENCHMARK_TEMPLATE(BM_BatchMerge, 128)->Arg(1)->Arg(4)->Arg(8)->Arg(32);
+
+}  // namespace
+
+BENCHMARK_MAIN();
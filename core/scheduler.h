@@ -31,7 +31,9 @@
 #ifndef BESS_SCHEDULER_H_
 #define BESS_SCHEDULER_H_
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -39,6 +41,7 @@
 #include "module.h"
 #include "traffic_class.h"
 #include "utils/extended_priority_queue.h"
+#include "utils/timer_wheel.h"
 #include "worker.h"
 
 namespace bess {
@@ -51,7 +54,10 @@ struct sched_stats {
 
 class Scheduler;
 
-// Queue of blocked traffic classes ordered by time expiration.
+// Queue of blocked traffic classes ordered by time expiration. By default it is
+// a binary heap. UseTimerWheel() switches it to a hierarchical timer wheel,
+// with constant-time Add() and wakeups, at the cost of waking traffic classes
+// up to a tick (see kTimerWheelTickNs) late.
 class SchedWakeupQueue {
  public:
   struct WakeupComp {
@@ -61,22 +67,61 @@ class SchedWakeupQueue {
     }
   };
 
-  SchedWakeupQueue() : q_() {}
+  // Approximate length of a tick of the timer wheel
+  static const uint64_t kTimerWheelTickNs = 1000;
+
+  SchedWakeupQueue() : q_(), wheel_() {}
+
+  // Must be called while the queue is empty.
+  void UseTimerWheel() {
+    DCHECK(q_.empty());
+    int tick_shift = 0;
+    while ((tsc_hz >> (tick_shift + 1)) * kTimerWheelTickNs >= 1000000000ull) {
+      tick_shift++;
+    }
+    wheel_.reset(new utils::TimerWheel<TrafficClass *>(tick_shift, rdtsc()));
+  }
+
+  bool timer_wheel() const { return wheel_ != nullptr; }
 
   // Adds the given traffic class to those that are considered blocked.
-  void Add(TrafficClass *c) { q_.push(c); }
+  void Add(TrafficClass *c) {
+    if (wheel_) {
+      wheel_->Add(c->wakeup_time(), c);
+    } else {
+      q_.push(c);
+    }
+  }
 
   // Removes the given traffic class from the blocked list.
   void Remove(const TrafficClass *c) {
+    if (wheel_) {
+      if (c->wakeup_time()) {
+        wheel_->Remove(c->wakeup_time(), const_cast<TrafficClass *>(c));
+      }
+      return;
+    }
     const auto del_pred = [&](const TrafficClass *t) { return t == c; };
     q_.delete_single_element(del_pred);
   }
 
+  // Returns the TSC of the next wakeup (an earlier one with the timer wheel),
+  // or UINT64_MAX if the queue is empty.
+  uint64_t NextWakeupTime() const {
+    if (wheel_) {
+      return wheel_->NextExpiry();
+    }
+    return q_.empty() ? UINT64_MAX : q_.top()->wakeup_time();
+  }
+
  private:
   friend class Scheduler;
 
   // A priority queue of TrafficClasses to wake up ordered by time.
   bess::utils::extended_priority_queue<TrafficClass *, WakeupComp> q_;
+
+  // Used instead of q_ if set
+  std::unique_ptr<utils::TimerWheel<TrafficClass *>> wheel_;
 };
 
 // The non-instantiable base class for schedulers.  Implements common routines
@@ -89,7 +134,9 @@ class Scheduler {
         wakeup_queue_(),
         stats_(),
         checkpoint_(),
-        ns_per_cycle_(1e9 / tsc_hz) {}
+        ns_per_cycle_(1e9 / tsc_hz),
+        idle_since_(),
+        idle_pauses_() {}
 
   // TODO(barath): Do real cleanup, akin to sched_free() from the old impl.
   virtual ~Scheduler() {
@@ -104,6 +151,15 @@ class Scheduler {
 
   // Wakes up any TrafficClasses whose wakeup time has passed.
   void WakeTCs(uint64_t tsc) {
+    if (wakeup_queue_.wheel_) {
+      wakeup_queue_.wheel_->Expire(tsc, [](TrafficClass *c) {
+        uint64_t wakeup_time = c->wakeup_time();
+        c->wakeup_time_ = 0;
+        c->UnblockTowardsRoot(wakeup_time);
+      });
+      return;
+    }
+
     while (!wakeup_queue_.q_.empty()) {
       TrafficClass *c = wakeup_queue_.q_.top();
       uint64_t wakeup_time = c->wakeup_time();
@@ -199,6 +255,127 @@ class Scheduler {
   // towards the root.
   void UnblockTowardsRoot(TrafficClass *c, uint64_t tsc);
 
+  // Runs the task of 'leaf', which belongs to this scheduler. If other
+  // workers may steal the leaf, only one of them can run it at a time, and a
+  // leaf that had a full batch to process is offered to them.
+  struct task_result RunLeaf(Context *ctx, LeafTrafficClass *leaf) {
+    if (likely(!leaf->stealable())) {
+      return (*ctx->task)(ctx);
+    }
+
+    if (!leaf->TryLock()) {
+      // A peer is running it right now
+      return {.block = false, .packets = 0, .bits = 0};
+    }
+    auto ret = (*ctx->task)(ctx);
+    leaf->Unlock();
+
+    if (ret.packets == bess::PacketBatch::kMaxBurst && !leaf->queued()) {
+      leaf->set_queued(true);
+      if (!current_worker.steal_queue()->Push(leaf)) {
+        leaf->set_queued(false);
+      }
+    }
+    return ret;
+  }
+
+  // Runs a leaf offered by a peer on the same socket, if there is one.
+  // Accounting stays with the owner: the run is only counted in the stolen
+  // run statistics of the leaf and of this worker. Returns the # of packets
+  // processed.
+  uint32_t TrySteal(Context *ctx, uint64_t now) {
+    int wid = current_worker.wid();
+    int socket = current_worker.socket();
+
+    for (int i = 1; i < Worker::kMaxWorkers; i++) {
+      Worker *victim = workers[(wid + i) % Worker::kMaxWorkers];
+      if (!victim || victim->socket() != socket ||
+          victim->steal_queue()->Empty()) {
+        continue;
+      }
+
+      uint32_t packets = 0;
+      LeafTrafficClass *leaf;
+      if (victim->BeginSteal() && victim->steal_queue()->Steal(&leaf)) {
+        leaf->set_queued(false);
+        if (leaf->TryLock()) {
+          ctx->current_tsc = now;
+          ctx->current_ns = now * this->ns_per_cycle_;
+          current_worker.set_current_tsc(ctx->current_tsc);
+          current_worker.set_current_ns(ctx->current_ns);
+          ctx->task = leaf->task();
+
+          auto ret = (*ctx->task)(ctx);
+          packets = ret.packets;
+
+          leaf->AddStolenRun(packets);
+          leaf->Unlock();
+          current_worker.AddStolenRun(packets);
+        }
+      }
+      victim->EndSteal();
+
+      if (packets) {
+        return packets;
+      }
+    }
+    return 0;
+  }
+
+  // Called after each round that processed 'packets' packets (0 if nothing
+  // was scheduled), if the worker does anything special when idle. Once rounds
+  // have been coming up empty, it steals work from peers if enabled, then
+  // applies the idle policy: pause loops of growing length or, with
+  // IDLE_SLEEP and after a while, sleeping until the next blocked TC is due.
+  // Returns the TSC after waiting.
+  uint64_t HandleIdle(Context *ctx, uint32_t packets, uint64_t now) {
+    // Upper bound of a single pause loop, roughly a few microseconds
+    static const uint32_t kMaxIdlePauses = 128;
+
+    if (packets) {
+      idle_since_ = 0;
+      idle_pauses_ = 0;
+      return now;
+    }
+
+    if (current_worker.work_stealing()) {
+      if (TrySteal(ctx, now)) {
+        idle_since_ = 0;
+        idle_pauses_ = 0;
+        return rdtsc();
+      }
+      if (current_worker.idle_policy() == IDLE_SPIN) {
+        return now;
+      }
+    }
+
+    if (!idle_since_) {
+      idle_since_ = now;
+      return now;
+    }
+
+    if (current_worker.idle_policy() == IDLE_SLEEP &&
+        now - idle_since_ >= current_worker.idle_sleep_cycles()) {
+      uint64_t deadline = now + current_worker.idle_max_sleep_cycles();
+      deadline = std::min(deadline, wakeup_queue_.NextWakeupTime());
+      if (deadline > now) {
+        current_worker.IdleSleep(now, deadline);
+      }
+
+      // Poll every task again for a while before going back to sleep
+      now = rdtsc();
+      idle_since_ = now;
+      idle_pauses_ = 0;
+      return now;
+    }
+
+    idle_pauses_ = std::min(kMaxIdlePauses, idle_pauses_ * 2 + 1);
+    for (uint32_t i = 0; i < idle_pauses_; i++) {
+      __builtin_ia32_pause();
+    }
+    return rdtsc();
+  }
+
   TrafficClass *root_;
 
   RoundRobinTrafficClass *default_rr_class_;
@@ -211,6 +388,9 @@ class Scheduler {
 
   double ns_per_cycle_;
 
+  uint64_t idle_since_;   // TSC of the first of consecutive idle rounds
+  uint32_t idle_pauses_;  // length of the last pause loop
+
  private:
   DISALLOW_COPY_AND_ASSIGN(Scheduler);
 };
@@ -248,6 +428,7 @@ class DefaultScheduler : public Scheduler {
       }
 
       ScheduleOnce(&ctx);
+      current_worker.EndRound();
     }
   }
 
@@ -259,6 +440,7 @@ class DefaultScheduler : public Scheduler {
     LeafTrafficClass *leaf = Scheduler::Next(this->checkpoint_);
 
     uint64_t now;
+    uint32_t packets = 0;
     if (leaf) {
       ctx->current_tsc = this->checkpoint_;  // Tasks see updated tsc.
       ctx->current_ns = this->checkpoint_ * this->ns_per_cycle_;
@@ -268,7 +450,7 @@ class DefaultScheduler : public Scheduler {
       ctx->task = leaf->task();
 
       // Run.
-      auto ret = (*ctx->task)(ctx);
+      auto ret = this->RunLeaf(ctx, leaf);
 
       now = rdtsc();
 
@@ -277,6 +459,7 @@ class DefaultScheduler : public Scheduler {
       usage[RESOURCE_CYCLE] = now - this->checkpoint_;
       usage[RESOURCE_PACKET] = ret.packets;
       usage[RESOURCE_BIT] = ret.bits;
+      packets = ret.packets;
 
       current_worker.incr_silent_drops(ctx->silent_drops);
       // TODO(barath): Re-enable scheduler-wide stats accumulation.
@@ -285,17 +468,19 @@ class DefaultScheduler : public Scheduler {
       leaf->FinishAndAccountTowardsRoot(&this->wakeup_queue_, nullptr, usage,
                                         now);
     } else {
-      // TODO(barath): Ideally, we wouldn't spin in this case but rather take
-      // the fact that Next() returned nullptr as an indication that everything
-      // is blocked, so we could wait until something is added that unblocks us.
-      // We currently have no functionality to support such whole-scheduler
-      // blocking/unblocking.
+      // Everything is blocked. Unless the worker spins when idle,
+      // HandleIdle() below steals work or waits until the next blocked TC is
+      // due.
       ++this->stats_.cnt_idle;
 
       now = rdtsc();
       this->stats_.cycles_idle += (now - this->checkpoint_);
     }
 
+    if (unlikely(current_worker.handles_idle())) {
+      now = this->HandleIdle(ctx, packets, now);
+    }
+
     this->checkpoint_ = now;
   }
 };
@@ -334,6 +519,7 @@ class ExperimentalScheduler : public Scheduler {
       }
 
       ScheduleOnce(&ctx);
+      current_worker.EndRound();
     }
   }
 
@@ -345,6 +531,7 @@ class ExperimentalScheduler : public Scheduler {
     LeafTrafficClass *leaf = Scheduler::Next(this->checkpoint_);
 
     uint64_t now;
+    uint32_t packets = 0;
     if (leaf) {
       ctx->current_tsc = this->checkpoint_;  // Tasks see updated tsc.
       ctx->current_ns = this->checkpoint_ * this->ns_per_cycle_;
@@ -354,8 +541,9 @@ class ExperimentalScheduler : public Scheduler {
       ctx->task = leaf->task();
 
       // Run.
-      auto ret = (*ctx->task)(ctx);
+      auto ret = this->RunLeaf(ctx, leaf);
       now = rdtsc();
+      packets = ret.packets;
 
       if (ret.packets == 0 && ret.block) {
         constexpr uint64_t kMaxWait = 1ull << 20;
@@ -389,6 +577,10 @@ class ExperimentalScheduler : public Scheduler {
       this->stats_.cycles_idle += (now - this->checkpoint_);
     }
 
+    if (unlikely(current_worker.handles_idle())) {
+      now = this->HandleIdle(ctx, packets, now);
+    }
+
     this->checkpoint_ = now;
   }
 };
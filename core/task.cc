@@ -30,10 +30,14 @@
 
 #include "task.h"
 
+#include <algorithm>
 #include <unordered_set>
 
 #include "gate.h"
+#include "mem_alloc.h"
 #include "module.h"
+#include "utils/time.h"
+#include "worker.h"
 
 // Called when the leaf that owns this task is destroyed.
 void Task::Detach() {
@@ -45,48 +49,158 @@ void Task::Attach(bess::LeafTrafficClass *c) {
   c_ = c;
 }
 
+void Task::ReservePacketBatches(uint32_t cnt, int socket) {
+  if (socket != pbatch_socket_) {
+    FreePacketBatchChunks();
+    pbatch_socket_ = socket;
+  }
+
+  size_t chunks = (std::max(cnt, 1u) + kPacketBatchChunkSize - 1) /
+                  kPacketBatchChunkSize;
+  while (pbatch_chunks_.size() < chunks) {
+    AddPacketBatchChunk();
+  }
+
+  ClearPacketBatch();
+}
+
+void Task::AddPacketBatchChunk() const {
+  void *chunk = mem_alloc_ex(sizeof(bess::PacketBatch) * kPacketBatchChunkSize,
+                             alignof(bess::PacketBatch), pbatch_socket_);
+  CHECK(chunk) << "Failed to allocate packet batches for a task";
+  pbatch_chunks_.push_back(static_cast<bess::PacketBatch *>(chunk));
+}
+
+void Task::FreePacketBatchChunks() {
+  for (bess::PacketBatch *chunk : pbatch_chunks_) {
+    mem_free(chunk);
+  }
+  pbatch_chunks_.clear();
+}
+
+// Called on the data path when the current chunk runs out, which should only
+// happen until the arena has grown to the high-water mark of the task.
+void Task::NextPacketBatchChunk() const {
+  pbatch_chunk_++;
+  if (pbatch_chunk_ == pbatch_chunks_.size()) {
+    AddPacketBatchChunk();
+    pbatch_grows_++;
+  }
+  pbatch_next_ = pbatch_chunks_[pbatch_chunk_];
+  pbatch_end_ = pbatch_next_ + kPacketBatchChunkSize;
+}
+
+void Task::CountCoalescingInput(bess::IGate *igate, int cnt) const {
+  bess::IGate::CoalesceStats *stats =
+      igate->mutable_coalesce_stats(current_worker.wid());
+  stats->in_batches++;
+  stats->in_packets += cnt;
+}
+
+void Task::CountCoalescedBatch(bess::IGate *igate,
+                               const bess::PacketBatch *batch) const {
+  bess::IGate::CoalesceStats *stats =
+      igate->mutable_coalesce_stats(current_worker.wid());
+  stats->out_batches++;
+  stats->out_packets += batch->cnt();
+}
+
+void Task::RunGate(Context *ctx, bess::IGate *igate, bess::PacketBatch *batch,
+                   bool profile) const {
+  ctx->current_igate = igate->gate_idx();
+
+  for (auto &hook : igate->hooks()) {
+    hook->ProcessBatch(batch);
+  }
+
+  Module *m = igate->module();
+  if (unlikely(profile)) {
+    int cnt = batch->cnt();
+    uint64_t start = rdtsc();
+    m->ProcessBatch(ctx, batch);
+    m->ProcessOGates(ctx);
+
+    task_profile &p = gate_profile_[igate->task_igate_index()];
+    p.cycles += rdtsc() - start;
+    p.batches++;
+    p.packets += cnt;
+    return;
+  }
+
+  m->ProcessBatch(ctx, batch);  // process module
+  m->ProcessOGates(ctx);        // process ogates
+}
+
 struct task_result Task::operator()(Context *ctx) const {
   bess::PacketBatch init_batch;
   ClearPacketBatch();
 
+  const bool profile = current_worker.profiling();
+  uint64_t start = profile ? rdtsc() : 0;
+
   // Start from the first module (task module)
   struct task_result result = module_->RunTask(ctx, &init_batch, arg_);
-  // next_gate_: Continuously run if modules are chained
-  // igates_to_run_ : If next module connection is not chained (merged),
-  // check priority to choose which module run next
-  while (next_gate_ || !igates_to_run_.empty()) {
-    bess::IGate *igate;
-    bess::PacketBatch *batch;
 
-    // choose igate and batch to run next
+  if (unlikely(profile)) {
+    task_profile_.cycles += rdtsc() - start;
+    task_profile_.batches++;
+    task_profile_.packets += result.packets;
+  }
+
+  // next_gate_: Continuously run if modules are chained
+  // run_bitmap_: If next module connection is not chained (merged),
+  // run igates in priority order
+  while (true) {
     if (next_gate_) {
-      igate = next_gate_;
-      batch = next_batch_;
+      bess::IGate *igate = next_gate_;
+      bess::PacketBatch *batch = next_batch_;
       next_gate_ = nullptr;
       next_batch_ = nullptr;
-    } else {
-      auto item = igates_to_run_.top();
-      igates_to_run_.pop();
 
-      igate = item.first;
-      batch = item.second;
-
-      set_gate_batch(igate, nullptr);
+      RunGate(ctx, igate, batch, profile);
+      continue;
     }
 
-    ctx->current_igate = igate->gate_idx();
+    uint32_t idx;
+    if (!NextGateToRun(&idx)) {
+      break;
+    }
 
-    for (auto &hook : igate->hooks()) {
-      hook->ProcessBatch(batch);
+    RunSlot &slot = run_slots_[idx];
+    bess::IGate *igate = slot.igate;
+    bess::PacketBatch *batch = get_gate_batch(igate);
+    uint32_t spill = slot.spill_head;
+
+    slot.spill_head = 0;
+    slot.spill_tail = 0;
+    set_gate_batch(igate, nullptr);
+
+    // Batches superseded as merge target are older, so they run first.
+    while (spill) {
+      const SpilledBatch &s = spilled_batches_[spill - 1];
+      bess::PacketBatch *spilled_batch = s.batch;
+      spill = s.next;
+      if (unlikely(igate->coalesce())) {
+        CountCoalescedBatch(igate, spilled_batch);
+      }
+      RunGate(ctx, igate, spilled_batch, profile);
     }
 
-    Module *m = igate->module();
-    m->ProcessBatch(ctx, batch);  // process module
-    m->ProcessOGates(ctx);        // process ogates
+    if (unlikely(igate->coalesce())) {
+      CountCoalescedBatch(igate, batch);
+    }
+    RunGate(ctx, igate, batch, profile);
   }
 
+  spilled_batches_.clear();
   deadend(ctx, &dead_batch_);
 
+  // Every batch handed out by the arena is reclaimed by the next round, so no
+  // gate may still refer to one.
+  DCHECK(std::all_of(gate_batch_.begin(), gate_batch_.end(),
+                     [](const bess::PacketBatch *b) { return b == nullptr; }))
+      << "Packet batch leaked by a gate of task " << module_->name();
+
   return result;
 }
 
@@ -31,12 +31,13 @@
 #ifndef BESS_TASK_H_
 #define BESS_TASK_H_
 
-#include <queue>
+#include <algorithm>
+#include <cstring>
 #include <string>
+#include <vector>
 
 #include "gate.h"
 #include "pktbatch.h"
-#include "utils/extended_priority_queue.h"
 
 struct task_result {
   bool block;
@@ -44,18 +45,22 @@ struct task_result {
   uint64_t bits;
 };
 
+// Resources used by a task to process packets, see Task::GetGateProfile().
+struct task_profile {
+  uint64_t cycles;
+  uint64_t batches;
+  uint64_t packets;
+};
+
 typedef uint16_t gate_idx_t;
 typedef uint16_t task_id_t;
 typedef uint64_t placement_constraint;
 
-#define MAX_PBATCH_CNT 256
-
 class Module;
 struct Context;
 
 namespace bess {
 class LeafTrafficClass;
-class PacketBatch;
 }  // namespace bess
 
 // Functor used by a leaf in a Worker's Scheduler to run a task in a module.
@@ -66,18 +71,28 @@ class Task {
   void *arg_;                  // Auxiliary value passed to Module::RunTask().
   bess::LeafTrafficClass *c_;  // Leaf TC associated with this task.
 
-  struct GateBatchGreater {
-    bool operator()(
-        const std::pair<bess::IGate *, bess::PacketBatch *> &left,
-        const std::pair<bess::IGate *, bess::PacketBatch *> &right) const {
-      return left.first->priority() > right.first->priority();
-    }
+  // Per-igate entry of the run schedule, indexed by task-local igate index.
+  struct RunSlot {
+    bess::IGate *igate;
+    uint32_t spill_head;  // 1-based index into spilled_batches_, 0 if none
+    uint32_t spill_tail;
   };
 
-  // XXX Tasks needs to be non-const in workers/modules
-  mutable bess::utils::extended_priority_queue<
-      std::pair<bess::IGate *, bess::PacketBatch *>, GateBatchGreater>
-      igates_to_run_;  // A queue for IGates to run
+  // A batch that could not be merged into the pending batch of its igate and
+  // was superseded by a newer one. Linked in FIFO order from RunSlot.
+  struct SpilledBatch {
+    bess::PacketBatch *batch;
+    uint32_t next;  // 1-based index of the next spilled batch, 0 if last
+  };
+
+  // Run schedule for IGates that are not chained. ModuleGraph assigns
+  // task-local igate indices in priority order, so sweeping the bitmap from
+  // its lowest set bit runs IGates in the same order a priority queue would,
+  // without paying O(log n) per batch.
+  mutable std::vector<uint64_t> run_bitmap_;  // bit set: igate has a batch
+  mutable size_t run_cursor_;  // no bit is set in words below this index
+  mutable std::vector<RunSlot> run_slots_;
+  mutable std::vector<SpilledBatch> spilled_batches_;
 
   mutable bess::IGate *next_gate_;  // Cache next module to run without merging
   // Optimization for chain
@@ -87,12 +102,124 @@ class Task {
   mutable bess::PacketBatch
       dead_batch_;  // A packet batch for storing packets to free
 
-  // Simple packet batch pool
-  mutable int pbatch_idx_;
-  mutable bess::PacketBatch *pbatch_;
-
+  // Packet batch arena. Batches are handed out in order and reclaimed all
+  // at once when the next round starts. Memory is kept in fixed-size chunks
+  // so that growing the arena never moves batches that are in use.
+  mutable std::vector<bess::PacketBatch *> pbatch_chunks_;
+  mutable size_t pbatch_chunk_;             // index of the chunk in use
+  mutable bess::PacketBatch *pbatch_next_;  // next batch to hand out
+  mutable bess::PacketBatch *pbatch_end_;   // end of the chunk in use
+  mutable uint32_t pbatch_cnt_;         // # of batches handed out this round
+  mutable uint32_t pbatch_high_water_;  // max. pbatch_cnt_ over all rounds
+  mutable uint64_t pbatch_grows_;       // # of chunks allocated on the fly
+  int pbatch_socket_;                   // NUMA node of the chunks
+
+  // Pending batch of each gate, indexed by task-local gate index
   mutable std::vector<bess::PacketBatch *> gate_batch_;
 
+  // Profile of the batches this task ran through each igate (indexed by
+  // task-local igate index) and of RunTask() of the task module. Only the
+  // worker running the task updates them; resetting a profile takes a
+  // snapshot instead of clearing the counters, so no synchronization is
+  // needed.
+  mutable std::vector<task_profile> gate_profile_;
+  mutable std::vector<task_profile> gate_profile_base_;
+  mutable task_profile task_profile_;
+  mutable task_profile task_profile_base_;
+
+  void MarkToRun(bess::IGate *ig) const {
+    uint32_t idx = ig->task_igate_index();
+    size_t word = idx / 64;
+    run_bitmap_[word] |= 1ull << (idx % 64);
+    if (word < run_cursor_) {
+      run_cursor_ = word;
+    }
+  }
+
+  // Keeps 'batch' scheduled on 'ig' after a newer batch replaces it as the
+  // merge target of the igate.
+  void SpillGateBatch(bess::IGate *ig, bess::PacketBatch *batch) const {
+    RunSlot &slot = run_slots_[ig->task_igate_index()];
+    spilled_batches_.push_back({batch, 0});
+    uint32_t pos = spilled_batches_.size();
+    if (slot.spill_tail) {
+      spilled_batches_[slot.spill_tail - 1].next = pos;
+    } else {
+      slot.spill_head = pos;
+    }
+    slot.spill_tail = pos;
+  }
+
+  // AddToRun() for igates in coalescing mode. Merges as much of 'batch' as
+  // fits into 'ibatch', the pending batch of 'ig', and schedules the rest of
+  // 'batch' as the new pending batch.
+  //
+  // An empty 'batch' is the open batch of an ogate that Module::EmitPacket()
+  // is about to fill, so it always becomes the pending batch as is. 'ibatch'
+  // may be such an open batch too: topping it up is safe, since the ogate
+  // appends after whatever the batch holds, and moves on once it is full.
+  void CoalesceToRun(bess::IGate *ig, bess::PacketBatch *ibatch,
+                     bess::PacketBatch *batch) const {
+    int cnt = batch->cnt();
+    if (cnt > 0) {
+      CountCoalescingInput(ig, cnt);
+    }
+
+    if (cnt > 0 && ibatch && !ibatch->full()) {
+      int room = bess::PacketBatch::kMaxBurst - ibatch->cnt();
+      if (cnt <= room) {
+        ibatch->add(batch);
+        return;
+      }
+
+      // Top up the pending batch and carry the remainder over
+      bess::utils::CopyInlined(ibatch->pkts() + ibatch->cnt(), batch->pkts(),
+                               room * sizeof(bess::Packet *));
+      ibatch->set_cnt(bess::PacketBatch::kMaxBurst);
+      memmove(batch->pkts(), batch->pkts() + room,
+              (cnt - room) * sizeof(bess::Packet *));
+      batch->set_cnt(cnt - room);
+    }
+
+    if (ibatch) {
+      SpillGateBatch(ig, ibatch);
+    }
+    set_gate_batch(ig, batch);
+    MarkToRun(ig);
+  }
+
+  // Returns the task-local index of the highest-priority igate with pending
+  // batches and clears its bit, or returns false if there is none.
+  bool NextGateToRun(uint32_t *idx) const {
+    const size_t words = run_bitmap_.size();
+    while (run_cursor_ < words) {
+      uint64_t bits = run_bitmap_[run_cursor_];
+      if (bits) {
+        int bit = __builtin_ctzll(bits);
+        run_bitmap_[run_cursor_] = bits & (bits - 1);
+        *idx = run_cursor_ * 64 + bit;
+        return true;
+      }
+      run_cursor_++;
+    }
+    return false;
+  }
+
+  void RunGate(Context *ctx, bess::IGate *igate, bess::PacketBatch *batch,
+               bool profile) const;
+
+  void CountCoalescingInput(bess::IGate *igate, int cnt) const;
+
+  void CountCoalescedBatch(bess::IGate *igate,
+                           const bess::PacketBatch *batch) const;
+
+  // Moves the arena to the next chunk, allocating one if needed.
+  void NextPacketBatchChunk() const;
+
+  void AddPacketBatchChunk() const;
+
+  void FreePacketBatchChunks();
+
  public:
   // When this task is scheduled it will execute 'm' with 'arg'.  When the
   // associated leaf is created/destroyed, 'module_task' will be updated.
@@ -100,17 +227,34 @@ class Task {
       : module_(m),
         arg_(arg),
         c_(),
-        igates_to_run_(),
+        run_bitmap_(),
+        run_cursor_(),
+        run_slots_(),
+        spilled_batches_(),
         next_gate_(),
         next_batch_(),
-        pbatch_idx_(),
-        pbatch_(
-            new bess::PacketBatch[MAX_PBATCH_CNT]),  // XXX Need to adjust size
-        gate_batch_(std::vector<bess::PacketBatch *>(64, 0)) {
+        pbatch_chunks_(),
+        pbatch_chunk_(),
+        pbatch_next_(),
+        pbatch_end_(),
+        pbatch_cnt_(),
+        pbatch_high_water_(),
+        pbatch_grows_(),
+        pbatch_socket_(-1),
+        gate_batch_(std::vector<bess::PacketBatch *>(64, 0)),
+        gate_profile_(),
+        gate_profile_base_(),
+        task_profile_(),
+        task_profile_base_() {
     dead_batch_.clear();
+    spilled_batches_.reserve(64);
+    ReservePacketBatches(kPacketBatchChunkSize, pbatch_socket_);
   }
 
-  ~Task() { delete[] pbatch_; }
+  ~Task() { FreePacketBatchChunks(); }
+
+  // # of batches in each chunk of the packet batch arena
+  static const uint32_t kPacketBatchChunkSize = 16;
 
   // Called when the leaf that owns this task is destroyed.
   void Detach();
@@ -125,48 +269,122 @@ class Task {
       next_batch_ = batch;
     } else {
       bess::PacketBatch *ibatch = get_gate_batch(ig);
-      if (ibatch && (static_cast<size_t>(ibatch->cnt() + batch->cnt()) <=
-                     bess::PacketBatch::kMaxBurst)) {
+      if (unlikely(ig->coalesce())) {
+        CoalesceToRun(ig, ibatch, batch);
+      } else if (ibatch && !ibatch->full() &&
+                 (static_cast<size_t>(ibatch->cnt() + batch->cnt()) <=
+                  bess::PacketBatch::kMaxBurst)) {
         // merge two batches
         ibatch->add(batch);
       } else {
         // set the input as new batch
+        if (ibatch) {
+          SpillGateBatch(ig, ibatch);
+        }
         set_gate_batch(ig, batch);
-        igates_to_run_.emplace(ig, batch);
+        MarkToRun(ig);
       }
     }
   }
 
-  // Do not track used/unsued for efficiency
+  // Batches are valid until the end of the current round. Do not track
+  // used/unused batches individually for efficiency.
   bess::PacketBatch *AllocPacketBatch() const {
-    DCHECK_LT(pbatch_idx_, MAX_PBATCH_CNT);
-    bess::PacketBatch *batch = &pbatch_[pbatch_idx_++];
+    if (unlikely(pbatch_next_ == pbatch_end_)) {
+      NextPacketBatchChunk();
+    }
+    pbatch_cnt_++;
+    bess::PacketBatch *batch = pbatch_next_++;
     batch->clear();
     return batch;
   }
 
-  void UpdatePerGateBatch(uint32_t gate_cnt) const {
-    if (gate_batch_.size() < gate_cnt) {
-      gate_batch_.resize(gate_cnt, nullptr);
+  // Makes room for at least 'cnt' batches per round on NUMA node 'socket'
+  // (-1 for any). Must not be called while the task is running.
+  void ReservePacketBatches(uint32_t cnt, int socket);
+
+  // Resize per-gate tables to the gates reachable from this task: 'igates'
+  // (with their task-local igate indices) and gates with task-local indices
+  // in [0, gate_cnt). Since indices may have changed, gate profiles are
+  // reset. Must not be called while the task is running.
+  void UpdatePerGateBatch(const std::vector<bess::IGate *> &igates,
+                          uint32_t gate_cnt) const {
+    uint32_t igate_cnt = 0;
+    for (const bess::IGate *ig : igates) {
+      igate_cnt = std::max(igate_cnt, ig->task_igate_index() + 1);
     }
+
+    gate_profile_.assign(igate_cnt, task_profile());
+    gate_profile_base_.assign(igate_cnt, task_profile());
+
+    gate_batch_.assign(gate_cnt, nullptr);
+
+    run_slots_.assign(igate_cnt, RunSlot());
+    for (bess::IGate *ig : igates) {
+      run_slots_[ig->task_igate_index()].igate = ig;
+    }
+    run_bitmap_.assign((igate_cnt + 63) / 64, 0);
+    run_cursor_ = run_bitmap_.size();
+  }
+
+  void ClearPacketBatch() const {
+    if (pbatch_cnt_ > pbatch_high_water_) {
+      pbatch_high_water_ = pbatch_cnt_;
+    }
+    pbatch_cnt_ = 0;
+    pbatch_chunk_ = 0;
+    pbatch_next_ = pbatch_chunks_[0];
+    pbatch_end_ = pbatch_next_ + kPacketBatchChunkSize;
   }
 
-  void ClearPacketBatch() const { pbatch_idx_ = 0; }
+  // Packet batch arena statistics
+  uint32_t pbatch_capacity() const {
+    return pbatch_chunks_.size() * kPacketBatchChunkSize;
+  }
+  uint32_t pbatch_high_water() const { return pbatch_high_water_; }
+  uint64_t pbatch_grows() const { return pbatch_grows_; }
 
   Module *module() const { return module_; }
 
   bess::PacketBatch *dead_batch() const { return &dead_batch_; }
 
   bess::PacketBatch *get_gate_batch(bess::Gate *gate) const {
-    return gate_batch_[gate->global_gate_index()];
+    return gate_batch_[gate->task_gate_index()];
   }
 
   void set_gate_batch(bess::Gate *gate, bess::PacketBatch *batch) const {
-    gate_batch_[gate->global_gate_index()] = batch;
+    gate_batch_[gate->task_gate_index()] = batch;
   }
 
   bess::LeafTrafficClass *GetTC() const { return c_; }
 
+  // Returns what this task spent on batches through 'igate' since the last
+  // ResetProfile().
+  task_profile GetGateProfile(const bess::IGate *igate) const {
+    uint32_t igate_idx = igate->task_igate_index();
+    if (igate_idx >= gate_profile_.size() ||
+        run_slots_[igate_idx].igate != igate) {
+      return task_profile();  // not reachable from this task
+    }
+    const task_profile &cur = gate_profile_[igate_idx];
+    const task_profile &base = gate_profile_base_[igate_idx];
+    return {cur.cycles - base.cycles, cur.batches - base.batches,
+            cur.packets - base.packets};
+  }
+
+  // Returns what RunTask() of the task module spent since the last
+  // ResetProfile().
+  task_profile GetTaskProfile() const {
+    return {task_profile_.cycles - task_profile_base_.cycles,
+            task_profile_.batches - task_profile_base_.batches,
+            task_profile_.packets - task_profile_base_.packets};
+  }
+
+  void ResetProfile() const {
+    gate_profile_base_ = gate_profile_;
+    task_profile_base_ = task_profile_;
+  }
+
   struct task_result operator()(Context *ctx) const;
 
   // Compute constraints for the pipeline starting at this task.
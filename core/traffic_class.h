@@ -30,6 +30,7 @@
 #ifndef BESS_TRAFFIC_CLASS_H_
 #define BESS_TRAFFIC_CLASS_H_
 
+#include <atomic>
 #include <cstdint>
 #include <deque>
 #include <functional>
@@ -578,7 +579,12 @@ class LeafTrafficClass final : public TrafficClass {
   explicit LeafTrafficClass(const std::string &name, Task *task)
       : TrafficClass(name, POLICY_LEAF, false),
         task_(task),
-        wait_cycles_(kInitialWaitCycles) {
+        wait_cycles_(kInitialWaitCycles),
+        stealable_(),
+        running_(false),
+        queued_(false),
+        stolen_runs_(),
+        stolen_packets_() {
     task_->Attach(this);
   }
 
@@ -616,10 +622,44 @@ class LeafTrafficClass final : public TrafficClass {
     parent_->FinishAndAccountTowardsRoot(wakeup_queue, this, usage, tsc);
   }
 
+  // If true, idle workers on the same socket as the owner of this class may
+  // run its task, one run at a time (see Scheduler::TrySteal()). The pipeline
+  // of the task then has to be safe to run on several workers.
+  bool stealable() const { return stealable_; }
+  void set_stealable(bool stealable) { stealable_ = stealable; }
+
+  // Serializes runs of a stealable task between its owner and thieves.
+  bool TryLock() {
+    return !running_.load(std::memory_order_relaxed) &&
+           !running_.exchange(true, std::memory_order_acquire);
+  }
+  void Unlock() { running_.store(false, std::memory_order_release); }
+
+  // True while the class is in the steal queue of its worker
+  bool queued() const { return queued_.load(std::memory_order_relaxed); }
+  void set_queued(bool queued) {
+    queued_.store(queued, std::memory_order_relaxed);
+  }
+
+  // Runs of the task by workers other than its owner. Only updated while
+  // holding the lock.
+  uint64_t stolen_runs() const { return stolen_runs_; }
+  uint64_t stolen_packets() const { return stolen_packets_; }
+  void AddStolenRun(uint64_t packets) {
+    stolen_runs_++;
+    stolen_packets_ += packets;
+  }
+
  private:
   Task *task_;
 
   uint64_t wait_cycles_;
+
+  bool stealable_;
+  std::atomic<bool> running_;
+  std::atomic<bool> queued_;
+  uint64_t stolen_runs_;
+  uint64_t stolen_packets_;
 };
 
 class PriorityChildArgs : public TCChildArgs {
@@ -58,6 +58,19 @@ class DummyModule : public Module {
   return {.block = false, .packets = 0, .bits = 0};
 }
 
+// Pretends to process a full batch of packets on every run.
+class BurstModule : public Module {
+ public:
+  struct task_result RunTask(Context *, bess::PacketBatch *,
+                             void *arg) override;
+};
+
+[[gnu::noinline]] struct task_result BurstModule::RunTask(Context *,
+                                                          bess::PacketBatch *,
+                                                          void *) {
+  return {.block = false, .packets = bess::PacketBatch::kMaxBurst, .bits = 0};
+}
+
 // Performs TC Scheduler init/deinit before/after each test.
 // Sets up a tree for weighted fair benchmarking.
 class TCWeightedFair : public benchmark::Fixture {
@@ -232,6 +245,43 @@ BENCHMARK_REGISTER_F(TCRoundRobin, TCScheduleOnce)
     ->Args({4 << 14})
     ->Complexity();
 
+// Many rate-limited leaves under a round-robin root, as with per-tenant rate
+// limits. Each leaf is limited to kRate packets/s, so almost all of them are
+// blocked in the wakeup queue at any time. items/s is packets/s.
+template <bool TimerWheel>
+void TCScheduleOnceRateLimited(benchmark::State &state) {
+  const uint64_t kRate = 10000;
+  int num_classes = state.range(0);
+  BurstModule dummy;
+
+  TrafficClass *root = CT("rr", {ROUND_ROBIN}, {});
+  DefaultScheduler s(root);
+  if (TimerWheel) {
+    s.wakeup_queue().UseTimerWheel();
+  }
+  RoundRobinTrafficClass *rr =
+      static_cast<RoundRobinTrafficClass *>(TrafficClassBuilder::Find("rr"));
+
+  for (int i = 0; i < num_classes; i++) {
+    std::string name("class_" + std::to_string(i));
+    TrafficClass *c =
+        CT("limit_" + name, {RATE_LIMIT, RESOURCE_PACKET, kRate, 0},
+           {CT(name, {LEAF, new Task(&dummy, nullptr)})});
+    CHECK(rr->AddChild(c));
+  }
+
+  while (state.KeepRunning()) {
+    Context ctx = {};
+    s.ScheduleOnce(&ctx);
+  }
+  state.SetItemsProcessed(rr->stats().usage[RESOURCE_PACKET]);
+
+  TrafficClassBuilder::ClearAll();
+}
+
+BENCHMARK_TEMPLATE(TCScheduleOnceRateLimited, false)->Arg(100)->Arg(10000);
+BENCHMARK_TEMPLATE(TCScheduleOnceRateLimited, true)->Arg(100)->Arg(10000);
+
 }  // namespace
 
 BENCHMARK_MAIN();
@@ -550,13 +550,16 @@ TEST(DefaultScheduleOnce, LeavesWeightedFairAndRoundRobin) {
 }
 
 // Tests that rate limit nodes get properly blocked and unblocked.
-TEST(RateLimit, BasicBlockUnblock) {
+static void TestBasicBlockUnblock(bool timer_wheel) {
   DefaultScheduler s(
       CT("root", {ROUND_ROBIN},
          {{CT("limit_1", {RATE_LIMIT, RESOURCE_COUNT, 1, 0},
               {CT("leaf_1", {LEAF, new Task(nullptr, nullptr)})})},
           {CT("limit_2", {RATE_LIMIT, RESOURCE_COUNT, 1, 0},
               {CT("leaf_2", {LEAF, new Task(nullptr, nullptr)})})}}));
+  if (timer_wheel) {
+    s.wakeup_queue().UseTimerWheel();
+  }
   ASSERT_EQ(5, TrafficClassBuilder::Find("root")->Size());
   RoundRobinTrafficClass *rr =
       static_cast<RoundRobinTrafficClass *>(TrafficClassBuilder::Find("root"));
@@ -624,4 +627,12 @@ TEST(RateLimit, BasicBlockUnblock) {
   TrafficClassBuilder::ClearAll();
 }
 
+TEST(RateLimit, BasicBlockUnblock) {
+  TestBasicBlockUnblock(false);
+}
+
+TEST(RateLimit, BasicBlockUnblockTimerWheel) {
+  TestBasicBlockUnblock(true);
+}
+
 }  // namespace bess
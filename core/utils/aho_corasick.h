@@ -0,0 +1,292 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef BESS_UTILS_AHO_CORASICK_H_
+#define BESS_UTILS_AHO_CORASICK_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace bess {
+namespace utils {
+
+// A multi-pattern string matcher, based on the Aho-Corasick automaton
+// (Aho and Corasick, "Efficient String Matching: An Aid to Bibliographic
+// Search", CACM 1975). It finds whether any of the patterns occurs in a text,
+// in a single pass over the text regardless of the number of patterns.
+//
+// The trie of the patterns is laid out as a double array (Aoe, "An Efficient
+// Digital Search Algorithm by Using a Double-Array Structure", 1989): the
+// child of state s with label c is at base[s] + c, if check of that slot is
+// s. This takes a few bytes per state, and a transition costs two loads from
+// one flat array, instead of a pointer chase. A missing transition follows
+// the failure link of the state, which is an amortized O(1) per byte.
+//
+// The matcher is immutable once built, so it can be shared by readers.
+class AhoCorasick {
+ public:
+  typedef uint32_t State;
+
+  // Where matching starts
+  static const State kStart = 0;
+
+  // Once a pattern is found, matching stays in this state
+  static const State kMatched = UINT32_MAX;
+
+  // Builds a matcher of the patterns. Empty patterns are ignored.
+  explicit AhoCorasick(std::vector<std::string> patterns)
+      : nodes_(1 + kAlphabet), num_states_(1), used_(),
+        single_from_(1),
+        multi_from_(1) {
+    std::sort(patterns.begin(), patterns.end());
+    patterns.erase(std::unique(patterns.begin(), patterns.end()),
+                   patterns.end());
+    Build(patterns);
+    used_.clear();
+    used_.shrink_to_fit();
+  }
+
+  // Returns the state after reading c from state s
+  State Next(State s, uint8_t c) const {
+    if (s == kMatched) {
+      return kMatched;
+    }
+
+    while (true) {
+      const State t = nodes_[s].base + c;
+      if (nodes_[t].check == s) {
+        return nodes_[t].match ? kMatched : t;
+      }
+      if (s == kStart) {
+        return kStart;
+      }
+      s = nodes_[s].fail;
+    }
+  }
+
+  // Returns the state after reading len bytes of buf from state s
+  State Feed(State s, const char *buf, size_t len) const {
+    for (size_t i = 0; i < len && s != kMatched; i++) {
+      s = Next(s, buf[i]);
+    }
+    return s;
+  }
+
+  // Returns true if any of the patterns occurs in text
+  bool Contains(const std::string &text) const {
+    return Feed(kStart, text.data(), text.size()) == kMatched;
+  }
+
+  size_t num_states() const { return num_states_; }
+
+  // Bytes taken by the automaton
+  size_t memory() const { return nodes_.size() * sizeof(Node); }
+
+ private:
+  static const size_t kAlphabet = 256;
+  static const State kNone = UINT32_MAX;
+
+  // Failed slots in FindBase() until later searches skip them
+  static const size_t kMaxTries = 16;
+
+  struct Node {
+    State base;   // children are at base + label
+    State check;  // parent state, or kNone if the slot is free
+    State fail;   // longest proper suffix that is also a state
+    bool match;   // a pattern ends here, possibly as a suffix
+  };
+
+  // Patterns [lo, hi) in sorted order share the first 'depth' bytes, which
+  // spell the state
+  struct Pending {
+    State state;
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t depth;
+  };
+
+  State Goto(State s, uint8_t c) const {
+    const State t = nodes_[s].base + c;
+    return nodes_[t].check == s ? t : kNone;
+  }
+
+  bool IsUsed(size_t i) const { return used_[i / 64] >> (i % 64) & 1; }
+
+  void SetUsed(size_t i) { used_[i / 64] |= 1ull << (i % 64); }
+
+  // Returns the first free slot at or after i
+  size_t NextFree(size_t i) const {
+    size_t w = i / 64;
+    uint64_t free_bits = ~used_[w] & (~0ull << (i % 64));
+    while (free_bits == 0) {
+      free_bits = ~used_[++w];
+    }
+    return w * 64 + __builtin_ctzll(free_bits);
+  }
+
+  // Finds a base such that all of base + labels are free slots, and makes
+  // sure that any base + c is within nodes_. A state with a single child
+  // takes the first free slot, and all slots before it are in use from then
+  // on. Others may need to skip over crowded slots; where that took long,
+  // later searches start past them.
+  State FindBase(const std::vector<uint8_t> &labels) {
+    const bool single = labels.size() == 1;
+    size_t &from = single ? single_from_ : multi_from_;
+    size_t tries = 0;
+
+    const size_t start =
+        std::max({from, single_from_, static_cast<size_t>(labels[0])});
+
+    for (size_t pos = NextFree(start);; pos = NextFree(pos + 1)) {
+      const size_t base = pos - labels[0];
+      Reserve(base + kAlphabet);
+
+      bool fits = true;
+      for (size_t k = 1; k < labels.size() && fits; k++) {
+        fits = !IsUsed(base + labels[k]);
+      }
+
+      if (fits) {
+        if (single || tries > kMaxTries) {
+          from = pos;
+        }
+        return base;
+      }
+      tries++;
+    }
+  }
+
+  // Grows nodes_ (and used_) to have at least n + 1 slots
+  void Reserve(size_t n) {
+    if (n < nodes_.size()) {
+      return;
+    }
+    size_t size = std::max(n + 1, nodes_.size() * 2);
+    nodes_.resize(size, {0, kNone, kStart, false});
+    // One spare word so that NextFree() always finds a free slot
+    used_.resize(size / 64 + 2, 0);
+  }
+
+  void Build(const std::vector<std::string> &patterns) {
+    for (Node &node : nodes_) {
+      node = {0, kNone, kStart, false};
+    }
+    used_.assign(nodes_.size() / 64 + 2, 0);
+    SetUsed(kStart);
+
+    // Breadth first, so that failure links always point to states that have
+    // been placed, along with their children.
+    std::deque<Pending> queue;
+    queue.push_back({kStart, 0, static_cast<uint32_t>(patterns.size()), 0});
+
+    std::vector<uint8_t> labels;
+    std::vector<Pending> children;
+
+    while (!queue.empty()) {
+      const Pending cur = queue.front();
+      queue.pop_front();
+
+      labels.clear();
+      children.clear();
+      for (uint32_t i = cur.lo; i < cur.hi; i++) {
+        if (patterns[i].size() <= cur.depth) {
+          continue;  // ends at this state (or empty)
+        }
+        uint8_t c = patterns[i][cur.depth];
+        if (labels.empty() || labels.back() != c) {
+          labels.push_back(c);
+          children.push_back({kNone, i, i, cur.depth + 1});
+        }
+        children.back().hi = i + 1;
+      }
+
+      if (labels.empty()) {
+        continue;
+      }
+
+      const State base = FindBase(labels);
+      nodes_[cur.state].base = base;
+
+      for (size_t k = 0; k < labels.size(); k++) {
+        const uint8_t c = labels[k];
+        const State t = base + c;
+        SetUsed(t);
+        num_states_++;
+
+        State fail = kStart;
+        if (cur.state != kStart) {
+          State f = nodes_[cur.state].fail;
+          while (Goto(f, c) == kNone && f != kStart) {
+            f = nodes_[f].fail;
+          }
+          fail = Goto(f, c) != kNone ? Goto(f, c) : kStart;
+        }
+
+        // The shortest pattern in the (sorted) range comes first
+        const Pending &child = children[k];
+        bool terminal = patterns[child.lo].size() == child.depth;
+
+        nodes_[t] = {0, cur.state, fail, terminal || nodes_[fail].match};
+
+        children[k].state = t;
+        queue.push_back(children[k]);
+      }
+    }
+
+    // Trim the free tail, leaving room for any base + c
+    size_t last = nodes_.size();
+    while (last > 1 && nodes_[last - 1].check == kNone) {
+      last--;
+    }
+    size_t max_base = 0;
+    for (size_t i = 0; i < last; i++) {
+      max_base = std::max<size_t>(max_base, nodes_[i].base);
+    }
+    nodes_.resize(std::max(last, max_base + kAlphabet));
+    nodes_.shrink_to_fit();
+  }
+
+  std::vector<Node> nodes_;
+  size_t num_states_;
+
+  // Bitmap of the slots in nodes_ taken by states, only while building
+  std::vector<uint64_t> used_;
+  size_t single_from_;  // where FindBase() starts, for a single child
+  size_t multi_from_;   // and for more
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_AHO_CORASICK_H_
@@ -0,0 +1,105 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmarks for the Aho-Corasick matcher, with blacklists of domain names.
+
+#include "aho_corasick.h"
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "random.h"
+
+using bess::utils::AhoCorasick;
+
+static std::string RandomLabel(Random *rd) {
+  std::string s(3 + rd->GetRange(8), 'a');
+  for (char &c : s) {
+    c = 'a' + rd->GetRange(26);
+  }
+  return s;
+}
+
+// Patterns like "\x01ads.foo.com\x02", as UrlFilter builds from host names
+static std::vector<std::string> MakeDomains(size_t n) {
+  static const char *kTlds[] = {"com", "net", "org", "io"};
+  Random rd;
+  rd.SetSeed(0);
+
+  std::vector<std::string> domains;
+  for (size_t i = 0; i < n; i++) {
+    domains.push_back("\x01" + RandomLabel(&rd) + "." + RandomLabel(&rd) +
+                      "." + kTlds[rd.GetRange(4)] + "\x02");
+  }
+  return domains;
+}
+
+static void BM_AhoCorasickBuild(benchmark::State &state) {
+  std::vector<std::string> domains = MakeDomains(state.range(0));
+
+  while (state.KeepRunning()) {
+    AhoCorasick ac(domains);
+    benchmark::DoNotOptimize(ac.num_states());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(BM_AhoCorasickBuild)
+    ->Arg(1 << 10)
+    ->Arg(1 << 16)
+    ->Arg(1 << 20)
+    ->Unit(benchmark::kMillisecond);
+
+// Matches text against the blacklist, half of which are listed domains
+static void BM_AhoCorasickMatch(benchmark::State &state) {
+  std::vector<std::string> domains = MakeDomains(state.range(0));
+  AhoCorasick ac(domains);
+
+  std::vector<std::string> texts = MakeDomains(1024);
+  for (size_t i = 0; i < texts.size(); i += 2) {
+    texts[i] = domains[i % domains.size()];
+  }
+
+  size_t i = 0;
+  size_t bytes = 0;
+  while (state.KeepRunning()) {
+    const std::string &text = texts[i++ % texts.size()];
+    benchmark::DoNotOptimize(ac.Contains(text));
+    bytes += text.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(bytes);
+}
+
+BENCHMARK(BM_AhoCorasickMatch)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,148 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "aho_corasick.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "random.h"
+
+using bess::utils::AhoCorasick;
+
+namespace {
+
+// Local copies, as gtest takes its arguments by reference
+const AhoCorasick::State kStart = AhoCorasick::kStart;
+const AhoCorasick::State kMatched = AhoCorasick::kMatched;
+
+bool NaiveContains(const std::vector<std::string> &patterns,
+                   const std::string &text) {
+  for (const std::string &p : patterns) {
+    if (!p.empty() && text.find(p) != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+TEST(AhoCorasickTest, Empty) {
+  AhoCorasick ac({});
+  EXPECT_FALSE(ac.Contains(""));
+  EXPECT_FALSE(ac.Contains("abc"));
+  EXPECT_EQ(1, ac.num_states());
+
+  // Empty patterns never match
+  AhoCorasick ac2({""});
+  EXPECT_FALSE(ac2.Contains("abc"));
+}
+
+TEST(AhoCorasickTest, Basic) {
+  AhoCorasick ac({"he", "she", "his", "hers"});
+  EXPECT_TRUE(ac.Contains("ushers"));
+  EXPECT_TRUE(ac.Contains("this"));
+  EXPECT_TRUE(ac.Contains("he"));
+  EXPECT_FALSE(ac.Contains("h"));
+  EXPECT_FALSE(ac.Contains("hi"));
+  EXPECT_FALSE(ac.Contains("sh"));
+  EXPECT_FALSE(ac.Contains(""));
+
+  // root, h, he, her, hers, hi, his, s, sh, she
+  EXPECT_EQ(10, ac.num_states());
+}
+
+// A pattern found as a suffix of a longer, partial match
+TEST(AhoCorasickTest, FailureLinks) {
+  AhoCorasick ac({"abcx", "bc", "cdq"});
+  EXPECT_TRUE(ac.Contains("abcy"));
+  EXPECT_FALSE(ac.Contains("abdcy"));
+
+  AhoCorasick ac2({"abcd", "bcdq"});
+  EXPECT_TRUE(ac2.Contains("abcdq"));
+  EXPECT_TRUE(ac2.Contains("abcbcdq"));
+  EXPECT_FALSE(ac2.Contains("abcbcd"));
+}
+
+TEST(AhoCorasickTest, BinaryBytes) {
+  const std::string zero("\x00\xff", 2);
+  AhoCorasick ac({zero, "\x01x"});
+  EXPECT_TRUE(ac.Contains(std::string("a\x00\xff", 3)));
+  EXPECT_FALSE(ac.Contains(std::string("a\xff\x00", 3)));
+  EXPECT_TRUE(ac.Contains("\x01x"));
+  EXPECT_FALSE(ac.Contains("x\x01"));
+}
+
+// Matching text in pieces is the same as matching it at once
+TEST(AhoCorasickTest, Feed) {
+  AhoCorasick ac({"\x01www.example.com\x02", "ads."});
+  AhoCorasick::State s = kStart;
+  s = ac.Next(s, '\x01');
+  s = ac.Feed(s, "www.example.com", 15);
+  EXPECT_NE(kMatched, s);
+  s = ac.Next(s, '\x02');
+  EXPECT_EQ(kMatched, s);
+  s = ac.Feed(s, "foo", 3);
+  EXPECT_EQ(kMatched, s);
+
+  s = ac.Feed(kStart, "ad", 2);
+  EXPECT_NE(kMatched, s);
+  EXPECT_EQ(kMatched, ac.Feed(s, "s.", 2));
+}
+
+TEST(AhoCorasickTest, Random) {
+  Random rd;
+
+  for (int round = 0; round < 20; round++) {
+    // A small alphabet makes partial matches common
+    const int alphabet = 2 + round % 5;
+    auto random_string = [&](int max_len) {
+      std::string s(rd.GetRange(max_len + 1), 'a');
+      for (char &c : s) {
+        c = 'a' + rd.GetRange(alphabet);
+      }
+      return s;
+    };
+
+    std::vector<std::string> patterns;
+    for (int i = 0; i < 100; i++) {
+      patterns.push_back(random_string(8));
+    }
+    AhoCorasick ac(patterns);
+
+    for (int i = 0; i < 1000; i++) {
+      const std::string text = random_string(16);
+      ASSERT_EQ(NaiveContains(patterns, text), ac.Contains(text)) << text;
+    }
+  }
+}
+
+}  // namespace
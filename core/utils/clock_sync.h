@@ -0,0 +1,133 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_UTILS_CLOCK_SYNC_H_
+#define BESS_UTILS_CLOCK_SYNC_H_
+
+#include <algorithm>
+#include <cstdint>
+
+namespace bess {
+namespace utils {
+
+// Maps the timestamps of another clock, e.g., a NIC's, to local time in ns.
+//
+// Each sample pairs a remote timestamp with the local time at which it was
+// seen, some unknown delay later. The offset between the clocks is thus at
+// most the difference of the two, and the smallest difference over a window
+// of time is taken as the offset. As the clocks do not run at exactly the
+// same rate, the offset drifts, and the estimates of the last two windows
+// give how fast.
+class ClockSync {
+ public:
+  static const uint64_t kDefaultWindowNs = 1'000'000'000;
+
+  // 'ns_per_tick' is the nominal period of the remote clock
+  explicit ClockSync(double ns_per_tick = 1.0,
+                     uint64_t window_ns = kDefaultWindowNs)
+      : ns_per_tick_(ns_per_tick),
+        window_ns_(window_ns),
+        window_start_(),
+        cur_(),
+        last_(),
+        drift_(),
+        offset_() {}
+
+  // Records that the remote timestamp 'ticks' was seen at 'local_ns'
+  void Sample(uint64_t ticks, uint64_t local_ns) {
+    int64_t offset = local_ns - RemoteNs(ticks);
+
+    if (!synced()) {
+      window_start_ = local_ns;
+    }
+    if (!cur_.valid || offset < cur_.offset) {
+      cur_ = {true, local_ns, offset};
+    }
+
+    if (local_ns - window_start_ >= window_ns_) {
+      if (last_.valid) {
+        drift_ = static_cast<double>(cur_.offset - last_.offset) /
+                 (cur_.time - last_.time);
+      }
+      last_ = cur_;
+      cur_.valid = false;
+      window_start_ = local_ns;
+    }
+
+    offset_ = Estimate(local_ns);
+  }
+
+  // Returns the local time of a remote timestamp, as of the last sample.
+  // Only valid once there has been a sample.
+  uint64_t ToLocal(uint64_t ticks) const { return RemoteNs(ticks) + offset_; }
+
+  bool synced() const { return last_.valid || cur_.valid; }
+
+ private:
+  struct Point {
+    bool valid;
+    uint64_t time;   // local time of the sample
+    int64_t offset;  // local time minus remote time
+  };
+
+  int64_t RemoteNs(uint64_t ticks) const { return ticks * ns_per_tick_; }
+
+  int64_t Extrapolate(const Point &p, uint64_t local_ns) const {
+    return p.offset + static_cast<int64_t>(drift_ * (local_ns - p.time));
+  }
+
+  // Estimates the offset at 'local_ns'. A sample of the current window that
+  // is lower than the estimate from the last window takes precedence.
+  int64_t Estimate(uint64_t local_ns) const {
+    if (!last_.valid) {
+      return cur_.offset;
+    }
+
+    int64_t offset = Extrapolate(last_, local_ns);
+    if (cur_.valid) {
+      offset = std::min(offset, Extrapolate(cur_, local_ns));
+    }
+    return offset;
+  }
+
+  double ns_per_tick_;
+  uint64_t window_ns_;
+  uint64_t window_start_;
+
+  Point cur_;   // lowest offset in the current window
+  Point last_;  // lowest offset in the last window
+
+  double drift_;  // of the offset, in ns per ns
+  int64_t offset_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_CLOCK_SYNC_H_
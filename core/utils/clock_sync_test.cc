@@ -0,0 +1,89 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "clock_sync.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "random.h"
+
+using bess::utils::ClockSync;
+
+namespace {
+
+TEST(ClockSyncTest, Offset) {
+  ClockSync clock(2.0);
+  EXPECT_FALSE(clock.synced());
+
+  // Remote time 0 is local time 1000, and samples are seen 300ns or more
+  // after their remote timestamp
+  clock.Sample(0, 1500);
+  EXPECT_TRUE(clock.synced());
+  EXPECT_EQ(1500, clock.ToLocal(0));
+  EXPECT_EQ(1700, clock.ToLocal(100));
+
+  clock.Sample(100, 1500);
+  EXPECT_EQ(1300, clock.ToLocal(0));
+
+  // Larger delays do not matter
+  clock.Sample(200, 1900);
+  EXPECT_EQ(1300, clock.ToLocal(0));
+}
+
+// A NIC clock that ticks every 6.4ns, and runs 50ppm fast
+TEST(ClockSyncTest, Drift) {
+  const double kNsPerTick = 6.4;
+  const double kRate = 1.0 + 50e-6;
+  const uint64_t kOffset = 123'456'789'000;
+  const uint64_t kMinDelay = 200;
+
+  ClockSync clock(kNsPerTick, 100'000'000);
+  Random rd;
+  double max_error = 0;
+
+  for (uint64_t t = 0; t < 2'000'000'000; t += 10'000) {
+    uint64_t ticks = t * kRate / kNsPerTick;
+    uint64_t delay = kMinDelay + rd.GetRange(5000) * (rd.GetRange(100) != 0);
+    clock.Sample(ticks, kOffset + t + delay);
+
+    // Once the drift is known
+    if (t >= 300'000'000) {
+      double error = static_cast<double>(clock.ToLocal(ticks)) -
+                     static_cast<double>(kOffset + t);
+      max_error = std::max(max_error, std::abs(error - kMinDelay));
+    }
+  }
+
+  // Without the drift, the error would grow by 5us per 100ms window
+  EXPECT_LT(max_error, 100);
+}
+
+}  // namespace
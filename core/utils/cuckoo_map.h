@@ -27,25 +27,41 @@
 // CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
-
 // Streamlined hash table implementation, with emphasis on lookup performance.
 // Key and value sizes are fixed. Lookup is thread-safe, but update is not.
 //
+// Lookups (Find() and FindBatch()) may also run concurrently with a single
+// writer, without locks. Each stripe of buckets has a version counter that
+// the writer bumps around every bucket update, and readers retry if a
+// version changed under them (optimistic reads, as in MemC3). Call
+// EnableConcurrentReads() to use the table this way: removed and replaced
+// entries, and the arrays left behind when the table grows, are then not
+// reused or freed until Reclaim(), which the writer must call only once all
+// readers that may have seen them are done.
+//
 // Note: If you want to use a custom hash function, it should be a reasonably
 // good one. If more than 8 (2 * kEntriesPerBucket) key values collide with
 // the same hash value, Insert() may fail returning nullptr.
+//
+// With InlineKeys set, small keys (up to 16 bytes) are also kept in the
+// bucket next to their hash values, so that a probe does not have to load
+// the entry to compare keys. This trades memory for one less cache miss.
 
 #ifndef BESS_UTILS_CUCKOOMAP_H_
 #define BESS_UTILS_CUCKOOMAP_H_
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <limits>
+#include <memory>
 #include <stack>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#include <x86intrin.h>
+
 #include <glog/logging.h>
 
 #include "../debug.h"
@@ -72,9 +88,12 @@ typedef uint32_t EntryIndex;
 // For more examples, please refer to cuckoo_map_test.cc
 
 template <typename K, typename V, typename H = std::hash<K>,
-          typename E = std::equal_to<K>>
+          typename E = std::equal_to<K>, bool InlineKeys = false>
 class CuckooMap {
  public:
+  static_assert(!InlineKeys || sizeof(K) <= 16,
+                "only keys up to 16 bytes can be inlined");
+
   typedef std::pair<K, V> Entry;
   class iterator {
    public:
@@ -86,8 +105,8 @@ class CuckooMap {
 
     iterator(CuckooMap& map, size_t bucket, size_t slot)
         : map_(map), bucket_idx_(bucket), slot_idx_(slot) {
-      while (bucket_idx_ < map_.buckets_.size() &&
-             map_.buckets_[bucket_idx_].hash_values[slot_idx_] == 0) {
+      while (bucket_idx_ < map_.table()->buckets.size() &&
+             map_.table()->buckets[bucket_idx_].hash_values[slot_idx_] == 0) {
         slot_idx_++;
         if (slot_idx_ == kEntriesPerBucket) {
           slot_idx_ = 0;
@@ -103,8 +122,8 @@ class CuckooMap {
           slot_idx_ = 0;
           bucket_idx_++;
         }
-      } while (bucket_idx_ < map_.buckets_.size() &&
-               map_.buckets_[bucket_idx_].hash_values[slot_idx_] == 0);
+      } while (bucket_idx_ < map_.table()->buckets.size() &&
+               map_.table()->buckets[bucket_idx_].hash_values[slot_idx_] == 0);
       return *this;
     }
 
@@ -116,8 +135,8 @@ class CuckooMap {
           slot_idx_ = 0;
           bucket_idx_++;
         }
-      } while (bucket_idx_ < map_.buckets_.size() &&
-               map_.buckets_[bucket_idx_].hash_values[slot_idx_] == 0);
+      } while (bucket_idx_ < map_.table()->buckets.size() &&
+               map_.table()->buckets[bucket_idx_].hash_values[slot_idx_] == 0);
       return tmp;
     }
 
@@ -132,13 +151,15 @@ class CuckooMap {
     }
 
     reference operator*() {
-      EntryIndex idx = map_.buckets_[bucket_idx_].entry_indices[slot_idx_];
-      return map_.entries_[idx];
+      Table* t = map_.table();
+      EntryIndex idx = t->buckets[bucket_idx_].entry_indices[slot_idx_];
+      return t->entries[idx];
     }
 
     pointer operator->() {
-      EntryIndex idx = map_.buckets_[bucket_idx_].entry_indices[slot_idx_];
-      return &map_.entries_[idx];
+      Table* t = map_.table();
+      EntryIndex idx = t->buckets[bucket_idx_].entry_indices[slot_idx_];
+      return &t->entries[idx];
     }
 
    private:
@@ -149,11 +170,13 @@ class CuckooMap {
 
   CuckooMap(size_t reserve_buckets = kInitNumBucket,
             size_t reserve_entries = kInitNumEntries)
-      : bucket_mask_(reserve_buckets - 1),
+      : table_(new Table(reserve_buckets, reserve_entries)),
         num_entries_(0),
-        buckets_(reserve_buckets),
-        entries_(reserve_entries),
-        free_entry_indices_() {
+        free_entry_indices_(),
+        versions_(new std::atomic<uint32_t>[kNumVersions]()),
+        concurrent_(false),
+        retired_tables_(),
+        retired_entry_indices_() {
     // the number of buckets must be a power of 2
     CHECK_EQ(align_ceil_pow2(reserve_buckets), reserve_buckets);
 
@@ -162,16 +185,39 @@ class CuckooMap {
     }
   }
 
+  ~CuckooMap() { delete table_.load(); }
+
   // Not allowing copying for now
   CuckooMap(CuckooMap&) = delete;
   CuckooMap& operator=(CuckooMap&) = delete;
 
   // Allow move
-  CuckooMap(CuckooMap&&) = default;
-  CuckooMap& operator=(CuckooMap&&) = default;
+  CuckooMap(CuckooMap&& other)
+      : table_(other.table_.exchange(nullptr)),
+        num_entries_(other.num_entries_),
+        free_entry_indices_(std::move(other.free_entry_indices_)),
+        versions_(std::move(other.versions_)),
+        concurrent_(other.concurrent_),
+        retired_tables_(std::move(other.retired_tables_)),
+        retired_entry_indices_(std::move(other.retired_entry_indices_)) {}
+
+  CuckooMap& operator=(CuckooMap&& other) {
+    delete table_.exchange(other.table_.exchange(nullptr));
+    num_entries_ = other.num_entries_;
+    free_entry_indices_ = std::move(other.free_entry_indices_);
+    versions_ = std::move(other.versions_);
+    concurrent_ = other.concurrent_;
+    retired_tables_ = std::move(other.retired_tables_);
+    retired_entry_indices_ = std::move(other.retired_entry_indices_);
+    return *this;
+  }
 
   iterator begin() { return iterator(*this, 0, 0); }
-  iterator end() { return iterator(*this, buckets_.size(), 0); }
+  iterator end() { return iterator(*this, table()->buckets.size(), 0); }
+
+  // Allow lookups from other threads while this thread updates the table.
+  // Memory that such readers may still be using is kept until Reclaim().
+  void EnableConcurrentReads() { concurrent_ = true; }
 
   // Insert/update a key value pair
   // Return the pointer to the inserted entry
@@ -180,9 +226,13 @@ class CuckooMap {
     Entry* entry;
     HashResult primary = Hash(key, hasher);
 
-    EntryIndex idx = FindWithHash(primary, key, eq);
+    EntryIndex idx = FindWithHash(table(), primary, key, eq);
     if (idx != kInvalidEntryIdx) {
-      entry = &entries_[idx];
+      if (concurrent_) {
+        // Readers may hold the entry, so update a copy of it
+        return ReplaceEntry(primary, idx, key, value);
+      }
+      entry = &table()->entries[idx];
       entry->second = value;
       return entry;
     }
@@ -219,43 +269,91 @@ class CuckooMap {
   // const version of Find()
   const Entry* Find(const K& key, const H& hasher = H(),
                     const E& eq = E()) const {
-    EntryIndex idx = FindWithHash(Hash(key, hasher), key, eq);
+    const Table* t = table_.load(std::memory_order_acquire);
+    EntryIndex idx = FindWithHash(t, Hash(key, hasher), key, eq);
     if (idx == kInvalidEntryIdx) {
       return nullptr;
     }
 
-    const Entry* ret = &entries_[idx];
+    const Entry* ret = &t->entries[idx];
     promise(ret != nullptr);
     return ret;
   }
 
+  // Find the entries of a batch of keys. entries[i] is set to the entry
+  // matching keys[i], or nullptr if not exist. All keys are hashed and their
+  // buckets prefetched before any of them is probed, so that the cache misses
+  // of independent lookups overlap.
+  // Return the number of keys found.
+  size_t FindBatch(const K* keys, size_t n, const Entry** entries,
+                   const H& hasher = H(), const E& eq = E()) const {
+    const Table* t = table_.load(std::memory_order_acquire);
+    HashResult hashes[kFindBatchSize];
+    size_t found = 0;
+
+    for (size_t base = 0; base < n; base += kFindBatchSize) {
+      size_t cnt = n - base;
+      if (cnt > kFindBatchSize) {
+        cnt = kFindBatchSize;
+      }
+
+      for (size_t i = 0; i < cnt; i++) {
+        HashResult primary = Hash(keys[base + i], hasher);
+        hashes[i] = primary;
+        __builtin_prefetch(&t->buckets[primary & t->bucket_mask]);
+        __builtin_prefetch(
+            &t->buckets[HashSecondary(primary) & t->bucket_mask]);
+      }
+
+      // Most keys live in their primary bucket. Prefetch their entries too.
+      for (size_t i = 0; i < cnt; i++) {
+        const Bucket& bucket = t->buckets[hashes[i] & t->bucket_mask];
+        int mask = MatchHash(bucket, hashes[i]);
+        if (mask) {
+          int j = __builtin_ctz(mask);
+          __builtin_prefetch(&t->entries[bucket.entry_indices[j]]);
+        }
+      }
+
+      for (size_t i = 0; i < cnt; i++) {
+        EntryIndex idx = FindWithHash(t, hashes[i], keys[base + i], eq);
+        if (idx == kInvalidEntryIdx) {
+          entries[base + i] = nullptr;
+        } else {
+          entries[base + i] = &t->entries[idx];
+          found++;
+        }
+      }
+    }
+
+    return found;
+  }
+
   // Remove the stored entry by the key
   // Return false if not exist.
   bool Remove(const K& key, const H& hasher = H(), const E& eq = E()) {
     HashResult pri = Hash(key, hasher);
-    if (RemoveFromBucket(pri, pri & bucket_mask_, key, eq)) {
+    if (RemoveFromBucket(pri, pri & table()->bucket_mask, key, eq)) {
       return true;
     }
     HashResult sec = HashSecondary(pri);
-    if (RemoveFromBucket(pri, sec & bucket_mask_, key, eq)) {
+    if (RemoveFromBucket(pri, sec & table()->bucket_mask, key, eq)) {
       return true;
     }
     return false;
   }
 
   void Clear() {
-    buckets_.clear();
-    entries_.clear();
-
     // std::stack doesn't have a clear() method. Strange.
     while (!free_entry_indices_.empty()) {
       free_entry_indices_.pop();
     }
 
+    // Entries retired so far belong to the old table
+    retired_entry_indices_.clear();
+
     num_entries_ = 0;
-    bucket_mask_ = kInitNumBucket - 1;
-    buckets_.resize(kInitNumBucket);
-    entries_.resize(kInitNumEntries);
+    ReplaceTable(new Table(kInitNumBucket, kInitNumEntries));
 
     for (int i = kInitNumEntries - 1; i >= 0; --i) {
       free_entry_indices_.push(i);
@@ -265,6 +363,23 @@ class CuckooMap {
   // Return the number of stored entries
   size_t Count() const { return num_entries_; }
 
+  // True if updates have left memory behind for Reclaim()
+  bool NeedsReclaim() const {
+    return !retired_tables_.empty() || !retired_entry_indices_.empty();
+  }
+
+  // Free the memory left behind by updates so far. With concurrent reads,
+  // no reader that started before those updates may still be running.
+  void Reclaim() {
+    retired_tables_.clear();
+
+    for (EntryIndex idx : retired_entry_indices_) {
+      table()->entries[idx] = Entry();
+      PushFreeEntryIndex(idx);
+    }
+    retired_entry_indices_.clear();
+  }
+
  protected:
   // Tunable macros
   static const int kInitNumBucket = 4;
@@ -277,21 +392,146 @@ class CuckooMap {
   // of insertion will grow exponentially, so be careful.
   static const int kMaxCuckooPath = 3;
 
+  // Number of keys FindBatch() hashes and prefetches ahead of probing
+  static const size_t kFindBatchSize = 32;
+
+  // Number of version counters. Buckets share them in stripes.
+  static const size_t kNumVersions = 1024;
+
   /* non-tunable macros */
   static const EntryIndex kInvalidEntryIdx =
       std::numeric_limits<EntryIndex>::max();
 
-  struct Bucket {
+  struct BucketKeys {
+    K keys[kEntriesPerBucket];
+  };
+  struct NoBucketKeys {};
+
+  struct Bucket : public std::conditional<InlineKeys, BucketKeys,
+                                          NoBucketKeys>::type {
     HashResult hash_values[kEntriesPerBucket];
     EntryIndex entry_indices[kEntriesPerBucket];
 
     Bucket() : hash_values(), entry_indices() {}
   };
 
+  static_assert(sizeof(HashResult) * kEntriesPerBucket == sizeof(__m128i),
+                "bucket hash values must fit in a SSE register");
+
+  struct Table {
+    Table(size_t num_buckets, size_t num_entries)
+        : bucket_mask(num_buckets - 1),
+          buckets(num_buckets),
+          entries(num_entries) {}
+
+    // # of buckets == mask + 1
+    HashResult bucket_mask;
+
+    // bucket and entry arrays grow independently
+    std::vector<Bucket> buckets;
+    std::vector<Entry> entries;
+  };
+
+  // The table, as seen by the writer
+  Table* table() const { return table_.load(std::memory_order_relaxed); }
+
+  // Install a new table, retiring the current one
+  void ReplaceTable(Table* new_table) {
+    Table* old_table = table();
+    table_.store(new_table, std::memory_order_release);
+    if (concurrent_) {
+      retired_tables_.emplace_back(old_table);
+    } else {
+      delete old_table;
+    }
+  }
+
+  std::atomic<uint32_t>& VersionOf(HashResult bucket_idx) const {
+    return versions_[bucket_idx & (kNumVersions - 1)];
+  }
+
+  // Mark the start and the end of an update to the bucket. The version of
+  // the stripe is odd in between.
+  void BeginWrite(HashResult bucket_idx) {
+    std::atomic<uint32_t>& version = VersionOf(bucket_idx);
+    version.store(version.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  void EndWrite(HashResult bucket_idx) {
+    std::atomic<uint32_t>& version = VersionOf(bucket_idx);
+    version.store(version.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_release);
+  }
+
+  // Return the version of the bucket once no update is in progress
+  uint32_t ReadBegin(HashResult bucket_idx) const {
+    uint32_t version;
+    while ((version = VersionOf(bucket_idx).load(std::memory_order_acquire)) &
+           1) {
+      __builtin_ia32_pause();
+    }
+    return version;
+  }
+
+  // Return true if the bucket may have changed since ReadBegin()
+  bool ReadRetry(HashResult bucket_idx, uint32_t version) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return VersionOf(bucket_idx).load(std::memory_order_relaxed) != version;
+  }
+
+  // Key stored in the slot of the bucket
+  const K& KeyAt(const Table* t, const Bucket& bucket, int slot_idx) const {
+    return KeyAt(t, bucket, slot_idx,
+                 std::integral_constant<bool, InlineKeys>());
+  }
+
+  const K& KeyAt(const Table*, const Bucket& bucket, int slot_idx,
+                 std::true_type) const {
+    return bucket.keys[slot_idx];
+  }
+
+  const K& KeyAt(const Table* t, const Bucket& bucket, int slot_idx,
+                 std::false_type) const {
+    return t->entries[bucket.entry_indices[slot_idx]].first;
+  }
+
+  // Copy the key into the slot of the bucket, if keys are inlined
+  static void SetKeyAt(Bucket* bucket, int slot_idx, const K& key) {
+    SetKeyAt(bucket, slot_idx, key, std::integral_constant<bool, InlineKeys>());
+  }
+
+  static void SetKeyAt(Bucket* bucket, int slot_idx, const K& key,
+                       std::true_type) {
+    bucket->keys[slot_idx] = key;
+  }
+
+  static void SetKeyAt(Bucket*, int, const K&, std::false_type) {}
+
+  // Return a bitmask of the slots in the bucket whose hash value is hash
+  static int MatchHash(const Bucket& bucket, HashResult hash) {
+#if __SSE2__
+    __m128i hashes = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(bucket.hash_values));
+    __m128i cmp = _mm_cmpeq_epi32(hashes, _mm_set1_epi32(hash));
+    return _mm_movemask_ps(_mm_castsi128_ps(cmp));
+#else
+    int ret = 0;
+    for (int i = 0; i < kEntriesPerBucket; i++) {
+      if (bucket.hash_values[i] == hash) {
+        ret |= 1 << i;
+      }
+    }
+    return ret;
+#endif
+  }
+
   // Push an unused entry index back to the  stack
   void PushFreeEntryIndex(EntryIndex idx) { free_entry_indices_.push(idx); }
 
-  // Pop a free entry index from stack and return the index
+  // Pop a free entry index from stack and return the index.
+  // Note that this may replace the table.
   EntryIndex PopFreeEntryIndex() {
     if (free_entry_indices_.empty()) {
       ExpandEntries();
@@ -305,22 +545,53 @@ class CuckooMap {
   // Return the pointer to the entry if success. Otherwise return nullptr.
   Entry* AddToBucket(HashResult bucket_idx, const K& key, const V& value,
                      const H& hasher) {
-    Bucket& bucket = buckets_[bucket_idx];
-    int slot_idx = FindEmptySlot(bucket);
+    int slot_idx = FindEmptySlot(table()->buckets[bucket_idx]);
     if (slot_idx == -1) {
       return nullptr;
     }
 
     EntryIndex free_idx = PopFreeEntryIndex();
+    Table* t = table();
 
-    bucket.hash_values[slot_idx] = Hash(key, hasher);
+    Entry& entry = t->entries[free_idx];
+    entry.first = key;
+    entry.second = value;
+
+    Bucket& bucket = t->buckets[bucket_idx];
+    BeginWrite(bucket_idx);
     bucket.entry_indices[slot_idx] = free_idx;
+    SetKeyAt(&bucket, slot_idx, key);
+    bucket.hash_values[slot_idx] = Hash(key, hasher);
+    EndWrite(bucket_idx);
+
+    num_entries_++;
+    return &entry;
+  }
+
+  // Point the slot of the key, whose entry is at idx, to a new entry with
+  // the value. The old entry is retired. Return the pointer to the new entry.
+  Entry* ReplaceEntry(HashResult primary, EntryIndex idx, const K& key,
+                      const V& value) {
+    EntryIndex new_idx = PopFreeEntryIndex();
+    Table* t = table();
 
-    Entry& entry = entries_[free_idx];
+    Entry& entry = t->entries[new_idx];
     entry.first = key;
     entry.second = value;
 
-    num_entries_++;
+    HashResult bucket_idx = primary & t->bucket_mask;
+    int slot_idx = FindIndexInBucket(t->buckets[bucket_idx], primary, idx);
+    if (slot_idx == -1) {
+      bucket_idx = HashSecondary(primary) & t->bucket_mask;
+      slot_idx = FindIndexInBucket(t->buckets[bucket_idx], primary, idx);
+    }
+    DCHECK_GE(slot_idx, 0);
+
+    BeginWrite(bucket_idx);
+    t->buckets[bucket_idx].entry_indices[slot_idx] = new_idx;
+    EndWrite(bucket_idx);
+
+    retired_entry_indices_.push_back(idx);
     return &entry;
   }
 
@@ -328,18 +599,25 @@ class CuckooMap {
   // Return true if success.
   bool RemoveFromBucket(HashResult primary, HashResult bucket_idx, const K& key,
                         const E& eq) {
-    Bucket& bucket = buckets_[bucket_idx];
+    Table* t = table();
+    Bucket& bucket = t->buckets[bucket_idx];
 
-    int slot_idx = FindSlot(bucket, primary, key, eq);
+    int slot_idx = FindSlot(t, bucket, primary, key, eq);
     if (slot_idx == -1) {
       return false;
     }
 
+    BeginWrite(bucket_idx);
     bucket.hash_values[slot_idx] = 0;
+    EndWrite(bucket_idx);
 
     EntryIndex idx = bucket.entry_indices[slot_idx];
-    entries_[idx] = Entry();
-    PushFreeEntryIndex(idx);
+    if (concurrent_) {
+      retired_entry_indices_.push_back(idx);
+    } else {
+      t->entries[idx] = Entry();
+      PushFreeEntryIndex(idx);
+    }
 
     num_entries_--;
     return true;
@@ -347,11 +625,12 @@ class CuckooMap {
 
   // Find key from the bucket indexed by bucket_idx
   // Return the index of the entry if success. Otherwise return nullptr.
-  EntryIndex GetFromBucket(HashResult primary, HashResult bucket_idx,
-                           const K& key, const E& eq) const {
-    const Bucket& bucket = buckets_[bucket_idx];
+  EntryIndex GetFromBucket(const Table* t, HashResult primary,
+                           HashResult bucket_idx, const K& key,
+                           const E& eq) const {
+    const Bucket& bucket = t->buckets[bucket_idx];
 
-    int slot_idx = FindSlot(bucket, primary, key, eq);
+    int slot_idx = FindSlot(t, bucket, primary, key, eq);
     if (slot_idx == -1) {
       return kInvalidEntryIdx;
     }
@@ -369,13 +648,13 @@ class CuckooMap {
     HashResult primary_bucket_index, secondary_bucket_index;
     Entry* entry = nullptr;
   again:
-    primary_bucket_index = primary & bucket_mask_;
+    primary_bucket_index = primary & table()->bucket_mask;
     if ((entry = AddToBucket(primary_bucket_index, key, value, hasher)) !=
         nullptr) {
       return entry;
     }
 
-    secondary_bucket_index = secondary & bucket_mask_;
+    secondary_bucket_index = secondary & table()->bucket_mask;
     if ((entry = AddToBucket(secondary_bucket_index, key, value, hasher)) !=
         nullptr) {
       return entry;
@@ -394,27 +673,36 @@ class CuckooMap {
 
   // Return an empty slot index in the bucket
   int FindEmptySlot(const Bucket& bucket) const {
-    for (int i = 0; i < kEntriesPerBucket; i++) {
-      if (bucket.hash_values[i] == 0) {
+    int mask = MatchHash(bucket, 0);
+    return mask ? __builtin_ctz(mask) : -1;
+  }
+
+  // Return the slot index in the bucket that matches the primary hash_value
+  // and the actual key. Return -1 if not found.
+  int FindSlot(const Table* t, const Bucket& bucket, HashResult primary,
+               const K& key, const E& eq) const {
+    int mask = MatchHash(bucket, primary);
+    while (mask) {
+      int i = __builtin_ctz(mask);
+      if (likely(Eq(KeyAt(t, bucket, i), key, eq))) {
         return i;
       }
+      mask &= mask - 1;
     }
     return -1;
   }
 
-  // Return the slot index in the bucket that matches the primary hash_value
-  // and the actual key. Return -1 if not found.
-  int FindSlot(const Bucket& bucket, HashResult primary, const K& key,
-               const E& eq) const {
-    for (int i = 0; i < kEntriesPerBucket; i++) {
-      if (bucket.hash_values[i] == primary) {
-        EntryIndex idx = bucket.entry_indices[i];
-        const Entry& entry = entries_[idx];
-
-        if (likely(Eq(entry.first, key, eq))) {
-          return i;
-        }
+  // Return the slot index in the bucket that holds the entry index idx with
+  // the primary hash value. Return -1 if not found.
+  int FindIndexInBucket(const Bucket& bucket, HashResult primary,
+                        EntryIndex idx) const {
+    int mask = MatchHash(bucket, primary);
+    while (mask) {
+      int i = __builtin_ctz(mask);
+      if (bucket.entry_indices[i] == idx) {
+        return i;
       }
+      mask &= mask - 1;
     }
     return -1;
   }
@@ -427,11 +715,11 @@ class CuckooMap {
       return -1;
     }
 
-    Bucket& bucket = buckets_[index];
+    Table* t = table();
+    Bucket& bucket = t->buckets[index];
 
     for (int i = 0; i < kEntriesPerBucket; i++) {
-      EntryIndex idx = bucket.entry_indices[i];
-      const K& key = entries_[idx].first;
+      const K& key = KeyAt(t, bucket, i);
       HashResult pri = Hash(key, hasher);
       HashResult sec = HashSecondary(pri);
 
@@ -439,22 +727,30 @@ class CuckooMap {
 
       // this entry is in its primary bucket?
       if (pri == bucket.hash_values[i]) {
-        alt_index = sec & bucket_mask_;
+        alt_index = sec & t->bucket_mask;
       } else if (sec == bucket.hash_values[i]) {
-        alt_index = pri & bucket_mask_;
+        alt_index = pri & t->bucket_mask;
       } else {
         return -1;
       }
 
-      int j = FindEmptySlot(buckets_[alt_index]);
+      int j = FindEmptySlot(t->buckets[alt_index]);
       if (j == -1) {
         j = MakeSpace(alt_index, depth + 1, hasher);
       }
       if (j >= 0) {
-        Bucket& alt_bucket = buckets_[alt_index];
-        alt_bucket.hash_values[j] = bucket.hash_values[i];
+        // Copy the entry to the alternative bucket before removing it, so
+        // that concurrent readers find it in either of them
+        Bucket& alt_bucket = t->buckets[alt_index];
+        BeginWrite(alt_index);
         alt_bucket.entry_indices[j] = bucket.entry_indices[i];
+        SetKeyAt(&alt_bucket, j, key);
+        alt_bucket.hash_values[j] = bucket.hash_values[i];
+        EndWrite(alt_index);
+
+        BeginWrite(index);
         bucket.hash_values[i] = 0;
+        EndWrite(index);
         return i;
       }
     }
@@ -464,13 +760,48 @@ class CuckooMap {
 
   // Get the entry given the primary hash value of the key.
   // Returns the pointer to the entry or nullptr if failed.
-  EntryIndex FindWithHash(HashResult primary, const K& key, const E& eq) const {
-    EntryIndex ret = GetFromBucket(primary, primary & bucket_mask_, key, eq);
+  EntryIndex FindWithHash(const Table* t, HashResult primary, const K& key,
+                          const E& eq) const {
+    if (concurrent_) {
+      return FindWithHashConcurrent(t, primary, key, eq);
+    }
+
+    EntryIndex ret =
+        GetFromBucket(t, primary, primary & t->bucket_mask, key, eq);
     if (ret != kInvalidEntryIdx) {
       return ret;
     }
-    return GetFromBucket(primary, HashSecondary(primary) & bucket_mask_, key,
-                         eq);
+    return GetFromBucket(t, primary, HashSecondary(primary) & t->bucket_mask,
+                         key, eq);
+  }
+
+  // FindWithHash() for concurrent reads. Retries as long as either bucket
+  // may have been updated during the lookup. Only the primary bucket needs
+  // to be stable if the key is found there. Kept out of line so that the
+  // plain path of FindWithHash() still gets inlined.
+  __attribute__((noinline)) EntryIndex FindWithHashConcurrent(
+      const Table* t, HashResult primary, const K& key, const E& eq) const {
+    HashResult primary_bucket_index = primary & t->bucket_mask;
+    HashResult secondary_bucket_index = HashSecondary(primary) & t->bucket_mask;
+
+    while (true) {
+      uint32_t pri_version = ReadBegin(primary_bucket_index);
+      EntryIndex ret =
+          GetFromBucket(t, primary, primary_bucket_index, key, eq);
+      if (ret != kInvalidEntryIdx) {
+        if (likely(!ReadRetry(primary_bucket_index, pri_version))) {
+          return ret;
+        }
+        continue;
+      }
+
+      uint32_t sec_version = ReadBegin(secondary_bucket_index);
+      ret = GetFromBucket(t, primary, secondary_bucket_index, key, eq);
+      if (likely(!ReadRetry(primary_bucket_index, pri_version) &&
+                 !ReadRetry(secondary_bucket_index, sec_version))) {
+        return ret;
+      }
+    }
   }
 
   // Secondary hash value
@@ -490,10 +821,18 @@ class CuckooMap {
 
   // Resize the space of entries. Grow less aggressively than buckets.
   void ExpandEntries() {
-    size_t old_size = entries_.size();
+    Table* t = table();
+    size_t old_size = t->entries.size();
     size_t new_size = old_size + old_size / 2;
 
-    entries_.resize(new_size);
+    if (concurrent_) {
+      // Readers may be using the current arrays. Grow a copy of them.
+      Table* bigger = new Table(*t);
+      bigger->entries.resize(new_size);
+      ReplaceTable(bigger);
+    } else {
+      t->entries.resize(new_size);
+    }
 
     for (EntryIndex i = new_size - 1; i >= old_size; --i) {
       free_entry_indices_.push(i);
@@ -502,7 +841,8 @@ class CuckooMap {
 
   // Resize the space of buckets, and rehash existing entries
   void ExpandBuckets(const H& hasher, const E& eq) {
-    CuckooMap<K, V, H, E> bigger(buckets_.size() * 2, entries_.size());
+    CuckooMap<K, V, H, E, InlineKeys> bigger(table()->buckets.size() * 2,
+                                             table()->entries.size());
 
     for (const auto& e : *this) {
       // While very unlikely, this insert() may cause recursive expansion
@@ -512,25 +852,33 @@ class CuckooMap {
       }
     }
 
-    bucket_mask_ = std::move(bigger.bucket_mask_);
+    // Entries retired so far belong to the old table
+    retired_entry_indices_.clear();
+
     num_entries_ = bigger.num_entries_;
-    buckets_ = std::move(bigger.buckets_);
-    entries_ = std::move(bigger.entries_);
+    ReplaceTable(bigger.table_.exchange(nullptr));
     free_entry_indices_ = std::move(bigger.free_entry_indices_);
   }
 
-  // # of buckets == mask + 1
-  HashResult bucket_mask_;
+  // Current table. Readers load it once per lookup, so the writer never
+  // reallocates its arrays in place with concurrent reads enabled.
+  std::atomic<Table*> table_;
 
   // # of entries
   size_t num_entries_;
 
-  // bucket and entry arrays grow independently
-  std::vector<Bucket> buckets_;
-  std::vector<Entry> entries_;
-
   // Stack of free entries
   std::stack<EntryIndex> free_entry_indices_;
+
+  // Version counters of bucket stripes. See BeginWrite() and ReadBegin().
+  std::unique_ptr<std::atomic<uint32_t>[]> versions_;
+
+  // If true, memory that readers may be using is retired, not reused
+  bool concurrent_;
+
+  // Tables and entries (of the current table) waiting for Reclaim()
+  std::vector<std::unique_ptr<Table>> retired_tables_;
+  std::vector<EntryIndex> retired_entry_indices_;
 };
 
 }  // namespace utils
@@ -39,7 +39,9 @@
 #include <cmath>
 #include <cstdio>
 #include <functional>
+#include <random>
 #include <unordered_map>
+#include <vector>
 
 #include <benchmark/benchmark.h>
 #include <glog/logging.h>
@@ -114,6 +116,36 @@ BENCHMARK_REGISTER_F(CuckooMapFixture, CuckooMapInlinedGet)
     ->RangeMultiplier(4)
     ->Range(4, 4 << 20);
 
+// Benchmarks the FindBatch() method in CuckooMap, in batches of 32 keys.
+BENCHMARK_DEFINE_F(CuckooMapFixture, CuckooMapBatchGet)
+(benchmark::State &state) {
+  const size_t kBatchSize = 32;
+  uint32_t keys[kBatchSize];
+  const std::pair<uint32_t, value_t> *vals[kBatchSize];
+
+  while (true) {
+    const size_t n = state.range(0);
+    rng.SetSeed(0);
+
+    for (size_t i = 0; i < n; i += kBatchSize) {
+      for (size_t j = 0; j < kBatchSize; j++) {
+        keys[j] = rng.Get();
+      }
+
+      benchmark::DoNotOptimize(cuckoo_->FindBatch(keys, kBatchSize, vals));
+
+      if (!state.KeepRunning()) {
+        state.SetItemsProcessed(state.iterations() * kBatchSize);
+        return;
+      }
+    }
+  }
+}
+
+BENCHMARK_REGISTER_F(CuckooMapFixture, CuckooMapBatchGet)
+    ->RangeMultiplier(4)
+    ->Range(4, 4 << 20);
+
 // Benchmarks the find method on the STL unordered_map.
 BENCHMARK_DEFINE_F(CuckooMapFixture, STLUnorderedMapGet)
 (benchmark::State &state) {
@@ -140,4 +172,36 @@ BENCHMARK_REGISTER_F(CuckooMapFixture, STLUnorderedMapGet)
     ->RangeMultiplier(4)
     ->Range(4, 4 << 20);
 
+// Benchmarks Find() on a table of 64-bit keys with and without the keys
+// inlined in buckets. Keys are looked up in random order, so that most
+// probes miss the cache.
+template <bool InlineKeys>
+static void BM_CuckooMapFind(benchmark::State &state) {
+  const size_t n = state.range(0);
+  CuckooMap<uint64_t, value_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+            InlineKeys>
+      cuckoo;
+  std::vector<uint64_t> keys(n);
+
+  rng.SetSeed(0);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = (static_cast<uint64_t>(rng.Get()) << 32) | rng.Get();
+    cuckoo.Insert(keys[i], derive_val(keys[i]));
+  }
+  std::shuffle(keys.begin(), keys.end(), std::default_random_engine());
+
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(cuckoo.Find(keys[i]));
+    if (++i == n) {
+      i = 0;
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_CuckooMapFind, false)->Arg(1 << 20)->Arg(16 << 20);
+BENCHMARK_TEMPLATE(BM_CuckooMapFind, true)->Arg(1 << 20)->Arg(16 << 20);
+
 BENCHMARK_MAIN();
@@ -29,6 +29,10 @@
 
 #include "cuckoo_map.h"
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include "random.h"
@@ -62,6 +66,32 @@ TEST(CuckooMapTest, Find) {
   EXPECT_EQ(cuckoo.Find(4), nullptr);
 }
 
+// Test FindBatch function
+TEST(CuckooMapTest, FindBatch) {
+  CuckooMap<uint32_t, uint16_t> cuckoo;
+  const std::pair<uint32_t, uint16_t>* entries[100];
+  uint32_t keys[100];
+
+  for (uint32_t i = 0; i < 100; i++) {
+    keys[i] = i;
+    if (i % 3 == 0) {
+      cuckoo.Insert(i, i + 1);
+    }
+  }
+
+  EXPECT_EQ(cuckoo.FindBatch(keys, 0, entries), 0);
+  EXPECT_EQ(cuckoo.FindBatch(keys, 100, entries), 34);
+  for (uint32_t i = 0; i < 100; i++) {
+    if (i % 3 == 0) {
+      ASSERT_NE(entries[i], nullptr);
+      EXPECT_EQ(entries[i]->first, i);
+      EXPECT_EQ(entries[i]->second, i + 1);
+    } else {
+      EXPECT_EQ(entries[i], nullptr);
+    }
+  }
+}
+
 // Test Remove function
 TEST(CuckooMapTest, Remove) {
   CuckooMap<uint32_t, uint16_t> cuckoo;
@@ -220,4 +250,137 @@ TEST(CuckooMapTest, RandomTest) {
   }
 }
 
+// Keys inlined in buckets must stay consistent across cuckoo moves and
+// table expansion
+TEST(CuckooMapTest, InlineKeys) {
+  typedef uint64_t key_t;
+  typedef uint32_t value_t;
+
+  const size_t iterations = 1000000;
+  const size_t array_size = 100000;
+  std::vector<value_t> truth(array_size);  // 0 means empty
+  Random rd;
+
+  CuckooMap<key_t, value_t, std::hash<key_t>, std::equal_to<key_t>, true>
+      cuckoo;
+
+  for (size_t i = 0; i < iterations; i++) {
+    uint32_t odd = rd.GetRange(10);
+    key_t idx = rd.GetRange(array_size);
+    key_t key = (idx << 32) | idx;  // only the lower half is hashed
+
+    if (odd < 3) {
+      value_t val = rd.Get() | 1;
+      ASSERT_NE(nullptr, cuckoo.Insert(key, val));
+      truth[idx] = val;
+    } else if (odd == 3) {
+      EXPECT_EQ(truth[idx] != 0, cuckoo.Remove(key));
+      truth[idx] = 0;
+    } else {
+      auto ret = cuckoo.Find(key);
+      if (truth[idx] == 0) {
+        EXPECT_EQ(nullptr, ret);
+      } else {
+        ASSERT_NE(nullptr, ret);
+        EXPECT_EQ(key, ret->first);
+        EXPECT_EQ(truth[idx], ret->second);
+      }
+    }
+  }
+
+  size_t count = 0;
+  for (const auto &e : cuckoo) {
+    EXPECT_EQ(truth[e.first & 0xffffffff], e.second);
+    count++;
+  }
+  EXPECT_EQ(cuckoo.Count(), count);
+}
+
+// Readers must always find the keys that are never removed, while a writer
+// keeps inserting, updating, and removing other keys and growing the table.
+TEST(CuckooMapTest, ConcurrentReads) {
+  typedef uint32_t key_t;
+  typedef uint64_t value_t;
+
+  const int num_readers = 3;
+  const key_t num_stable = 1000;
+  const size_t iterations = 200000;
+
+  CuckooMap<key_t, value_t> cuckoo;
+  cuckoo.EnableConcurrentReads();
+
+  // Stable keys are even, and their values are (key << 32) | version
+  for (key_t i = 0; i < num_stable; i++) {
+    cuckoo.Insert(i * 2, static_cast<value_t>(i * 2) << 32);
+  }
+
+  std::atomic<bool> done(false);
+  std::atomic<uint64_t> lookups[num_readers];
+  std::atomic<uint64_t> errors(0);
+  std::vector<std::thread> readers;
+
+  for (int r = 0; r < num_readers; r++) {
+    lookups[r] = 0;
+    readers.emplace_back([&, r]() {
+      Random rd;
+      rd.SetSeed(r + 1);
+      while (!done) {
+        key_t key = rd.GetRange(num_stable * 2);
+        const auto *entry =
+            static_cast<const decltype(cuckoo) &>(cuckoo).Find(key);
+        if (key % 2 == 0) {
+          if (!entry || entry->first != key || entry->second >> 32 != key) {
+            errors++;
+          }
+        } else if (entry && entry->first != key) {
+          errors++;
+        }
+        lookups[r]++;
+      }
+    });
+  }
+
+  // Waits until every reader has finished the lookup it was in
+  auto synchronize = [&]() {
+    uint64_t snapshot[num_readers];
+    for (int r = 0; r < num_readers; r++) {
+      snapshot[r] = lookups[r];
+    }
+    for (int r = 0; r < num_readers; r++) {
+      while (lookups[r] == snapshot[r]) {
+      }
+    }
+  };
+
+  Random rd;
+  for (size_t i = 0; i < iterations; i++) {
+    uint32_t odd = rd.GetRange(10);
+    key_t idx = rd.GetRange(num_stable * 8);
+
+    if (odd < 4) {
+      cuckoo.Insert(idx * 2 + 1, idx);
+    } else if (odd < 8) {
+      cuckoo.Remove(idx * 2 + 1);
+    } else {
+      key_t key = rd.GetRange(num_stable) * 2;
+      cuckoo.Insert(key, (static_cast<value_t>(key) << 32) | i);
+    }
+
+    if (i % 1000 == 0 && cuckoo.NeedsReclaim()) {
+      synchronize();
+      cuckoo.Reclaim();
+    }
+  }
+
+  done = true;
+  for (auto &t : readers) {
+    t.join();
+  }
+
+  EXPECT_EQ(0, errors);
+  for (key_t i = 0; i < num_stable; i++) {
+    ASSERT_NE(nullptr, cuckoo.Find(i * 2));
+  }
+}
+
 }  // namespace (unnamed)
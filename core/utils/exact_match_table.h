@@ -219,6 +219,16 @@ class ExactMatchTable {
   // Remove all rules from the table.
   void ClearRules() { table_.Clear(); }
 
+  // Allow Find() from other threads while rules are updated. See CuckooMap.
+  void EnableConcurrentReads() { table_.EnableConcurrentReads(); }
+
+  // True if rule updates have left memory behind for Reclaim()
+  bool NeedsReclaim() const { return table_.NeedsReclaim(); }
+
+  // Free the memory left behind by rule updates, once no concurrent Find()
+  // may be using it.
+  void Reclaim() { table_.Reclaim(); }
+
   size_t Size() const { return table_.Count(); }
 
   // Extract an ExactMatchKey from `buf` based on the fields that have been
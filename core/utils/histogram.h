@@ -33,6 +33,7 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
@@ -44,8 +45,13 @@
 
 // Class for general purpose histogram. T generally should be an
 // integral type, though floating point types will also work.
-// A bin b_i corresponds for the range [i * width, (i + 1) * width)
-// (note that it's left-closed and right-open), and (i * width) is used for its
+//
+// Buckets are log-linear, as in HdrHistogram: values are counted in units of
+// "resolution", and the first 2^kBits buckets are one unit wide. Beyond that,
+// each range of [2^k, 2^(k+1)) units is split into 2^(kBits-1) buckets, so a
+// bucket is never wider than 1/2^(kBits-1) of the values in it. The number of
+// buckets grows with the log of the range, rather than with the range.
+// A bucket is left-closed and right-open, and its lowest value is used as its
 // representative value.
 template <typename T = uint64_t>
 class Histogram {
@@ -61,10 +67,14 @@ class Histogram {
     std::vector<T> percentile_values;
   };
 
-  // Construct a new histogram with "num_buckets" buckets of width
-  // "bucket_width".
-  Histogram(size_t num_buckets, T bucket_width)
-      : bucket_width_(bucket_width), buckets_(num_buckets + 1) {}
+  // Buckets are at most 1/128 (0.78%) of their values wide
+  static const int kBits = 8;
+
+  // Construct a new histogram of values up to "max_value", at least, with
+  // the given resolution.
+  Histogram(T resolution, T max_value) : resolution_(), buckets_() {
+    Resize(resolution, max_value);
+  }
 
   // Swap operator allows clean summarizing with external lock,
   // when using a histogram on an active data stream.
@@ -74,19 +84,19 @@ class Histogram {
   // from tmphist while new data accumulate into datahist.
   void swap(Histogram &other) noexcept {
     using std::swap;
-    swap(bucket_width_, other.bucket_width_);
+    swap(resolution_, other.resolution_);
     swap(buckets_, other.buckets_);
   }
 
   // Move constructor and assignment operator to take from another
   // histogram -- note that this is very much non-atomic.
   Histogram(Histogram &&other) noexcept {
-    bucket_width_ = other.bucket_width_;
+    resolution_ = other.resolution_;
     buckets_ = std::move(other.buckets_);
   }
 
   Histogram &operator=(Histogram &&other) noexcept {
-    bucket_width_ = other.bucket_width_;
+    resolution_ = other.resolution_;
     buckets_ = std::move(other.buckets_);
     return *this;
   }
@@ -94,22 +104,25 @@ class Histogram {
   // Inserts x into the histogram.
   // Note: this particular insert is NOT atomic.
   void Insert(T x) {
-    // The last element of the buckets_ is used to count data points above
-    // the upper bound of the histogram range.
-    size_t index = x / bucket_width_;
-    index = std::min(index, buckets_.size() - 1);
+    size_t index = IndexOf(x);
     buckets_[index].store(1 + buckets_[index].load(std::memory_order_relaxed),
                           std::memory_order_relaxed);
   }
 
   // Inserts x into the histogram.
   // Note: this particular insert IS atomic.
-  void AtomicInsert(T x) {
-    // The last element of the buckets_ is used to count data points above
-    // the upper bound of the histogram range.
-    size_t index = x / bucket_width_;
-    index = std::min(index, buckets_.size() - 1);
-    buckets_[index].fetch_add(1);
+  void AtomicInsert(T x) { buckets_[IndexOf(x)].fetch_add(1); }
+
+  // Adds the counts of "other", which must have the same resolution and
+  // range. Insert()s into "other" may go on concurrently.
+  void Merge(const Histogram &other) {
+    CHECK_EQ(resolution_, other.resolution_);
+    CHECK_EQ(buckets_.size(), other.buckets_.size());
+    for (size_t i = 0; i < buckets_.size(); i++) {
+      buckets_[i].store(buckets_[i].load(std::memory_order_relaxed) +
+                            other.buckets_[i].load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+    }
   }
 
   // Returns the summary of the histogram.
@@ -124,7 +137,8 @@ class Histogram {
   // percentile_values
   const Summary Summarize(const std::vector<double> &percentiles = {}) const {
     Summary ret = {};
-    uint64_t count = std::accumulate(buckets_.begin(), buckets_.end(), 0);
+    uint64_t count =
+        std::accumulate(buckets_.begin(), buckets_.end(), uint64_t{0});
     ret.count = count;
     ret.above_range = buckets_.back();
     ret.percentile_values = std::vector<T>(percentiles.size());
@@ -136,7 +150,7 @@ class Histogram {
     auto percentile_value_it = ret.percentile_values.begin();
 
     for (size_t i = 0; i < buckets_.size(); i++) {
-      T val = i * bucket_width_;
+      T val = BucketValue(i) * resolution_;
       T freq = buckets_[i];
       total += val * freq;
       count_so_far += freq;
@@ -176,13 +190,7 @@ class Histogram {
   }
 
   size_t num_buckets() const { return buckets_.size(); }
-  T bucket_width() const { return bucket_width_; }
-
-  size_t max_num_buckets() const {
-    // This constant is mainly to keep resets to a reasonable speed.
-    const size_t max_buckets = 10'000'000;
-    return std::min(max_buckets, buckets_.max_size());
-  }
+  T resolution() const { return resolution_; }
 
   // Resets all counters, and the count of such counters.
   // Note that the number of buckets remains unchanged.
@@ -190,14 +198,44 @@ class Histogram {
 
   // Resize the histogram.  Note that this resets it (i.e., this
   // does not attempt to redistribute existing counts).
-  void Resize(size_t num_buckets, T bucket_width) {
-    buckets_ = std::move(std::vector<std::atomic<uint64_t>>(num_buckets + 1));
-    bucket_width_ = bucket_width;
+  void Resize(T resolution, T max_value) {
+    uint64_t max_units =
+        std::ceil(static_cast<double>(max_value) / resolution);
+
+    // The last element of the buckets_ is used to count data points above
+    // the upper bound of the histogram range.
+    size_t num_buckets = (max_units ? BucketIndex(max_units - 1) + 1 : 0) + 1;
+    buckets_ = std::vector<std::atomic<uint64_t>>(num_buckets);
+    resolution_ = resolution;
+  }
+
+  // Returns the bucket for a value, in units
+  static size_t BucketIndex(uint64_t units) {
+    if (units < (1ull << kBits)) {
+      return units;
+    }
+
+    int shift = 64 - __builtin_clzll(units) - kBits;
+    return (static_cast<size_t>(shift) << (kBits - 1)) + (units >> shift);
+  }
+
+  // Returns the lowest value of a bucket, in units
+  static uint64_t BucketValue(size_t index) {
+    if (index < (1ull << kBits)) {
+      return index;
+    }
+
+    size_t shift = (index >> (kBits - 1)) - 1;
+    return static_cast<uint64_t>(index - (shift << (kBits - 1))) << shift;
   }
 
  private:
-  // TODO(melvin): add support for logarithmic binning
-  T bucket_width_;
+  size_t IndexOf(T x) const {
+    uint64_t units = x / resolution_;
+    return std::min(BucketIndex(units), buckets_.size() - 1);
+  }
+
+  T resolution_;
   std::vector<std::atomic<uint64_t>> buckets_;
 };
 
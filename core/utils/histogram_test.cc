@@ -37,7 +37,7 @@ TEST(HistogramTest, U32Quartiles) {
   // 1002 is out of range, thus will be floored to 1000
   const std::vector<uint32_t> values = {1, 2, 3, 4, 5, 1002};
 
-  Histogram<uint32_t> hist(1000, 1);
+  Histogram<uint32_t> hist(1, 1000);
   for (uint32_t x : values) {
     hist.Insert(x);
   }
@@ -59,7 +59,7 @@ TEST(HistogramTest, U32Quartiles) {
 TEST(HistogramTest, DoubleQuartiles) {
   const std::vector<double> values = {1.0, 1.0, 2.0, 2.0, 4.0, 6.0};
 
-  Histogram<double> hist(1000, 0.5);
+  Histogram<double> hist(0.5, 500);
   for (double x : values) {
     hist.Insert(x);
   }
@@ -78,4 +78,68 @@ TEST(HistogramTest, DoubleQuartiles) {
   EXPECT_DOUBLE_EQ(6.0, ret.percentile_values[3]);  // 100th percentile
 }
 
+TEST(HistogramTest, Buckets) {
+  const int linear = 1 << Histogram<>::kBits;
+
+  // Exact for small values
+  for (uint64_t x = 0; x < linear; x++) {
+    EXPECT_EQ(x, Histogram<>::BucketIndex(x));
+    EXPECT_EQ(x, Histogram<>::BucketValue(x));
+  }
+
+  // Contiguous, and never wider than 1/2^(kBits-1) of the values in them
+  for (size_t i = linear / 2; i < 50 * (linear / 2); i++) {
+    uint64_t lo = Histogram<>::BucketValue(i);
+    uint64_t next = Histogram<>::BucketValue(i + 1);
+    ASSERT_LT(lo, next);
+    ASSERT_LE((next - lo) * (linear / 2), lo) << i;
+    ASSERT_EQ(i, Histogram<>::BucketIndex(lo));
+    ASSERT_EQ(i, Histogram<>::BucketIndex(next - 1));
+  }
+}
+
+TEST(HistogramTest, WideRange) {
+  // 1ns to 10s
+  Histogram<uint64_t> hist(1, 10'000'000'000);
+  EXPECT_LT(hist.num_buckets(), 4000);
+
+  // 1, 1, 10, 15, 100, 150, ..., 1'000'000'000, 1'500'000'000
+  for (uint64_t x = 1; x <= 1'000'000'000; x *= 10) {
+    hist.Insert(x);
+    hist.Insert(x + x / 2);
+  }
+
+  auto ret = hist.Summarize({10.0, 50.0, 90.0});
+  EXPECT_EQ(0, ret.above_range);
+  EXPECT_EQ(1, ret.min);
+  EXPECT_NEAR(1'500'000'000, ret.max, 1'500'000'000 / 128);
+  EXPECT_EQ(10, ret.percentile_values[0]);
+  EXPECT_NEAR(100'000, ret.percentile_values[1], 100'000 / 128);
+  EXPECT_NEAR(1'000'000'000, ret.percentile_values[2], 1'000'000'000 / 128);
+}
+
+TEST(HistogramTest, Merge) {
+  Histogram<uint64_t> a(10, 1'000'000);
+  Histogram<uint64_t> b(10, 1'000'000);
+  Histogram<uint64_t> both(10, 1'000'000);
+
+  for (uint64_t x = 0; x < 2'000'000; x += 997) {
+    a.Insert(x);
+    both.Insert(x);
+    b.Insert(x / 3);
+    both.Insert(x / 3);
+  }
+
+  Histogram<uint64_t> merged(10, 1'000'000);
+  merged.Merge(a);
+  merged.Merge(b);
+
+  auto ret = merged.Summarize({50.0, 99.0});
+  auto expected = both.Summarize({50.0, 99.0});
+  EXPECT_EQ(expected.count, ret.count);
+  EXPECT_EQ(expected.above_range, ret.above_range);
+  EXPECT_EQ(expected.total, ret.total);
+  EXPECT_EQ(expected.percentile_values, ret.percentile_values);
+}
+
 }  // namespace (unnamed)
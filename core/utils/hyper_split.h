@@ -0,0 +1,300 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_UTILS_HYPER_SPLIT_H_
+#define BESS_UTILS_HYPER_SPLIT_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace bess {
+namespace utils {
+
+// A packet classifier over N fields of up to 32 bits, based on HyperSplit
+// (Qi et al., "Packet Classification Algorithms: From Theory to Practice",
+// INFOCOM 2009). Each rule is a range per field, and a lookup returns the
+// first (i.e., highest priority) rule that matches all fields of a key.
+//
+// The rules are compiled into a binary decision tree. Every internal node
+// splits the space covered by its parent in two along one field, and a leaf
+// holds the (at most kLeafRules, in most cases) rules that overlap its space,
+// in priority order. A lookup costs a tree walk plus a short scan, instead
+// of a scan of all rules. Rules that span both sides of a split are copied to
+// both; once the copies exceed kMaxCopies per rule, no more splits are made,
+// trading lookup time for bounded memory.
+//
+// The classifier is immutable once built, so it can be shared by readers.
+template <size_t N>
+class HyperSplit {
+ public:
+  struct Range {
+    uint32_t lo;
+    uint32_t hi;  // inclusive
+  };
+
+  typedef std::array<Range, N> Rule;
+  typedef std::array<uint32_t, N> Key;
+
+  // Leaves hold up to this many rules, unless they are too deep in the tree
+  static const size_t kLeafRules = 8;
+  static const int kMaxDepth = 48;
+  static const size_t kMaxCopies = 32;
+
+  explicit HyperSplit(const std::vector<Rule> &rules)
+      : rules_(rules),
+        nodes_(),
+        leaf_rules_(),
+        copies_left_(rules.size() * kMaxCopies) {
+    std::vector<uint32_t> ids(rules.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+      ids[i] = i;
+    }
+
+    Rule space;
+    for (size_t d = 0; d < N; d++) {
+      space[d] = {0, UINT32_MAX};
+    }
+
+    nodes_.emplace_back();
+    Build(0, space, ids, 0);
+  }
+
+  size_t num_rules() const { return rules_.size(); }
+  size_t num_nodes() const { return nodes_.size(); }
+
+  // Rules stored in leaves, including copies of rules that span several
+  size_t num_leaf_rules() const { return leaf_rules_.size(); }
+
+  // Returns the index of the first rule that matches 'key', or -1.
+  int Lookup(const Key &key) const {
+    const Node *node = &nodes_[0];
+    while (node->dim != kLeaf) {
+      node = &nodes_[node->child + (key[node->dim] > node->value)];
+    }
+    return MatchLeaf(*node, key);
+  }
+
+  // Batched version of Lookup(). The tree walks of all keys are interleaved,
+  // one level at a time, so that the cache misses of different keys overlap.
+  void Lookup(const Key *keys, size_t cnt, int *matches) const {
+    uint32_t cur[kMaxBatch];
+
+    for (size_t base = 0; base < cnt; base += kMaxBatch) {
+      size_t n = cnt - base;
+      if (n > kMaxBatch) {
+        n = kMaxBatch;
+      }
+      const Key *k = keys + base;
+
+      for (size_t i = 0; i < n; i++) {
+        cur[i] = 0;
+      }
+
+      bool walking = true;
+      while (walking) {
+        walking = false;
+        for (size_t i = 0; i < n; i++) {
+          const Node &node = nodes_[cur[i]];
+          if (node.dim != kLeaf) {
+            cur[i] = node.child + (k[i][node.dim] > node.value);
+            __builtin_prefetch(&nodes_[cur[i]]);
+            walking = true;
+          }
+        }
+      }
+
+      for (size_t i = 0; i < n; i++) {
+        matches[base + i] = MatchLeaf(nodes_[cur[i]], k[i]);
+      }
+    }
+  }
+
+ private:
+  static const uint8_t kLeaf = UINT8_MAX;
+  static const size_t kMaxBatch = 64;
+
+  struct Node {
+    uint32_t value;  // go to child + 1 if key[dim] > value
+    uint32_t child;  // index of the first child, or into leaf_rules_
+    uint32_t count;  // # of rules of leaves
+    uint8_t dim;     // kLeaf for leaves
+  };
+
+  static bool Match(const Rule &rule, const Key &key) {
+    for (size_t d = 0; d < N; d++) {
+      if (key[d] < rule[d].lo || key[d] > rule[d].hi) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  int MatchLeaf(const Node &leaf, const Key &key) const {
+    const uint32_t *ids = leaf_rules_.data() + leaf.child;
+    for (uint32_t i = 0; i < leaf.count; i++) {
+      if (Match(rules_[ids[i]], key)) {
+        return ids[i];
+      }
+    }
+    return -1;
+  }
+
+  static bool Covers(const Rule &rule, const Rule &space) {
+    for (size_t d = 0; d < N; d++) {
+      if (rule[d].lo > space[d].lo || rule[d].hi < space[d].hi) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Picks where to split 'space': the median of the (clipped) rule boundaries
+  // along the field that leaves the fewest rules on the larger side.
+  // Returns false if no field can be split.
+  bool ChooseSplit(const Rule &space, const std::vector<uint32_t> &ids,
+                   size_t *dim, uint32_t *value) const {
+    size_t best_cost = SIZE_MAX;
+    std::vector<uint32_t> points;
+
+    for (size_t d = 0; d < N; d++) {
+      // A boundary b splits [space.lo, b - 1] from [b, space.hi]
+      points.clear();
+      for (uint32_t id : ids) {
+        const Range &r = rules_[id][d];
+        if (r.lo > space[d].lo) {
+          points.push_back(r.lo);
+        }
+        if (r.hi < space[d].hi) {
+          points.push_back(r.hi + 1);
+        }
+      }
+      if (points.empty()) {
+        continue;
+      }
+
+      std::sort(points.begin(), points.end());
+      points.erase(std::unique(points.begin(), points.end()), points.end());
+      uint32_t v = points[points.size() / 2] - 1;
+
+      size_t left = 0;
+      size_t right = 0;
+      for (uint32_t id : ids) {
+        const Range &r = rules_[id][d];
+        left += r.lo <= v;
+        right += r.hi > v;
+      }
+
+      size_t cost = std::max(left, right) * 2 + std::min(left, right);
+      if (cost < best_cost) {
+        best_cost = cost;
+        *dim = d;
+        *value = v;
+      }
+    }
+
+    return best_cost != SIZE_MAX;
+  }
+
+  void MakeLeaf(uint32_t idx, const std::vector<uint32_t> &ids) {
+    nodes_[idx].dim = kLeaf;
+    nodes_[idx].child = leaf_rules_.size();
+    nodes_[idx].count = ids.size();
+    leaf_rules_.insert(leaf_rules_.end(), ids.begin(), ids.end());
+  }
+
+  // 'ids' are the rules that overlap 'space', in priority order
+  void Build(uint32_t idx, const Rule &space, std::vector<uint32_t> ids,
+             int depth) {
+    // Rules after one that covers the whole space can never match here
+    for (size_t i = 0; i < ids.size(); i++) {
+      if (Covers(rules_[ids[i]], space)) {
+        ids.resize(i + 1);
+        break;
+      }
+    }
+
+    size_t dim;
+    uint32_t value;
+    if (ids.size() <= kLeafRules || depth >= kMaxDepth ||
+        !ChooseSplit(space, ids, &dim, &value)) {
+      MakeLeaf(idx, ids);
+      return;
+    }
+
+    std::vector<uint32_t> left_ids;
+    std::vector<uint32_t> right_ids;
+    for (uint32_t id : ids) {
+      const Range &r = rules_[id][dim];
+      if (r.lo <= value) {
+        left_ids.push_back(id);
+      }
+      if (r.hi > value) {
+        right_ids.push_back(id);
+      }
+    }
+
+    size_t copies = left_ids.size() + right_ids.size() - ids.size();
+    if (copies > copies_left_) {
+      MakeLeaf(idx, ids);
+      return;
+    }
+    copies_left_ -= copies;
+    ids.clear();
+    ids.shrink_to_fit();
+
+    uint32_t child = nodes_.size();
+    nodes_.emplace_back();
+    nodes_.emplace_back();
+    nodes_[idx].dim = dim;
+    nodes_[idx].value = value;
+    nodes_[idx].child = child;
+
+    Rule left_space = space;
+    Rule right_space = space;
+    left_space[dim].hi = value;
+    right_space[dim].lo = value + 1;
+
+    Build(child, left_space, std::move(left_ids), depth + 1);
+    Build(child + 1, right_space, std::move(right_ids), depth + 1);
+  }
+
+  std::vector<Rule> rules_;
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> leaf_rules_;
+  size_t copies_left_;  // copies of rules that splits may still make
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_HYPER_SPLIT_H_
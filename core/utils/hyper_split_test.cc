@@ -0,0 +1,114 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "hyper_split.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "random.h"
+
+using bess::utils::HyperSplit;
+
+namespace {
+
+typedef HyperSplit<2> Classifier;
+
+int LinearLookup(const std::vector<Classifier::Rule> &rules,
+                 const Classifier::Key &key) {
+  for (size_t i = 0; i < rules.size(); i++) {
+    if (key[0] >= rules[i][0].lo && key[0] <= rules[i][0].hi &&
+        key[1] >= rules[i][1].lo && key[1] <= rules[i][1].hi) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+TEST(HyperSplitTest, Empty) {
+  Classifier c({});
+  EXPECT_EQ(-1, c.Lookup({{1, 2}}));
+}
+
+// Earlier rules take precedence over later, overlapping ones
+TEST(HyperSplitTest, Priority) {
+  std::vector<Classifier::Rule> rules;
+  for (uint32_t i = 0; i < 20; i++) {
+    rules.push_back({{{100 + i * 10, 109 + i * 10}, {0, UINT32_MAX}}});
+  }
+  rules.push_back({{{0, UINT32_MAX}, {0, UINT32_MAX}}});
+  rules.push_back({{{150, 150}, {0, 0}}});  // shadowed
+
+  Classifier c(rules);
+  EXPECT_EQ(20, c.Lookup({{0, 0}}));
+  EXPECT_EQ(0, c.Lookup({{100, 7}}));
+  EXPECT_EQ(1, c.Lookup({{110, 7}}));
+  EXPECT_EQ(5, c.Lookup({{150, 0}}));
+  EXPECT_EQ(19, c.Lookup({{299, 0}}));
+  EXPECT_EQ(20, c.Lookup({{300, 0}}));
+}
+
+// Prefixes on the first field, and single values or wildcards on the second,
+// as in ACL
+TEST(HyperSplitTest, Random) {
+  Random rd;
+  std::vector<Classifier::Rule> rules;
+  for (int i = 0; i < 2000; i++) {
+    int len = rd.GetRange(33);
+    uint32_t mask = len ? ~0u << (32 - len) : 0;
+    uint32_t addr = (rd.Get() & mask & 0xff00ffff) | 0x0a000000;
+    Classifier::Range port = {0, 65535};
+    if (rd.GetRange(2)) {
+      port.lo = port.hi = rd.GetRange(64);
+    }
+    rules.push_back({{{addr, addr | ~mask}, port}});
+  }
+
+  Classifier c(rules);
+  EXPECT_GT(c.num_nodes(), 1);
+  EXPECT_LE(c.num_leaf_rules(), rules.size() * (Classifier::kMaxCopies + 1));
+
+  std::vector<Classifier::Key> keys;
+  for (int i = 0; i < 100000; i++) {
+    const Classifier::Rule &r = rules[rd.GetRange(rules.size())];
+    uint32_t addr = r[0].lo + rd.GetRange(r[0].hi - r[0].lo + 1);
+    keys.push_back({{rd.GetRange(4) ? addr : rd.Get(), rd.GetRange(64)}});
+  }
+
+  std::vector<int> matches(keys.size());
+  c.Lookup(keys.data(), keys.size(), matches.data());
+  for (size_t i = 0; i < keys.size(); i++) {
+    int expected = LinearLookup(rules, keys[i]);
+    ASSERT_EQ(expected, c.Lookup(keys[i])) << i;
+    ASSERT_EQ(expected, matches[i]) << i;
+  }
+}
+
+}  // namespace
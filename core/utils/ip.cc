@@ -29,6 +29,7 @@
 
 #include "ip.h"
 
+#include <arpa/inet.h>
 #include <glog/logging.h>
 
 #include "bits.h"
@@ -60,6 +61,22 @@ std::string ToIpv4Address(be32_t addr) {
                              t.bytes[2], t.bytes[3]);
 }
 
+bool ParseIpv6Address(const std::string &str, Ipv6Address *addr) {
+  Ipv6Address parsed;
+  if (inet_pton(AF_INET6, str.c_str(), parsed.data()) != 1) {
+    return false;
+  }
+
+  *addr = parsed;
+  return true;
+}
+
+std::string ToIpv6Address(const Ipv6Address &addr) {
+  char buf[INET6_ADDRSTRLEN];
+  inet_ntop(AF_INET6, addr.data(), buf, sizeof(buf));
+  return buf;
+}
+
 Ipv4Prefix::Ipv4Prefix(const std::string &prefix) {
   size_t delim_pos = prefix.find('/');
 
@@ -30,6 +30,7 @@
 #ifndef BESS_UTILS_IP_H_
 #define BESS_UTILS_IP_H_
 
+#include <array>
 #include <string>
 
 #include "endian.h"
@@ -43,6 +44,15 @@ bool ParseIpv4Address(const std::string &str, be32_t *addr);
 // be32 -> string
 std::string ToIpv4Address(be32_t addr);
 
+// An IPv6 address, in network order
+typedef std::array<uint8_t, 16> Ipv6Address;
+
+// return false if string -> Ipv6Address conversion failed (*addr is unmodified)
+bool ParseIpv6Address(const std::string &str, Ipv6Address *addr);
+
+// Ipv6Address -> string
+std::string ToIpv6Address(const Ipv6Address &addr);
+
 // An IPv4 header definition loosely based on the BSD version.
 struct[[gnu::packed]] Ipv4 {
   enum Flag : uint16_t {
@@ -87,6 +97,19 @@ struct[[gnu::packed]] Ipv4 {
 static_assert(std::is_pod<Ipv4>::value, "not a POD type");
 static_assert(sizeof(Ipv4) == 20, "struct Ipv4 is incorrect");
 
+// An IPv6 header definition, without extension headers
+struct[[gnu::packed]] Ipv6 {
+  be32_t vtc_flow;        // Version, traffic class, and flow label.
+  be16_t payload_length;  // Payload length.
+  uint8_t next_header;    // Next header (protocol).
+  uint8_t hop_limit;      // Hop limit.
+  Ipv6Address src;        // Source address.
+  Ipv6Address dst;        // Destination address.
+};
+
+static_assert(std::is_pod<Ipv6>::value, "not a POD type");
+static_assert(sizeof(Ipv6) == 40, "struct Ipv6 is incorrect");
+
 struct Ipv4Prefix {
   // Implicit default constructor is not allowed
   Ipv4Prefix() = delete;
@@ -36,6 +36,9 @@ using bess::utils::be32_t;
 namespace {
 
 using bess::utils::Ipv4Prefix;
+using bess::utils::Ipv6Address;
+using bess::utils::ParseIpv6Address;
+using bess::utils::ToIpv6Address;
 
 TEST(IPTest, AddressInStr) {
   be32_t a(192 << 24 | 168 << 16 | 100 << 8 | 199);
@@ -53,6 +56,25 @@ TEST(IPTest, AddressInStr) {
   EXPECT_FALSE(ParseIpv4Address("1.1.256.1", &b));
 }
 
+TEST(IPTest, Ipv6AddressInStr) {
+  Ipv6Address a = {
+      {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01}};
+
+  std::string str = ToIpv6Address(a);
+  EXPECT_EQ(str, "2001:db8::1");
+
+  Ipv6Address b;
+  EXPECT_TRUE(ParseIpv6Address(str, &b));
+  EXPECT_EQ(a, b);
+
+  EXPECT_TRUE(ParseIpv6Address("::", &b));
+  EXPECT_EQ(Ipv6Address(), b);
+
+  EXPECT_FALSE(ParseIpv6Address("hello", &b));
+  EXPECT_FALSE(ParseIpv6Address("1.1.1.1", &b));
+  EXPECT_FALSE(ParseIpv6Address("2001:db8::1::2", &b));
+}
+
 // Check if Ipv4Prefix can be correctly constructed from strings
 TEST(IPTest, PrefixInStr) {
   Ipv4Prefix prefix_1("192.168.0.1/24");
@@ -0,0 +1,440 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef BESS_UTILS_LPM_H_
+#define BESS_UTILS_LPM_H_
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "../mem_alloc.h"
+
+namespace bess {
+namespace utils {
+
+// A longest prefix match table over N-byte keys in network order, e.g., IPv4
+// (N = 4) or IPv6 (N = 16) addresses, that maps prefixes to 24-bit values.
+//
+// The table is a multibit trie in the style of DIR-24-8 (Gupta et al.,
+// "Routing Lookups in Hardware at Memory Access Speeds", INFOCOM 1998): the
+// root is indexed by the first kRootBits bits of a key, and each further level
+// by one more byte. Every entry holds either the value and the length of the
+// longest prefix that covers it, or a group of 256 entries of the next level,
+// so that a lookup takes one memory access per level it goes through. With
+// kRootBits = 24, an IPv4 lookup takes at most two.
+//
+// Routes are added and deleted in place, touching only the entries they cover.
+// Each entry keeps the length of its prefix, so that a route overrides only
+// shorter ones, and a deleted route is replaced by the next longest one that
+// covers it. Groups are taken from a pool of up to max_groups, and are
+// returned to it when all their entries become the same again.
+//
+// Lookups may not run concurrently with updates. To update a table that is in
+// use, update a copy (see CopyFrom()) and swap them.
+template <size_t N, int kRootBits>
+class Lpm {
+ public:
+  typedef std::array<uint8_t, N> Key;
+
+  static const int kMaxDepth = N * 8;
+  static const uint32_t kMaxValue = (1u << 24) - 1;
+
+  static_assert(kRootBits % 8 == 0 && kRootBits > 0 && kRootBits <= kMaxDepth,
+                "the root must be indexed by whole bytes of a key");
+
+  // Allocates the tables on the NUMA node 'socket'. max_rules bounds the
+  // number of prefixes in the table, and max_groups the number of groups of
+  // 256 entries below the root, which must not exceed kMaxValue + 1. If the
+  // tables cannot be allocated, allocated() returns false and the table must
+  // not be used.
+  Lpm(size_t max_rules, size_t max_groups, int socket)
+      : max_rules_(max_rules),
+        max_groups_(max_groups),
+        socket_(socket),
+        num_rules_(0),
+        root_(),
+        groups_(),
+        free_groups_(),
+        rules_(kMaxDepth + 1) {
+    root_ = static_cast<uint32_t *>(
+        mem_alloc_ex(sizeof(uint32_t) << kRootBits, 64, socket));
+    groups_ = static_cast<uint32_t *>(
+        mem_alloc_ex(sizeof(uint32_t) * kGroupSize * max_groups, 64, socket));
+    if (allocated()) {
+      ResetGroups();
+    }
+  }
+
+  ~Lpm() {
+    mem_free(root_);
+    mem_free(groups_);
+  }
+
+  Lpm(const Lpm &) = delete;
+  Lpm &operator=(const Lpm &) = delete;
+
+  // Maps prefix/depth to the value, replacing the old value if the prefix is
+  // already in the table. Bits of the prefix beyond depth are ignored.
+  // Returns 0 on success, -EINVAL if depth or the value is out of range, or
+  // -ENOSPC if the table has no room for the prefix.
+  int Add(const Key &prefix, int depth, uint32_t value) {
+    if (depth < 0 || depth > kMaxDepth || value > kMaxValue) {
+      return -EINVAL;
+    }
+
+    const Key key = Mask(prefix, depth);
+    auto &rules = rules_[depth];
+    auto it = rules.find(key);
+    if (it == rules.end() && num_rules_ >= max_rules_) {
+      return -ENOSPC;
+    }
+
+    const int last = LevelOf(depth);
+    uint32_t *path[kMaxLevels] = {};
+
+    // Make sure there are enough groups to reach the last level
+    uint32_t *entry = &root_[RootIndex(key)];
+    for (int level = 0; level < last; level++) {
+      if (!IsGroup(*entry)) {
+        if (free_groups_.size() < static_cast<size_t>(last - level)) {
+          return -ENOSPC;
+        }
+        break;
+      }
+      entry = &Group(*entry)[key[kRootBytes + level]];
+    }
+
+    if (it == rules.end()) {
+      rules.emplace(key, value);
+      num_rules_++;
+    } else {
+      it->second = value;
+    }
+
+    uint32_t *table = FindTable(key, last, true, path);
+    const uint32_t leaf = Leaf(value, depth);
+    Update(table, last, RangeBegin(key, depth), RangeSize(depth),
+           [=](uint32_t e) { return Depth(e) <= depth ? leaf : e; });
+    Collapse(path, last);
+    return 0;
+  }
+
+  // Removes prefix/depth from the table. Returns 0 on success, or -ENOENT if
+  // the prefix is not in the table.
+  int Delete(const Key &prefix, int depth) {
+    if (depth < 0 || depth > kMaxDepth) {
+      return -ENOENT;
+    }
+
+    const Key key = Mask(prefix, depth);
+    if (rules_[depth].erase(key) == 0) {
+      return -ENOENT;
+    }
+    num_rules_--;
+
+    // The next longest prefix takes over
+    uint32_t replacement = kEmpty;
+    for (int d = depth - 1; d >= 0; d--) {
+      auto it = rules_[d].find(Mask(key, d));
+      if (it != rules_[d].end()) {
+        replacement = Leaf(it->second, d);
+        break;
+      }
+    }
+
+    const int last = LevelOf(depth);
+    uint32_t *path[kMaxLevels] = {};
+    uint32_t *table = FindTable(key, last, false, path);
+    if (table == nullptr) {
+      return 0;  // covered by longer prefixes only
+    }
+
+    Update(table, last, RangeBegin(key, depth), RangeSize(depth),
+           [=](uint32_t e) { return Depth(e) == depth ? replacement : e; });
+    Collapse(path, last);
+    return 0;
+  }
+
+  // Removes all prefixes
+  void Clear() {
+    for (auto &rules : rules_) {
+      rules.clear();
+    }
+    num_rules_ = 0;
+    memset(root_, 0, sizeof(uint32_t) << kRootBits);
+    ResetGroups();
+  }
+
+  // Makes this table the same as 'other', which must have the same limits
+  void CopyFrom(const Lpm &other) {
+    CHECK_EQ(max_rules_, other.max_rules_);
+    CHECK_EQ(max_groups_, other.max_groups_);
+
+    memcpy(root_, other.root_, sizeof(uint32_t) << kRootBits);
+    memcpy(groups_, other.groups_, sizeof(uint32_t) * kGroupSize * max_groups_);
+    free_groups_ = other.free_groups_;
+    rules_ = other.rules_;
+    num_rules_ = other.num_rules_;
+  }
+
+  // Returns true and sets *value if a prefix of the table covers key
+  bool Lookup(const Key &key, uint32_t *value) const {
+    uint32_t e = root_[RootIndex(key)];
+    for (size_t i = kRootBytes; IsGroup(e); i++) {
+      e = Group(e)[key[i]];
+    }
+
+    if (e == kEmpty) {
+      return false;
+    }
+    *value = e & kMaxValue;
+    return true;
+  }
+
+  // Looks up cnt keys, and sets values[i] to the value for keys[i], or to
+  // default_value if no prefix covers it. Each level is resolved for all keys
+  // before the next, so that their memory accesses overlap.
+  void LookupBatch(const Key *keys, size_t cnt, uint32_t *values,
+                   uint32_t default_value) const {
+    for (size_t i = 0; i < cnt; i++) {
+      values[i] = root_[RootIndex(keys[i])];
+    }
+
+    bool more = true;
+    for (size_t b = kRootBytes; b < N && more; b++) {
+      more = false;
+      for (size_t i = 0; i < cnt; i++) {
+        if (IsGroup(values[i])) {
+          values[i] = Group(values[i])[keys[i][b]];
+          more = true;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < cnt; i++) {
+      values[i] = (values[i] == kEmpty) ? default_value : values[i] & kMaxValue;
+    }
+  }
+
+  // Calls f(prefix, depth, value) for every prefix in the table
+  template <typename F>
+  void ForEachRule(F f) const {
+    for (int depth = 0; depth <= kMaxDepth; depth++) {
+      for (const auto &rule : rules_[depth]) {
+        f(rule.first, depth, rule.second);
+      }
+    }
+  }
+
+  bool allocated() const { return root_ && groups_; }
+  size_t num_rules() const { return num_rules_; }
+  size_t num_groups() const { return max_groups_ - free_groups_.size(); }
+  size_t max_rules() const { return max_rules_; }
+  size_t max_groups() const { return max_groups_; }
+  int socket() const { return socket_; }
+
+ private:
+  static const size_t kRootBytes = kRootBits / 8;
+  static const int kMaxLevels = 1 + N - kRootBytes;
+  static const size_t kGroupSize = 256;
+
+  // An entry is kEmpty, a group (kGroupTag << 24 | group index), or a leaf
+  // ((depth + 1) << 24 | value).
+  static const uint32_t kEmpty = 0;
+  static const uint32_t kGroupTag = 0xff;
+
+  static_assert(kMaxDepth + 1 < kGroupTag, "depth does not fit in an entry");
+
+  struct KeyHash {
+    size_t operator()(const Key &key) const {
+      size_t h = 0;
+      for (uint8_t b : key) {
+        h = h * 131 + b;
+      }
+      return h;
+    }
+  };
+
+  static uint32_t Leaf(uint32_t value, int depth) {
+    return static_cast<uint32_t>(depth + 1) << 24 | value;
+  }
+
+  static bool IsGroup(uint32_t e) { return (e >> 24) == kGroupTag; }
+
+  // Returns the depth of a leaf, or -1 if empty
+  static int Depth(uint32_t e) { return static_cast<int>(e >> 24) - 1; }
+
+  static Key Mask(const Key &prefix, int depth) {
+    Key key = prefix;
+    for (int i = 0; i < kMaxDepth / 8; i++) {
+      int bits = std::min(std::max(depth - i * 8, 0), 8);
+      key[i] &= static_cast<uint8_t>(0xff00 >> bits);
+    }
+    return key;
+  }
+
+  static uint32_t RootIndex(const Key &key) {
+    uint32_t idx = 0;
+    for (size_t i = 0; i < kRootBytes; i++) {
+      idx = idx << 8 | key[i];
+    }
+    return idx;
+  }
+
+  // The level of the entries that a prefix of the depth covers
+  static int LevelOf(int depth) {
+    return depth <= kRootBits ? 0 : (depth - kRootBits + 7) / 8;
+  }
+
+  // The number of prefix bits that the entries of the level resolve
+  static int LevelEnd(int level) { return kRootBits + level * 8; }
+
+  // Entries of the last level that a prefix covers
+  static size_t RangeSize(int depth) {
+    return size_t{1} << (LevelEnd(LevelOf(depth)) - depth);
+  }
+
+  static size_t RangeBegin(const Key &key, int depth) {
+    int level = LevelOf(depth);
+    size_t idx = (level == 0) ? RootIndex(key) : key[kRootBytes + level - 1];
+    return idx & ~(RangeSize(depth) - 1);
+  }
+
+  uint32_t *Group(uint32_t e) const {
+    return &groups_[(e & kMaxValue) * kGroupSize];
+  }
+
+  void ResetGroups() {
+    free_groups_.clear();
+    for (size_t i = max_groups_; i > 0; i--) {
+      free_groups_.push_back(i - 1);
+    }
+  }
+
+  // Returns the table of the level that covers the key, and the entries that
+  // lead there in path[0..level). If create is true, leaves on the way are
+  // split into groups, or else nullptr is returned where there is no group.
+  uint32_t *FindTable(const Key &key, int level, bool create,
+                      uint32_t **path) {
+    uint32_t *table = root_;
+    size_t idx = RootIndex(key);
+
+    for (int l = 0; l < level; l++) {
+      uint32_t *entry = &table[idx];
+      if (!IsGroup(*entry)) {
+        if (!create) {
+          return nullptr;
+        }
+        *entry = NewGroup(*entry);
+      }
+      path[l] = entry;
+      table = Group(*entry);
+      idx = key[kRootBytes + l];
+    }
+    return table;
+  }
+
+  // Returns a group (entry) of 256 copies of the leaf
+  uint32_t NewGroup(uint32_t leaf) {
+    DCHECK(!free_groups_.empty());
+    uint32_t idx = free_groups_.back();
+    free_groups_.pop_back();
+
+    uint32_t *group = &groups_[idx * kGroupSize];
+    for (size_t i = 0; i < kGroupSize; i++) {
+      group[i] = leaf;
+    }
+    return kGroupTag << 24 | idx;
+  }
+
+  // Applies f to the leaves in table[begin, begin + size) of the level and
+  // in the groups below them
+  template <typename F>
+  void Update(uint32_t *table, int level, size_t begin, size_t size, F f) {
+    for (size_t i = begin; i < begin + size; i++) {
+      if (IsGroup(table[i])) {
+        Update(Group(table[i]), level + 1, 0, kGroupSize, f);
+        TryCollapse(&table[i], level);
+      } else {
+        table[i] = f(table[i]);
+      }
+    }
+  }
+
+  // Replaces the group of the entry with a leaf, if all of its entries are
+  // the same leaf, and that leaf could have been set at the level
+  void TryCollapse(uint32_t *entry, int level) {
+    const uint32_t *group = Group(*entry);
+    const uint32_t first = group[0];
+    if (IsGroup(first) || Depth(first) > LevelEnd(level)) {
+      return;
+    }
+
+    for (size_t i = 1; i < kGroupSize; i++) {
+      if (group[i] != first) {
+        return;
+      }
+    }
+
+    free_groups_.push_back(*entry & kMaxValue);
+    *entry = first;
+  }
+
+  void Collapse(uint32_t **path, int level) {
+    for (int l = level - 1; l >= 0; l--) {
+      TryCollapse(path[l], l);
+    }
+  }
+
+  const size_t max_rules_;
+  const size_t max_groups_;
+  const int socket_;
+  size_t num_rules_;
+
+  uint32_t *root_;    // 2^kRootBits entries
+  uint32_t *groups_;  // max_groups_ groups of kGroupSize entries
+  std::vector<uint32_t> free_groups_;
+
+  // Prefixes of each depth, with their values
+  std::vector<std::unordered_map<Key, uint32_t, KeyHash>> rules_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_LPM_H_
@@ -0,0 +1,246 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+// Benchmarks for the LPM table, over a full Internet routing table.
+//
+// Set LPM_BENCH_TABLE to a file with one prefix per line, IPv4 or IPv6 (e.g.,
+// "1.0.4.0/22" or "2001:db8::/32", as the first field of the line), such as
+// the prefixes of a BGP table dump. Without it, tables of 900k IPv4 and 200k
+// IPv6 prefixes are made up, with the prefix lengths of a typical dump.
+
+#include "lpm.h"
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ip.h"
+#include "random.h"
+
+using bess::utils::Lpm;
+
+typedef Lpm<4, 24> Lpm4;
+typedef Lpm<16, 16> Lpm6;
+
+template <typename Key>
+struct Route {
+  Key prefix;
+  int depth;
+};
+
+struct RouteTable {
+  std::vector<Route<Lpm4::Key>> v4;
+  std::vector<Route<Lpm6::Key>> v6;
+};
+
+static void LoadTable(const char *path, RouteTable *table) {
+  std::ifstream in(path);
+  CHECK(in) << "cannot open " << path;
+
+  std::string line;
+  while (std::getline(in, line)) {
+    std::string prefix;
+    std::istringstream(line) >> prefix;
+    size_t slash = prefix.find('/');
+    if (prefix.empty() || prefix[0] == '#' || slash == std::string::npos) {
+      continue;
+    }
+
+    const std::string addr = prefix.substr(0, slash);
+    const int depth = std::atoi(prefix.c_str() + slash + 1);
+    bess::utils::be32_t v4;
+    bess::utils::Ipv6Address v6;
+
+    if (bess::utils::ParseIpv4Address(addr, &v4) && depth <= 32) {
+      Lpm4::Key key;
+      memcpy(key.data(), &v4, key.size());
+      table->v4.push_back({key, depth});
+    } else if (bess::utils::ParseIpv6Address(addr, &v6) && depth <= 128) {
+      table->v6.push_back({v6, depth});
+    }
+  }
+}
+
+// Picks a prefix length by the share of each length in the table
+static int RandomDepth(Random *rd,
+                       const std::vector<std::pair<int, int>> &pct) {
+  int r = rd->GetRange(100);
+  for (const auto &p : pct) {
+    if (r < p.second) {
+      return p.first;
+    }
+    r -= p.second;
+  }
+  return pct.back().first;
+}
+
+static void MakeTable(RouteTable *table) {
+  Random rd;
+
+  static const std::vector<std::pair<int, int>> kV4Depths = {
+      {24, 57}, {23, 9}, {22, 11}, {21, 4}, {20, 4}, {19, 3},
+      {18, 2},  {17, 1}, {16, 2},  {12, 1}, {28, 2}, {32, 4}};
+  for (int i = 0; i < 900000; i++) {
+    Lpm4::Key key;
+    uint32_t addr = rd.Get();
+    memcpy(key.data(), &addr, key.size());
+    key[0] = 1 + rd.GetRange(223);
+    table->v4.push_back({key, RandomDepth(&rd, kV4Depths)});
+  }
+
+  // Most IPv6 prefixes are /48s, in a smaller number of /32s
+  static const std::vector<std::pair<int, int>> kV6Depths = {
+      {48, 55}, {32, 15}, {29, 5}, {36, 5}, {40, 8}, {44, 7}, {64, 5}};
+  std::vector<Lpm6::Key> blocks(30000);
+  for (Lpm6::Key &block : blocks) {
+    block = {{static_cast<uint8_t>(0x20 + rd.GetRange(0x10)),
+              static_cast<uint8_t>(rd.Get()), static_cast<uint8_t>(rd.Get()),
+              static_cast<uint8_t>(rd.Get())}};
+  }
+  for (int i = 0; i < 200000; i++) {
+    Lpm6::Key key = blocks[rd.GetRange(blocks.size())];
+    for (size_t b = 4; b < 8; b++) {
+      key[b] = rd.Get();
+    }
+    table->v6.push_back({key, RandomDepth(&rd, kV6Depths)});
+  }
+}
+
+static const RouteTable &GetTable() {
+  static RouteTable *table = nullptr;
+  if (table == nullptr) {
+    table = new RouteTable();
+    const char *path = std::getenv("LPM_BENCH_TABLE");
+    if (path) {
+      LoadTable(path, table);
+    } else {
+      MakeTable(table);
+    }
+  }
+  return *table;
+}
+
+template <typename T>
+static T *Build(const std::vector<Route<typename T::Key>> &routes,
+                size_t max_groups) {
+  T *lpm = new T(routes.size(), max_groups, 0);
+  for (size_t i = 0; i < routes.size(); i++) {
+    int ret = lpm->Add(routes[i].prefix, routes[i].depth, i % 64);
+    CHECK_EQ(ret, 0);
+  }
+  return lpm;
+}
+
+// Destinations within the routed prefixes, with random host bits
+template <typename Key>
+static std::vector<Key> MakeKeys(const std::vector<Route<Key>> &routes) {
+  Random rd;
+  std::vector<Key> keys(1 << 16);
+  for (Key &key : keys) {
+    const Route<Key> &route = routes[rd.GetRange(routes.size())];
+    key = route.prefix;
+    for (size_t b = route.depth / 8; b < key.size(); b++) {
+      uint8_t host = rd.Get();
+      int bits = std::max(route.depth - static_cast<int>(b) * 8, 0);
+      key[b] = (key[b] & (0xff00 >> bits)) | (host & (0xff >> bits));
+    }
+  }
+  return keys;
+}
+
+// Arg(0) is the number of keys per lookup call
+template <typename T>
+static void LookupBench(benchmark::State &state,
+                        const std::vector<Route<typename T::Key>> &routes,
+                        size_t max_groups) {
+  typedef typename T::Key Key;
+  const size_t batch = state.range(0);
+  std::unique_ptr<T> lpm(Build<T>(routes, max_groups));
+  std::vector<Key> keys = MakeKeys(routes);
+  uint32_t values[64];
+  size_t i = 0;
+
+  while (state.KeepRunning()) {
+    if (batch == 1) {
+      benchmark::DoNotOptimize(lpm->Lookup(keys[i], values));
+    } else {
+      lpm->LookupBatch(&keys[i], batch, values, 0);
+      benchmark::DoNotOptimize(values[0]);
+    }
+    i = (i + batch) % (keys.size() - batch);
+  }
+  state.SetItemsProcessed(state.iterations() * batch);
+}
+
+// Deletes a random route and adds it back
+template <typename T>
+static void UpdateBench(benchmark::State &state,
+                        const std::vector<Route<typename T::Key>> &routes,
+                        size_t max_groups) {
+  std::unique_ptr<T> lpm(Build<T>(routes, max_groups));
+  Random rd;
+
+  while (state.KeepRunning()) {
+    // As in Build()
+    const size_t i = rd.GetRange(routes.size());
+    lpm->Delete(routes[i].prefix, routes[i].depth);
+    lpm->Add(routes[i].prefix, routes[i].depth, i % 64);
+  }
+  state.SetItemsProcessed(state.iterations() * 2);
+}
+
+static void BM_Lpm4Lookup(benchmark::State &state) {
+  LookupBench<Lpm4>(state, GetTable().v4, 1 << 16);
+}
+
+static void BM_Lpm6Lookup(benchmark::State &state) {
+  LookupBench<Lpm6>(state, GetTable().v6, 1 << 18);
+}
+
+static void BM_Lpm4Update(benchmark::State &state) {
+  UpdateBench<Lpm4>(state, GetTable().v4, 1 << 16);
+}
+
+static void BM_Lpm6Update(benchmark::State &state) {
+  UpdateBench<Lpm6>(state, GetTable().v6, 1 << 18);
+}
+
+BENCHMARK(BM_Lpm4Lookup)->Arg(1)->Arg(32);
+BENCHMARK(BM_Lpm6Lookup)->Arg(1)->Arg(32);
+BENCHMARK(BM_Lpm4Update);
+BENCHMARK(BM_Lpm6Update);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,265 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "lpm.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "random.h"
+
+using bess::utils::Lpm;
+
+namespace {
+
+typedef Lpm<4, 24> Lpm4;
+
+// A small root makes all levels of an IPv4 table easy to exercise
+typedef Lpm<4, 8> SmallLpm4;
+typedef Lpm<16, 16> Lpm6;
+
+Lpm4::Key Ip(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+  return {{a, b, c, d}};
+}
+
+TEST(LpmTest, Basic) {
+  Lpm4 lpm(16, 16, 0);
+  uint32_t value;
+
+  EXPECT_FALSE(lpm.Lookup(Ip(10, 0, 0, 1), &value));
+
+  ASSERT_EQ(0, lpm.Add(Ip(10, 0, 0, 0), 8, 1));
+  ASSERT_EQ(0, lpm.Add(Ip(10, 1, 0, 0), 16, 2));
+  ASSERT_EQ(0, lpm.Add(Ip(10, 1, 2, 128), 25, 3));
+  EXPECT_EQ(3, lpm.num_rules());
+  EXPECT_EQ(1, lpm.num_groups());
+
+  ASSERT_TRUE(lpm.Lookup(Ip(10, 0, 0, 1), &value));
+  EXPECT_EQ(1, value);
+  ASSERT_TRUE(lpm.Lookup(Ip(10, 1, 2, 127), &value));
+  EXPECT_EQ(2, value);
+  ASSERT_TRUE(lpm.Lookup(Ip(10, 1, 2, 200), &value));
+  EXPECT_EQ(3, value);
+  EXPECT_FALSE(lpm.Lookup(Ip(11, 1, 2, 200), &value));
+
+  // Replacing a value
+  ASSERT_EQ(0, lpm.Add(Ip(10, 1, 0, 0), 16, 4));
+  ASSERT_TRUE(lpm.Lookup(Ip(10, 1, 2, 127), &value));
+  EXPECT_EQ(4, value);
+  EXPECT_EQ(3, lpm.num_rules());
+
+  // The /16 takes over the /25, and the group is no longer needed
+  ASSERT_EQ(0, lpm.Delete(Ip(10, 1, 2, 128), 25));
+  ASSERT_TRUE(lpm.Lookup(Ip(10, 1, 2, 200), &value));
+  EXPECT_EQ(4, value);
+  EXPECT_EQ(0, lpm.num_groups());
+
+  EXPECT_EQ(-ENOENT, lpm.Delete(Ip(10, 1, 2, 128), 25));
+  ASSERT_EQ(0, lpm.Delete(Ip(10, 1, 0, 0), 16));
+  ASSERT_EQ(0, lpm.Delete(Ip(10, 0, 0, 0), 8));
+  EXPECT_FALSE(lpm.Lookup(Ip(10, 1, 2, 200), &value));
+  EXPECT_EQ(0, lpm.num_rules());
+}
+
+TEST(LpmTest, Limits) {
+  Lpm4 lpm(2, 1, 0);
+  uint32_t value;
+
+  EXPECT_EQ(-EINVAL, lpm.Add(Ip(10, 0, 0, 0), 33, 1));
+  EXPECT_EQ(-EINVAL, lpm.Add(Ip(10, 0, 0, 0), 8, Lpm4::kMaxValue + 1));
+
+  // Out of groups
+  ASSERT_EQ(0, lpm.Add(Ip(10, 0, 0, 0), 32, 1));
+  EXPECT_EQ(-ENOSPC, lpm.Add(Ip(10, 0, 1, 0), 32, 2));
+  EXPECT_FALSE(lpm.Lookup(Ip(10, 0, 1, 0), &value));
+
+  // Out of rules
+  ASSERT_EQ(0, lpm.Add(Ip(0, 0, 0, 0), 0, 3));
+  EXPECT_EQ(-ENOSPC, lpm.Add(Ip(10, 0, 0, 0), 8, 4));
+  ASSERT_TRUE(lpm.Lookup(Ip(10, 0, 1, 0), &value));
+  EXPECT_EQ(3, value);
+
+  // Host bits are ignored
+  ASSERT_EQ(0, lpm.Delete(Ip(1, 2, 3, 4), 0));
+  ASSERT_EQ(0, lpm.Add(Ip(10, 0, 0, 0), 8, 4));
+
+  lpm.Clear();
+  EXPECT_EQ(0, lpm.num_rules());
+  EXPECT_EQ(0, lpm.num_groups());
+  EXPECT_FALSE(lpm.Lookup(Ip(10, 0, 0, 0), &value));
+}
+
+TEST(LpmTest, CopyFrom) {
+  Lpm4 a(16, 16, 0);
+  Lpm4 b(16, 16, 0);
+  uint32_t value;
+
+  ASSERT_EQ(0, a.Add(Ip(10, 0, 0, 0), 8, 1));
+  ASSERT_EQ(0, a.Add(Ip(10, 1, 2, 128), 25, 2));
+  ASSERT_EQ(0, b.Add(Ip(20, 0, 0, 0), 8, 3));
+
+  b.CopyFrom(a);
+  EXPECT_EQ(2, b.num_rules());
+  EXPECT_EQ(1, b.num_groups());
+  EXPECT_FALSE(b.Lookup(Ip(20, 0, 0, 1), &value));
+  ASSERT_TRUE(b.Lookup(Ip(10, 1, 2, 200), &value));
+  EXPECT_EQ(2, value);
+
+  // The copies are independent
+  ASSERT_EQ(0, b.Delete(Ip(10, 1, 2, 128), 25));
+  ASSERT_TRUE(a.Lookup(Ip(10, 1, 2, 200), &value));
+  EXPECT_EQ(2, value);
+  EXPECT_EQ(0, b.num_groups());
+  EXPECT_EQ(1, a.num_groups());
+}
+
+TEST(LpmTest, Ipv6) {
+  Lpm6 lpm(16, 16, 0);
+  Lpm6::Key a = {{0x20, 0x01, 0x0d, 0xb8}};
+  Lpm6::Key b = a;
+  b[15] = 1;
+  uint32_t value;
+
+  ASSERT_EQ(0, lpm.Add(a, 32, 1));
+  ASSERT_EQ(0, lpm.Add(b, 128, 2));
+  EXPECT_EQ(14, lpm.num_groups());
+
+  ASSERT_TRUE(lpm.Lookup(a, &value));
+  EXPECT_EQ(1, value);
+  ASSERT_TRUE(lpm.Lookup(b, &value));
+  EXPECT_EQ(2, value);
+
+  ASSERT_EQ(0, lpm.Delete(b, 128));
+  ASSERT_TRUE(lpm.Lookup(b, &value));
+  EXPECT_EQ(1, value);
+  EXPECT_EQ(2, lpm.num_groups());
+}
+
+// Compares against a linear search over the rules, with random updates of
+// prefixes of at least min_depth, over the first max_bytes of keys
+template <typename T>
+void RandomTest(int min_depth, int max_bytes) {
+  typedef typename T::Key Key;
+  const int max_depth = max_bytes * 8;
+  Random rd;
+
+  T lpm(1 << 16, 1 << 12, 0);
+  std::map<std::pair<int, Key>, uint32_t> rules;  // (depth, prefix) -> value
+
+  // Keys in a narrow space, so that prefixes overlap a lot
+  auto random_key = [&]() {
+    Key key = {};
+    for (int i = 0; i < max_bytes; i++) {
+      key[i] = rd.GetRange(4) << 6 | rd.GetRange(4);
+    }
+    return key;
+  };
+
+  auto mask = [](Key key, int depth) {
+    for (size_t i = 0; i < key.size(); i++) {
+      int bits = std::min(std::max(depth - static_cast<int>(i) * 8, 0), 8);
+      key[i] &= static_cast<uint8_t>(0xff00 >> bits);
+    }
+    return key;
+  };
+
+  auto check = [&]() {
+    for (int i = 0; i < 200; i++) {
+      Key key = random_key();
+      bool found = false;
+      uint32_t expected = 0;
+      for (auto it = rules.rbegin(); it != rules.rend(); ++it) {
+        if (mask(key, it->first.first) == it->first.second) {
+          found = true;
+          expected = it->second;
+          break;
+        }
+      }
+
+      uint32_t value;
+      ASSERT_EQ(found, lpm.Lookup(key, &value));
+      if (found) {
+        ASSERT_EQ(expected, value);
+      }
+
+      uint32_t batch_value;
+      lpm.LookupBatch(&key, 1, &batch_value, 12345);
+      ASSERT_EQ(found ? expected : 12345, batch_value);
+    }
+  };
+
+  for (int round = 0; round < 4000; round++) {
+    int depth = min_depth + rd.GetRange(max_depth - min_depth + 1);
+    Key prefix = mask(random_key(), depth);
+
+    if (rd.GetRange(3) > 0 || rules.empty()) {
+      uint32_t value = rd.GetRange(1000);
+      ASSERT_EQ(0, lpm.Add(prefix, depth, value));
+      rules[{depth, prefix}] = value;
+    } else {
+      auto it = rules.begin();
+      std::advance(it, rd.GetRange(rules.size()));
+      ASSERT_EQ(0, lpm.Delete(it->first.second, it->first.first));
+      rules.erase(it);
+    }
+
+    if (round % 100 == 0) {
+      check();
+    }
+  }
+  check();
+  EXPECT_EQ(rules.size(), lpm.num_rules());
+
+  // Every group is returned once all rules are gone
+  while (!rules.empty()) {
+    auto it = rules.begin();
+    ASSERT_EQ(0, lpm.Delete(it->first.second, it->first.first));
+    rules.erase(it);
+  }
+  EXPECT_EQ(0, lpm.num_groups());
+}
+
+// Short prefixes take long to update in a large root
+TEST(LpmTest, RandomIpv4) {
+  RandomTest<Lpm4>(16, 4);
+}
+
+TEST(LpmTest, RandomSmallRoot) {
+  RandomTest<SmallLpm4>(0, 4);
+}
+
+TEST(LpmTest, RandomIpv6) {
+  RandomTest<Lpm6>(0, 5);
+}
+
+}  // namespace
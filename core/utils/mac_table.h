@@ -0,0 +1,586 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_UTILS_MAC_TABLE_H_
+#define BESS_UTILS_MAC_TABLE_H_
+
+#include <x86intrin.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <rte_config.h>
+#include <rte_hash_crc.h>
+#include <rte_prefetch.h>
+
+#include "../mem_alloc.h"
+
+namespace bess {
+namespace utils {
+
+// An exact match table from 48-bit MAC addresses to 15-bit values (e.g.,
+// gates), for L2 forwarding.
+//
+// The table is a bucketized cuckoo hash table (Fan et al., "MemC3: Compact
+// and Concurrent MemCache with Dumber Caching and Smarter Hashing", NSDI
+// 2013): each address may be in any of the 4 slots of two buckets chosen by
+// its hash, and each bucket fills one cache line, so that a lookup touches at
+// most two cache lines. LookupBatch() hashes and prefetches the buckets of
+// all addresses before it reads any of them. When both buckets of a new
+// address are full, the entries on the shortest path to a free slot are moved
+// to their other bucket.
+//
+// The table grows by doubling, a bit at a time: the buckets of the old table
+// are moved to the new one by every update and by Step(), and until they all
+// are, lookups check both. Entries may expire at a deadline, for addresses
+// learned from traffic. Expired entries are not found, and Expire() removes
+// them.
+//
+// Lookups may not run concurrently with updates.
+class MacTable {
+ public:
+  typedef uint16_t Value;
+
+  static const Value kMaxValue = (1 << 15) - 1;
+  static const uint64_t kMaxAddr = (1ull << 48) - 1;
+
+  // Number of old buckets moved to the new table by each update or Step()
+  static const size_t kMigrateStep = 16;
+
+  // The table starts with 'buckets' buckets of 4 entries each, and may grow up
+  // to 'max_buckets' buckets. Both must be powers of 2. The buckets are
+  // allocated on the NUMA node 'socket'.
+  MacTable(size_t buckets, size_t max_buckets, int socket)
+      : max_buckets_(max_buckets),
+        socket_(socket),
+        count_(),
+        cur_(),
+        old_(),
+        cursor_(),
+        expire_cursor_(),
+        stash_() {
+    DCHECK(IsPowerOf2(buckets) && IsPowerOf2(max_buckets));
+    DCHECK_LE(buckets, max_buckets);
+    cur_ = NewTable(buckets);
+    CHECK(cur_.buckets);
+  }
+
+  ~MacTable() {
+    mem_free(cur_.buckets);
+    mem_free(old_.buckets);
+  }
+
+  MacTable(const MacTable &) = delete;
+  MacTable &operator=(const MacTable &) = delete;
+
+  static bool IsPowerOf2(size_t n) { return n && !(n & (n - 1)); }
+
+  // Maps addr to value. The entry expires at 'deadline', or never if it is 0.
+  // An entry learned from traffic is replaced. Returns 0 on success, -EINVAL
+  // if addr or value is out of range, -EEXIST if addr is already in the table
+  // and never expires, or -ENOSPC if the table is full and cannot grow any
+  // more.
+  int Add(uint64_t addr, Value value, uint32_t deadline = 0) {
+    if (addr > kMaxAddr || value > kMaxValue) {
+      return -EINVAL;
+    }
+
+    Ref ref = Find(addr, Hash(addr));
+    if (!ref.entry) {
+      return Insert(MakeEntry(addr, value), deadline);
+    }
+    if (*ref.deadline == 0) {
+      return -EEXIST;
+    }
+
+    *ref.entry = MakeEntry(addr, value);
+    *ref.deadline = deadline;
+    return 0;
+  }
+
+  // Maps addr to value, and sets the deadline of its entry, for an address
+  // seen on traffic. Entries that never expire are left as they are, so that
+  // those added by Add() take precedence. Returns as Add().
+  int Learn(uint64_t addr, Value value, uint32_t deadline) {
+    if (addr > kMaxAddr || value > kMaxValue) {
+      return -EINVAL;
+    }
+
+    Ref ref = Find(addr, Hash(addr));
+    if (!ref.entry) {
+      return Insert(MakeEntry(addr, value), deadline);
+    }
+
+    // Avoid dirtying the cache line if nothing has changed
+    uint64_t entry = MakeEntry(addr, value);
+    if (*ref.deadline != 0 &&
+        (*ref.entry != entry || *ref.deadline != deadline)) {
+      *ref.entry = entry;
+      *ref.deadline = deadline;
+    }
+    return 0;
+  }
+
+  // Returns 0 on success, or -ENOENT if addr is not in the table
+  int Delete(uint64_t addr) {
+    Ref ref = Find(addr, Hash(addr));
+    if (!ref.entry) {
+      return -ENOENT;
+    }
+
+    *ref.entry = 0;
+    *ref.deadline = 0;
+    count_--;
+
+    for (size_t i = 0; i < stash_.size(); i++) {
+      if (!(stash_[i].entry & kOccupied)) {
+        stash_[i] = stash_.back();
+        stash_.pop_back();
+        break;
+      }
+    }
+    return 0;
+  }
+
+  // Removes all entries
+  void Clear() {
+    mem_free(old_.buckets);
+    old_ = Table();
+    cursor_ = 0;
+    memset(cur_.buckets, 0, sizeof(Bucket) * (cur_.mask + 1));
+    stash_.clear();
+    count_ = 0;
+  }
+
+  // Sets *value to the value for addr and returns true, or returns false if
+  // addr is not in the table or its entry has expired as of 'now'.
+  bool Lookup(uint64_t addr, Value *value, uint32_t now = 0) const {
+    Ref ref = const_cast<MacTable *>(this)->Find(addr, Hash(addr));
+    if (!ref.entry || Expired(*ref.deadline, now)) {
+      return false;
+    }
+    *value = ValueOf(*ref.entry);
+    return true;
+  }
+
+  // Looks up cnt addresses, and sets values[i] to the value for addrs[i], or
+  // to default_value if it is not in the table. The buckets of up to kBatch
+  // addresses are prefetched before any of them is read.
+  void LookupBatch(const uint64_t *addrs, size_t cnt, Value *values,
+                   Value default_value, uint32_t now = 0) const {
+    for (size_t i = 0; i < cnt; i += kBatch) {
+      size_t n = (cnt - i < kBatch) ? cnt - i : kBatch;
+      LookupBurst(addrs + i, n, values + i, default_value, now);
+    }
+  }
+
+  // Moves some of the old buckets to the new table, if it is growing
+  void Step() {
+    if (resizing()) {
+      Migrate(kMigrateStep);
+    }
+  }
+
+  // Removes entries that have expired as of 'now' from the next 'buckets'
+  // buckets, going around the table over successive calls. Returns the number
+  // of entries removed.
+  size_t Expire(uint32_t now, size_t buckets) {
+    size_t removed = 0;
+
+    for (size_t i = 0; i < buckets; i++) {
+      Bucket &b = cur_.buckets[expire_cursor_++ & cur_.mask];
+      for (int s = 0; s < kSlots; s++) {
+        if ((b.entries[s] & kOccupied) && Expired(b.deadlines[s], now)) {
+          b.entries[s] = 0;
+          b.deadlines[s] = 0;
+          removed++;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < stash_.size();) {
+      if (Expired(stash_[i].deadline, now)) {
+        stash_[i] = stash_.back();
+        stash_.pop_back();
+        removed++;
+      } else {
+        i++;
+      }
+    }
+
+    count_ -= removed;
+    return removed;
+  }
+
+  size_t Count() const { return count_; }
+
+  // Number of buckets in the (new) table
+  size_t Buckets() const { return cur_.mask + 1; }
+
+  bool resizing() const { return old_.buckets != nullptr; }
+
+ private:
+  static const int kSlots = 4;
+  static const size_t kBatch = 32;
+
+  static const uint64_t kOccupied = 1ull << 63;
+  static const uint64_t kKeyMask = kOccupied | kMaxAddr;
+
+  // The table grows when it is this full, in 1/16ths
+  static const size_t kMaxLoad = 15;
+
+  // Bounds the search for a path to a free slot
+  static const int kMaxPath = 4;
+  static const int kMaxSearch = 256;
+
+  // Slots hold the address, the value, and whether the slot is used, in this
+  // order from the least significant bit.
+  struct alignas(64) Bucket {
+    uint64_t entries[kSlots];
+    uint32_t deadlines[kSlots];
+  };
+
+  static_assert(sizeof(Bucket) == 64, "a bucket must fill a cache line");
+
+  struct Table {
+    Bucket *buckets;
+    uint32_t mask;  // number of buckets - 1
+  };
+
+  // An entry that did not fit in the new table while it grew
+  struct StashEntry {
+    uint64_t entry;
+    uint32_t deadline;
+  };
+
+  struct Ref {
+    uint64_t *entry;
+    uint32_t *deadline;
+  };
+
+  // A slot on the search for a free slot, with the index of the previous one
+  struct PathNode {
+    uint32_t bucket;
+    int slot;
+    int prev;
+    int depth;
+  };
+
+  static uint64_t MakeEntry(uint64_t addr, Value value) {
+    return kOccupied | (static_cast<uint64_t>(value) << 48) | addr;
+  }
+
+  static uint64_t AddrOf(uint64_t entry) { return entry & kMaxAddr; }
+
+  static Value ValueOf(uint64_t entry) { return (entry >> 48) & kMaxValue; }
+
+  static bool Expired(uint32_t deadline, uint32_t now) {
+    return deadline != 0 && deadline <= now;
+  }
+
+  static uint32_t Hash(uint64_t addr) { return rte_hash_crc_8byte(addr, 0); }
+
+  static uint32_t Index(uint32_t hash, uint32_t mask) { return hash & mask; }
+
+  // The other bucket of an address in bucket 'index'. As the hash picks the
+  // bits to flip, either bucket gives the other. The multiplier is odd, so
+  // the two are never the same.
+  static uint32_t AltIndex(uint32_t hash, uint32_t index, uint32_t mask) {
+    uint32_t tag = (hash >> 16) | 1;
+    return (index ^ (tag * 0x5bd1e995)) & mask;
+  }
+
+  // Returns the slot of the address in b, or -1
+  static int FindSlot(const Bucket &b, uint64_t addr) {
+    uint64_t key = kOccupied | addr;
+#if __AVX2__
+    __m256i entries =
+        _mm256_load_si256(reinterpret_cast<const __m256i *>(b.entries));
+    entries = _mm256_and_si256(entries, _mm256_set1_epi64x(kKeyMask));
+    __m256i eq = _mm256_cmpeq_epi64(entries, _mm256_set1_epi64x(key));
+    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+    return mask ? __builtin_ctz(mask) : -1;
+#else
+    for (int s = 0; s < kSlots; s++) {
+      if ((b.entries[s] & kKeyMask) == key) {
+        return s;
+      }
+    }
+    return -1;
+#endif
+  }
+
+  static int FreeSlot(const Bucket &b) {
+    for (int s = 0; s < kSlots; s++) {
+      if (!(b.entries[s] & kOccupied)) {
+        return s;
+      }
+    }
+    return -1;
+  }
+
+  Table NewTable(size_t buckets) const {
+    Table t;
+    t.buckets = static_cast<Bucket *>(
+        mem_alloc_ex(sizeof(Bucket) * buckets, alignof(Bucket), socket_));
+    t.mask = buckets - 1;
+    return t;
+  }
+
+  Ref Find(uint64_t addr, uint32_t hash) {
+    uint32_t index = Index(hash, cur_.mask);
+    Bucket *b = &cur_.buckets[index];
+    int slot = FindSlot(*b, addr);
+    if (slot < 0) {
+      b = &cur_.buckets[AltIndex(hash, index, cur_.mask)];
+      slot = FindSlot(*b, addr);
+    }
+    if (slot >= 0) {
+      return {&b->entries[slot], &b->deadlines[slot]};
+    }
+
+    // Old buckets before the cursor have been moved already
+    if (resizing()) {
+      index = Index(hash, old_.mask);
+      uint32_t alt = AltIndex(hash, index, old_.mask);
+      for (uint32_t i : {index, alt}) {
+        if (i >= cursor_) {
+          b = &old_.buckets[i];
+          slot = FindSlot(*b, addr);
+          if (slot >= 0) {
+            return {&b->entries[slot], &b->deadlines[slot]};
+          }
+        }
+      }
+    }
+
+    for (StashEntry &e : stash_) {
+      if ((e.entry & kKeyMask) == (kOccupied | addr)) {
+        return {&e.entry, &e.deadline};
+      }
+    }
+
+    return {nullptr, nullptr};
+  }
+
+  void LookupBurst(const uint64_t *addrs, size_t cnt, Value *values,
+                   Value default_value, uint32_t now) const {
+    uint32_t hashes[kBatch];
+
+    for (size_t i = 0; i < cnt; i++) {
+      uint32_t hash = Hash(addrs[i]);
+      uint32_t index = Index(hash, cur_.mask);
+      hashes[i] = hash;
+      rte_prefetch0(&cur_.buckets[index]);
+      rte_prefetch0(&cur_.buckets[AltIndex(hash, index, cur_.mask)]);
+    }
+
+    for (size_t i = 0; i < cnt; i++) {
+      Ref ref = const_cast<MacTable *>(this)->Find(addrs[i], hashes[i]);
+      values[i] = (!ref.entry || Expired(*ref.deadline, now))
+                      ? default_value
+                      : ValueOf(*ref.entry);
+    }
+  }
+
+  int Insert(uint64_t entry, uint32_t deadline) {
+    Step();
+
+    if ((count_ + 1) * 16 > Buckets() * kSlots * kMaxLoad) {
+      Grow();  // If it fails, there may still be room
+    }
+
+    if (!Place(&cur_, entry, deadline)) {
+      int ret = Grow();
+      if (ret != 0) {
+        return ret;
+      }
+      if (!Place(&cur_, entry, deadline)) {
+        return -ENOSPC;
+      }
+    }
+
+    count_++;
+    return 0;
+  }
+
+  // Starts moving the entries to a table twice as large
+  int Grow() {
+    if (Buckets() >= max_buckets_) {
+      return -ENOSPC;
+    }
+
+    // Only two tables at a time
+    while (resizing()) {
+      Migrate(old_.mask + 1);
+    }
+
+    Table t = NewTable(Buckets() * 2);
+    if (!t.buckets) {
+      return -ENOMEM;
+    }
+
+    old_ = cur_;
+    cur_ = t;
+    cursor_ = 0;
+    return 0;
+  }
+
+  // Moves n old buckets to the new table
+  void Migrate(size_t n) {
+    for (; n > 0 && resizing(); n--) {
+      Bucket &b = old_.buckets[cursor_];
+      for (int s = 0; s < kSlots; s++) {
+        if (b.entries[s] & kOccupied) {
+          // Practically never fails, as the new table is at most half full
+          if (!Place(&cur_, b.entries[s], b.deadlines[s])) {
+            stash_.push_back({b.entries[s], b.deadlines[s]});
+          }
+        }
+      }
+
+      if (++cursor_ > old_.mask) {
+        mem_free(old_.buckets);
+        old_ = Table();
+        cursor_ = 0;
+        Unstash();
+      }
+    }
+  }
+
+  // Tries to move stashed entries back to the table
+  void Unstash() {
+    for (size_t i = 0; i < stash_.size();) {
+      if (Place(&cur_, stash_[i].entry, stash_[i].deadline)) {
+        stash_[i] = stash_.back();
+        stash_.pop_back();
+      } else {
+        i++;
+      }
+    }
+  }
+
+  // Puts the entry in one of its buckets in t, moving others out of the way
+  // if they are full. Returns false if there is no room.
+  bool Place(Table *t, uint64_t entry, uint32_t deadline) {
+    uint32_t hash = Hash(AddrOf(entry));
+    uint32_t index = Index(hash, t->mask);
+    uint32_t alt = AltIndex(hash, index, t->mask);
+
+    PathNode path[kMaxSearch];
+    int head = 0;
+    int tail = 0;
+
+    for (uint32_t i : {index, alt}) {
+      int slot = FreeSlot(t->buckets[i]);
+      if (slot >= 0) {
+        Set(t, i, slot, entry, deadline);
+        return true;
+      }
+      for (int s = 0; s < kSlots; s++) {
+        path[tail++] = {i, s, -1, 1};
+      }
+    }
+
+    // Breadth-first search for the shortest path to a free slot
+    for (; head < tail; head++) {
+      const PathNode &node = path[head];
+      uint64_t victim = t->buckets[node.bucket].entries[node.slot];
+      uint32_t victim_hash = Hash(AddrOf(victim));
+      uint32_t next = Index(victim_hash, t->mask);
+      if (next == node.bucket) {
+        next = AltIndex(victim_hash, next, t->mask);
+      }
+
+      int slot = FreeSlot(t->buckets[next]);
+      if (slot >= 0) {
+        // Move the entries along the path, starting from the last one
+        for (int i = head; i >= 0; i = path[i].prev) {
+          const Bucket &from = t->buckets[path[i].bucket];
+          Set(t, next, slot, from.entries[path[i].slot],
+              from.deadlines[path[i].slot]);
+          next = path[i].bucket;
+          slot = path[i].slot;
+        }
+        Set(t, next, slot, entry, deadline);
+        return true;
+      }
+
+      if (node.depth >= kMaxPath || tail + kSlots > kMaxSearch ||
+          OnPath(path, head, next)) {
+        continue;
+      }
+      for (int s = 0; s < kSlots; s++) {
+        path[tail++] = {next, s, head, node.depth + 1};
+      }
+    }
+
+    return false;
+  }
+
+  // Whether the path to path[i] goes through the bucket, in which case its
+  // slots could be moved twice
+  static bool OnPath(const PathNode *path, int i, uint32_t bucket) {
+    for (; i >= 0; i = path[i].prev) {
+      if (path[i].bucket == bucket) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static void Set(Table *t, uint32_t bucket, int slot, uint64_t entry,
+                  uint32_t deadline) {
+    t->buckets[bucket].entries[slot] = entry;
+    t->buckets[bucket].deadlines[slot] = deadline;
+  }
+
+  const size_t max_buckets_;
+  const int socket_;
+
+  size_t count_;
+
+  Table cur_;
+  Table old_;        // The table being moved to cur_, if growing
+  uint32_t cursor_;  // The next bucket of old_ to move
+
+  uint32_t expire_cursor_;
+
+  std::vector<StashEntry> stash_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_MAC_TABLE_H_
@@ -0,0 +1,136 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmarks for the MAC table, with 1M addresses.
+
+#include "mac_table.h"
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include <memory>
+#include <vector>
+
+#include "random.h"
+
+using bess::utils::MacTable;
+
+static const size_t kNumAddrs = 1 << 20;
+
+static const std::vector<uint64_t> &GetAddrs() {
+  static std::vector<uint64_t> *addrs = nullptr;
+  if (addrs == nullptr) {
+    Random rd;
+    addrs = new std::vector<uint64_t>();
+    for (size_t i = 0; i < kNumAddrs; i++) {
+      addrs->push_back(((static_cast<uint64_t>(rd.Get()) << 32) | rd.Get()) &
+                       MacTable::kMaxAddr);
+    }
+  }
+  return *addrs;
+}
+
+// Starts from a single bucket, so that every address goes through growth
+static MacTable *Build(const std::vector<uint64_t> &addrs) {
+  MacTable *table = new MacTable(1, 1 << 24, 0);
+  for (size_t i = 0; i < addrs.size(); i++) {
+    int ret = table->Add(addrs[i], i % 64);
+    CHECK(ret == 0 || ret == -EEXIST);
+  }
+  while (table->resizing()) {
+    table->Step();
+  }
+  return table;
+}
+
+// Arg(0) is the number of addresses per lookup call
+static void BM_MacTableLookup(benchmark::State &state) {
+  const size_t batch = state.range(0);
+  const std::vector<uint64_t> &addrs = GetAddrs();
+  std::unique_ptr<MacTable> table(Build(addrs));
+
+  // Random order, so that the buckets are not in cache
+  Random rd;
+  std::vector<uint64_t> keys(1 << 16);
+  for (uint64_t &key : keys) {
+    key = addrs[rd.GetRange(addrs.size())];
+  }
+
+  MacTable::Value values[32];
+  size_t i = 0;
+
+  while (state.KeepRunning()) {
+    if (batch == 1) {
+      benchmark::DoNotOptimize(table->Lookup(keys[i], values));
+    } else {
+      table->LookupBatch(&keys[i], batch, values, 0);
+      benchmark::DoNotOptimize(values[0]);
+    }
+    i = (i + batch) % (keys.size() - batch);
+  }
+  state.SetItemsProcessed(state.iterations() * batch);
+}
+
+// Adds all addresses to an empty table, including the time to grow
+static void BM_MacTableBuild(benchmark::State &state) {
+  const std::vector<uint64_t> &addrs = GetAddrs();
+
+  while (state.KeepRunning()) {
+    std::unique_ptr<MacTable> table(Build(addrs));
+    benchmark::DoNotOptimize(table->Count());
+  }
+  state.SetItemsProcessed(state.iterations() * addrs.size());
+}
+
+// Refreshes random learned addresses, with a sweep for expired ones
+static void BM_MacTableLearn(benchmark::State &state) {
+  const std::vector<uint64_t> &addrs = GetAddrs();
+  std::unique_ptr<MacTable> table(new MacTable(1 << 18, 1 << 24, 0));
+  for (size_t i = 0; i < addrs.size(); i++) {
+    table->Learn(addrs[i], i % 64, 100);
+  }
+
+  Random rd;
+  uint32_t now = 0;
+
+  while (state.KeepRunning()) {
+    for (int i = 0; i < 32; i++) {
+      table->Learn(addrs[rd.GetRange(addrs.size())], i, 100 + (now >> 10));
+    }
+    table->Step();
+    table->Expire(now++ >> 10, 8);
+  }
+  state.SetItemsProcessed(state.iterations() * 32);
+}
+
+BENCHMARK(BM_MacTableLookup)->Arg(1)->Arg(32);
+BENCHMARK(BM_MacTableBuild)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MacTableLearn);
+
+BENCHMARK_MAIN();
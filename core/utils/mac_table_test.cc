@@ -0,0 +1,232 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "mac_table.h"
+
+#include <gtest/gtest.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "random.h"
+
+using bess::utils::MacTable;
+
+namespace {
+
+uint64_t RandomAddr(Random *rd) {
+  return ((static_cast<uint64_t>(rd->Get()) << 32) | rd->Get()) &
+         MacTable::kMaxAddr;
+}
+
+TEST(MacTableTest, Basic) {
+  MacTable table(4, 4, 0);
+  MacTable::Value value;
+
+  EXPECT_FALSE(table.Lookup(0x0123456789ab, &value));
+  EXPECT_EQ(0, table.Add(0x0123456789ab, 1));
+  EXPECT_EQ(0, table.Add(0x000000000000, 2));
+  EXPECT_EQ(-EEXIST, table.Add(0x0123456789ab, 3));
+  EXPECT_EQ(-EINVAL, table.Add(0x10123456789ab, 3));
+  EXPECT_EQ(-EINVAL, table.Add(0x0123456789ac, 1 << 15));
+  EXPECT_EQ(2, table.Count());
+
+  ASSERT_TRUE(table.Lookup(0x0123456789ab, &value));
+  EXPECT_EQ(1, value);
+  ASSERT_TRUE(table.Lookup(0x000000000000, &value));
+  EXPECT_EQ(2, value);
+  EXPECT_FALSE(table.Lookup(0x0123456789ac, &value));
+
+  EXPECT_EQ(0, table.Delete(0x0123456789ab));
+  EXPECT_EQ(-ENOENT, table.Delete(0x0123456789ab));
+  EXPECT_FALSE(table.Lookup(0x0123456789ab, &value));
+  EXPECT_EQ(1, table.Count());
+
+  table.Clear();
+  EXPECT_FALSE(table.Lookup(0x000000000000, &value));
+  EXPECT_EQ(0, table.Count());
+}
+
+// Fills the table while it grows from a single bucket, checking that nothing
+// is lost along the way.
+TEST(MacTableTest, Grow) {
+  const size_t kEntries = 100000;
+  MacTable table(1, 1 << 20, 0);
+  std::unordered_map<uint64_t, MacTable::Value> entries;
+  std::vector<uint64_t> addrs;
+  Random rd;
+
+  while (entries.size() < kEntries) {
+    uint64_t addr = RandomAddr(&rd);
+    MacTable::Value value = rd.GetRange(MacTable::kMaxValue + 1);
+    if (entries.emplace(addr, value).second) {
+      ASSERT_EQ(0, table.Add(addr, value));
+      addrs.push_back(addr);
+    }
+
+    // Check a few, as some buckets may have been moved
+    for (int i = 0; i < 4; i++) {
+      MacTable::Value found;
+      uint64_t a = addrs[rd.GetRange(addrs.size())];
+      ASSERT_TRUE(table.Lookup(a, &found));
+      ASSERT_EQ(entries[a], found);
+    }
+  }
+
+  EXPECT_EQ(kEntries, table.Count());
+  EXPECT_GE(table.Buckets() * 4, kEntries);
+
+  while (table.resizing()) {
+    table.Step();
+  }
+
+  for (const auto &e : entries) {
+    MacTable::Value found;
+    ASSERT_TRUE(table.Lookup(e.first, &found));
+    EXPECT_EQ(e.second, found);
+  }
+
+  for (size_t i = 0; i < kEntries; i += 2) {
+    ASSERT_EQ(0, table.Delete(addrs[i]));
+  }
+  EXPECT_EQ(kEntries / 2, table.Count());
+  for (size_t i = 0; i < kEntries; i++) {
+    MacTable::Value found;
+    EXPECT_EQ(i % 2 == 1, table.Lookup(addrs[i], &found));
+  }
+}
+
+// Once the table cannot grow, it refuses new entries but keeps the others
+TEST(MacTableTest, Full) {
+  MacTable table(16, 64, 0);
+  std::vector<uint64_t> addrs;
+  Random rd;
+  int ret;
+
+  for (;;) {
+    uint64_t addr = RandomAddr(&rd);
+    if ((ret = table.Add(addr, 7)) != 0) {
+      break;
+    }
+    addrs.push_back(addr);
+    ASSERT_LE(table.Count(), 64 * 4);
+  }
+  EXPECT_EQ(-ENOSPC, ret);
+  EXPECT_EQ(64, table.Buckets());
+  // Should be mostly full
+  EXPECT_GT(table.Count(), 64 * 4 * 9 / 10);
+
+  EXPECT_EQ(addrs.size(), table.Count());
+  for (uint64_t addr : addrs) {
+    MacTable::Value found;
+    ASSERT_TRUE(table.Lookup(addr, &found));
+    EXPECT_EQ(7, found);
+  }
+}
+
+TEST(MacTableTest, LookupBatch) {
+  MacTable table(64, 1024, 0);
+  std::vector<uint64_t> addrs;
+  Random rd;
+
+  for (int i = 0; i < 1000; i++) {
+    uint64_t addr = RandomAddr(&rd);
+    if (rd.GetRange(2) && table.Add(addr, i) == 0) {
+      addrs.push_back(addr);
+    } else {
+      addrs.push_back(addr ^ 1);
+    }
+  }
+
+  std::vector<MacTable::Value> values(addrs.size());
+  table.LookupBatch(addrs.data(), addrs.size(), values.data(), 12345);
+  for (size_t i = 0; i < addrs.size(); i++) {
+    MacTable::Value found;
+    if (table.Lookup(addrs[i], &found)) {
+      EXPECT_EQ(found, values[i]);
+    } else {
+      EXPECT_EQ(12345, values[i]);
+    }
+  }
+}
+
+TEST(MacTableTest, Learn) {
+  MacTable table(4, 4, 0);
+  MacTable::Value value;
+
+  EXPECT_EQ(0, table.Add(0x020000000001, 1));
+  EXPECT_EQ(0, table.Learn(0x020000000002, 2, 10));
+  EXPECT_EQ(2, table.Count());
+
+  // Learned entries move, but static ones do not
+  EXPECT_EQ(0, table.Learn(0x020000000001, 3, 10));
+  EXPECT_EQ(0, table.Learn(0x020000000002, 4, 20));
+  ASSERT_TRUE(table.Lookup(0x020000000001, &value, 15));
+  EXPECT_EQ(1, value);
+  ASSERT_TRUE(table.Lookup(0x020000000002, &value, 15));
+  EXPECT_EQ(4, value);
+  EXPECT_EQ(2, table.Count());
+
+  // Adding a learned address makes it static
+  EXPECT_EQ(0, table.Add(0x020000000002, 5));
+  EXPECT_EQ(-EEXIST, table.Add(0x020000000002, 6));
+  ASSERT_TRUE(table.Lookup(0x020000000002, &value, 1000));
+  EXPECT_EQ(5, value);
+  EXPECT_EQ(0, table.Learn(0x020000000002, 7, 30));
+  ASSERT_TRUE(table.Lookup(0x020000000002, &value, 1000));
+  EXPECT_EQ(5, value);
+  EXPECT_EQ(0, table.Expire(1000, 4));
+  EXPECT_EQ(2, table.Count());
+}
+
+TEST(MacTableTest, Expire) {
+  MacTable table(16, 16, 0);
+  MacTable::Value value;
+
+  EXPECT_EQ(0, table.Add(0x020000000001, 1));
+  EXPECT_EQ(0, table.Learn(0x020000000002, 2, 10));
+  EXPECT_EQ(0, table.Learn(0x020000000003, 3, 20));
+
+  EXPECT_TRUE(table.Lookup(0x020000000002, &value, 9));
+  EXPECT_FALSE(table.Lookup(0x020000000002, &value, 10));
+  EXPECT_TRUE(table.Lookup(0x020000000001, &value, 10));
+
+  EXPECT_EQ(0, table.Expire(9, 16));
+  EXPECT_EQ(1, table.Expire(10, 16));
+  EXPECT_EQ(2, table.Count());
+
+  // A refreshed entry lives on
+  EXPECT_EQ(0, table.Learn(0x020000000003, 3, 30));
+  EXPECT_EQ(0, table.Expire(25, 16));
+  EXPECT_EQ(1, table.Expire(30, 16));
+  EXPECT_EQ(1, table.Count());
+  EXPECT_TRUE(table.Lookup(0x020000000001, &value, 1000));
+}
+
+}  // namespace
@@ -0,0 +1,137 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "steal_deque.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using bess::utils::StealDeque;
+
+TEST(StealDequeTest, Empty) {
+  StealDeque<int, 8> q = {};
+  int x;
+  EXPECT_TRUE(q.Empty());
+  EXPECT_FALSE(q.Pop(&x));
+  EXPECT_FALSE(q.Steal(&x));
+  EXPECT_EQ(0, q.Size());
+}
+
+// Pop() takes the newest item and Steal() the oldest
+TEST(StealDequeTest, PopAndSteal) {
+  StealDeque<int, 8> q = {};
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(q.Push(i));
+  }
+  EXPECT_EQ(4, q.Size());
+
+  int x;
+  ASSERT_TRUE(q.Pop(&x));
+  EXPECT_EQ(3, x);
+  ASSERT_TRUE(q.Steal(&x));
+  EXPECT_EQ(0, x);
+  ASSERT_TRUE(q.Steal(&x));
+  EXPECT_EQ(1, x);
+  ASSERT_TRUE(q.Pop(&x));
+  EXPECT_EQ(2, x);
+  EXPECT_FALSE(q.Pop(&x));
+  EXPECT_FALSE(q.Steal(&x));
+  EXPECT_TRUE(q.Empty());
+}
+
+TEST(StealDequeTest, Full) {
+  StealDeque<int, 4> q = {};
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(q.Push(i));
+  }
+  EXPECT_FALSE(q.Push(4));
+
+  int x;
+  ASSERT_TRUE(q.Steal(&x));
+  EXPECT_EQ(0, x);
+  ASSERT_TRUE(q.Push(4));
+
+  for (int i = 1; i <= 4; i++) {
+    ASSERT_TRUE(q.Steal(&x));
+    EXPECT_EQ(i, x);
+  }
+}
+
+// Every item pushed is taken exactly once, by either the owner or a thief.
+TEST(StealDequeTest, ConcurrentSteal) {
+  const int kItems = 100000;
+  const int kThieves = 3;
+
+  StealDeque<int, 64> q = {};
+  std::vector<std::atomic<int>> taken(kItems);
+  for (auto &t : taken) {
+    t = 0;
+  }
+  std::atomic<bool> done(false);
+
+  std::vector<std::thread> thieves;
+  for (int i = 0; i < kThieves; i++) {
+    thieves.emplace_back([&]() {
+      int x;
+      while (!done || !q.Empty()) {
+        if (q.Steal(&x)) {
+          taken[x]++;
+        }
+      }
+    });
+  }
+
+  int x;
+  for (int i = 0; i < kItems; i++) {
+    while (!q.Push(i)) {
+      if (q.Pop(&x)) {
+        taken[x]++;
+      }
+    }
+  }
+  while (q.Pop(&x)) {
+    taken[x]++;
+  }
+  done = true;
+
+  for (auto &t : thieves) {
+    t.join();
+  }
+
+  for (int i = 0; i < kItems; i++) {
+    ASSERT_EQ(1, taken[i]) << "item " << i;
+  }
+}
+
+}  // namespace
@@ -30,6 +30,8 @@
 #ifndef BESS_UTILS_TCP_FLOW_RECONSTRUCT_H_
 #define BESS_UTILS_TCP_FLOW_RECONSTRUCT_H_
 
+#include <algorithm>
+#include <utility>
 #include <vector>
 
 #include "../packet.h"
@@ -47,10 +49,26 @@ class TcpFlowReconstruct {
   // Constructs a TCP flow reconstruction object that can hold initial_buflen
   // bytes to start with.
   explicit TcpFlowReconstruct(size_t initial_buflen = 1024)
-      : initialized_(false), init_seq_(0), buf_(initial_buflen) {}
+      : initialized_(false),
+        init_seq_(0),
+        initial_buflen_(initial_buflen),
+        buf_(initial_buflen),
+        segments_() {}
 
   virtual ~TcpFlowReconstruct() {}
 
+  // Forgets the flow, so that this object can be reused for another one
+  // without allocating memory. The buffer is kept, unless it has grown larger
+  // than max_buflen, in which case it goes back to its initial size.
+  void Reset(size_t max_buflen) {
+    initialized_ = false;
+    init_seq_ = 0;
+    segments_.clear();
+    if (buf_.size() > max_buflen) {
+      std::vector<char>(initial_buflen_).swap(buf_);
+    }
+  }
+
   // Returns the underlying buffer of reconstructed flow bytes.  Not guaranteed
   // to return the same pointer between calls to InsertPacket().
   const char *buf() const { return buf_.data(); }
@@ -64,8 +82,9 @@ class TcpFlowReconstruct {
   // Returns the length of contiguous data available in the buffer starting from
   // the beginning.  Updated every time InsertPacket() is called.
   size_t contiguous_len() const {
-    const auto it = received_map_.begin();
-    return (it == received_map_.end()) ? 0 : (it->second - it->first);
+    return segments_.empty()
+               ? 0
+               : (segments_.front().second - segments_.front().first);
   }
 
   // Adds the data of the given packet based upon its TCP sequence number.  If
@@ -132,8 +151,10 @@ class TcpFlowReconstruct {
     // existing segments with a hole   |---A---|   |--B--|-C-|
     //                                             ^
     //                                             lower_bound(start)
-    auto it = received_map_.lower_bound(start);
-    if (it != received_map_.begin()) {
+    auto it = std::lower_bound(
+        segments_.begin(), segments_.end(), start,
+        [](const Segment &s, uint32_t offset) { return s.first < offset; });
+    if (it != segments_.begin()) {
       auto it_prev = it;
       it_prev--;
       if (it_prev->second >= start) {
@@ -145,14 +166,20 @@ class TcpFlowReconstruct {
       }
     }
 
-    // Remove all ovlerapping segments
-    while (it != received_map_.end() && it->first <= end) {
-      end = std::max(end, it->second);
-      it = received_map_.erase(it);
+    // Find all ovlerapping segments
+    auto last = it;
+    while (last != segments_.end() && last->first <= end) {
+      end = std::max(end, last->second);
+      last++;
     }
 
-    // Insert the merged segment
-    received_map_.emplace(start, end);
+    // Replace them with the merged segment
+    if (it == last) {
+      segments_.insert(it, Segment(start, end));
+    } else {
+      *it = Segment(start, end);
+      segments_.erase(it + 1, last);
+    }
 
     return true;
   }
@@ -165,13 +192,17 @@ class TcpFlowReconstruct {
   // The initial sequence number of data bytes in the TCP flow.
   uint32_t init_seq_;
 
+  // The size of buf_ to start with.
+  size_t initial_buflen_;
+
   // A buffer (potentially with holes) of received data.
   std::vector<char> buf_;
 
   // Sorted list of received segments. Segments are merged as necessary.
-  // Key: offset from init_seq_
-  // T: end offset of the segment
-  std::map<uint32_t, uint32_t> received_map_;
+  // first: offset from init_seq_
+  // second: end offset of the segment
+  typedef std::pair<uint32_t, uint32_t> Segment;
+  std::vector<Segment> segments_;
 
   DISALLOW_COPY_AND_ASSIGN(TcpFlowReconstruct);
 };
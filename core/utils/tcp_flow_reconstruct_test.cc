@@ -141,6 +141,26 @@ TEST_F(TcpFlowReconstructTest, ReorderedReconstruction) {
   } while (std::next_permutation(pkt_rotation.begin(), pkt_rotation.end()));
 }
 
+// Tests that a flow can be reconstructed again after a reset, with or without
+// the buffer going back to its initial size.
+TEST_F(TcpFlowReconstructTest, Reset) {
+  TcpFlowReconstruct t(1);
+
+  for (size_t max_buflen : {SIZE_MAX, size_t{1}}) {
+    for (Packet *p : pkts_) {
+      ASSERT_TRUE(t.InsertPacket(p));
+    }
+    ASSERT_EQ(bytestream_.size(), t.contiguous_len());
+    EXPECT_EQ(0, memcmp(t.buf(), bytestream_.data(), bytestream_.size()));
+
+    size_t buf_size = t.buf_size();
+    t.Reset(max_buflen);
+    EXPECT_EQ(0, t.contiguous_len());
+    EXPECT_EQ(max_buflen == 1 ? 1 : buf_size, t.buf_size());
+    ASSERT_FALSE(t.InsertPacket(pkts_[1]));
+  }
+}
+
 // Tests that we reject packet insertion without the SYN.
 TEST_F(TcpFlowReconstructTest, MissingSyn) {
   Packet *syn = pkts_[0];
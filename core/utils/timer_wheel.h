@@ -0,0 +1,300 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BESS_UTILS_TIMER_WHEEL_H_
+#define BESS_UTILS_TIMER_WHEEL_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bess {
+namespace utils {
+
+// A hierarchical timing wheel (Varghese & Lauck) that holds values until their
+// expiry time (e.g., in TSC cycles) has passed. Time is divided into ticks of
+// 2^tick_shift units. Add() and Remove() take constant time, and Expire()
+// takes constant time per expired value (and per value that moves down one
+// level of the hierarchy), plus one step per 2^kSlotBits ticks of idle time.
+//
+// A value is expired by the first call to Expire() whose tick is past the tick
+// of its expiry time, so it may be up to one tick late, but never early.
+template <typename T>
+class TimerWheel {
+ public:
+  static const int kSlotBits = 8;
+  static const size_t kSlots = 1 << kSlotBits;
+  static const int kLevels = 4;
+
+  // Values that expire more than kRange ticks in the future are parked at the
+  // top level, and are put back when they come up.
+  static const uint64_t kRange = 1ull << (kSlotBits * kLevels);
+
+  // 'now' is the current time, in the same unit as expiry times.
+  explicit TimerWheel(int tick_shift = 0, uint64_t now = 0)
+      : tick_shift_(tick_shift),
+        now_(now >> tick_shift),
+        size_(),
+        occupied_(),
+        slots_(),
+        scratch_() {}
+
+  int tick_shift() const { return tick_shift_; }
+
+  size_t Size() const { return size_; }
+  bool Empty() const { return size_ == 0; }
+
+  void Add(uint64_t expiry, const T &value) { Insert({expiry, value}); }
+
+  // Removes 'value' that was added with 'expiry'. Returns false if not found.
+  bool Remove(uint64_t expiry, const T &value) {
+    uint64_t t = std::max(expiry >> tick_shift_, now_);
+    for (int level = 0; level < kLevels; level++) {
+      size_t idx = (t >> (kSlotBits * level)) & kSlotMask;
+      if (RemoveFromSlot(level, idx, value)) {
+        return true;
+      }
+    }
+
+    // Values that were beyond kRange are not where their expiry time says
+    for (int level = 0; level < kLevels; level++) {
+      for (size_t idx = 0; idx < kSlots; idx++) {
+        if (RemoveFromSlot(level, idx, value)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // Calls f(value) for every value whose expiry tick is before the tick of
+  // 'now'. 'f' may Add() values, but must not Remove() them.
+  template <typename F>
+  void Expire(uint64_t now, F f) {
+    Expire(now, f, SIZE_MAX);
+  }
+
+  // Same as above, but stops after 'budget' values, leaving the rest for the
+  // next call. Returns the number of values expired.
+  template <typename F>
+  size_t Expire(uint64_t now, F f, size_t budget) {
+    uint64_t target = now >> tick_shift_;
+    size_t expired = 0;
+    while (now_ < target && expired < budget) {
+      if (size_ == 0) {
+        now_ = target;
+        break;
+      }
+
+      size_t idx = now_ & kSlotMask;
+      if (idx == 0) {
+        Cascade(1);
+      }
+
+      size_t d = NextOccupied(0, idx);
+      if (d < kSlots - idx) {
+        if (d >= target - now_) {
+          now_ = target;
+          break;
+        }
+        now_ += d;
+        expired += ExpireSlot(now_ & kSlotMask, f, budget - expired);
+        if (expired < budget) {
+          now_++;
+        }
+        continue;
+      }
+
+      // Nothing left in this round of level 0. Skip to the next round, or
+      // further if there is nothing to cascade until then.
+      uint64_t next = now_ - idx + kSlots;
+      if (d == kSlots) {
+        next = std::max(next, NextCascade());
+      }
+      now_ = std::min(next, target);
+    }
+    return expired;
+  }
+
+  // Returns a lower bound of the time when the next value will be expired, or
+  // UINT64_MAX if the wheel is empty.
+  uint64_t NextExpiry() const {
+    if (size_ == 0) {
+      return UINT64_MAX;
+    }
+
+    uint64_t tick = NextCascade();
+    size_t d = NextOccupied(0, now_ & kSlotMask);
+    if (d < kSlots) {
+      tick = std::min(tick, now_ + d);
+    }
+    return (tick + 1) << tick_shift_;
+  }
+
+ private:
+  static const size_t kSlotMask = kSlots - 1;
+  static const size_t kWordBits = 64;
+
+  struct Entry {
+    uint64_t expiry;
+    T value;
+  };
+
+  typedef std::vector<Entry> Slot;
+
+  void Insert(const Entry &e) {
+    uint64_t t = std::max(e.expiry >> tick_shift_, now_);
+    uint64_t delta = t - now_;
+    if (delta >= kRange) {
+      delta = kRange - 1;
+      t = now_ + delta;
+    }
+
+    int level = 0;
+    while (delta >> (kSlotBits * (level + 1))) {
+      level++;
+    }
+
+    size_t idx = (t >> (kSlotBits * level)) & kSlotMask;
+    slots_[level][idx].push_back(e);
+    occupied_[level][idx / kWordBits] |= 1ull << (idx % kWordBits);
+    size_++;
+  }
+
+  bool RemoveFromSlot(int level, size_t idx, const T &value) {
+    Slot &slot = slots_[level][idx];
+    for (auto it = slot.begin(); it != slot.end(); ++it) {
+      if (it->value == value) {
+        *it = slot.back();
+        slot.pop_back();
+        if (slot.empty()) {
+          occupied_[level][idx / kWordBits] &= ~(1ull << (idx % kWordBits));
+        }
+        size_--;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Moves the values out of slot 'idx' of 'level' into 'scratch_'
+  void TakeSlot(int level, size_t idx) {
+    scratch_.swap(slots_[level][idx]);
+    occupied_[level][idx / kWordBits] &= ~(1ull << (idx % kWordBits));
+    size_ -= scratch_.size();
+  }
+
+  // Called when 'now_' enters a new round of 'level' - 1. Moves the values
+  // for this round down to lower levels.
+  void Cascade(int level) {
+    size_t idx = (now_ >> (kSlotBits * level)) & kSlotMask;
+    if (!slots_[level][idx].empty()) {
+      TakeSlot(level, idx);
+      for (const Entry &e : scratch_) {
+        Insert(e);
+      }
+      scratch_.clear();
+    }
+
+    if (idx == 0 && level + 1 < kLevels) {
+      Cascade(level + 1);
+    }
+  }
+
+  // Expires up to 'budget' values of slot 'idx' of level 0, and returns how
+  // many. The rest go back to the slot.
+  template <typename F>
+  size_t ExpireSlot(size_t idx, F &f, size_t budget) {
+    size_t expired = 0;
+    TakeSlot(0, idx);
+    for (const Entry &e : scratch_) {
+      if ((e.expiry >> tick_shift_) > now_ || expired == budget) {
+        Insert(e);  // parked beyond kRange, or left for later
+      } else {
+        f(e.value);
+        expired++;
+      }
+    }
+    scratch_.clear();
+    return expired;
+  }
+
+  // Returns the earliest tick at which a value of level 1 or above may be
+  // cascaded down, or UINT64_MAX if there is none.
+  uint64_t NextCascade() const {
+    uint64_t tick = UINT64_MAX;
+    for (int level = 1; level < kLevels; level++) {
+      int shift = kSlotBits * level;
+      uint64_t block = now_ >> shift;
+      size_t idx = block & kSlotMask;
+      size_t d = NextOccupied(level, idx);
+      if (d == kSlots) {
+        continue;
+      }
+      if (d == 0) {
+        if ((now_ & ((1ull << shift) - 1)) == 0) {
+          // Not cascaded yet, if Expire() stopped right at the boundary
+          return now_;
+        }
+        // Values for the next time around
+        d = 1 + NextOccupied(level, (idx + 1) & kSlotMask);
+      }
+      tick = std::min(tick, (block + d) << shift);
+    }
+    return tick;
+  }
+
+  // Returns the distance from slot 'from' of 'level' to the next non-empty
+  // slot, wrapping around, or kSlots if all slots are empty.
+  size_t NextOccupied(int level, size_t from) const {
+    for (size_t d = 0; d < kSlots;) {
+      size_t i = (from + d) & kSlotMask;
+      uint64_t word = occupied_[level][i / kWordBits] >> (i % kWordBits);
+      if (word) {
+        return d + __builtin_ctzll(word);
+      }
+      d += kWordBits - i % kWordBits;
+    }
+    return kSlots;
+  }
+
+  int tick_shift_;
+  uint64_t now_;  // current tick. All slots before it have been expired.
+  size_t size_;
+
+  uint64_t occupied_[kLevels][kSlots / kWordBits];  // non-empty slots
+  Slot slots_[kLevels][kSlots];
+  Slot scratch_;
+};
+
+}  // namespace utils
+}  // namespace bess
+
+#endif  // BESS_UTILS_TIMER_WHEEL_H_
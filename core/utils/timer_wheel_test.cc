@@ -0,0 +1,211 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "timer_wheel.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "random.h"
+
+using bess::utils::TimerWheel;
+
+namespace {
+
+TEST(TimerWheelTest, Empty) {
+  TimerWheel<int> wheel;
+  EXPECT_TRUE(wheel.Empty());
+  EXPECT_EQ(UINT64_MAX, wheel.NextExpiry());
+
+  int calls = 0;
+  wheel.Expire(1ull << 40, [&](int) { calls++; });
+  EXPECT_EQ(0, calls);
+}
+
+// Values are expired once the tick of their expiry time has passed
+TEST(TimerWheelTest, TickGranularity) {
+  TimerWheel<int> wheel(4, 1000);
+  wheel.Add(1000, 1);
+  wheel.Add(1010, 2);
+  wheel.Add(1020, 3);
+  EXPECT_EQ(3, wheel.Size());
+  EXPECT_EQ(1008, wheel.NextExpiry());
+
+  std::vector<int> expired;
+  auto f = [&](int v) { expired.push_back(v); };
+
+  wheel.Expire(1007, f);
+  EXPECT_TRUE(expired.empty());
+
+  wheel.Expire(1008, f);
+  EXPECT_EQ(std::vector<int>({1}), expired);
+  EXPECT_EQ(1024, wheel.NextExpiry());
+
+  wheel.Expire(1024, f);
+  EXPECT_EQ(std::vector<int>({1, 2, 3}), expired);
+  EXPECT_TRUE(wheel.Empty());
+}
+
+TEST(TimerWheelTest, Remove) {
+  TimerWheel<int> wheel;
+  wheel.Add(10, 1);
+  wheel.Add(100000, 2);
+  wheel.Add(1ull << 40, 3);  // beyond kRange
+
+  EXPECT_FALSE(wheel.Remove(10, 4));
+  EXPECT_TRUE(wheel.Remove(100000, 2));
+  EXPECT_FALSE(wheel.Remove(100000, 2));
+  EXPECT_TRUE(wheel.Remove(1ull << 40, 3));
+  EXPECT_EQ(1, wheel.Size());
+
+  std::vector<int> expired;
+  wheel.Expire(1ull << 41, [&](int v) { expired.push_back(v); });
+  EXPECT_EQ(std::vector<int>({1}), expired);
+}
+
+// Values far in the future go through every level, and are expired in order
+TEST(TimerWheelTest, Levels) {
+  TimerWheel<uint64_t> wheel;
+  std::vector<uint64_t> expiries = {
+      0, 1, 255, 256, 257, 65535, 65536, 1ull << 24, (1ull << 24) + 3,
+      TimerWheel<uint64_t>::kRange - 1, TimerWheel<uint64_t>::kRange,
+      TimerWheel<uint64_t>::kRange * 3 + 12345};
+  for (uint64_t e : expiries) {
+    wheel.Add(e, e);
+  }
+
+  for (uint64_t e : expiries) {
+    std::vector<uint64_t> expired;
+    auto f = [&](uint64_t v) { expired.push_back(v); };
+    wheel.Expire(e, f);
+    EXPECT_TRUE(expired.empty()) << e;
+    EXPECT_LE(wheel.NextExpiry(), e + 1);
+    wheel.Expire(e + 1, f);
+    EXPECT_EQ(std::vector<uint64_t>({e}), expired);
+  }
+  EXPECT_TRUE(wheel.Empty());
+}
+
+// A budget bounds the values expired per call, and the rest come up later
+TEST(TimerWheelTest, Budget) {
+  TimerWheel<int> wheel;
+  for (int i = 0; i < 10; i++) {
+    wheel.Add(i % 2 ? 100000 : 5, i);
+  }
+
+  std::vector<int> expired;
+  auto f = [&](int v) { expired.push_back(v); };
+
+  EXPECT_EQ(3, wheel.Expire(200000, f, 3));
+  EXPECT_EQ(3, expired.size());
+  EXPECT_EQ(7, wheel.Size());
+  for (int v : expired) {
+    EXPECT_EQ(0, v % 2);
+  }
+
+  EXPECT_EQ(6, wheel.Expire(200000, f, 6));
+  EXPECT_EQ(1, wheel.Expire(200000, f, 6));
+  EXPECT_EQ(0, wheel.Expire(200000, f, 6));
+  EXPECT_TRUE(wheel.Empty());
+
+  std::sort(expired.begin(), expired.end());
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}), expired);
+}
+
+// Compares against a multimap while time advances in random steps, and values
+// are added (also from within the expiry callback) and removed.
+TEST(TimerWheelTest, Random) {
+  const int kTickShift = 3;
+  Random rd;
+  TimerWheel<int> wheel(kTickShift);
+  std::multimap<uint64_t, int> ref;  // tick -> value
+  std::map<int, uint64_t> expiry_of;
+  uint64_t now = 0;
+  int next_value = 0;
+
+  auto add = [&](uint64_t expiry) {
+    int v = next_value++;
+    wheel.Add(expiry, v);
+    ref.emplace(expiry >> kTickShift, v);
+    expiry_of[v] = expiry;
+  };
+
+  for (int round = 0; round < 20000; round++) {
+    int n = rd.GetRange(4);
+    for (int i = 0; i < n; i++) {
+      uint64_t range = (round % 100 == 0) ? (1u << 30) : (1u << 14);
+      add(now + rd.GetRange(range));
+    }
+
+    if (!expiry_of.empty() && rd.GetRange(8) == 0) {
+      auto it = expiry_of.begin();
+      std::advance(it, rd.GetRange(expiry_of.size()));
+      int v = it->first;
+      ASSERT_TRUE(wheel.Remove(it->second, v));
+      auto range = ref.equal_range(it->second >> kTickShift);
+      for (auto r = range.first; r != range.second; ++r) {
+        if (r->second == v) {
+          ref.erase(r);
+          break;
+        }
+      }
+      expiry_of.erase(it);
+    }
+
+    if (!ref.empty()) {
+      ASSERT_LE(wheel.NextExpiry(), (ref.begin()->first + 1) << kTickShift);
+    }
+
+    now += (round % 1000 == 0) ? rd.GetRange(1u << 24) : rd.GetRange(256);
+    uint64_t tick = now >> kTickShift;
+    wheel.Expire(now, [&](int v) {
+      uint64_t e = expiry_of.at(v);
+      ASSERT_LT(e >> kTickShift, tick);
+      auto range = ref.equal_range(e >> kTickShift);
+      for (auto r = range.first; r != range.second; ++r) {
+        if (r->second == v) {
+          ref.erase(r);
+          break;
+        }
+      }
+      expiry_of.erase(v);
+      if (v % 7 == 0) {
+        add(now + 100);
+      }
+    });
+
+    ASSERT_TRUE(ref.empty() || ref.begin()->first >= tick) << round;
+    ASSERT_EQ(ref.size(), wheel.Size());
+  }
+}
+
+}  // namespace
@@ -30,6 +30,7 @@
 
 #include "worker.h"
 
+#include <poll.h>
 #include <sched.h>
 #include <sys/eventfd.h>
 #include <unistd.h>
@@ -39,13 +40,17 @@
 #include <rte_lcore.h>
 
 #include <cassert>
+#include <cerrno>
 #include <climits>
 #include <list>
+#include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "metadata.h"
 #include "module.h"
+#include "module_graph.h"
 #include "opts.h"
 #include "packet.h"
 #include "resume_hook.h"
@@ -75,6 +80,10 @@ struct thread_arg {
   int wid;
   int core;
   Scheduler *scheduler;
+  idle_policy_t idle_policy;
+  uint64_t idle_sleep_us;
+  uint64_t idle_max_sleep_us;
+  bool work_stealing;
 };
 
 #define SYS_CPU_DIR "/sys/devices/system/cpu/cpu%u"
@@ -111,8 +120,21 @@ void pause_worker(int wid) {
 
     FULL_BARRIER();
 
+    workers[wid]->WakeUp();
+
     while (workers[wid]->status() == WORKER_PAUSING) {
     } /* spin */
+
+    // Peers may still be running our leaves. Wait for them, then forget the
+    // leaves offered to them, since they may be modified or destroyed before
+    // the worker resumes.
+    while (workers[wid]->thieves() > 0) {
+    } /* spin */
+
+    bess::LeafTrafficClass *leaf;
+    while (workers[wid]->steal_queue()->Steal(&leaf)) {
+      leaf->set_queued(false);
+    }
   }
 }
 
@@ -229,6 +251,31 @@ bool is_any_worker_running() {
   return false;
 }
 
+void synchronize_workers() {
+  bool running[Worker::kMaxWorkers];
+  uint64_t rounds[Worker::kMaxWorkers];
+
+  // Workers must not start a round before seeing what we have unlinked
+  FULL_BARRIER();
+
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    running[wid] = is_worker_running(wid);
+    if (running[wid]) {
+      rounds[wid] = workers[wid]->rounds();
+    }
+  }
+
+  // A sleeping or paused worker is between rounds
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    if (running[wid]) {
+      Worker *w = workers[wid];
+      while (w->rounds() == rounds[wid] && w->status() == WORKER_RUNNING &&
+             !w->sleeping()) {
+      } /* spin */
+    }
+  }
+}
+
 void Worker::SetNonWorker() {
   int socket;
 
@@ -239,6 +286,7 @@ void Worker::SetNonWorker() {
   core_ = INT_MIN;
   socket_ = INT_MIN;
   fd_event_ = INT_MIN;
+  fd_idle_ = INT_MIN;
 
   // Packet pools should be available to non-worker threads.
   // (doesn't need to be NUMA-aware, so pick any)
@@ -274,6 +322,53 @@ int Worker::BlockWorker() {
   return 0;
 }
 
+void Worker::IdleSleep(uint64_t now, uint64_t deadline) {
+  sleeping_ = true;
+
+  // Pairs with the barrier in pause_worker(): either we see the pause request
+  // here, or the master sees sleeping_ and wakes us up.
+  FULL_BARRIER();
+
+  if (is_pause_requested()) {
+    sleeping_ = false;
+    return;
+  }
+
+  uint64_t ns = tsc_to_ns(deadline - now);
+  struct timespec timeout = {.tv_sec = static_cast<time_t>(ns / 1000000000),
+                             .tv_nsec = static_cast<long>(ns % 1000000000)};
+  struct pollfd pfd = {.fd = fd_idle_, .events = POLLIN, .revents = 0};
+
+  int ret = ppoll(&pfd, 1, &timeout, nullptr);
+  sleeping_ = false;
+
+  uint64_t woke = rdtsc();
+  idle_stats_.sleeps++;
+  idle_stats_.sleep_cycles += woke - now;
+
+  if (ret > 0) {
+    uint64_t val;
+    ret = read(fd_idle_, &val, sizeof(val));
+    DCHECK_EQ(ret, sizeof(val));
+    idle_stats_.woken++;
+  } else {
+    uint64_t latency = (woke > deadline) ? woke - deadline : 0;
+    idle_stats_.timed_wakeups++;
+    idle_stats_.latency_cycles += latency;
+    if (latency > idle_stats_.max_latency_cycles) {
+      idle_stats_.max_latency_cycles = latency;
+    }
+  }
+}
+
+void Worker::WakeUp() {
+  if (sleeping_) {
+    uint64_t val = 1;
+    int ret = write(fd_idle_, &val, sizeof(val));
+    DCHECK_EQ(ret, sizeof(val));
+  }
+}
+
 /* The entry point of worker threads */
 void *Worker::Run(void *_arg) {
   struct thread_arg *arg = (struct thread_arg *)_arg;
@@ -295,6 +390,15 @@ void *Worker::Run(void *_arg) {
   DCHECK_GE(socket_, 0); /* shouldn't be SOCKET_ID_ANY (-1) */
   fd_event_ = eventfd(0, 0);
   DCHECK_GE(fd_event_, 0);
+  // A stale wake-up token only cuts the next sleep short, so never block on
+  // reading it
+  fd_idle_ = eventfd(0, EFD_NONBLOCK);
+  DCHECK_GE(fd_idle_, 0);
+
+  idle_policy_ = arg->idle_policy;
+  idle_sleep_cycles_ = arg->idle_sleep_us * tsc_hz / 1000000;
+  idle_max_sleep_cycles_ = arg->idle_max_sleep_us * tsc_hz / 1000000;
+  work_stealing_ = arg->work_stealing;
 
   scheduler_ = arg->scheduler;
 
@@ -322,6 +426,7 @@ void *Worker::Run(void *_arg) {
 
   delete scheduler_;
   delete rand_;
+  close(fd_idle_);
 
   return nullptr;
 }
@@ -332,8 +437,17 @@ void *run_worker(void *_arg) {
 }
 
 void launch_worker(int wid, int core,
-                   [[maybe_unused]] const std::string &scheduler) {
-  struct thread_arg arg = {.wid = wid, .core = core, .scheduler = nullptr};
+                   [[maybe_unused]] const std::string &scheduler,
+                   idle_policy_t idle_policy, uint64_t idle_sleep_us,
+                   uint64_t idle_max_sleep_us, bool work_stealing,
+                   const std::string &wakeup_queue) {
+  struct thread_arg arg = {.wid = wid,
+                           .core = core,
+                           .scheduler = nullptr,
+                           .idle_policy = idle_policy,
+                           .idle_sleep_us = idle_sleep_us,
+                           .idle_max_sleep_us = idle_max_sleep_us,
+                           .work_stealing = work_stealing};
   if (scheduler == "") {
     arg.scheduler = new DefaultScheduler();
   } else if (scheduler == "experimental") {
@@ -342,6 +456,13 @@ void launch_worker(int wid, int core,
     CHECK(false) << "Scheduler " << scheduler << " is invalid.";
   }
 
+  if (wakeup_queue == "timer_wheel") {
+    arg.scheduler->wakeup_queue().UseTimerWheel();
+  } else {
+    CHECK(wakeup_queue == "" || wakeup_queue == "heap")
+        << "Wakeup queue " << wakeup_queue << " is invalid.";
+  }
+
   worker_threads[wid] = std::thread(run_worker, &arg);
   worker_threads[wid].detach();
 
@@ -412,6 +533,108 @@ bool detach_tc(bess::TrafficClass *c) {
   return remove_tc_from_orphan(c);
 }
 
+// Deliver PreResume to the modules active on worker 'wid' that have not
+// received it yet ('modules_run').
+static void run_pre_resume_events(int wid, std::set<Module *> *modules_run) {
+  auto &resume_modules = bess::event_modules[bess::Event::PreResume];
+  for (auto it = resume_modules.begin(); it != resume_modules.end();) {
+    Module *m = *it;
+    if (!modules_run->count(m) && m->active_workers()[wid]) {
+      int ret = m->OnEvent(bess::Event::PreResume);
+      modules_run->insert(m);
+      if (ret == -ENOTSUP) {
+        it = resume_modules.erase(it);
+      } else {
+        it++;
+      }
+    } else {
+      it++;
+    }
+  }
+}
+
+int migrate_leaf(bess::LeafTrafficClass *c, int dst,
+                 const std::function<bool(bess::TrafficClass *)> &attach,
+                 struct tc_migration_stats *stats) {
+  int src = c->WorkerId();
+  if (src == Worker::kAnyWorker) {
+    return -ENOENT;
+  }
+  CHECK(is_worker_active(dst));
+
+  bool src_running = is_worker_running(src);
+  bool dst_running = is_worker_running(dst);
+  uint64_t start = rdtsc();
+
+  // Once paused, the source worker (and any peer stealing from it) is done
+  // with 'c', and will not see it again after it resumes.
+  pause_worker(src);
+  if (!detach_tc(c)) {
+    if (src_running) {
+      resume_worker(src);
+    }
+    return -EINVAL;
+  }
+  workers[src]->scheduler()->AdjustDefault();
+
+  uint64_t dst_paused = start;
+  if (src != dst) {
+    pause_worker(dst);
+    dst_paused = rdtsc();
+  }
+
+  bool attached = attach && attach(c);
+  if (!attached) {
+    CHECK(workers[dst]->scheduler()->AttachOrphan(c, dst));
+  }
+
+  // The task may now run on other workers than before. PreResume handlers
+  // rewrite state of their modules that every worker running them reads
+  // (e.g., IPLookup tables and ShardedQueue producers), so all workers must
+  // stay paused until they are done, not just the source and the destination.
+  std::vector<int> others_paused;
+  for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
+    if (wid != src && wid != dst && is_worker_running(wid)) {
+      pause_worker(wid);
+      others_paused.push_back(wid);
+    }
+  }
+
+  ModuleGraph::PropagateActiveWorker();
+  std::set<Module *> modules_run;
+  run_pre_resume_events(dst, &modules_run);
+  if (src != dst) {
+    run_pre_resume_events(src, &modules_run);
+  }
+
+  for (int wid : others_paused) {
+    resume_worker(wid);
+  }
+
+  if (src != dst && src_running) {
+    resume_worker(src);
+  }
+  uint64_t src_resumed = rdtsc();
+  if (dst_running || (src == dst && src_running)) {
+    resume_worker(dst);
+  }
+  uint64_t end = rdtsc();
+
+  if (src == dst) {
+    src_resumed = end;
+  }
+
+  if (stats) {
+    stats->src_wid = src;
+    stats->dst_wid = dst;
+    stats->src_pause_ns = tsc_to_ns(src_resumed - start);
+    stats->dst_pause_ns = tsc_to_ns(end - dst_paused);
+    stats->detached_ns = tsc_to_ns(end - start);
+  }
+
+  return attached || !attach ? 0 : -EEXIST;
+}
+
 WorkerPauser::WorkerPauser() {
   if (is_any_worker_running()) {
     for (int wid = 0; wid < Worker::kMaxWorkers; wid++) {
@@ -433,21 +656,7 @@ WorkerPauser::~WorkerPauser() {
 
   std::set<Module *> modules_run;
   for (int wid : workers_paused_) {
-    auto &resume_modules = bess::event_modules[bess::Event::PreResume];
-    for (auto it = resume_modules.begin(); it != resume_modules.end();) {
-      Module *m = *it;
-      if (!modules_run.count(m) && m->active_workers()[wid]) {
-        int ret = m->OnEvent(bess::Event::PreResume);
-        modules_run.insert(m);
-        if (ret == -ENOTSUP) {
-	  it = resume_modules.erase(it);
-        } else {
-	  it++;
-	}
-      } else {
-	it++;
-      }
-    }
+    run_pre_resume_events(wid, &modules_run);
     resume_worker(wid);
     VLOG(1) << "*** Worker " << wid << " Resumed ***";
   }
@@ -33,7 +33,9 @@
 
 #include <glog/logging.h>
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <thread>
 #include <type_traits>
@@ -43,6 +45,7 @@
 #include "traffic_class.h"
 #include "utils/common.h"
 #include "utils/random.h"
+#include "utils/steal_deque.h"
 
 #define MAX_GATES 8192
 
@@ -66,7 +69,24 @@ typedef enum {
   WORKER_FINISHED,
 } worker_status_t;
 
+/* What a worker does while its tasks have no packets to process */
+typedef enum {
+  IDLE_SPIN = 0, /* keep polling at full speed */
+  IDLE_BACKOFF,  /* poll with growing pause loops in between */
+  IDLE_SLEEP,    /* back off, then sleep once idle for long enough */
+} idle_policy_t;
+
+struct worker_idle_stats {
+  uint64_t sleeps;          // # of times the worker went to sleep
+  uint64_t sleep_cycles;    // total time asleep
+  uint64_t woken;           // sleeps cut short by Worker::WakeUp()
+  uint64_t timed_wakeups;   // sleeps that ran until their deadline
+  uint64_t latency_cycles;  // total delay past the deadline of timed wakeups
+  uint64_t max_latency_cycles;
+};
+
 namespace bess {
+class LeafTrafficClass;
 class Scheduler;
 }  // namespace bess
 
@@ -77,6 +97,15 @@ class Worker {
   static const int kMaxWorkers = 64;
   static const int kAnyWorker = -1;  // unspecified worker ID
 
+  // Defaults for IDLE_SLEEP, see launch_worker()
+  static const uint64_t kDefaultIdleSleepUs = 100;
+  static const uint64_t kDefaultIdleMaxSleepUs = 1000;
+
+  // Capacity of the queue of leaves offered to work-stealing peers
+  static const size_t kStealQueueSize = 64;
+  typedef bess::utils::StealDeque<bess::LeafTrafficClass *, kStealQueueSize>
+      StealQueue;
+
   /* ----------------------------------------------------------------------
    * functions below are invoked by non-worker threads (the master)
    * ---------------------------------------------------------------------- */
@@ -90,6 +119,23 @@ class Worker {
   /* Block myself. Return nonzero if the worker needs to die */
   int BlockWorker();
 
+  /* Sleep until TSC 'deadline' or until another thread calls WakeUp() */
+  void IdleSleep(uint64_t now, uint64_t deadline);
+
+  /* Interrupt IdleSleep(), if the worker is in it. */
+  void WakeUp();
+
+  /* Called by a peer before and after taking leaves from steal_queue() and
+   * running them. BeginSteal() returns false if the worker is not running, in
+   * which case the peer must leave the worker alone (and still call
+   * EndSteal()). pause_worker() waits for ongoing steals to finish. */
+  bool BeginSteal() {
+    thieves_.fetch_add(1);
+    return status_ == WORKER_RUNNING;
+  }
+  void EndSteal() { thieves_.fetch_sub(1); }
+  int thieves() const { return thieves_.load(); }
+
   /* The entry point of worker threads */
   void *Run(void *_arg);
 
@@ -119,6 +165,50 @@ class Worker {
 
   Random *rand() const { return rand_; }
 
+  // If true, tasks run by this worker record per-igate cycles and packets.
+  // See Task::operator().
+  bool profiling() const { return profiling_; }
+  void set_profiling(bool profiling) { profiling_ = profiling; }
+
+  idle_policy_t idle_policy() const { return idle_policy_; }
+  // How long the worker must have been idle before it sleeps
+  uint64_t idle_sleep_cycles() const { return idle_sleep_cycles_; }
+  // Upper bound of a single sleep. Inputs that cannot wake the worker up
+  // (e.g., ports and queues) are polled at least this often.
+  uint64_t idle_max_sleep_cycles() const { return idle_max_sleep_cycles_; }
+
+  const struct worker_idle_stats &idle_stats() const { return idle_stats_; }
+
+  // If true, the worker runs stealable leaves of busy peers on the same socket
+  // when it is idle.
+  bool work_stealing() const { return work_stealing_; }
+
+  // True if the scheduler has to do anything on idle rounds
+  bool handles_idle() const {
+    return idle_policy_ != IDLE_SPIN || work_stealing_;
+  }
+
+  // Stealable leaves that recently had a full batch to process
+  StealQueue *steal_queue() { return &steal_queue_; }
+
+  // Scheduling rounds completed by the worker. Between rounds, the worker
+  // holds no reference to module state. See synchronize_workers().
+  uint64_t rounds() const { return rounds_.load(std::memory_order_acquire); }
+  void EndRound() {
+    rounds_.store(rounds_.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_release);
+  }
+
+  bool sleeping() const { return sleeping_; }
+
+  // Runs of peers' leaves done by this worker
+  uint64_t stolen_runs() const { return stolen_runs_; }
+  uint64_t stolen_packets() const { return stolen_packets_; }
+  void AddStolenRun(uint64_t packets) {
+    stolen_runs_++;
+    stolen_packets_ += packets;
+  }
+
  private:
   volatile worker_status_t status_;
 
@@ -137,6 +227,24 @@ class Worker {
   uint64_t current_ns_;
 
   Random *rand_;
+
+  volatile bool profiling_;
+
+  idle_policy_t idle_policy_;
+  uint64_t idle_sleep_cycles_;
+  uint64_t idle_max_sleep_cycles_;
+  int fd_idle_;  // eventfd to interrupt IdleSleep()
+  volatile bool sleeping_;
+
+  struct worker_idle_stats idle_stats_;
+
+  bool work_stealing_;
+  StealQueue steal_queue_;
+  std::atomic<int> thieves_;  // # of peers in BeginSteal()/EndSteal()
+  uint64_t stolen_runs_;
+  uint64_t stolen_packets_;
+
+  std::atomic<uint64_t> rounds_;
 };
 
 // NOTE: Do not use "thread_local" here. It requires a function call every time
@@ -177,6 +285,11 @@ void destroy_all_workers();
 
 bool is_any_worker_running();
 
+// Wait until every running worker has finished the scheduling round it was
+// in, if any. Data that was unlinked before the call is then no longer seen
+// by workers and can be freed, without pausing them.
+void synchronize_workers();
+
 int is_cpu_present(unsigned int core_id);
 
 static inline int is_worker_active(int wid) {
@@ -188,8 +301,15 @@ inline bool is_worker_running(int wid) {
 }
 
 // arg (int) is the core id the worker should run on, and optionally the
-// scheduler to use.
-void launch_worker(int wid, int core, const std::string &scheduler = "");
+// scheduler to use, what to do when idle (see idle_policy_t), whether to
+// steal work from peers when idle, and the wakeup queue of the scheduler
+// ("" or "heap", or "timer_wheel").
+void launch_worker(int wid, int core, const std::string &scheduler = "",
+                   idle_policy_t idle_policy = IDLE_SPIN,
+                   uint64_t idle_sleep_us = Worker::kDefaultIdleSleepUs,
+                   uint64_t idle_max_sleep_us = Worker::kDefaultIdleMaxSleepUs,
+                   bool work_stealing = false,
+                   const std::string &wakeup_queue = "");
 
 Worker *get_next_active_worker();
 
@@ -215,6 +335,33 @@ const std::list<std::pair<int, bess::TrafficClass *>> &list_orphan_tcs();
 // Otherwise, return false
 bool detach_tc(bess::TrafficClass *c);
 
+struct tc_migration_stats {
+  int src_wid;
+  int dst_wid;
+  uint64_t src_pause_ns;  // how long the source worker was paused
+  uint64_t dst_pause_ns;  // how long the destination worker was paused
+  uint64_t detached_ns;   // how long no worker could schedule the leaf
+};
+
+// Move leaf 'c' from the tree of the worker it belongs to, to the tree of
+// worker 'dst'. 'attach' is called to insert 'c' into the destination tree;
+// if it is null or fails, 'c' is attached at the top of the tree.
+//
+// Unlike WorkerPauser, only the source and the destination workers are paused
+// while the trees change. The source worker is paused first to unlink 'c' (and
+// to wait for peers that may be running it), then the destination worker to
+// link it. Since the task may have changed the set of workers that its modules
+// are active on, all other running workers are then paused too, while the
+// modules handle PreResume, and all are resumed once they are done. Workers
+// that were not running are left paused.
+//
+// Return 0 if successful, -ENOENT if 'c' is not attached to a worker, -EINVAL
+// if it cannot be detached (in both cases nothing has changed), or -EEXIST if
+// 'attach' fails (then 'c' is attached at the top of the tree of 'dst').
+int migrate_leaf(bess::LeafTrafficClass *c, int dst,
+                 const std::function<bool(bess::TrafficClass *)> &attach,
+                 struct tc_migration_stats *stats);
+
 // This class is used as a resource manager to automatically pause workers if
 // running and then restarts workers if they were previously paused.
 class WorkerPauser {
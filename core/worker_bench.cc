@@ -0,0 +1,135 @@
+// Copyright (c) 2016-2017, Nefeli Networks, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// * Neither the names of the copyright holders nor the names of their
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmarks for operations on running workers.
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dpdk.h"
+#include "module.h"
+#include "packet.h"
+#include "scheduler.h"
+#include "traffic_class.h"
+#include "worker.h"
+
+using namespace bess;
+
+namespace {
+
+const int kNumWorkers = 2;
+
+class DummyModule : public Module {
+ public:
+  struct task_result RunTask(Context *, bess::PacketBatch *, void *) override {
+    return {.block = false, .packets = 0, .bits = 0};
+  }
+};
+
+// migrate_leaf() of one leaf back and forth between two running workers,
+// each with state.range(0) leaves under its default round-robin root. This is
+// the whole path, from pausing the source worker to resuming the destination
+// worker, so it includes the pause/resume handshakes with the worker threads
+// and the PreResume events.
+void BM_MigrateLeaf(benchmark::State &state) {
+  int num_classes = state.range(0);
+  DummyModule dummy;
+  std::vector<LeafTrafficClass *> leaves;
+
+  pause_all_workers();
+  for (int i = 0; i < num_classes * kNumWorkers; i++) {
+    std::string name("class_" + std::to_string(i));
+    LeafTrafficClass *c =
+        TrafficClassBuilder::CreateTrafficClass<LeafTrafficClass>(
+            name, new Task(&dummy, nullptr));
+    int wid = i % kNumWorkers;
+    CHECK(workers[wid]->scheduler()->AttachOrphan(c, wid));
+    leaves.push_back(c);
+  }
+  resume_all_workers();
+
+  LeafTrafficClass *leaf = leaves[0];
+  struct tc_migration_stats stats;
+  uint64_t src_pause_ns = 0;
+  uint64_t dst_pause_ns = 0;
+  while (state.KeepRunning()) {
+    int dst = (leaf->WorkerId() + 1) % kNumWorkers;
+    CHECK_EQ(migrate_leaf(leaf, dst, nullptr, &stats), 0);
+    src_pause_ns += stats.src_pause_ns;
+    dst_pause_ns += stats.dst_pause_ns;
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetLabel("src/dst paused " +
+                 std::to_string(src_pause_ns / state.iterations()) + "/" +
+                 std::to_string(dst_pause_ns / state.iterations()) + "ns");
+
+  pause_all_workers();
+  for (LeafTrafficClass *c : leaves) {
+    CHECK(detach_tc(c));
+    delete c;
+  }
+  for (int wid = 0; wid < kNumWorkers; wid++) {
+    workers[wid]->scheduler()->AdjustDefault();
+  }
+  resume_all_workers();
+}
+
+BENCHMARK(BM_MigrateLeaf)->Arg(1)->Arg(64)->Arg(4096);
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+
+  if (geteuid() != 0) {
+    LOG(INFO) << "This benchmark requires root privileges. Skipping...";
+    return 0;
+  }
+
+  init_dpdk(argv[0], 1024, 0, true);
+  bess::init_mempool();
+
+  int num_cores = std::thread::hardware_concurrency();
+  for (int wid = 0; wid < kNumWorkers; wid++) {
+    launch_worker(wid, wid % num_cores);
+  }
+  resume_all_workers();
+
+  benchmark::RunSpecifiedBenchmarks();
+
+  for (int wid = 0; wid < kNumWorkers; wid++) {
+    destroy_worker(wid);
+  }
+  return 0;
+}
@@ -448,6 +448,13 @@ class BESS(object):
         request.ogate = ogate
         return self._request('DisconnectModules', request)
 
+    def configure_igate(self, name, igate=0, coalesce=False):
+        request = bess_msg.ConfigureIGateRequest()
+        request.name = name
+        request.igate = igate
+        request.coalesce = coalesce
+        return self._request('ConfigureIGate', request)
+
     def run_module_command(self, name, cmd, arg_type, arg):
         request = bess_msg.CommandRequest()
         request.name = name
@@ -577,11 +584,18 @@ class BESS(object):
     def list_workers(self):
         return self._request('ListWorkers')
 
-    def add_worker(self, wid, core, scheduler=None):
+    def add_worker(self, wid, core, scheduler=None, idle_policy=None,
+                   idle_sleep_us=0, idle_max_sleep_us=0, work_stealing=False,
+                   wakeup_queue=None):
         request = bess_msg.AddWorkerRequest()
         request.wid = wid
         request.core = core
         request.scheduler = scheduler or ''
+        request.idle_policy = idle_policy or ''
+        request.idle_sleep_us = idle_sleep_us
+        request.idle_max_sleep_us = idle_max_sleep_us
+        request.work_stealing = work_stealing
+        request.wakeup_queue = wakeup_queue or ''
         return self._request('AddWorker', request)
 
     def destroy_worker(self, wid):
@@ -589,6 +603,18 @@ class BESS(object):
         request.wid = wid
         return self._request('DestroyWorker', request)
 
+    def set_worker_profiling(self, wid, enable):
+        request = bess_msg.SetWorkerProfilingRequest()
+        request.wid = wid
+        request.enable = enable
+        return self._request('SetWorkerProfiling', request)
+
+    def get_worker_profile(self, wid, reset=False):
+        request = bess_msg.GetWorkerProfileRequest()
+        request.wid = wid
+        request.reset = reset
+        return self._request('GetWorkerProfile', request)
+
     def list_tcs(self, wid=-1):
         request = bess_msg.ListTcsRequest()
         request.wid = wid
@@ -629,7 +655,8 @@ class BESS(object):
         return self._request('AddTc', request)
 
     def update_tc_params(self, name, resource=None, limit=None, max_burst=None,
-                         leaf_module_name=None, leaf_module_taskid=0):
+                         leaf_module_name=None, leaf_module_taskid=0,
+                         stealable=False):
         request = bess_msg.UpdateTcParamsRequest()
         class_ = getattr(request, 'class')
         class_.name = name
@@ -648,6 +675,7 @@ class BESS(object):
             class_.leaf_module_name = leaf_module_name
         if leaf_module_taskid is not None:
             class_.leaf_module_taskid = leaf_module_taskid
+        class_.stealable = stealable
 
         return self._request('UpdateTcParams', request)
 
@@ -684,6 +712,23 @@ class BESS(object):
     def attach_module(self, *args, **kwargs):
         return self.attach_task(*args, **kwargs)
 
+    # Move the leaf TC `name` to another worker, pausing only the source and
+    # destination workers. Arguments are the same as for attach_task().
+    def migrate_tc(self, name, parent='', wid=-1, priority=None, share=None):
+        request = bess_msg.MigrateTcRequest()
+        class_ = getattr(request, 'class')
+        class_.name = name
+        class_.parent = parent
+        class_.wid = wid
+
+        if priority is not None:
+            class_.priority = priority
+
+        if share is not None:
+            class_.share = share
+
+        return self._request('MigrateTc', request)
+
     def get_tc_stats(self, name):
         request = bess_msg.GetTcStatsRequest()
         request.name = name